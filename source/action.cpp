@@ -18,8 +18,10 @@
 #include "main.h"
 
 #include "action.h"
+#include "floor_selection.h"
 #include "settings.h"
 #include "map.h"
+#include "creature.h"
 #include "editor.h"
 #include "gui.h"
 
@@ -34,6 +36,12 @@ Change::Change(Tile* t) :
 	data = t;
 }
 
+Change::Change(FloorSelection* selection) :
+	type(CHANGE_SELECTION) {
+	ASSERT(selection);
+	data = selection;
+}
+
 Change* Change::Create(House* house, const Position& where) {
 	Change* c = newd Change();
 	c->type = CHANGE_MOVE_HOUSE_EXIT;
@@ -64,6 +72,14 @@ void Change::clear() {
 			ASSERT(data);
 			delete reinterpret_cast<Tile*>(data);
 			break;
+		case CHANGE_TILE_DELTA:
+			ASSERT(data);
+			delete reinterpret_cast<TileDelta*>(data);
+			break;
+		case CHANGE_SELECTION:
+			ASSERT(data);
+			delete reinterpret_cast<FloorSelection*>(data);
+			break;
 		case CHANGE_MOVE_HOUSE_EXIT:
 			ASSERT(data);
 			delete reinterpret_cast<std::pair<uint32_t, Position>*>(data);
@@ -93,12 +109,34 @@ uint32_t Change::memsize() const {
 			ASSERT(data);
 			mem += reinterpret_cast<Tile*>(data)->memsize();
 			break;
+		case CHANGE_TILE_DELTA:
+			ASSERT(data);
+			mem += reinterpret_cast<TileDelta*>(data)->memsize();
+			break;
+		case CHANGE_SELECTION:
+			ASSERT(data);
+			mem += reinterpret_cast<FloorSelection*>(data)->memsize();
+			break;
 		default:
 			break;
 	}
 	return mem;
 }
 
+void Change::compact(const Tile* current) {
+	ASSERT(type == CHANGE_TILE && data);
+	data = TileDelta::Create(reinterpret_cast<Tile*>(data), current);
+	type = CHANGE_TILE_DELTA;
+}
+
+void Change::expand(BaseMap& map) {
+	ASSERT(type == CHANGE_TILE_DELTA && data);
+	TileDelta* delta = reinterpret_cast<TileDelta*>(data);
+	data = delta->restore(map, map.getTile(delta->getPosition()));
+	type = CHANGE_TILE;
+	delete delta;
+}
+
 Action::Action(Editor& editor, ActionIdentifier ident) :
 	commited(false),
 	editor(editor),
@@ -115,7 +153,15 @@ Action::~Action() {
 
 size_t Action::approx_memsize() const {
 	uint32_t mem = sizeof(*this);
-	mem += changes.size() * (sizeof(Change) + sizeof(Tile) + sizeof(Item) + 6 /* approx overhead*/);
+	for (const Change* c : changes) {
+		if (c->type == CHANGE_TILE_DELTA) {
+			mem += sizeof(Change) + reinterpret_cast<const TileDelta*>(c->data)->approx_memsize();
+		} else if (c->type == CHANGE_SELECTION) {
+			mem += sizeof(Change) + reinterpret_cast<const FloorSelection*>(c->data)->memsize();
+		} else {
+			mem += sizeof(Change) + sizeof(Tile) + sizeof(Item) + 6 /* approx overhead*/;
+		}
+	}
 	return mem;
 }
 
@@ -132,6 +178,18 @@ size_t Action::memsize() const {
 				break;
 			}
 
+			case CHANGE_TILE_DELTA: {
+				ASSERT(c->data);
+				mem += reinterpret_cast<TileDelta*>(c->data)->memsize();
+				break;
+			}
+
+			case CHANGE_SELECTION: {
+				ASSERT(c->data);
+				mem += reinterpret_cast<FloorSelection*>(c->data)->memsize();
+				break;
+			}
+
 			default:
 				break;
 		}
@@ -140,11 +198,28 @@ size_t Action::memsize() const {
 	return mem;
 }
 
+void Action::applySelection(FloorSelection* state) {
+	ASSERT(state);
+	state->swap();
+
+	Floor* floor = state->getFloor();
+	for (int i = 0; i < MAP_LAYERS; ++i) {
+		Tile* tile = floor->locs[i].get();
+		if (tile && (state->getTiles() & (1 << i))) {
+			editor.selection.updateInternal(tile);
+		}
+	}
+	editor.map.tileTouched(floor->locs[0].getPosition());
+}
+
 void Action::commit(DirtyList* dirty_list) {
 	editor.selection.start(Selection::INTERNAL);
 	ChangeList::const_iterator it = changes.begin();
 	while (it != changes.end()) {
 		Change* c = *it;
+		if (c->type == CHANGE_TILE_DELTA) {
+			c->expand(editor.map);
+		}
 		switch (c->type) {
 			case CHANGE_TILE: {
 				void** data = &c->data;
@@ -173,9 +248,8 @@ void Action::commit(DirtyList* dirty_list) {
 				newtile->update();
 
 				// std::cout << "\tSwitched tile at " << pos.x << ";" << pos.y << ";" << pos.z << " from " << (void*)oldtile << " to " << *data <<  std::endl;
-				if (newtile->isSelected()) {
-					editor.selection.addInternal(newtile);
-				}
+				// The selection is kept per location, the new tile decides it
+				editor.selection.updateInternal(newtile);
 
 				if (oldtile) {
 					if (newtile->getHouseID() != oldtile->getHouseID()) {
@@ -205,10 +279,6 @@ void Action::commit(DirtyList* dirty_list) {
 					}
 
 					// oldtile->update();
-					if (oldtile->isSelected()) {
-						editor.selection.removeInternal(oldtile);
-					}
-
 					*data = oldtile;
 				} else {
 					*data = editor.map.allocator(location);
@@ -227,6 +297,13 @@ void Action::commit(DirtyList* dirty_list) {
 				// Mark the tile as modified
 				newtile->modify();
 
+				// Keep only what the old tile doesn't share with the new one.
+				// Remote changes never enter the history, so in live sessions
+				// the map can change under a delta and full copies are kept.
+				if (!editor.IsLive()) {
+					c->compact(newtile);
+				}
+
 				// Update client dirty list
 				if (editor.IsLiveClient() && dirty_list && type != ACTION_REMOTE) {
 					// Local action, assemble changes
@@ -235,6 +312,11 @@ void Action::commit(DirtyList* dirty_list) {
 				break;
 			}
 
+			case CHANGE_SELECTION: {
+				applySelection(reinterpret_cast<FloorSelection*>(c->data));
+				break;
+			}
+
 			case CHANGE_MOVE_HOUSE_EXIT: {
 				std::pair<uint32_t, Position>* p = reinterpret_cast<std::pair<uint32_t, Position>*>(c->data);
 				ASSERT(p);
@@ -269,7 +351,7 @@ void Action::commit(DirtyList* dirty_list) {
 
 					// Update shit
 					Position oldpos = wp->pos;
-					wp->pos = p->second;
+					editor.map.waypoints.moveWaypoint(wp, p->second);
 					p->second = oldpos;
 				}
 				break;
@@ -294,6 +376,9 @@ void Action::undo(DirtyList* dirty_list) {
 
 	while (it != changes.rend()) {
 		Change* c = *it;
+		if (c->type == CHANGE_TILE_DELTA) {
+			c->expand(editor.map);
+		}
 		switch (c->type) {
 			case CHANGE_TILE: {
 				void** data = &c->data;
@@ -318,12 +403,7 @@ void Action::undo(DirtyList* dirty_list) {
 					dirty_list->AddPosition(pos.x, pos.y, pos.z);
 				}
 
-				if (oldtile->isSelected()) {
-					editor.selection.addInternal(oldtile);
-				}
-				if (newtile->isSelected()) {
-					editor.selection.removeInternal(newtile);
-				}
+				editor.selection.updateInternal(oldtile);
 
 				if (newtile->getHouseID() != oldtile->getHouseID()) {
 					// oooooomggzzz we need to remove it from the appropriate house!
@@ -354,6 +434,9 @@ void Action::undo(DirtyList* dirty_list) {
 					editor.map.removeSpawn(newtile);
 				}
 				*data = newtile;
+				if (!editor.IsLive()) {
+					c->compact(oldtile);
+				}
 
 				// Update client dirty list
 				if (editor.IsLiveClient() && dirty_list && type != ACTION_REMOTE) {
@@ -363,6 +446,11 @@ void Action::undo(DirtyList* dirty_list) {
 				break;
 			}
 
+			case CHANGE_SELECTION: {
+				applySelection(reinterpret_cast<FloorSelection*>(c->data));
+				break;
+			}
+
 			case CHANGE_MOVE_HOUSE_EXIT: {
 				std::pair<uint32_t, Position>* p = reinterpret_cast<std::pair<uint32_t, Position>*>(c->data);
 				ASSERT(p);
@@ -398,7 +486,7 @@ void Action::undo(DirtyList* dirty_list) {
 
 					// Update shit
 					Position oldpos = wp->pos;
-					wp->pos = p->second;
+					editor.map.waypoints.moveWaypoint(wp, p->second);
 					p->second = oldpos;
 				}
 				break;
@@ -19,11 +19,17 @@
 #define RME_ACTION_H_
 
 #include "position.h"
+#include "tile_delta.h"
 
 #include <deque>
 
 class Editor;
+class BaseMap;
 class Tile;
+class FloorSelection;
+class Item;
+class Creature;
+class Spawn;
 class House;
 class Waypoint;
 class Change;
@@ -34,6 +40,8 @@ class ActionQueue;
 enum ChangeType {
 	CHANGE_NONE,
 	CHANGE_TILE,
+	CHANGE_TILE_DELTA,
+	CHANGE_SELECTION,
 	CHANGE_MOVE_HOUSE_EXIT,
 	CHANGE_MOVE_WAYPOINT,
 };
@@ -47,6 +55,7 @@ private:
 
 public:
 	Change(Tile* tile);
+	Change(FloorSelection* selection);
 	static Change* Create(House* house, const Position& where);
 	static Change* Create(Waypoint* wp, const Position& where);
 	~Change();
@@ -62,6 +71,11 @@ public:
 	// Get memory footprint
 	uint32_t memsize() const;
 
+	// Replaces the stored tile with a TileDelta against current
+	void compact(const Tile* current);
+	// Turns a TileDelta back into the full tile
+	void expand(BaseMap& map);
+
 	friend class Action;
 };
 
@@ -149,6 +163,9 @@ public:
 protected:
 	Action(Editor& editor, ActionIdentifier ident);
 
+	// Swaps the recorded selection state with the one on the map
+	void applySelection(FloorSelection* state);
+
 	bool commited;
 	ChangeList changes;
 	Editor& editor;
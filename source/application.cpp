@@ -20,6 +20,7 @@
 #include "application.h"
 #include "sprites.h"
 #include "editor.h"
+#include "map_tab.h"
 #include "common_windows.h"
 #include "palette_window.h"
 #include "preferences.h"
@@ -27,6 +28,7 @@
 #include "minimap_window.h"
 #include "about_window.h"
 #include "main_menubar.h"
+#include "map_image_export.h"
 #include "updater.h"
 #include "artprovider.h"
 
@@ -122,9 +124,22 @@ bool Application::OnInit() {
 	g_gui.LoadHotkeys();
 	ClientVersion::loadVersions();
 
+	m_file_to_open = wxEmptyString;
+	m_export_image = wxEmptyString;
+	m_export_floor = GROUND_LAYER;
+	m_exit_code = 0;
+	ParseCommandLineMap(m_file_to_open);
+
+	// Exporting runs on its own even if another editor is open
+	const bool exporting = argc >= 2 && argv[1] == "--export-image";
+	if (exporting && m_export_image.empty()) {
+		return false;
+	}
+
 #ifdef _USE_PROCESS_COM
+	m_proc_server = nullptr;
 	m_single_instance_checker = newd wxSingleInstanceChecker; // Instance checker has to stay alive throughout the applications lifetime
-	if (g_settings.getInteger(Config::ONLY_ONE_INSTANCE) && m_single_instance_checker->IsAnotherRunning()) {
+	if (!exporting && g_settings.getInteger(Config::ONLY_ONE_INSTANCE) && m_single_instance_checker->IsAnotherRunning()) {
 		RMEProcessClient client;
 		wxConnectionBase* connection = client.MakeConnection("localhost", "rme_host", "rme_talk");
 		if (connection) {
@@ -140,9 +155,11 @@ bool Application::OnInit() {
 		return false; // Since we return false - OnExit is never called
 	}
 	// We act as server then
-	m_proc_server = newd RMEProcessServer();
-	if (!m_proc_server->Create("rme_host")) {
-		wxLogWarning("Could not register IPC service!");
+	if (!exporting) {
+		m_proc_server = newd RMEProcessServer();
+		if (!m_proc_server->Create("rme_host")) {
+			wxLogWarning("Could not register IPC service!");
+		}
 	}
 #endif
 
@@ -161,9 +178,6 @@ bool Application::OnInit() {
 	std::string error;
 	StringVector warnings;
 
-	m_file_to_open = wxEmptyString;
-	ParseCommandLineMap(m_file_to_open);
-
 	g_gui.root = newd MainFrame(__W_RME_APPLICATION_NAME__, wxDefaultPosition, wxSize(700, 500));
 	SetTopWindow(g_gui.root);
 	g_gui.SetTitle("");
@@ -185,6 +199,12 @@ bool Application::OnInit() {
 	// Set idle event handling mode
 	wxIdleEvent::SetMode(wxIDLE_PROCESS_SPECIFIED);
 
+	// Nothing below may ask the user anything while exporting
+	if (exporting) {
+		m_startup = true;
+		return true;
+	}
+
 	// Goto RME website?
 	if (g_settings.getInteger(Config::GOTO_WEBSITE_ON_BOOT) == 1) {
 		::wxLaunchDefaultBrowser(__SITE_URL__, wxBROWSER_NEW_WINDOW);
@@ -275,6 +295,11 @@ void Application::OnEventLoopEnter(wxEventLoopBase* loop) {
 	}
 	m_startup = false;
 
+	if (m_export_image != wxEmptyString) {
+		ExportMapImage();
+		return;
+	}
+
 	// Don't try to create a map if we didn't load the client map.
 	if (ClientVersion::getLatestVersion() == nullptr) {
 		return;
@@ -289,6 +314,39 @@ void Application::OnEventLoopEnter(wxEventLoopBase* loop) {
 	}
 }
 
+void Application::ExportMapImage() {
+	m_exit_code = 1;
+	if (ClientVersion::getLatestVersion() == nullptr) {
+		std::cerr << "Could not export map image: no client version is configured." << std::endl;
+		g_gui.root->Close(true);
+		return;
+	}
+
+	// Opened without GUI::LoadMap, which asks about warnings in dialogs
+	Editor* editor = nullptr;
+	try {
+		editor = newd Editor(g_gui.copybuffer, FileName(m_file_to_open));
+	} catch (std::runtime_error& e) {
+		std::cerr << "Could not export map image: " << e.what() << std::endl;
+		g_gui.root->Close(true);
+		return;
+	}
+
+	for (const wxString& warning : editor->map.getWarnings()) {
+		std::cerr << "Warning: " << warning << std::endl;
+	}
+
+	MapTab* tab = newd MapTab(g_gui.tabbook, editor);
+	MapImageExporter exporter(*editor, tab->GetCanvas());
+	if (exporter.exportFloor(FileName(m_export_image), m_export_floor, false, true)) {
+		std::cout << "Exported floor " << m_export_floor << " to " << m_export_image << std::endl;
+		m_exit_code = 0;
+	} else {
+		std::cerr << "Could not export map image: " << exporter.getError() << std::endl;
+	}
+	g_gui.root->Close(true);
+}
+
 void Application::MacOpenFiles(const wxArrayString& fileNames) {
 	if (!fileNames.IsEmpty()) {
 		g_gui.LoadMap(FileName(fileNames.Item(0)));
@@ -330,6 +388,11 @@ void Application::Unload() {
 	g_gui.root = nullptr;
 }
 
+int Application::OnRun() {
+	const int exit_code = wxApp::OnRun();
+	return m_export_image.empty() ? exit_code : m_exit_code;
+}
+
 int Application::OnExit() {
 #ifdef _USE_PROCESS_COM
 	wxDELETE(m_proc_server);
@@ -343,6 +406,22 @@ void Application::OnFatalException() {
 }
 
 bool Application::ParseCommandLineMap(wxString& fileName) {
+	// --export-image <map> <image.png> [floor] opens the map, renders the floor and quits
+	if (argc >= 2 && argv[1] == "--export-image") {
+		long floor = GROUND_LAYER;
+		if (argc != 4 && argc != 5) {
+			std::cerr << "Usage: --export-image <map> <image.png> [floor]" << std::endl;
+		} else if (argc == 5 && (!wxString(argv[4]).ToLong(&floor) || floor < 0 || floor > MAP_MAX_LAYER)) {
+			std::cerr << "Invalid floor " << argv[4] << ", it must be between 0 and " << MAP_MAX_LAYER << "." << std::endl;
+		} else {
+			fileName = wxString(argv[2]);
+			m_export_image = wxString(argv[3]);
+			m_export_floor = int(floor);
+		}
+		// Never hand this over to an already running instance
+		return false;
+	}
+
 	if (argc == 2) {
 		fileName = wxString(argv[1]);
 		return true;
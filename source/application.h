@@ -41,13 +41,18 @@ public:
 	virtual bool OnInit();
 	virtual void OnEventLoopEnter(wxEventLoopBase* loop);
 	virtual void MacOpenFiles(const wxArrayString& fileNames);
+	virtual int OnRun();
 	virtual int OnExit();
 	void Unload();
 
 private:
 	bool m_startup;
 	wxString m_file_to_open;
+	wxString m_export_image;
+	int m_export_floor;
+	int m_exit_code;
 	void FixVersionDiscrapencies();
+	void ExportMapImage();
 	bool ParseCommandLineMap(wxString& fileName);
 
 	virtual void OnFatalException();
@@ -20,10 +20,45 @@
 #include "tile.h"
 #include "basemap.h"
 
+// Tiles without anything that ends up in an OTBM tile area, replacing
+// them doesn't change the serialized block
+static bool hasAreaData(const Tile* tile) {
+	return tile && (tile->ground || !tile->items.empty() || tile->getMapFlags() || tile->isHouseTile());
+}
+
+MapLeafIndex::~MapLeafIndex() {
+	clear();
+}
+
+void MapLeafIndex::set(int x, int y, QTreeNode* leaf) {
+	if (!directory) {
+		directory = newd Page*[256 * 256]();
+	}
+	Page*& page = directory[((x >> 8) << 8) | (y >> 8)];
+	if (!page) {
+		page = newd Page();
+	}
+	page->leaves[(((x >> 2) & 63) << 6) | ((y >> 2) & 63)] = leaf;
+}
+
+void MapLeafIndex::clear() {
+	if (!directory) {
+		return;
+	}
+	for (int i = 0; i < 256 * 256; ++i) {
+		delete directory[i];
+	}
+	delete[] directory;
+	directory = nullptr;
+}
+
 BaseMap::BaseMap() :
 	allocator(),
+	area_cache(),
 	tilecount(0),
-	root(*this) {
+	revision(0),
+	root(*this),
+	leaves() {
 	////
 }
 
@@ -32,14 +67,22 @@ BaseMap::~BaseMap() {
 }
 
 void BaseMap::clear(bool del) {
-	PositionVector pos_vec;
-	for (MapIterator map_iter = begin(); map_iter != end(); ++map_iter) {
-		Tile* t = (*map_iter)->get();
-		pos_vec.push_back(t->getPosition());
+	// One walk over the tree instead of looking every tile up again
+	root.clearTiles(del);
+	tilecount = 0;
+	area_cache.clear();
+}
+
+QTreeNode* BaseMap::createLeaf(int x, int y) {
+	if (!MapLeafIndex::covers(x, y)) {
+		return root.getLeafForce(x, y);
 	}
-	for (PositionVector::iterator pos_iter = pos_vec.begin(); pos_iter != pos_vec.end(); ++pos_iter) {
-		setTile(*pos_iter, nullptr, del);
+	QTreeNode* leaf = leaves.get(x, y);
+	if (!leaf) {
+		leaf = root.getLeafForce(x, y);
+		leaves.set(x, y, leaf);
 	}
+	return leaf;
 }
 
 void BaseMap::clearVisible(uint32_t mask) {
@@ -48,7 +91,7 @@ void BaseMap::clearVisible(uint32_t mask) {
 
 Tile* BaseMap::createTile(int x, int y, int z) {
 	ASSERT(z < MAP_LAYERS);
-	QTreeNode* leaf = root.getLeafForce(x, y);
+	QTreeNode* leaf = createLeaf(x, y);
 	TileLocation* loc = leaf->createTile(x, y, z);
 	if (loc->get()) {
 		return loc->get();
@@ -70,7 +113,7 @@ Tile* BaseMap::getOrCreateTile(const Position& pos) {
 
 TileLocation* BaseMap::getTileL(int x, int y, int z) {
 	ASSERT(z < MAP_LAYERS);
-	QTreeNode* leaf = root.getLeaf(x, y);
+	QTreeNode* leaf = getLeaf(x, y);
 	if (leaf) {
 		Floor* floor = leaf->getFloor(z);
 		if (floor) {
@@ -95,10 +138,45 @@ const TileLocation* BaseMap::getTileL(const Position& pos) const {
 	return getTileL(pos.x, pos.y, pos.z);
 }
 
+void BaseMap::getNeighbourhood(int x, int y, int z, TileNeighbourhood& around) {
+	ASSERT(z < MAP_LAYERS);
+
+	// The block spans at most two leaves in each direction
+	const int first_leaf_x = (x - 1) >> 2;
+	const int first_leaf_y = (y - 1) >> 2;
+	Floor* floors[2][2];
+	bool looked_up[2][2] = { { false, false }, { false, false } };
+
+	for (int dy = -1; dy <= 1; ++dy) {
+		for (int dx = -1; dx <= 1; ++dx) {
+			Tile*& tile = around.tiles[(dy + 1) * 3 + dx + 1];
+			tile = nullptr;
+
+			const int nx = x + dx;
+			const int ny = y + dy;
+			if (nx < 0 || ny < 0) {
+				continue;
+			}
+
+			const int leaf_x = (nx >> 2) - first_leaf_x;
+			const int leaf_y = (ny >> 2) - first_leaf_y;
+			Floor*& floor = floors[leaf_x][leaf_y];
+			if (!looked_up[leaf_x][leaf_y]) {
+				QTreeNode* leaf = getLeaf(nx, ny);
+				floor = leaf ? leaf->getFloor(z) : nullptr;
+				looked_up[leaf_x][leaf_y] = true;
+			}
+			if (floor) {
+				tile = floor->locs[(nx & 3) * 4 + (ny & 3)].get();
+			}
+		}
+	}
+}
+
 TileLocation* BaseMap::createTileL(int x, int y, int z) {
 	ASSERT(z < MAP_LAYERS);
 
-	QTreeNode* leaf = root.getLeafForce(x, y);
+	QTreeNode* leaf = createLeaf(x, y);
 	Floor* floor = leaf->createFloor(x, y, z);
 	uint32_t offsetX = x & 3;
 	uint32_t offsetY = y & 3;
@@ -115,8 +193,11 @@ void BaseMap::setTile(int x, int y, int z, Tile* newtile, bool remove) {
 	ASSERT(!newtile || newtile->getY() == int(y));
 	ASSERT(!newtile || newtile->getZ() == int(z));
 
-	QTreeNode* leaf = root.getLeafForce(x, y);
+	QTreeNode* leaf = createLeaf(x, y);
 	Tile* old = leaf->setTile(x, y, z, newtile);
+	if (hasAreaData(old) || hasAreaData(newtile)) {
+		area_cache.invalidate(x, y);
+	}
 	if (remove) {
 		delete old;
 	}
@@ -128,8 +209,32 @@ Tile* BaseMap::swapTile(int x, int y, int z, Tile* newtile) {
 	ASSERT(!newtile || newtile->getY() == int(y));
 	ASSERT(!newtile || newtile->getZ() == int(z));
 
-	QTreeNode* leaf = root.getLeafForce(x, y);
-	return leaf->setTile(x, y, z, newtile);
+	QTreeNode* leaf = createLeaf(x, y);
+	Tile* old = leaf->setTile(x, y, z, newtile);
+	if (hasAreaData(old) || hasAreaData(newtile)) {
+		area_cache.invalidate(x, y);
+	}
+	return old;
+}
+
+void BaseMap::tileChanged(const Position& pos) {
+	area_cache.invalidate(pos);
+	tileTouched(pos);
+}
+
+void BaseMap::tileTouched(const Position& pos) {
+	QTreeNode* leaf = getLeaf(pos.x, pos.y);
+	if (leaf) {
+		Floor* floor = leaf->getFloor(pos.z);
+		if (floor) {
+			floor->touch();
+		}
+	}
+}
+
+void BaseMap::tilesChanged() {
+	area_cache.clear();
+	++revision;
 }
 
 // Iterators
@@ -24,6 +24,8 @@
 #include "map_allocator.h"
 #include "tile.h"
 
+#include <unordered_map>
+
 // Class declarations
 class QTreeNode;
 class BaseMap;
@@ -32,6 +34,112 @@ class Floor;
 class QTreeNode;
 class TileLocation;
 
+// Serialized OTBM tile areas from the last time the map was loaded or saved.
+// Entries are kept per 256x256 block (all floors) and dropped as soon as a
+// tile in the block is replaced, so the saver can copy untouched blocks
+// instead of encoding them again.
+class TileAreaCache {
+public:
+	TileAreaCache() :
+		tag(0) { }
+
+	// Identifies the format the cached blocks were encoded with
+	uint32_t getTag() const {
+		return tag;
+	}
+	void setTag(uint32_t newtag) {
+		if (newtag != tag) {
+			blocks.clear();
+			tag = newtag;
+		}
+	}
+
+	const std::vector<uint8_t>* get(int x, int y) const {
+		auto it = blocks.find(key(x, y));
+		return it == blocks.end() ? nullptr : &it->second;
+	}
+	// Returns the entry of the block, an empty one if it isn't cached
+	std::vector<uint8_t>& emplace(int x, int y) {
+		return blocks[key(x, y)];
+	}
+	void invalidate(int x, int y) {
+		if (!blocks.empty()) {
+			blocks.erase(key(x, y));
+		}
+	}
+	void invalidate(const Position& pos) {
+		invalidate(pos.x, pos.y);
+	}
+	void clear() {
+		blocks.clear();
+	}
+	void swap(TileAreaCache& other) {
+		blocks.swap(other.blocks);
+		std::swap(tag, other.tag);
+	}
+
+	size_t size() const {
+		return blocks.size();
+	}
+
+	static uint32_t key(int x, int y) {
+		return (uint32_t(x >> 8) << 8) | uint32_t((y >> 8) & 0xFF);
+	}
+
+private:
+	std::unordered_map<uint32_t, std::vector<uint8_t>> blocks;
+	uint32_t tag;
+};
+
+// Flat lookup from tile coordinates to the tree leaf holding them. A
+// directory with one entry per 256x256 block points to pages holding the
+// 64x64 leaves of that block, so finding a leaf takes two array reads
+// instead of a walk down the tree, and neighbouring tiles share a page.
+// Only covers coordinates from 0 to 0xFFFF, the tree handles the rest.
+class MapLeafIndex {
+public:
+	MapLeafIndex() :
+		directory(nullptr) { }
+	~MapLeafIndex();
+
+	MapLeafIndex(const MapLeafIndex&) = delete;
+	MapLeafIndex& operator=(const MapLeafIndex&) = delete;
+
+	static bool covers(int x, int y) {
+		return ((x | y) & ~0xFFFF) == 0;
+	}
+
+	QTreeNode* get(int x, int y) const {
+		if (!directory) {
+			return nullptr;
+		}
+		const Page* page = directory[((x >> 8) << 8) | (y >> 8)];
+		return page ? page->leaves[(((x >> 2) & 63) << 6) | ((y >> 2) & 63)] : nullptr;
+	}
+	void set(int x, int y, QTreeNode* leaf);
+	void clear();
+
+private:
+	struct Page {
+		QTreeNode* leaves[64 * 64];
+	};
+	Page** directory;
+};
+
+// The 3x3 block of tiles around a position, row by row from the top left
+struct TileNeighbourhood {
+	Tile* tiles[9];
+
+	Tile* get(int dx, int dy) const {
+		return tiles[(dy + 1) * 3 + dx + 1];
+	}
+	// The eight neighbours in the order the brushes use: the row above,
+	// left and right, then the row below
+	Tile* getNeighbour(int index) const {
+		return tiles[index < 4 ? index : index + 1];
+	}
+};
+
 class MapIterator {
 public:
 	MapIterator(BaseMap* _map = nullptr);
@@ -107,16 +215,25 @@ public:
 	TileLocation* getTileL(const Position& pos);
 	TileLocation* createTileL(int x, int y, int z);
 	TileLocation* createTileL(const Position& pos);
+
+	// Fills the tiles around a position, nullptr where there is no tile or
+	// the position is off the map. Looks up each of the (at most four)
+	// leaves involved once.
+	void getNeighbourhood(int x, int y, int z, TileNeighbourhood& around);
+	void getNeighbourhood(const Position& pos, TileNeighbourhood& around) {
+		getNeighbourhood(pos.x, pos.y, pos.z, around);
+	}
 	const TileLocation* getTileL(int x, int y, int z) const;
 	const TileLocation* getTileL(const Position& pos) const;
 
 	// Get a Quad Tree Leaf from the map
 	QTreeNode* getLeaf(int x, int y) {
+		if (MapLeafIndex::covers(x, y)) {
+			return leaves.get(x, y);
+		}
 		return root.getLeaf(x, y);
 	}
-	QTreeNode* createLeaf(int x, int y) {
-		return root.getLeafForce(x, y);
-	}
+	QTreeNode* createLeaf(int x, int y);
 
 	// Assigns a tile, it might seem pointless to provide position, but it is not, as the passed tile may be nullptr
 	void setTile(int _x, int _y, int _z, Tile* newtile, bool remove = false);
@@ -135,17 +252,33 @@ public:
 	// Clears the visiblity according to the mask passed
 	void clearVisible(uint32_t mask);
 
+	// Call after editing a tile in place, tiles replaced through setTile or
+	// swapTile are tracked already
+	void tileChanged(const Position& pos);
+	// Same, for edits that touch too many tiles to list them
+	void tilesChanged();
+	// Call after a change that only affects drawing, like selecting the
+	// tile, the saved form of its area stays valid
+	void tileTouched(const Position& pos);
+	// Bumped by tilesChanged, see Floor::getRevision for single tiles
+	uint32_t getRevision() const {
+		return revision;
+	}
+
 	uint64_t getTileCount() const {
 		return tilecount;
 	}
 
 public:
 	MapAllocator allocator;
+	TileAreaCache area_cache;
 
 protected:
 	uint64_t tilecount;
+	uint32_t revision;
 
 	QTreeNode root; // The Quad Tree root
+	MapLeafIndex leaves; // Every leaf of the tree by position
 
 	friend class QTreeNode;
 };
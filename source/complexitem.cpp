@@ -44,6 +44,22 @@ Item* Container::deepCopy() const {
 	return copy;
 }
 
+bool Container::isSameAs(const Item& other) const {
+	if (!Item::isSameAs(other)) {
+		return false;
+	}
+	const Container& container = static_cast<const Container&>(other);
+	if (contents.size() != container.contents.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < contents.size(); ++i) {
+		if (!contents[i]->isSameAs(*container.contents[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
 Item* Container::getItem(size_t index) const {
 	if (index < contents.size()) {
 		return contents[index];
@@ -68,6 +84,10 @@ Item* Teleport::deepCopy() const {
 	return copy;
 }
 
+bool Teleport::isSameAs(const Item& other) const {
+	return Item::isSameAs(other) && destination == static_cast<const Teleport&>(other).destination;
+}
+
 // Door
 Door::Door(const uint16_t type) :
 	Item(type, 0),
@@ -81,6 +101,10 @@ Item* Door::deepCopy() const {
 	return copy;
 }
 
+bool Door::isSameAs(const Item& other) const {
+	return Item::isSameAs(other) && doorId == static_cast<const Door&>(other).doorId;
+}
+
 // Depot
 Depot::Depot(const uint16_t type) :
 	Item(type, 0),
@@ -97,6 +121,10 @@ Item* Depot::deepCopy() const {
 	return copy;
 }
 
+bool Depot::isSameAs(const Item& other) const {
+	return Item::isSameAs(other) && depotId == static_cast<const Depot&>(other).depotId;
+}
+
 // Podium
 Podium::Podium(const uint16_t type) :
 	Item(type, 0),
@@ -113,3 +141,17 @@ Item* Podium::deepCopy() const {
 	copy->direction = direction;
 	return copy;
 }
+
+bool Podium::isSameAs(const Item& other) const {
+	if (!Item::isSameAs(other)) {
+		return false;
+	}
+	const Podium& podium = static_cast<const Podium&>(other);
+	const Outfit& look = podium.outfit;
+	return outfit.lookType == look.lookType && outfit.lookItem == look.lookItem && outfit.lookAddon == look.lookAddon
+		&& outfit.getColorHash() == look.getColorHash() && outfit.lookMount == look.lookMount
+		&& outfit.lookMountHead == look.lookMountHead && outfit.lookMountBody == look.lookMountBody
+		&& outfit.lookMountLegs == look.lookMountLegs && outfit.lookMountFeet == look.lookMountFeet
+		&& direction == podium.direction && showOutfit == podium.showOutfit && showMount == podium.showMount
+		&& showPlatform == podium.showPlatform;
+}
@@ -38,6 +38,7 @@ public:
 	~Container();
 
 	Item* deepCopy() const;
+	bool isSameAs(const Item& other) const;
 	Item* getItem(size_t index) const;
 
 	size_t getItemCount() const {
@@ -66,6 +67,7 @@ public:
 	Teleport(const uint16_t type);
 
 	Item* deepCopy() const;
+	bool isSameAs(const Item& other) const;
 
 	virtual void serializeItemAttributes_OTBM(const IOMap& maphandle, NodeFileWriteHandle& f) const;
 	virtual bool readItemAttribute_OTBM(const IOMap& maphandle, OTBM_ItemAttribute attr, BinaryNode* node);
@@ -105,6 +107,7 @@ public:
 	Door(const uint16_t type);
 
 	Item* deepCopy() const;
+	bool isSameAs(const Item& other) const;
 
 	uint8_t getDoorID() const;
 	void setDoorID(uint8_t id);
@@ -126,6 +129,7 @@ public:
 	Depot(const uint16_t _type);
 
 	Item* deepCopy() const;
+	bool isSameAs(const Item& other) const;
 
 	uint8_t getDepotID() const {
 		return depotId;
@@ -148,6 +152,7 @@ public:
 	Podium(const uint16_t _type);
 
 	Item* deepCopy() const;
+	bool isSameAs(const Item& other) const;
 
 	const Outfit& getOutfit() const {
 		return outfit;
@@ -21,83 +21,269 @@
 #include "editor.h"
 #include "gui.h"
 #include "creature.h"
+#include "filehandle.h"
+#include "iomap_otbm.h"
+
+// Not part of OTBM, copied spawns and creatures are kept on their tile node
+enum CopyBufferAttribute {
+	COPYBUFFER_ATTR_SPAWN = 200,
+	COPYBUFFER_ATTR_CREATURE = 201,
+};
+
+static uint32_t chunkKey(int x, int y) {
+	return (static_cast<uint32_t>(x >> 2) << 16) | static_cast<uint32_t>(y >> 2);
+}
+
+static void writeTile(const IOMap& version, MemoryNodeFileWriteHandle& writer, const Position& position, uint32_t house_id, uint16_t mapflags, const ItemVector& items, const Creature* creature, const Spawn* spawn) {
+	writer.addNode(house_id ? OTBM_HOUSETILE : OTBM_TILE);
+	writer.addU16(position.x);
+	writer.addU16(position.y);
+	writer.addU8(position.z);
+
+	if (house_id) {
+		writer.addU32(house_id);
+	}
+
+	if (mapflags) {
+		writer.addByte(OTBM_ATTR_TILE_FLAGS);
+		writer.addU32(mapflags);
+	}
+
+	if (spawn) {
+		writer.addByte(COPYBUFFER_ATTR_SPAWN);
+		writer.addU32(spawn->getSize());
+	}
+
+	if (creature) {
+		writer.addByte(COPYBUFFER_ATTR_CREATURE);
+		writer.addString(creature->getName());
+		writer.addU32(creature->getSpawnTime());
+		writer.addU8(creature->getDirection());
+	}
+
+	for (const Item* item : items) {
+		item->serializeItemNode_OTBM(version, writer);
+	}
+
+	writer.endNode();
+}
 
 CopyBuffer::CopyBuffer() :
-	tiles(newd BaseMap()) {
+	mapVersion(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE)),
+	tile_count(0),
+	preview(newd BaseMap()) {
 	;
 }
 
 size_t CopyBuffer::GetTileCount() {
-	return tiles ? (size_t)tiles->size() : 0;
+	return tile_count;
 }
 
-BaseMap& CopyBuffer::getBufferMap() {
-	ASSERT(tiles);
-	return *tiles;
+BaseMap& CopyBuffer::getPreviewMap() {
+	return *preview;
 }
 
 CopyBuffer::~CopyBuffer() {
 	clear();
+	delete preview;
 }
 
 Position CopyBuffer::getPosition() const {
-	ASSERT(tiles);
 	return copyPos;
 }
 
 void CopyBuffer::clear() {
-	delete tiles;
-	tiles = nullptr;
+	chunks.clear();
+	tile_count = 0;
+	preview->clear();
+	preview_chunks.clear();
 }
 
-void CopyBuffer::copy(Editor& editor, int floor) {
-	if (editor.selection.size() == 0) {
-		g_gui.SetStatusText("No tiles to copy.");
-		return;
-	}
+void CopyBuffer::addChunk(uint32_t key, MemoryNodeFileWriteHandle& writer) {
+	writer.endNode();
+	chunks[key].assign(writer.getMemory(), writer.getMemory() + writer.getSize());
+}
 
-	clear();
-	tiles = newd BaseMap();
+TileVector CopyBuffer::readChunk(BaseMap& map, const std::vector<uint8_t>& data, const Position& offset) {
+	TileVector tiles;
 
-	int tile_count = 0;
-	int item_count = 0;
-	copyPos = Position(0xFFFF, 0xFFFF, floor);
+	MemoryNodeFileReadHandle reader(data.data(), data.size());
+	BinaryNode* rootNode = reader.getRootNode();
+	if (!rootNode) {
+		return tiles;
+	}
 
-	for (TileSet::iterator it = editor.selection.begin(); it != editor.selection.end(); ++it) {
-		++tile_count;
+	BinaryNode* tileNode = rootNode->getChild();
+	if (!tileNode) {
+		return tiles;
+	}
 
-		Tile* tile = *it;
-		TileLocation* newlocation = tiles->createTileL(tile->getPosition());
-		Tile* copied_tile = tiles->allocator(newlocation);
+	do {
+		uint8_t tileType;
+		uint16_t x, y;
+		uint8_t z;
+		if (!tileNode->getByte(tileType) || !tileNode->getU16(x) || !tileNode->getU16(y) || !tileNode->getU8(z)) {
+			continue;
+		}
 
-		if (tile->ground && tile->ground->isSelected()) {
-			copied_tile->house_id = tile->house_id;
-			copied_tile->setMapFlags(tile->getMapFlags());
+		Position pos = Position(x, y, z) + offset;
+		if (!pos.isValid()) {
+			continue;
 		}
 
-		ItemVector tile_selection = tile->getSelectedItems();
-		for (ItemVector::iterator iit = tile_selection.begin(); iit != tile_selection.end(); ++iit) {
-			++item_count;
-			// Copy items to copybuffer
-			copied_tile->addItem((*iit)->deepCopy());
+		Tile* tile = map.allocator(map.createTileL(pos));
+		bool ok = tileType != OTBM_HOUSETILE || tileNode->getU32(tile->house_id);
+
+		uint8_t attribute;
+		while (ok && tileNode->getU8(attribute)) {
+			switch (attribute) {
+				case OTBM_ATTR_TILE_FLAGS: {
+					uint32_t flags = 0;
+					ok = tileNode->getU32(flags);
+					tile->setMapFlags(flags);
+					break;
+				}
+				case COPYBUFFER_ATTR_SPAWN: {
+					uint32_t size = 0;
+					ok = tileNode->getU32(size);
+					if (ok) {
+						delete tile->spawn;
+						tile->spawn = newd Spawn(size);
+					}
+					break;
+				}
+				case COPYBUFFER_ATTR_CREATURE: {
+					std::string name;
+					uint32_t spawntime = 0;
+					uint8_t direction = SOUTH;
+					ok = tileNode->getString(name) && tileNode->getU32(spawntime) && tileNode->getU8(direction);
+					if (ok) {
+						delete tile->creature;
+						tile->creature = newd Creature(name);
+						tile->creature->setSpawnTime(spawntime);
+						tile->creature->setDirection(static_cast<Direction>(direction));
+					}
+					break;
+				}
+				default:
+					break;
+			}
 		}
 
-		if (tile->creature && tile->creature->isSelected()) {
-			copied_tile->creature = tile->creature->deepCopy();
+		// A chunk that was cut short, the rest of the tile can't be trusted
+		if (!ok) {
+			delete tile;
+			continue;
 		}
-		if (tile->spawn && tile->spawn->isSelected()) {
-			copied_tile->spawn = tile->spawn->deepCopy();
+
+		BinaryNode* itemNode = tileNode->getChild();
+		if (itemNode) {
+			do {
+				uint8_t itemType;
+				if (!itemNode->getByte(itemType) || itemType != OTBM_ITEM) {
+					continue;
+				}
+
+				Item* item = Item::Create_OTBM(mapVersion, itemNode);
+				if (item) {
+					item->unserializeItemNode_OTBM(mapVersion, itemNode);
+					tile->addItem(item);
+				}
+			} while (itemNode->advance());
 		}
 
-		tiles->setTile(copied_tile);
+		// Everything in the buffer was selected when it was copied
+		tile->select();
+		tiles.push_back(tile);
+	} while (tileNode->advance());
+
+	return tiles;
+}
+
+void CopyBuffer::preparePreview(const Position& start, const Position& end) {
+	std::vector<uint32_t> missing;
+	size_t visible = 0;
+	for (int x = std::max(start.x, 0) & ~3; x <= end.x; x += 4) {
+		for (int y = std::max(start.y, 0) & ~3; y <= end.y; y += 4) {
+			uint32_t key = chunkKey(x, y);
+			if (chunks.find(key) == chunks.end()) {
+				continue;
+			}
 
-		if (copied_tile->getX() < copyPos.x) {
-			copyPos.x = copied_tile->getX();
+			++visible;
+			if (preview_chunks.find(key) == preview_chunks.end()) {
+				missing.push_back(key);
+			}
 		}
+	}
+
+	if (missing.empty()) {
+		return;
+	}
 
-		if (copied_tile->getY() < copyPos.y) {
-			copyPos.y = copied_tile->getY();
+	// Start over rather than keeping everything that has been scrolled past
+	if (preview_chunks.size() + missing.size() > std::max<size_t>(COPYBUFFER_PREVIEW_CHUNKS, visible * 2)) {
+		preview->clear();
+		preview_chunks.clear();
+		preparePreview(start, end);
+		return;
+	}
+
+	for (uint32_t key : missing) {
+		for (Tile* tile : readChunk(*preview, chunks[key], Position())) {
+			preview->setTile(tile);
 		}
+		preview_chunks.insert(key);
+	}
+}
+
+void CopyBuffer::copy(Editor& editor, int floor) {
+	if (editor.selection.size() == 0) {
+		g_gui.SetStatusText("No tiles to copy.");
+		return;
+	}
+
+	clear();
+
+	int item_count = 0;
+	copyPos = Position(0xFFFF, 0xFFFF, floor);
+
+	std::map<uint32_t, TileVector> leaves;
+	for (Tile* tile : editor.selection) {
+		leaves[chunkKey(tile->getX(), tile->getY())].push_back(tile);
+	}
+
+	MemoryNodeFileWriteHandle writer;
+	for (const auto& leaf : leaves) {
+		writer.reset();
+		writer.addNode(0);
+
+		for (Tile* tile : leaf.second) {
+			++tile_count;
+
+			bool ground_selected = tile->ground && tile->ground->isSelected();
+			ItemVector tile_selection = tile->getSelectedItems();
+			item_count += tile_selection.size();
+
+			writeTile(
+				mapVersion, writer, tile->getPosition(),
+				ground_selected ? tile->house_id : 0,
+				ground_selected ? tile->getMapFlags() : 0,
+				tile_selection,
+				tile->creature && tile->creature->isSelected() ? tile->creature : nullptr,
+				tile->spawn && tile->spawn->isSelected() ? tile->spawn : nullptr
+			);
+
+			if (tile->getX() < copyPos.x) {
+				copyPos.x = tile->getX();
+			}
+
+			if (tile->getY() < copyPos.y) {
+				copyPos.y = tile->getY();
+			}
+		}
+
+		addChunk(leaf.first, writer);
 	}
 
 	std::ostringstream ss;
@@ -112,9 +298,7 @@ void CopyBuffer::cut(Editor& editor, int floor) {
 	}
 
 	clear();
-	tiles = newd BaseMap();
 
-	int tile_count = 0;
 	int item_count = 0;
 	copyPos = Position(0xFFFF, 0xFFFF, floor);
 
@@ -123,55 +307,72 @@ void CopyBuffer::cut(Editor& editor, int floor) {
 
 	PositionList tilestoborder;
 
-	for (TileSet::iterator it = editor.selection.begin(); it != editor.selection.end(); ++it) {
-		tile_count++;
+	std::map<uint32_t, TileVector> leaves;
+	for (Tile* tile : editor.selection) {
+		leaves[chunkKey(tile->getX(), tile->getY())].push_back(tile);
+	}
 
-		Tile* tile = *it;
-		Tile* newtile = tile->deepCopy(editor.map);
-		Tile* copied_tile = tiles->allocator(tile->getLocation());
+	MemoryNodeFileWriteHandle writer;
+	for (const auto& leaf : leaves) {
+		writer.reset();
+		writer.addNode(0);
 
-		if (tile->ground && tile->ground->isSelected()) {
-			copied_tile->house_id = newtile->house_id;
-			newtile->house_id = 0;
-			copied_tile->setMapFlags(tile->getMapFlags());
-			newtile->setMapFlags(TILESTATE_NONE);
-		}
+		for (Tile* tile : leaf.second) {
+			tile_count++;
 
-		ItemVector tile_selection = newtile->popSelectedItems();
-		for (ItemVector::iterator iit = tile_selection.begin(); iit != tile_selection.end(); ++iit) {
-			item_count++;
-			// Add items to copybuffer
-			copied_tile->addItem(*iit);
-		}
+			Tile* newtile = tile->deepCopy(editor.map);
 
-		if (newtile->creature && newtile->creature->isSelected()) {
-			copied_tile->creature = newtile->creature;
-			newtile->creature = nullptr;
-		}
+			uint32_t house_id = 0;
+			uint16_t mapflags = 0;
+			if (tile->ground && tile->ground->isSelected()) {
+				house_id = newtile->house_id;
+				newtile->house_id = 0;
+				mapflags = tile->getMapFlags();
+				newtile->setMapFlags(TILESTATE_NONE);
+			}
 
-		if (newtile->spawn && newtile->spawn->isSelected()) {
-			copied_tile->spawn = newtile->spawn;
-			newtile->spawn = nullptr;
-		}
+			ItemVector tile_selection = newtile->popSelectedItems();
+			item_count += tile_selection.size();
 
-		tiles->setTile(copied_tile->getPosition(), copied_tile);
+			Creature* creature = nullptr;
+			if (newtile->creature && newtile->creature->isSelected()) {
+				creature = newtile->creature;
+				newtile->creature = nullptr;
+			}
 
-		if (copied_tile->getX() < copyPos.x) {
-			copyPos.x = copied_tile->getX();
-		}
+			Spawn* spawn = nullptr;
+			if (newtile->spawn && newtile->spawn->isSelected()) {
+				spawn = newtile->spawn;
+				newtile->spawn = nullptr;
+			}
 
-		if (copied_tile->getY() < copyPos.y) {
-			copyPos.y = copied_tile->getY();
-		}
+			// The removed parts only live on in the buffer
+			writeTile(mapVersion, writer, tile->getPosition(), house_id, mapflags, tile_selection, creature, spawn);
+			for (Item* item : tile_selection) {
+				delete item;
+			}
+			delete creature;
+			delete spawn;
+
+			if (tile->getX() < copyPos.x) {
+				copyPos.x = tile->getX();
+			}
+
+			if (tile->getY() < copyPos.y) {
+				copyPos.y = tile->getY();
+			}
 
-		if (g_settings.getInteger(Config::USE_AUTOMAGIC)) {
-			for (int y = -1; y <= 1; y++) {
-				for (int x = -1; x <= 1; x++) {
-					tilestoborder.push_back(Position(tile->getX() + x, tile->getY() + y, tile->getZ()));
+			if (g_settings.getInteger(Config::USE_AUTOMAGIC)) {
+				for (int y = -1; y <= 1; y++) {
+					for (int x = -1; x <= 1; x++) {
+						tilestoborder.push_back(Position(tile->getX() + x, tile->getY() + y, tile->getZ()));
+					}
 				}
 			}
+			action->addChange(newd Change(newtile));
 		}
-		action->addChange(newd Change(newtile));
+
+		addChunk(leaf.first, writer);
 	}
 
 	batch->addAndCommitAction(action);
@@ -210,50 +411,68 @@ void CopyBuffer::cut(Editor& editor, int floor) {
 }
 
 void CopyBuffer::paste(Editor& editor, const Position& toPosition) {
-	if (!tiles) {
+	if (chunks.empty()) {
 		return;
 	}
 
+	bool show_progress = chunks.size() > COPYBUFFER_PROGRESS_CHUNKS;
+	if (show_progress) {
+		g_gui.CreateLoadBar("Pasting...", true);
+	}
+
 	BatchAction* batchAction = editor.actionQueue->createBatch(ACTION_PASTE_TILES);
 	Action* action = editor.actionQueue->createAction(batchAction);
-	for (MapIterator it = tiles->begin(); it != tiles->end(); ++it) {
-		Tile* buffer_tile = (*it)->get();
-		Position pos = buffer_tile->getPosition() - copyPos + toPosition;
-
-		if (!pos.isValid()) {
-			continue;
+	PositionVector pasted;
+
+	// Chunks are decoded one at a time straight onto the map
+	const Position offset = toPosition - copyPos;
+	size_t done = 0;
+	for (const auto& chunk : chunks) {
+		if (show_progress && !g_gui.SetLoadDone(static_cast<int32_t>(100 * done / chunks.size()))) {
+			g_gui.DestroyLoadBar();
+			delete action;
+			delete batchAction;
+			g_gui.SetStatusText("Paste cancelled.");
+			return;
 		}
+		++done;
 
-		TileLocation* location = editor.map.createTileL(pos);
-		Tile* copy_tile = buffer_tile->deepCopy(editor.map);
-		Tile* old_dest_tile = location->get();
-		Tile* new_dest_tile = nullptr;
-		copy_tile->setLocation(location);
+		for (Tile* copy_tile : readChunk(editor.map, chunk.second, offset)) {
+			const Position& pos = copy_tile->getPosition();
+			TileLocation* location = copy_tile->getLocation();
+			Tile* old_dest_tile = location->get();
+			Tile* new_dest_tile = nullptr;
 
-		if (g_settings.getInteger(Config::MERGE_PASTE) || !copy_tile->ground) {
-			if (old_dest_tile) {
-				new_dest_tile = old_dest_tile->deepCopy(editor.map);
+			if (g_settings.getInteger(Config::MERGE_PASTE) || !copy_tile->ground) {
+				if (old_dest_tile) {
+					new_dest_tile = old_dest_tile->deepCopy(editor.map);
+				} else {
+					new_dest_tile = editor.map.allocator(location);
+				}
+				new_dest_tile->merge(copy_tile);
+				delete copy_tile;
 			} else {
-				new_dest_tile = editor.map.allocator(location);
+				// If the copied tile has ground, replace target tile
+				new_dest_tile = copy_tile;
 			}
-			new_dest_tile->merge(copy_tile);
-			delete copy_tile;
-		} else {
-			// If the copied tile has ground, replace target tile
-			new_dest_tile = copy_tile;
+
+			// Add all surrounding tiles to the map, so they get borders
+			editor.map.createTile(pos.x - 1, pos.y - 1, pos.z);
+			editor.map.createTile(pos.x, pos.y - 1, pos.z);
+			editor.map.createTile(pos.x + 1, pos.y - 1, pos.z);
+			editor.map.createTile(pos.x - 1, pos.y, pos.z);
+			editor.map.createTile(pos.x + 1, pos.y, pos.z);
+			editor.map.createTile(pos.x - 1, pos.y + 1, pos.z);
+			editor.map.createTile(pos.x, pos.y + 1, pos.z);
+			editor.map.createTile(pos.x + 1, pos.y + 1, pos.z);
+
+			pasted.push_back(pos);
+			action->addChange(newd Change(new_dest_tile));
 		}
+	}
 
-		// Add all surrounding tiles to the map, so they get borders
-		editor.map.createTile(pos.x - 1, pos.y - 1, pos.z);
-		editor.map.createTile(pos.x, pos.y - 1, pos.z);
-		editor.map.createTile(pos.x + 1, pos.y - 1, pos.z);
-		editor.map.createTile(pos.x - 1, pos.y, pos.z);
-		editor.map.createTile(pos.x + 1, pos.y, pos.z);
-		editor.map.createTile(pos.x - 1, pos.y + 1, pos.z);
-		editor.map.createTile(pos.x, pos.y + 1, pos.z);
-		editor.map.createTile(pos.x + 1, pos.y + 1, pos.z);
-
-		action->addChange(newd Change(new_dest_tile));
+	if (show_progress) {
+		g_gui.DestroyLoadBar();
 	}
 	batchAction->addAndCommitAction(action);
 
@@ -263,12 +482,8 @@ void CopyBuffer::paste(Editor& editor, const Position& toPosition) {
 		Map& map = editor.map;
 
 		// Go through all modified (selected) tiles (might be slow)
-		for (MapIterator it = tiles->begin(); it != tiles->end(); ++it) {
+		for (const Position& pos : pasted) {
 			bool add_me = false; // If this tile is touched
-			Position pos = (*it)->getPosition() - copyPos + toPosition;
-			if (pos.z < 0 || pos.z >= MAP_LAYERS) {
-				continue;
-			}
 			// Go through all neighbours
 			Tile* t;
 			t = map.getTile(pos.x - 1, pos.y - 1, pos.z);
@@ -341,5 +556,5 @@ void CopyBuffer::paste(Editor& editor, const Position& toPosition) {
 }
 
 bool CopyBuffer::canPaste() const {
-	return tiles && tiles->size() != 0;
+	return !chunks.empty();
 }
@@ -22,8 +22,15 @@
 
 #include "position.h"
 #include "basemap.h"
+#include "iomap.h"
 
 class Editor;
+class MemoryNodeFileWriteHandle;
+
+// Chunks decoded for the paste preview before the oldest are dropped
+#define COPYBUFFER_PREVIEW_CHUNKS 4096
+// Pastes with more chunks than this show a progress bar
+#define COPYBUFFER_PROGRESS_CHUNKS 256
 
 class CopyBuffer {
 public:
@@ -43,11 +50,25 @@ public:
 
 	size_t GetTileCount();
 
-	BaseMap& getBufferMap();
+	// Decodes the chunks between start and end (in buffer coordinates) into
+	// the preview map, call before drawing the preview.
+	void preparePreview(const Position& start, const Position& end);
+	BaseMap& getPreviewMap();
 
 private:
+	void addChunk(uint32_t key, MemoryNodeFileWriteHandle& writer);
+	TileVector readChunk(BaseMap& map, const std::vector<uint8_t>& data, const Position& offset);
+
+	VirtualIOMap mapVersion;
 	Position copyPos;
-	BaseMap* tiles;
+	size_t tile_count;
+
+	// The copied tiles serialized as OTBM tile nodes, one chunk per 4x4 leaf
+	// holding every floor, so huge copies don't keep a second map in memory.
+	std::map<uint32_t, std::vector<uint8_t>> chunks;
+
+	BaseMap* preview;
+	std::set<uint32_t> preview_chunks;
 };
 
 #endif
@@ -39,6 +39,11 @@
 #include "live_client.h"
 #include "live_action.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 Editor::Editor(CopyBuffer& copybuffer) :
 	live_server(nullptr),
 	live_client(nullptr),
@@ -388,8 +393,7 @@ bool Editor::exportSelectionAsMiniMap(FileName directory, wxString fileName) {
 	int min_x = MAP_MAX_WIDTH + 1, min_y = MAP_MAX_HEIGHT + 1, min_z = MAP_MAX_LAYER + 1;
 	int max_x = 0, max_y = 0, max_z = 0;
 
-	const TileSet& tiles = selection.getTiles();
-	for (Tile* tile : tiles) {
+	for (Tile* tile : selection) {
 		if (tile->empty()) {
 			continue;
 		}
@@ -714,8 +718,7 @@ bool Editor::importMap(FileName filename, int import_x_offset, int import_y_offs
 		iter->second->pos += offset;
 	}
 
-	map.waypoints.waypoints.insert(imported_map.waypoints.begin(), imported_map.waypoints.end());
-	imported_map.waypoints.waypoints.clear();
+	map.waypoints.merge(imported_map.waypoints);
 
 	uint64_t tiles_merged = 0;
 	uint64_t tiles_to_import = imported_map.tilecount;
@@ -833,24 +836,141 @@ void Editor::borderizeSelection() {
 	addAction(action);
 }
 
-void Editor::borderizeMap(bool showdialog) {
-	if (showdialog) {
-		g_gui.CreateLoadBar("Borderizing map...");
+// Runs process on every tile of the map. With several worker threads the
+// calling thread walks the map and hands runs of consecutive tiles (which
+// are whole leaves, or parts of one) to the workers. Every tile is in exactly
+// one run, so process may change the tile it is given and read its
+// neighbours, as long as it never changes what it reads from them.
+// Updating the progress bar dispatches paint events that read the map, so
+// it is only done while every worker is idle.
+template <typename Process>
+static void processMapTiles(Map& map, bool showdialog, Process process) {
+	uint64_t tiles_done = 0;
+	auto updateProgress = [&]() {
+		g_gui.SetLoadDone(static_cast<int32_t>(tiles_done / double(map.getTileCount()) * 100.0));
+	};
+
+	const int thread_count = g_settings.getInteger(Config::WORKER_THREADS);
+	if (thread_count <= 1) {
+		for (TileLocation* tileLocation : map) {
+			if (showdialog && tiles_done % 4096 == 0) {
+				updateProgress();
+			}
+
+			Tile* tile = tileLocation->get();
+			ASSERT(tile);
+
+			process(tile);
+			++tiles_done;
+		}
+		return;
 	}
 
-	uint64_t tiles_done = 0;
-	for (TileLocation* tileLocation : map) {
-		if (showdialog && tiles_done % 4096 == 0) {
-			g_gui.SetLoadDone(static_cast<int32_t>(tiles_done / double(map.tilecount) * 100.0));
+	const size_t run_size = 4096;
+	const uint64_t progress_step = std::max<uint64_t>(run_size * thread_count * 4, map.getTileCount() / 100);
+	uint64_t next_progress = progress_step;
+
+	std::mutex mutex;
+	std::condition_variable run_queued;
+	std::condition_variable run_taken;
+	std::condition_variable run_done;
+	std::deque<std::vector<Tile*>> runs;
+	int busy = 0;
+	bool finished = false;
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < thread_count; ++i) {
+		threads.emplace_back([&]() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				run_queued.wait(lock, [&]() { return finished || !runs.empty(); });
+				if (runs.empty()) {
+					return;
+				}
+
+				std::vector<Tile*> run = std::move(runs.front());
+				runs.pop_front();
+				++busy;
+				run_taken.notify_one();
+
+				lock.unlock();
+				for (Tile* tile : run) {
+					process(tile);
+				}
+				lock.lock();
+
+				--busy;
+				if (busy == 0 && runs.empty()) {
+					run_done.notify_all();
+				}
+			}
+		});
+	}
+
+	std::vector<Tile*> run;
+	auto queueRun = [&]() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			run_taken.wait(lock, [&]() { return runs.size() < size_t(thread_count) * 4; });
+			runs.push_back(std::move(run));
 		}
+		run_queued.notify_one();
+		run = std::vector<Tile*>();
+		run.reserve(run_size);
+	};
 
+	run.reserve(run_size);
+	for (TileLocation* tileLocation : map) {
 		Tile* tile = tileLocation->get();
 		ASSERT(tile);
 
-		tile->borderize(&map);
+		run.push_back(tile);
 		++tiles_done;
+		if (run.size() >= run_size) {
+			queueRun();
+
+			if (showdialog && tiles_done >= next_progress) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					run_done.wait(lock, [&]() { return busy == 0 && runs.empty(); });
+				}
+				// Nothing is queued, the workers stay idle until the next run
+				updateProgress();
+				next_progress += progress_step;
+			}
+		}
+	}
+	if (!run.empty()) {
+		queueRun();
 	}
 
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished = true;
+	}
+	run_queued.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+void Editor::borderizeMap(bool showdialog) {
+	if (showdialog) {
+		g_gui.CreateLoadBar("Borderizing map...");
+	}
+
+	// Tiles are changed in place, no block can be reused as it was and the
+	// undo history, which only stores what differs from the map, is no
+	// longer valid
+	map.tilesChanged();
+	actionQueue->clear();
+
+	// Borders only depend on the grounds around a tile, which borderizing
+	// never changes, so tiles can be done in any order
+	processMapTiles(map, showdialog, [this](Tile* tile) {
+		tile->borderize(&map);
+	});
+
 	if (showdialog) {
 		g_gui.DestroyLoadBar();
 	}
@@ -887,38 +1007,44 @@ void Editor::randomizeMap(bool showdialog) {
 		g_gui.CreateLoadBar("Randomizing map...");
 	}
 
-	uint64_t tiles_done = 0;
-	for (TileLocation* tileLocation : map) {
-		if (showdialog && tiles_done % 4096 == 0) {
-			g_gui.SetLoadDone(static_cast<int32_t>(tiles_done / double(map.tilecount) * 100.0));
-		}
+	// Tiles are changed in place, no block can be reused as it was and the
+	// undo history, which only stores what differs from the map, is no
+	// longer valid
+	map.tilesChanged();
+	actionQueue->clear();
 
-		Tile* tile = tileLocation->get();
-		ASSERT(tile);
+	// Every tile draws from its own random stream, the result is the same
+	// however many threads share the work
+	const uint64_t seed = (uint64_t(mt_randi()) << 32) | mt_randi();
 
+	processMapTiles(map, showdialog, [this, seed](Tile* tile) {
 		GroundBrush* groundBrush = tile->getGroundBrush();
-		if (groundBrush) {
-			Item* oldGround = tile->ground;
+		if (!groundBrush) {
+			return;
+		}
 
-			uint16_t actionId, uniqueId;
-			if (oldGround) {
-				actionId = oldGround->getActionID();
-				uniqueId = oldGround->getUniqueID();
-			} else {
-				actionId = 0;
-				uniqueId = 0;
-			}
-			groundBrush->draw(&map, tile, nullptr);
+		const Position& position = tile->getPosition();
+		MTRandomStream stream(MTRandomStream::key(seed, position.x, position.y, position.z));
 
-			Item* newGround = tile->ground;
-			if (newGround) {
-				newGround->setActionID(actionId);
-				newGround->setUniqueID(uniqueId);
-			}
-			tile->update();
+		Item* oldGround = tile->ground;
+
+		uint16_t actionId, uniqueId;
+		if (oldGround) {
+			actionId = oldGround->getActionID();
+			uniqueId = oldGround->getUniqueID();
+		} else {
+			actionId = 0;
+			uniqueId = 0;
 		}
-		++tiles_done;
-	}
+		groundBrush->draw(&map, tile, nullptr);
+
+		Item* newGround = tile->ground;
+		if (newGround) {
+			newGround->setActionID(actionId);
+			newGround->setUniqueID(uniqueId);
+		}
+		tile->update();
+	});
 
 	if (showdialog) {
 		g_gui.DestroyLoadBar();
@@ -968,6 +1094,7 @@ void Editor::clearInvalidHouseTiles(bool showdialog) {
 		if (tile->isHouseTile()) {
 			if (houses.getHouse(tile->getHouseID()) == nullptr) {
 				tile->setHouse(nullptr);
+				map.tileChanged(tile->getPosition());
 			}
 		}
 		++tiles_done;
@@ -1010,7 +1137,7 @@ void Editor::moveSelection(Position offset) {
 	TileSet tmp_storage;
 
 	// Update the tiles with the newd positions
-	for (TileSet::iterator it = selection.begin(); it != selection.end(); ++it) {
+	for (Selection::iterator it = selection.begin(); it != selection.end(); ++it) {
 		// First we get the old tile and it's position
 		Tile* tile = (*it);
 		// const Position pos = tile->getPosition();
@@ -1170,7 +1297,7 @@ void Editor::moveSelection(Position offset) {
 		action = actionQueue->createAction(batchAction);
 		TileList borderize_tiles;
 		// Go through all modified (selected) tiles (might be slow)
-		for (TileSet::iterator it = selection.begin(); it != selection.end(); it++) {
+		for (Selection::iterator it = selection.begin(); it != selection.end(); it++) {
 			bool add_me = false; // If this tile is touched
 			Position pos = (*it)->getPosition();
 			// Go through all neighbours
@@ -1269,7 +1396,7 @@ void Editor::destroySelection() {
 		BatchAction* batch = actionQueue->createBatch(ACTION_DELETE_TILES);
 		Action* action = actionQueue->createAction(batch);
 
-		for (TileSet::iterator it = selection.begin(); it != selection.end(); ++it) {
+		for (Selection::iterator it = selection.begin(); it != selection.end(); ++it) {
 			tile_count++;
 
 			Tile* tile = *it;
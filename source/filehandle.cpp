@@ -22,6 +22,16 @@
 #include <stdio.h>
 #include <assert.h>
 
+#ifdef __WINDOWS__
+	#include <windows.h>
+#else
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
 uint8_t NodeFileWriteHandle::NODE_START = ::NODE_START;
 uint8_t NodeFileWriteHandle::NODE_END = ::NODE_END;
 uint8_t NodeFileWriteHandle::ESCAPE_CHAR = ::ESCAPE_CHAR;
@@ -134,11 +144,122 @@ bool FileReadHandle::seekRelative(size_t offset) {
 	return fseek(file, long(offset), SEEK_CUR) == 0;
 }
 
+//=============================================================================
+// Positional file read handle
+
+PositionalFileReadHandle::PositionalFileReadHandle() :
+#ifdef __WINDOWS__
+	handle(INVALID_HANDLE_VALUE),
+#else
+	fd(-1),
+#endif
+	file_size(0) {
+	////
+}
+
+PositionalFileReadHandle::~PositionalFileReadHandle() {
+	close();
+}
+
+bool PositionalFileReadHandle::open(const std::string& name) {
+	close();
+#ifdef __WINDOWS__
+	#if defined __VISUALC__ && defined _UNICODE
+	HANDLE fh = CreateFileW(string2wstring(name).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	#else
+	HANDLE fh = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	#endif
+	if (fh == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fh, &size)) {
+		CloseHandle(fh);
+		return false;
+	}
+	handle = fh;
+	file_size = size_t(size.QuadPart);
+#else
+	int file = ::open(name.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(file, &st) != 0) {
+		::close(file);
+		return false;
+	}
+	fd = file;
+	file_size = size_t(st.st_size);
+#endif
+	return true;
+}
+
+void PositionalFileReadHandle::close() {
+#ifdef __WINDOWS__
+	if (handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(handle);
+		handle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+#endif
+	file_size = 0;
+}
+
+bool PositionalFileReadHandle::isOpen() const {
+#ifdef __WINDOWS__
+	return handle != INVALID_HANDLE_VALUE;
+#else
+	return fd >= 0;
+#endif
+}
+
+bool PositionalFileReadHandle::read(size_t offset, uint8_t* ptr, size_t sz) const {
+	if (!isOpen() || offset > file_size || sz > file_size - offset) {
+		return false;
+	}
+
+	while (sz > 0) {
+#ifdef __WINDOWS__
+		// An explicit offset in the OVERLAPPED block makes ReadFile ignore the
+		// handle's own position, which is what pread does on POSIX
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = DWORD(uint64_t(offset) & 0xFFFFFFFF);
+		overlapped.OffsetHigh = DWORD(uint64_t(offset) >> 32);
+		DWORD chunk = DWORD(sz > 0x40000000 ? 0x40000000 : sz);
+		DWORD got = 0;
+		if (!ReadFile(handle, ptr, chunk, &got, &overlapped) || got == 0) {
+			return false;
+		}
+#else
+		ssize_t got = pread(fd, ptr, sz, off_t(offset));
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return false;
+		}
+#endif
+		offset += size_t(got);
+		ptr += got;
+		sz -= size_t(got);
+	}
+	return true;
+}
+
 //=============================================================================
 // Node file read handle
 
 NodeFileReadHandle::NodeFileReadHandle() :
 	last_was_start(false),
+	zero_copy(false),
+	parse_mode(NODE_PARSE_BULK),
 	cache(nullptr),
 	cache_size(32768),
 	cache_length(0),
@@ -184,6 +305,7 @@ void MemoryNodeFileReadHandle::assign(const uint8_t* data, size_t size) {
 	root_node = nullptr;
 	// Highly volatile, but we know we're not gonna modify
 	cache = const_cast<uint8_t*>(data);
+	zero_copy = true;
 	cache_size = cache_length = size;
 	local_read_index = 0;
 }
@@ -210,6 +332,163 @@ BinaryNode* MemoryNodeFileReadHandle::getRootNode() {
 	return root_node;
 }
 
+//=============================================================================
+// Memory mapped file
+
+MappedFile::MappedFile() :
+	mapping(nullptr),
+	mapping_size(0),
+	mapped(false) {
+	////
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& name, bool map) {
+	close();
+#ifdef __WINDOWS__
+	#if defined __VISUALC__ && defined _UNICODE
+	HANDLE fh = CreateFileW(string2wstring(name).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	#else
+	HANDLE fh = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	#endif
+	if (fh == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fh, &size)) {
+		CloseHandle(fh);
+		return false;
+	}
+	mapping_size = size_t(size.QuadPart);
+
+	if (map && mapping_size > 0) {
+		// The view keeps the mapping object alive, so both handles can be closed right away
+		HANDLE mh = CreateFileMapping(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mh) {
+			mapping = static_cast<uint8_t*>(MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0));
+			mapped = mapping != nullptr;
+			CloseHandle(mh);
+		}
+	}
+	CloseHandle(fh);
+#else
+	int fd = ::open(name.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	mapping_size = size_t(st.st_size);
+
+	if (map && mapping_size > 0) {
+		void* view = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED) {
+			madvise(view, mapping_size, MADV_SEQUENTIAL);
+			mapping = static_cast<uint8_t*>(view);
+			mapped = true;
+		}
+	}
+	::close(fd);
+#endif
+
+	if (!mapped) {
+		// Mapping is not available for this file or was not asked for, read all of it into memory instead
+		FileReadHandle fallback(name);
+		if (!fallback.isOk()) {
+			mapping_size = 0;
+			return false;
+		}
+		mapping_size = fallback.size();
+		mapping = static_cast<uint8_t*>(malloc(mapping_size + 1));
+		if (!mapping || !fallback.getRAW(mapping, mapping_size)) {
+			free(mapping);
+			mapping = nullptr;
+			mapping_size = 0;
+			return false;
+		}
+	}
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapping) {
+		if (mapped) {
+#ifdef __WINDOWS__
+			UnmapViewOfFile(mapping);
+#else
+			munmap(mapping, mapping_size);
+#endif
+		} else {
+			free(mapping);
+		}
+		mapping = nullptr;
+	}
+	mapping_size = 0;
+	mapped = false;
+}
+
+//=============================================================================
+// Memory mapped node file read handle
+
+MappedNodeFileReadHandle::MappedNodeFileReadHandle(const std::string& name, const std::vector<std::string>& acceptable_identifiers, bool map) :
+	MemoryNodeFileReadHandle(nullptr, 0) {
+	if (!mapped_file.open(name, map)) {
+		error_code = FILE_COULD_NOT_OPEN;
+		return;
+	}
+
+	if (mapped_file.size() < 4) {
+		close();
+		error_code = FILE_SYNTAX_ERROR;
+		return;
+	}
+
+	// 0x00 00 00 00 is accepted as a wildcard version
+	const uint8_t* ver = mapped_file.data();
+	if (ver[0] != 0 || ver[1] != 0 || ver[2] != 0 || ver[3] != 0) {
+		bool accepted = false;
+		for (const std::string& identifier : acceptable_identifiers) {
+			if (memcmp(ver, identifier.c_str(), 4) == 0) {
+				accepted = true;
+				break;
+			}
+		}
+
+		if (!accepted) {
+			close();
+			error_code = FILE_SYNTAX_ERROR;
+			return;
+		}
+	}
+
+	assign(mapped_file.data() + 4, mapped_file.size() - 4);
+}
+
+MappedNodeFileReadHandle::~MappedNodeFileReadHandle() {
+	close();
+}
+
+void MappedNodeFileReadHandle::close() {
+	MemoryNodeFileReadHandle::close();
+	mapped_file.close();
+}
+
+BinaryNode* MappedNodeFileReadHandle::getRootNode() {
+	if (cache_length == 0 || cache[0] != NODE_START) {
+		error_code = FILE_SYNTAX_ERROR;
+		return nullptr;
+	}
+	return MemoryNodeFileReadHandle::getRootNode();
+}
+
 //=============================================================================
 // File based node file read handle
 
@@ -296,7 +575,10 @@ BinaryNode* DiskNodeFileReadHandle::getRootNode() {
 // Binary file node
 
 BinaryNode::BinaryNode(NodeFileReadHandle* file, BinaryNode* parent) :
+	payload(nullptr),
+	payload_size(0),
 	read_offset(0),
+	raw_start(0),
 	file(file),
 	parent(parent),
 	child(nullptr) {
@@ -320,21 +602,21 @@ BinaryNode* BinaryNode::getChild() {
 }
 
 bool BinaryNode::getRAW(uint8_t* ptr, size_t sz) {
-	if (read_offset + sz > data.size()) {
-		read_offset = data.size();
+	if (read_offset + sz > payload_size) {
+		read_offset = payload_size;
 		return false;
 	}
-	memcpy(ptr, data.data() + read_offset, sz);
+	memcpy(ptr, payload + read_offset, sz);
 	read_offset += sz;
 	return true;
 }
 
 bool BinaryNode::getRAW(std::string& str, size_t sz) {
-	if (read_offset + sz > data.size()) {
-		read_offset = data.size();
+	if (read_offset + sz > payload_size) {
+		read_offset = payload_size;
 		return false;
 	}
-	str.assign(data.data() + read_offset, sz);
+	str.assign(reinterpret_cast<const char*>(payload) + read_offset, sz);
 	read_offset += sz;
 	return true;
 }
@@ -399,7 +681,6 @@ BinaryNode* BinaryNode::advance() {
 			// Another node follows this.
 			// Load this node as the next one
 			read_offset = 0;
-			data.clear();
 			load();
 			return this;
 		} else if (op == NODE_END) {
@@ -415,8 +696,160 @@ BinaryNode* BinaryNode::advance() {
 	}
 }
 
+// Returns the first NODE_START, NODE_END or ESCAPE_CHAR in [ptr, end), or end.
+// All three control bytes are >= 0xFD, so a word is inverted and tested for
+// any byte below 3, which lets plain payload bytes be skipped 8 at a time.
+static const uint8_t* findControlByte(const uint8_t* ptr, const uint8_t* end) {
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+	while (end - ptr >= 8) {
+		uint64_t word;
+		memcpy(&word, ptr, sizeof(word));
+		word = ~word;
+		if (((word - ones * 3) & ~word & highs) != 0) {
+			break;
+		}
+		ptr += 8;
+	}
+	while (ptr < end && *ptr < ESCAPE_CHAR) {
+		++ptr;
+	}
+	return ptr;
+}
+
+bool BinaryNode::skipRaw(const uint8_t*& raw, size_t& raw_size) {
+	ASSERT(file);
+	if (!file->zero_copy || child != nullptr || file->error_code != FILE_NO_ERROR) {
+		return false;
+	}
+
+	const uint8_t* cache = file->cache;
+	size_t cache_length = file->cache_length;
+	size_t& local_read_index = file->local_read_index;
+
+	if (file->last_was_start) {
+		// Both this node and its first child are open
+		int depth = 2;
+		while (depth > 0) {
+			local_read_index = findControlByte(cache + local_read_index, cache + cache_length) - cache;
+			if (local_read_index >= cache_length) {
+				file->error_code = FILE_PREMATURE_END;
+				return false;
+			}
+
+			uint8_t op = cache[local_read_index];
+			++local_read_index;
+			if (op == NODE_START) {
+				++depth;
+			} else if (op == NODE_END) {
+				--depth;
+			} else {
+				// Escaped byte
+				++local_read_index;
+			}
+		}
+		file->last_was_start = false;
+	}
+
+	raw = cache + raw_start;
+	raw_size = local_read_index - raw_start;
+	return true;
+}
+
 void BinaryNode::load() {
 	ASSERT(file);
+	data.clear();
+	raw_start = file->local_read_index - 1;
+
+	if (file->parse_mode == NODE_PARSE_BYTEWISE) {
+		loadBytewise();
+		payload = reinterpret_cast<const uint8_t*>(data.data());
+		payload_size = data.size();
+	} else {
+		loadBulk();
+	}
+}
+
+void BinaryNode::loadBulk() {
+	uint8_t*& cache = file->cache;
+	size_t& cache_length = file->cache_length;
+	size_t& local_read_index = file->local_read_index;
+
+	// As long as no escape has been seen the node is one contiguous run of
+	// the cache, which zero copy handles can hand out without copying it.
+	const uint8_t* view = nullptr;
+	size_t view_size = 0;
+	bool copied = !file->zero_copy;
+
+	while (true) {
+		if (local_read_index >= cache_length) {
+			if (!file->renewCache()) {
+				// Failed to renew, exit
+				file->error_code = FILE_PREMATURE_END;
+				break;
+			}
+		}
+
+		const uint8_t* start = cache + local_read_index;
+		const uint8_t* stop = findControlByte(start, cache + cache_length);
+		size_t run = stop - start;
+		if (run > 0) {
+			if (!copied) {
+				if (!view) {
+					view = start;
+				}
+				view_size += run;
+			} else {
+				data.append(reinterpret_cast<const char*>(start), run);
+			}
+			local_read_index += run;
+		}
+
+		if (local_read_index >= cache_length) {
+			// Run continues in the next chunk of the file
+			continue;
+		}
+
+		uint8_t op = cache[local_read_index];
+		++local_read_index;
+
+		if (op == NODE_START) {
+			file->last_was_start = true;
+			break;
+		} else if (op == NODE_END) {
+			file->last_was_start = false;
+			break;
+		}
+
+		// ESCAPE_CHAR, the next byte is data no matter its value
+		if (local_read_index >= cache_length) {
+			if (!file->renewCache()) {
+				// Failed to renew, exit
+				file->error_code = FILE_PREMATURE_END;
+				break;
+			}
+		}
+
+		if (!copied) {
+			if (view) {
+				data.assign(reinterpret_cast<const char*>(view), view_size);
+			}
+			copied = true;
+		}
+		data.append(1, cache[local_read_index]);
+		++local_read_index;
+	}
+
+	if (!copied && view) {
+		payload = view;
+		payload_size = view_size;
+	} else {
+		payload = reinterpret_cast<const uint8_t*>(data.data());
+		payload_size = data.size();
+	}
+}
+
+void BinaryNode::loadBytewise() {
 	// Read until next node starts
 	uint8_t*& cache = file->cache;
 	size_t& cache_length = file->cache_length;
@@ -461,7 +894,6 @@ void BinaryNode::load() {
 			default:
 				break;
 		}
-		// std::cout << "Appending..." << std::endl;
 		data.append(1, op);
 	}
 }
@@ -702,3 +1134,17 @@ bool NodeFileWriteHandle::addRAW(const uint8_t* ptr, size_t sz) {
 	writeBytes(ptr, sz);
 	return error_code == FILE_NO_ERROR;
 }
+
+bool NodeFileWriteHandle::addNodeData(const uint8_t* ptr, size_t sz) {
+	while (sz > 0) {
+		size_t length = std::min(sz, cache_size - local_write_index);
+		memcpy(cache + local_write_index, ptr, length);
+		local_write_index += length;
+		ptr += length;
+		sz -= length;
+		if (local_write_index >= cache_size) {
+			renewCache();
+		}
+	}
+	return error_code == FILE_NO_ERROR;
+}
@@ -24,6 +24,7 @@
 #include <string>
 #include <stack>
 #include <stdio.h>
+#include <string.h>
 
 #ifndef FORCEINLINE
 	#ifdef _MSV_VER
@@ -50,6 +51,15 @@ enum NodeType {
 	ESCAPE_CHAR = 0xfd,
 };
 
+// How BinaryNode::load unescapes a node
+enum NodeParseMode {
+	// Scans for control bytes a word at a time and copies whole runs, nodes
+	// of zero copy handles point into the file when they hold no escapes
+	NODE_PARSE_BULK,
+	// Copies the node one byte at a time, as older versions did
+	NODE_PARSE_BYTEWISE,
+};
+
 class FileHandle : boost::noncopyable {
 public:
 	FileHandle() :
@@ -126,6 +136,31 @@ protected:
 	}
 };
 
+// Reads from absolute offsets without moving a shared file position, so
+// several threads can read through the same handle at once.
+class PositionalFileReadHandle : boost::noncopyable {
+public:
+	PositionalFileReadHandle();
+	~PositionalFileReadHandle();
+
+	bool open(const std::string& name);
+	void close();
+	bool isOpen() const;
+
+	size_t size() const {
+		return file_size;
+	}
+	bool read(size_t offset, uint8_t* ptr, size_t sz) const;
+
+protected:
+#ifdef __WINDOWS__
+	void* handle;
+#else
+	int fd;
+#endif
+	size_t file_size;
+};
+
 class NodeFileReadHandle;
 class DiskNodeFileReadHandle;
 class MemoryNodeFileReadHandle;
@@ -151,8 +186,8 @@ public:
 		return getType(u64);
 	}
 	FORCEINLINE bool skip(size_t sz) {
-		if (read_offset + sz > data.size()) {
-			read_offset = data.size();
+		if (read_offset + sz > payload_size) {
+			read_offset = payload_size;
 			return false;
 		}
 		read_offset += sz;
@@ -166,23 +201,35 @@ public:
 	BinaryNode* getChild();
 	// Returns this on success, nullptr on failure
 	BinaryNode* advance();
+	// Skips all children of this node without loading them and returns the
+	// whole node, still escaped, from its NODE_START to its NODE_END.
+	// Only possible on zero copy handles and before getChild has been called.
+	bool skipRaw(const uint8_t*& raw, size_t& raw_size);
 
 protected:
 	template <class T>
 	bool getType(T& ref) {
-		if (read_offset + sizeof(ref) > data.size()) {
-			read_offset = data.size();
+		if (read_offset + sizeof(ref) > payload_size) {
+			read_offset = payload_size;
 			return false;
 		}
-		ref = *(T*)(data.data() + read_offset);
+		memcpy(&ref, payload + read_offset, sizeof(ref));
 
 		read_offset += sizeof(ref);
 		return true;
 	}
 
 	void load();
+	void loadBulk();
+	void loadBytewise();
+	// Unescaped node contents, either a view straight into the file cache
+	// or into 'data' when the node had to be copied out of it.
+	const uint8_t* payload;
+	size_t payload_size;
 	std::string data;
 	size_t read_offset;
+	// Cache offset of the NODE_START that opened this node (zero copy only)
+	size_t raw_start;
 	NodeFileReadHandle* file;
 	BinaryNode* parent;
 	BinaryNode* child;
@@ -201,6 +248,18 @@ public:
 	virtual size_t size() = 0;
 	virtual size_t tell() = 0;
 
+	bool isZeroCopy() const {
+		return zero_copy;
+	}
+
+	// Takes effect for nodes loaded after the call
+	void setParseMode(NodeParseMode mode) {
+		parse_mode = mode;
+	}
+	NodeParseMode getParseMode() const {
+		return parse_mode;
+	}
+
 protected:
 	BinaryNode* getNode(BinaryNode* parent);
 	void freeNode(BinaryNode* node);
@@ -208,6 +267,10 @@ protected:
 	virtual bool renewCache() = 0;
 
 	bool last_was_start;
+	// Set when the cache holds the whole file and is never refilled,
+	// nodes may then reference it directly instead of copying their data.
+	bool zero_copy;
+	NodeParseMode parse_mode;
 	uint8_t* cache;
 	size_t cache_size;
 	size_t cache_length;
@@ -271,6 +334,58 @@ protected:
 	uint8_t* index;
 };
 
+// A whole file mapped read-only into memory. If the file can't be mapped it
+// is read into a heap buffer instead, so data() is always the full contents.
+class MappedFile : boost::noncopyable {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// With map set to false the file is always read into a heap buffer
+	bool open(const std::string& name, bool map = true);
+	void close();
+
+	bool isOpen() const {
+		return mapping != nullptr;
+	}
+	bool isMapped() const {
+		return mapped;
+	}
+	const uint8_t* data() const {
+		return mapping;
+	}
+	size_t size() const {
+		return mapping_size;
+	}
+
+protected:
+	uint8_t* mapping;
+	size_t mapping_size;
+	// False if the file could not be mapped and was read into a heap buffer
+	bool mapped;
+};
+
+// Maps the whole file into memory and parses it in place, so node data is
+// paged in by the OS and never copied into a read cache.
+class MappedNodeFileReadHandle : public MemoryNodeFileReadHandle {
+public:
+	MappedNodeFileReadHandle(const std::string& name, const std::vector<std::string>& acceptable_identifiers, bool map = true);
+	virtual ~MappedNodeFileReadHandle();
+
+	virtual void close();
+	virtual BinaryNode* getRootNode();
+
+	virtual bool isOpen() {
+		return mapped_file.isOpen();
+	}
+	virtual bool isOk() {
+		return isOpen() && error_code == FILE_NO_ERROR;
+	}
+
+protected:
+	MappedFile mapped_file;
+};
+
 class FileWriteHandle : public FileHandle {
 public:
 	explicit FileWriteHandle(const std::string& name);
@@ -328,6 +443,9 @@ public:
 	bool addRAW(const char* c) {
 		return addRAW(reinterpret_cast<const uint8_t*>(c), strlen(c));
 	}
+	// Appends node data that is already escaped and delimited, such as the
+	// contents of a MemoryNodeFileWriteHandle, without escaping it again
+	bool addNodeData(const uint8_t* ptr, size_t sz);
 
 protected:
 	virtual void renewCache() = 0;
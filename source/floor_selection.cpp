@@ -0,0 +1,261 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "floor_selection.h"
+#include "map_region.h"
+#include "tile.h"
+#include "item.h"
+#include "creature.h"
+#include "spawn.h"
+
+template <typename T>
+static void setSelected(T* part, bool selected) {
+	if (!part) {
+		return;
+	}
+	if (selected) {
+		part->select();
+	} else {
+		part->deselect();
+	}
+}
+
+template <typename T>
+static int countPart(const T* part, bool selected, int& count) {
+	if (part) {
+		++count;
+		return selected ? 1 : 0;
+	}
+	return 0;
+}
+
+template <typename T>
+static int countPart(const T* part, int& count) {
+	return countPart(part, part && part->isSelected(), count);
+}
+
+std::vector<bool> FloorSelection::readParts(const Tile* tile) {
+	std::vector<bool> bits(FIRST_ITEM + tile->items.size(), false);
+	bits[GROUND] = tile->ground && tile->ground->isSelected();
+	bits[SPAWN] = tile->spawn && tile->spawn->isSelected();
+	bits[CREATURE] = tile->creature && tile->creature->isSelected();
+	for (size_t i = 0; i < tile->items.size(); ++i) {
+		bits[FIRST_ITEM + i] = tile->items[i]->isSelected();
+	}
+	return bits;
+}
+
+int FloorSelection::stateOf(const Tile* tile, const std::vector<bool>& bits) {
+	int count = 0;
+	int selected = countPart(tile->ground, bits[GROUND], count);
+	selected += countPart(tile->spawn, bits[SPAWN], count);
+	selected += countPart(tile->creature, bits[CREATURE], count);
+	for (size_t i = 0; i < tile->items.size() && FIRST_ITEM + i < bits.size(); ++i) {
+		selected += countPart(tile->items[i], bits[FIRST_ITEM + i], count);
+	}
+	if (selected == 0) {
+		return 0;
+	}
+	return selected == count ? 1 : -1;
+}
+
+int FloorSelection::stateOf(const Tile* tile) {
+	int count = 0;
+	int selected = countPart(tile->ground, count);
+	selected += countPart(tile->spawn, count);
+	selected += countPart(tile->creature, count);
+	for (const Item* item : tile->items) {
+		selected += countPart(item, count);
+	}
+	if (selected == 0) {
+		return 0;
+	}
+	return selected == count ? 1 : -1;
+}
+
+FloorSelection::FloorSelection(Floor* floor) :
+	floor(floor),
+	tiles(0),
+	selected(0) {
+	ASSERT(floor);
+}
+
+int FloorSelection::indexOf(const Tile* tile) {
+	const Position pos = tile->getPosition();
+	return (pos.x & 3) * 4 + (pos.y & 3);
+}
+
+void FloorSelection::record(const Tile* tile) {
+	const int index = indexOf(tile);
+	if (tiles & (1 << index)) {
+		return;
+	}
+	tiles |= 1 << index;
+
+	const int state = stateOf(tile);
+	if (state < 0) {
+		partial.push_back({ uint8_t(index), readParts(tile) });
+	} else if (state > 0) {
+		selected |= 1 << index;
+	}
+}
+
+std::vector<bool>& FloorSelection::parts(const Tile* tile) {
+	record(tile);
+	const int index = indexOf(tile);
+	for (Parts& entry : partial) {
+		if (entry.index == index) {
+			return entry.bits;
+		}
+	}
+	if (partial.empty()) {
+		// A floor that gets one partly selected tile usually gets more
+		partial.reserve(MAP_LAYERS);
+	}
+	partial.push_back({ uint8_t(index), std::vector<bool>(FIRST_ITEM + tile->items.size(), (selected & (1 << index)) != 0) });
+	selected &= ~(1 << index);
+	return partial.back().bits;
+}
+
+void FloorSelection::settle(const Tile* tile) {
+	const int index = indexOf(tile);
+	for (auto it = partial.begin(); it != partial.end(); ++it) {
+		if (it->index != index) {
+			continue;
+		}
+		const int state = stateOf(tile, it->bits);
+		if (state >= 0) {
+			if (state > 0) {
+				selected |= 1 << index;
+			}
+			partial.erase(it);
+		}
+		return;
+	}
+}
+
+void FloorSelection::select(const Tile* tile, const Item* item, bool selected) {
+	std::vector<bool>& bits = parts(tile);
+	if (item == tile->ground) {
+		bits[GROUND] = selected;
+	} else {
+		for (size_t i = 0; i < tile->items.size() && FIRST_ITEM + i < bits.size(); ++i) {
+			if (tile->items[i] == item) {
+				bits[FIRST_ITEM + i] = selected;
+				break;
+			}
+		}
+	}
+	settle(tile);
+}
+
+void FloorSelection::selectSpawn(const Tile* tile, bool selected) {
+	parts(tile)[SPAWN] = selected;
+	settle(tile);
+}
+
+void FloorSelection::selectCreature(const Tile* tile, bool selected) {
+	parts(tile)[CREATURE] = selected;
+	settle(tile);
+}
+
+void FloorSelection::selectGround(const Tile* tile, bool selected) {
+	std::vector<bool>& bits = parts(tile);
+	bits[GROUND] = selected;
+	for (size_t i = 0; i < tile->items.size() && FIRST_ITEM + i < bits.size(); ++i) {
+		if (!tile->items[i]->isBorder()) {
+			break;
+		}
+		bits[FIRST_ITEM + i] = selected;
+	}
+	settle(tile);
+}
+
+void FloorSelection::selectAll(const Tile* tile, bool selected) {
+	record(tile);
+	const int index = indexOf(tile);
+	for (auto it = partial.begin(); it != partial.end(); ++it) {
+		if (it->index == index) {
+			partial.erase(it);
+			break;
+		}
+	}
+	if (selected) {
+		this->selected |= 1 << index;
+	} else {
+		this->selected &= ~(1 << index);
+	}
+}
+
+void FloorSelection::swap() {
+	uint16_t current = 0;
+	std::vector<Parts> current_partial;
+
+	for (int index = 0; index < MAP_LAYERS; ++index) {
+		Tile* tile = floor->locs[index].get();
+		if (!(tiles & (1 << index)) || !tile) {
+			continue;
+		}
+
+		// What is on the map now, read before it is changed
+		const int state = stateOf(tile);
+		std::vector<bool> bits;
+		if (state < 0) {
+			bits = readParts(tile);
+		}
+
+		const Parts* entry = nullptr;
+		for (const Parts& parts : partial) {
+			if (parts.index == index) {
+				entry = &parts;
+				break;
+			}
+		}
+		if (entry) {
+			setSelected(tile->ground, entry->bits[GROUND]);
+			setSelected(tile->spawn, entry->bits[SPAWN]);
+			setSelected(tile->creature, entry->bits[CREATURE]);
+			for (size_t i = 0; i < tile->items.size() && FIRST_ITEM + i < entry->bits.size(); ++i) {
+				setSelected(tile->items[i], entry->bits[FIRST_ITEM + i]);
+			}
+		} else if (selected & (1 << index)) {
+			tile->select();
+		} else {
+			tile->deselect();
+		}
+		tile->update();
+
+		if (state < 0) {
+			current_partial.push_back({ uint8_t(index), std::move(bits) });
+		} else if (state > 0) {
+			current |= 1 << index;
+		}
+	}
+
+	selected = current;
+	partial.swap(current_partial);
+}
+
+uint32_t FloorSelection::memsize() const {
+	uint32_t mem = sizeof(*this) + partial.capacity() * sizeof(Parts);
+	for (const Parts& parts : partial) {
+		mem += parts.bits.capacity() / 8;
+	}
+	return mem;
+}
@@ -0,0 +1,88 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_FLOOR_SELECTION_H_
+#define RME_FLOOR_SELECTION_H_
+
+#include "position.h"
+
+class Floor;
+class Tile;
+class Item;
+
+// The selection of some tiles on one floor of a leaf. It holds the state
+// the tiles should get, applying it swaps that state with the one on the
+// map so the same record undoes and redoes the change. Tiles selected
+// entirely or not at all take a bit each, only partly selected tiles keep
+// a bit for the ground, spawn, creature and every item.
+class FloorSelection {
+public:
+	explicit FloorSelection(Floor* floor);
+
+	// The first change to a tile starts from the state it has on the map
+	void select(const Tile* tile, const Item* item, bool selected);
+	void selectSpawn(const Tile* tile, bool selected);
+	void selectCreature(const Tile* tile, bool selected);
+	// The ground and the borders on top of it
+	void selectGround(const Tile* tile, bool selected);
+	void selectAll(const Tile* tile, bool selected);
+
+	void swap();
+
+	Floor* getFloor() const {
+		return floor;
+	}
+	// Tiles the record changes, a bit for each location on the floor
+	uint16_t getTiles() const {
+		return tiles;
+	}
+
+	// Get memory footprint
+	uint32_t memsize() const;
+
+private:
+	enum {
+		GROUND,
+		SPAWN,
+		CREATURE,
+		FIRST_ITEM,
+	};
+
+	struct Parts {
+		uint8_t index;
+		std::vector<bool> bits;
+	};
+
+	static int indexOf(const Tile* tile);
+	static std::vector<bool> readParts(const Tile* tile);
+	// 1 if every part of the tile is selected, 0 if none is, -1 otherwise
+	static int stateOf(const Tile* tile);
+	static int stateOf(const Tile* tile, const std::vector<bool>& bits);
+	// Adds the tile with the state it has on the map
+	void record(const Tile* tile);
+	// The bits of a tile, it is made partly selected if it wasn't
+	std::vector<bool>& parts(const Tile* tile);
+	// Goes back to a single bit if every part is in the same state
+	void settle(const Tile* tile);
+
+	Floor* floor;
+	uint16_t tiles;
+	uint16_t selected;
+	std::vector<Parts> partial;
+};
+
+#endif
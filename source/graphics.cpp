@@ -19,10 +19,12 @@
 
 #include "sprites.h"
 #include "graphics.h"
+#include "sprite_batch.h"
 #include "filehandle.h"
 #include "settings.h"
 #include "gui.h"
 #include "otml.h"
+#include "sprite_decode.h"
 
 #include <wx/mstream.h>
 #include <wx/stopwatch.h>
@@ -42,142 +44,9 @@
 #include "../brushes/door_archway.xpm"
 #include "../brushes/door_archway_small.xpm"
 
-// All 133 template colors
-static uint32_t TemplateOutfitLookupTable[] = {
-	0xFFFFFF,
-	0xFFD4BF,
-	0xFFE9BF,
-	0xFFFFBF,
-	0xE9FFBF,
-	0xD4FFBF,
-	0xBFFFBF,
-	0xBFFFD4,
-	0xBFFFE9,
-	0xBFFFFF,
-	0xBFE9FF,
-	0xBFD4FF,
-	0xBFBFFF,
-	0xD4BFFF,
-	0xE9BFFF,
-	0xFFBFFF,
-	0xFFBFE9,
-	0xFFBFD4,
-	0xFFBFBF,
-	0xDADADA,
-	0xBF9F8F,
-	0xBFAF8F,
-	0xBFBF8F,
-	0xAFBF8F,
-	0x9FBF8F,
-	0x8FBF8F,
-	0x8FBF9F,
-	0x8FBFAF,
-	0x8FBFBF,
-	0x8FAFBF,
-	0x8F9FBF,
-	0x8F8FBF,
-	0x9F8FBF,
-	0xAF8FBF,
-	0xBF8FBF,
-	0xBF8FAF,
-	0xBF8F9F,
-	0xBF8F8F,
-	0xB6B6B6,
-	0xBF7F5F,
-	0xBFAF8F,
-	0xBFBF5F,
-	0x9FBF5F,
-	0x7FBF5F,
-	0x5FBF5F,
-	0x5FBF7F,
-	0x5FBF9F,
-	0x5FBFBF,
-	0x5F9FBF,
-	0x5F7FBF,
-	0x5F5FBF,
-	0x7F5FBF,
-	0x9F5FBF,
-	0xBF5FBF,
-	0xBF5F9F,
-	0xBF5F7F,
-	0xBF5F5F,
-	0x919191,
-	0xBF6A3F,
-	0xBF943F,
-	0xBFBF3F,
-	0x94BF3F,
-	0x6ABF3F,
-	0x3FBF3F,
-	0x3FBF6A,
-	0x3FBF94,
-	0x3FBFBF,
-	0x3F94BF,
-	0x3F6ABF,
-	0x3F3FBF,
-	0x6A3FBF,
-	0x943FBF,
-	0xBF3FBF,
-	0xBF3F94,
-	0xBF3F6A,
-	0xBF3F3F,
-	0x6D6D6D,
-	0xFF5500,
-	0xFFAA00,
-	0xFFFF00,
-	0xAAFF00,
-	0x54FF00,
-	0x00FF00,
-	0x00FF54,
-	0x00FFAA,
-	0x00FFFF,
-	0x00A9FF,
-	0x0055FF,
-	0x0000FF,
-	0x5500FF,
-	0xA900FF,
-	0xFE00FF,
-	0xFF00AA,
-	0xFF0055,
-	0xFF0000,
-	0x484848,
-	0xBF3F00,
-	0xBF7F00,
-	0xBFBF00,
-	0x7FBF00,
-	0x3FBF00,
-	0x00BF00,
-	0x00BF3F,
-	0x00BF7F,
-	0x00BFBF,
-	0x007FBF,
-	0x003FBF,
-	0x0000BF,
-	0x3F00BF,
-	0x7F00BF,
-	0xBF00BF,
-	0xBF007F,
-	0xBF003F,
-	0xBF0000,
-	0x242424,
-	0x7F2A00,
-	0x7F5500,
-	0x7F7F00,
-	0x557F00,
-	0x2A7F00,
-	0x007F00,
-	0x007F2A,
-	0x007F55,
-	0x007F7F,
-	0x00547F,
-	0x002A7F,
-	0x00007F,
-	0x2A007F,
-	0x54007F,
-	0x7F007F,
-	0x7F0055,
-	0x7F002A,
-	0x7F0000,
-};
+// Sprites decoded in the background that are uploaded per frame, each one is
+// a 34x34 texture update so this keeps a frame from stalling on uploads
+static const size_t DECODED_SPRITE_UPLOADS_PER_FRAME = 128;
 
 GraphicManager::GraphicManager() :
 	client_version(nullptr),
@@ -188,13 +57,18 @@ GraphicManager::GraphicManager() :
 	has_transparency(false),
 	has_frame_durations(false),
 	has_frame_groups(false),
-	loaded_textures(0),
-	lastclean(0) {
+	placeholder_texture(0),
+	synchronous_decoding(false),
+	lastclean(0),
+	generation(0) {
 	animation_timer = newd wxStopWatch();
 	animation_timer->Start();
 }
 
 GraphicManager::~GraphicManager() {
+	decoder.cancel();
+	releaseMappedDumps();
+
 	for (SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
 		delete iter->second;
 	}
@@ -214,12 +88,12 @@ bool GraphicManager::isUnloaded() const {
 	return unloaded;
 }
 
-GLuint GraphicManager::getFreeTextureID() {
-	static GLuint id_counter = 0x10000000;
-	return id_counter++; // This should (hopefully) never run out
-}
-
 void GraphicManager::clear() {
+	// Jobs point at images that are about to be deleted
+	decoder.cancel();
+	decoded.clear();
+	releaseMappedDumps();
+
 	SpriteMap new_sprite_space;
 	for (SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
 		if (iter->first >= 0) { // Don't clean internal sprites
@@ -239,10 +113,16 @@ void GraphicManager::clear() {
 
 	item_count = 0;
 	creature_count = 0;
-	loaded_textures = 0;
+	atlas.clear();
+	if (placeholder_texture != 0) {
+		glDeleteTextures(1, &placeholder_texture);
+		placeholder_texture = 0;
+	}
 	lastclean = time(nullptr);
-	spritefile = "";
+	sprite_handle.close();
+	sprite_offsets.clear();
 
+	++generation;
 	unloaded = true;
 }
 
@@ -494,6 +374,15 @@ bool GraphicManager::loadSpriteMetadata(const FileName& datafile, wxString& erro
 		has_frame_groups = dat_format >= DAT_FORMAT_1057;
 	}
 
+	FileName cachefile;
+	if (client_version) {
+		cachefile = client_version->getLocalDataPath();
+		cachefile.SetFullName("metadata.cache");
+		if (loadMetadataCache(cachefile, datafile, datSignature)) {
+			return true;
+		}
+	}
+
 	uint16_t id = minID;
 	// loop through all ItemDatabase until we reach the end of file
 	while (id <= maxID) {
@@ -587,9 +476,252 @@ bool GraphicManager::loadSpriteMetadata(const FileName& datafile, wxString& erro
 		++id;
 	}
 
+	if (client_version && !saveMetadataCache(cachefile, datafile, datSignature)) {
+		// Not fatal, the .dat is just parsed again next time
+		std::remove(nstr(cachefile.GetFullPath()).c_str());
+	}
 	return true;
 }
 
+// ============================================================================
+// Metadata cache
+
+static const uint8_t METADATA_CACHE_MAGIC[4] = { 'R', 'M', 'D', 'C' };
+// Bump whenever the layout below or the way the .dat is parsed changes
+static const uint32_t METADATA_CACHE_VERSION = 1;
+
+// Reads native endian values from a mapped cache file
+class MetadataCacheReader {
+public:
+	MetadataCacheReader(const uint8_t* data, size_t size) :
+		pos(data), end(data + size) { }
+
+	template <typename T>
+	bool get(T& value) {
+		if (size_t(end - pos) < sizeof(T)) {
+			return false;
+		}
+		memcpy(&value, pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	// Returns the next size bytes without copying them
+	const uint8_t* skip(size_t size) {
+		if (size_t(end - pos) < size) {
+			return nullptr;
+		}
+		const uint8_t* start = pos;
+		pos += size;
+		return start;
+	}
+
+	bool atEnd() const {
+		return pos == end;
+	}
+
+private:
+	const uint8_t* pos;
+	const uint8_t* end;
+};
+
+static uint8_t getMetadataCacheFlags(bool is_extended, bool has_frame_durations, bool has_frame_groups) {
+	return (is_extended ? 1 : 0) | (has_frame_durations ? 2 : 0) | (has_frame_groups ? 4 : 0);
+}
+
+bool GraphicManager::loadMetadataCache(const FileName& cachefile, const FileName& datafile, uint32_t dat_signature) {
+	if (!cachefile.FileExists()) {
+		return false;
+	}
+
+	MappedFile cache;
+	if (!cache.open(nstr(cachefile.GetFullPath()))) {
+		return false;
+	}
+	MetadataCacheReader reader(cache.data(), cache.size());
+
+	const uint8_t* magic = reader.skip(sizeof(METADATA_CACHE_MAGIC));
+	uint32_t version, signature, format;
+	uint64_t dat_size, dat_time;
+	uint8_t flags;
+	uint16_t items, creatures;
+	if (!magic || memcmp(magic, METADATA_CACHE_MAGIC, sizeof(METADATA_CACHE_MAGIC)) != 0 ||
+		!reader.get(version) || !reader.get(signature) || !reader.get(dat_size) || !reader.get(dat_time) ||
+		!reader.get(format) || !reader.get(flags) || !reader.get(items) || !reader.get(creatures)) {
+		return false;
+	}
+
+	// Anything that would make the .dat parse differently invalidates the cache
+	if (version != METADATA_CACHE_VERSION || signature != dat_signature ||
+		dat_size != uint64_t(datafile.GetSize().GetValue()) || dat_time != uint64_t(datafile.GetModificationTime().GetTicks()) ||
+		format != uint32_t(dat_format) || flags != getMetadataCacheFlags(is_extended, has_frame_durations, has_frame_groups) ||
+		items != item_count || creatures != creature_count) {
+		return false;
+	}
+
+	bool ok = true;
+	const uint32_t maxID = item_count + creature_count;
+	for (uint32_t id = 100; id <= maxID && ok; ++id) {
+		GameSprite* sType = newd GameSprite();
+		sprite_space[id] = sType;
+		sType->id = id;
+
+		uint8_t has_light, has_animator;
+		uint32_t sprite_count;
+		ok = reader.get(sType->width) && reader.get(sType->height) && reader.get(sType->layers) &&
+			reader.get(sType->pattern_x) && reader.get(sType->pattern_y) && reader.get(sType->pattern_z) &&
+			reader.get(sType->frames) && reader.get(sType->numsprites) && reader.get(sType->draw_height) &&
+			reader.get(sType->drawoffset_x) && reader.get(sType->drawoffset_y) && reader.get(sType->minimap_color) &&
+			reader.get(has_light) && reader.get(sType->light.intensity) && reader.get(sType->light.color) &&
+			reader.get(sprite_count);
+		if (!ok) {
+			break;
+		}
+		sType->has_light = has_light != 0;
+
+		const uint8_t* sprite_ids = reader.skip(size_t(sprite_count) * sizeof(uint32_t));
+		if (!sprite_ids) {
+			ok = false;
+			break;
+		}
+		sType->spriteList.reserve(sprite_count);
+		for (uint32_t i = 0; i < sprite_count; ++i) {
+			uint32_t sprite_id;
+			memcpy(&sprite_id, sprite_ids + i * sizeof(uint32_t), sizeof(sprite_id));
+
+			GameSprite::Image*& image = image_space[sprite_id];
+			if (image == nullptr) {
+				GameSprite::NormalImage* img = newd GameSprite::NormalImage();
+				img->id = sprite_id;
+				image = img;
+			}
+			sType->spriteList.push_back(static_cast<GameSprite::NormalImage*>(image));
+		}
+
+		if (!reader.get(has_animator)) {
+			ok = false;
+			break;
+		}
+		if (has_animator) {
+			uint32_t frame_count;
+			int32_t start_frame, loop_count;
+			uint8_t async;
+			if (!reader.get(frame_count) || !reader.get(start_frame) || !reader.get(loop_count) || !reader.get(async) ||
+				frame_count == 0 || start_frame < -1 || start_frame >= int32_t(frame_count)) {
+				ok = false;
+				break;
+			}
+
+			sType->animator = newd Animator(int(frame_count), start_frame, loop_count, async != 0);
+			for (uint32_t i = 0; i < frame_count; ++i) {
+				uint32_t min, max;
+				if (!reader.get(min) || !reader.get(max) || min > max) {
+					ok = false;
+					break;
+				}
+				sType->animator->getFrameDuration(int(i))->setValues(int(min), int(max));
+			}
+			sType->animator->reset();
+		}
+	}
+
+	if (ok && reader.atEnd()) {
+		return true;
+	}
+
+	// Broken cache, throw away what was read and parse the .dat instead
+	for (SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end();) {
+		if (iter->first >= 0) {
+			delete iter->second;
+			iter = sprite_space.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+	for (ImageMap::iterator iter = image_space.begin(); iter != image_space.end(); ++iter) {
+		delete iter->second;
+	}
+	image_space.clear();
+	return false;
+}
+
+bool GraphicManager::saveMetadataCache(const FileName& cachefile, const FileName& datafile, uint32_t dat_signature) const {
+	// Written under another name first, so an interrupted write never leaves a
+	// cache behind that looks complete
+	const std::string filename = nstr(cachefile.GetFullPath());
+	const std::string tempname = filename + ".tmp";
+	{
+		FileWriteHandle file(tempname);
+		if (!file.isOk()) {
+			return false;
+		}
+
+		file.addRAW(METADATA_CACHE_MAGIC, sizeof(METADATA_CACHE_MAGIC));
+		file.addU32(METADATA_CACHE_VERSION);
+		file.addU32(dat_signature);
+		file.addU64(uint64_t(datafile.GetSize().GetValue()));
+		file.addU64(uint64_t(datafile.GetModificationTime().GetTicks()));
+		file.addU32(uint32_t(dat_format));
+		file.addU8(getMetadataCacheFlags(is_extended, has_frame_durations, has_frame_groups));
+		file.addU16(item_count);
+		file.addU16(creature_count);
+
+		const uint32_t maxID = item_count + creature_count;
+		for (uint32_t id = 100; id <= maxID; ++id) {
+			SpriteMap::const_iterator it = sprite_space.find(id);
+			if (it == sprite_space.end()) {
+				file.close();
+				std::remove(tempname.c_str());
+				return false;
+			}
+			const GameSprite* sType = static_cast<const GameSprite*>(it->second);
+
+			file.addU8(sType->width);
+			file.addU8(sType->height);
+			file.addU8(sType->layers);
+			file.addU8(sType->pattern_x);
+			file.addU8(sType->pattern_y);
+			file.addU8(sType->pattern_z);
+			file.addU8(sType->frames);
+			file.addU32(sType->numsprites);
+			file.addU16(sType->draw_height);
+			file.addU16(sType->drawoffset_x);
+			file.addU16(sType->drawoffset_y);
+			file.addU16(sType->minimap_color);
+			file.addU8(sType->has_light ? 1 : 0);
+			file.addU8(sType->light.intensity);
+			file.addU8(sType->light.color);
+
+			file.addU32(uint32_t(sType->spriteList.size()));
+			for (const GameSprite::NormalImage* image : sType->spriteList) {
+				file.addU32(image->id);
+			}
+
+			const Animator* animator = sType->animator;
+			file.addU8(animator ? 1 : 0);
+			if (animator) {
+				file.addU32(uint32_t(animator->frame_count));
+				file.addU32(uint32_t(animator->start_frame));
+				file.addU32(uint32_t(animator->loop_count));
+				file.addU8(animator->async ? 1 : 0);
+				for (const FrameDuration* duration : animator->durations) {
+					file.addU32(uint32_t(duration->min));
+					file.addU32(uint32_t(duration->max));
+				}
+			}
+		}
+
+		if (!file.isOk()) {
+			file.close();
+			std::remove(tempname.c_str());
+			return false;
+		}
+	}
+
+	std::remove(filename.c_str());
+	return std::rename(tempname.c_str(), filename.c_str()) == 0;
+}
+
 bool GraphicManager::loadSpriteMetadataFlags(FileReadHandle& file, GameSprite* sType, wxString& error, wxArrayString& warnings) {
 	uint8_t prev_flag = 0;
 	uint8_t flag = DatFlagLast;
@@ -803,48 +935,63 @@ bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, w
 		total_pics = u16;
 	}
 
+	std::vector<uint32_t> sprite_indexes;
+	sprite_indexes.resize(total_pics);
+	if (total_pics > 0 && !fh.getRAW(reinterpret_cast<uint8_t*>(sprite_indexes.data()), total_pics * sizeof(uint32_t))) {
+		error = wxstr(fh.getErrorMessage());
+		return false;
+	}
+
 	if (!g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
-		spritefile = nstr(datafile.GetFullPath());
+		// Keep the index table and one handle around, so a sprite dump costs
+		// two positional reads instead of reopening the file
+		if (!sprite_handle.open(nstr(datafile.GetFullPath()))) {
+			error = "Failed to open file for reading";
+			return false;
+		}
+		sprite_offsets.swap(sprite_indexes);
 		unloaded = false;
 		return true;
 	}
 
-	std::vector<uint32_t> sprite_indexes;
-	for (uint32_t i = 0; i < total_pics; ++i) {
-		uint32_t index;
-		safe_get(U32, index);
-		sprite_indexes.push_back(index);
+	// Map the whole file and point the dumps straight into it, instead of
+	// reading every sprite into a buffer of its own
+	if (!sprite_file.open(nstr(datafile.GetFullPath()))) {
+		error = "Failed to open file for reading";
+		return false;
 	}
+	const uint8_t* data = sprite_file.data();
+	const size_t data_size = sprite_file.size();
 
-	// Now read individual sprites
 	int id = 1;
 	for (std::vector<uint32_t>::iterator sprite_iter = sprite_indexes.begin(); sprite_iter != sprite_indexes.end(); ++sprite_iter, ++id) {
-		uint32_t index = *sprite_iter + 3;
-		fh.seek(index);
-		uint16_t size;
-		safe_get(U16, size);
+		const size_t index = size_t(*sprite_iter) + 3;
+		if (index + 2 > data_size) {
+			error = "Unexpected end of file";
+			return false;
+		}
+		const uint16_t size = data[index] | data[index + 1] << 8;
 
 		ImageMap::iterator it = image_space.find(id);
-		if (it != image_space.end()) {
-			GameSprite::NormalImage* spr = dynamic_cast<GameSprite::NormalImage*>(it->second);
-			if (spr && size > 0) {
-				if (spr->size > 0) {
-					wxString ss;
-					ss << "items.spr: Duplicate GameSprite id " << id;
-					warnings.push_back(ss);
-					fh.seekRelative(size);
-				} else {
-					spr->id = id;
-					spr->size = size;
-					spr->dump = newd uint8_t[size];
-					if (!fh.getRAW(spr->dump, size)) {
-						error = wxstr(fh.getErrorMessage());
-						return false;
-					}
-				}
+		if (it == image_space.end()) {
+			continue;
+		}
+
+		GameSprite::NormalImage* spr = dynamic_cast<GameSprite::NormalImage*>(it->second);
+		if (spr && size > 0) {
+			if (spr->size > 0) {
+				wxString ss;
+				ss << "items.spr: Duplicate GameSprite id " << id;
+				warnings.push_back(ss);
+			} else if (index + 2 + size > data_size) {
+				error = "Unexpected end of file";
+				return false;
+			} else {
+				spr->id = id;
+				spr->size = size;
+				// Dumps are only ever read, the mapping owns them
+				spr->dump = const_cast<uint8_t*>(data + index + 2);
 			}
-		} else {
-			fh.seekRelative(size);
 		}
 	}
 #undef safe_get
@@ -852,6 +999,21 @@ bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, w
 	return true;
 }
 
+void GraphicManager::releaseMappedDumps() {
+	if (!sprite_file.isOpen()) {
+		return;
+	}
+	// Keeps the images from deleting memory that belongs to the mapping
+	for (ImageMap::iterator iter = image_space.begin(); iter != image_space.end(); ++iter) {
+		GameSprite::NormalImage* image = dynamic_cast<GameSprite::NormalImage*>(iter->second);
+		if (image) {
+			image->dump = nullptr;
+			image->size = 0;
+		}
+	}
+	sprite_file.close();
+}
+
 bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite_id) {
 	if (g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
 		return false;
@@ -864,31 +1026,101 @@ bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite
 		return true;
 	}
 
-	FileReadHandle fh(spritefile);
-	if (!fh.isOk()) {
+	if (sprite_id < 0) {
 		return false;
 	}
-	unloaded = false;
 
-	if (!fh.seek((is_extended ? 4 : 2) + sprite_id * sizeof(uint32_t))) {
+	std::vector<uint8_t> dump;
+	if (!readSpriteDump(uint32_t(sprite_id), dump)) {
 		return false;
 	}
 
-	uint32_t to_seek = 0;
-	if (fh.getU32(to_seek)) {
-		fh.seek(to_seek + 3);
-		uint16_t sprite_size;
-		if (fh.getU16(sprite_size)) {
-			target = newd uint8_t[sprite_size];
-			if (fh.getRAW(target, sprite_size)) {
-				size = sprite_size;
-				return true;
-			}
-			delete[] target;
-			target = nullptr;
+	target = newd uint8_t[dump.size()];
+	memcpy(target, dump.data(), dump.size());
+	size = uint16_t(dump.size());
+	return true;
+}
+
+bool GraphicManager::readSpriteDump(uint32_t sprite_id, std::vector<uint8_t>& dump) const {
+	if (sprite_id == 0) {
+		// Empty GameSprite
+		dump.clear();
+		return true;
+	}
+
+	if (sprite_id > sprite_offsets.size()) {
+		return false;
+	}
+
+	// Sprite data starts with a 3 byte color key, followed by the dump size
+	const size_t offset = size_t(sprite_offsets[sprite_id - 1]) + 3;
+	uint8_t size_bytes[2];
+	if (!sprite_handle.read(offset, size_bytes, sizeof(size_bytes))) {
+		return false;
+	}
+
+	dump.resize(size_bytes[0] | size_bytes[1] << 8);
+	return dump.empty() || sprite_handle.read(offset + sizeof(size_bytes), dump.data(), dump.size());
+}
+
+bool GraphicManager::decodeInBackground() const {
+	return !synchronous_decoding && g_settings.getBoolean(Config::USE_BACKGROUND_SPRITE_DECODING);
+}
+
+bool GraphicManager::requestDecode(GameSprite::Image* image) {
+	SpriteDecodeJob job;
+	job.image = image;
+	job.use_alpha = has_transparency;
+	if (!image->prepareDecode(job)) {
+		return false;
+	}
+
+	image->decode_pending = true;
+	decoder.request(std::move(job));
+	return true;
+}
+
+SpriteRegion GraphicManager::getPlaceholder() {
+	if (placeholder_texture == 0) {
+		// A faint square, so it is visible that something is still loading
+		static const uint8_t pixel[4] = { 0x80, 0x80, 0x80, 0x30 };
+
+		GLint bound = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+		glGenTextures(1, &placeholder_texture);
+		glBindTexture(GL_TEXTURE_2D, placeholder_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+		glBindTexture(GL_TEXTURE_2D, bound);
+	}
+
+	SpriteRegion region;
+	region.texture = placeholder_texture;
+	return region;
+}
+
+void GraphicManager::uploadDecodedSprites() {
+	decoded.clear();
+	decoder.collect(decoded, DECODED_SPRITE_UPLOADS_PER_FRAME);
+
+	for (SpriteDecodeJob& job : decoded) {
+		GameSprite::Image* image = job.image;
+		image->decode_pending = false;
+		if (image->isGLLoaded) {
+			// Was needed right away and decoded while drawing
+			continue;
+		}
+
+		if (!job.rgba.empty()) {
+			image->atlas_slot = atlas.insert(image, job.rgba.data());
+			image->isGLLoaded = image->atlas_slot >= 0;
 		}
+		// Don't keep asking for sprites that can't be decoded
+		image->decode_failed = !image->isGLLoaded;
+		image->visit();
 	}
-	return false;
+	decoded.clear();
 }
 
 void GraphicManager::addSpriteToCleanup(GameSprite* spr) {
@@ -905,7 +1137,7 @@ void GraphicManager::addSpriteToCleanup(GameSprite* spr) {
 void GraphicManager::garbageCollection() {
 	if (g_settings.getInteger(Config::TEXTURE_MANAGEMENT)) {
 		int t = time(nullptr);
-		if (loaded_textures > g_settings.getInteger(Config::TEXTURE_CLEAN_THRESHOLD) && t - lastclean > g_settings.getInteger(Config::TEXTURE_CLEAN_PULSE)) {
+		if (atlas.getUsedSlots() > g_settings.getInteger(Config::TEXTURE_CLEAN_THRESHOLD) && t - lastclean > g_settings.getInteger(Config::TEXTURE_CLEAN_PULSE)) {
 			ImageMap::iterator iit = image_space.begin();
 			while (iit != image_space.end()) {
 				iit->second->clean(t);
@@ -1006,7 +1238,7 @@ int GameSprite::getIndex(int width, int height, int layer, int pattern_x, int pa
 	return ((((((frame % this->frames) * this->pattern_z + pattern_z) * this->pattern_y + pattern_y) * this->pattern_x + pattern_x) * this->layers + layer) * this->height + height) * this->width + width;
 }
 
-GLuint GameSprite::getHardwareID(int _x, int _y, int _layer, int _count, int _pattern_x, int _pattern_y, int _pattern_z, int _frame) {
+SpriteRegion GameSprite::getHardwareID(int _x, int _y, int _layer, int _count, int _pattern_x, int _pattern_y, int _pattern_z, int _frame) {
 	uint32_t v;
 	if (_count >= 0 && height <= 1 && width <= 1) {
 		v = _count;
@@ -1044,7 +1276,7 @@ GameSprite::TemplateImage* GameSprite::getTemplateImage(int sprite_index, const
 	return img;
 }
 
-GLuint GameSprite::getHardwareID(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame) {
+SpriteRegion GameSprite::getHardwareID(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame) {
 	uint32_t v = getIndex(_x, _y, 0, _dir, _addon, _pattern_z, _frame);
 	if (v >= numsprites) {
 		if (numsprites == 1) {
@@ -1121,15 +1353,36 @@ void GameSprite::DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int w
 
 GameSprite::Image::Image() :
 	isGLLoaded(false),
-	lastaccess(0) {
+	lastaccess(0),
+	atlas_slot(-1),
+	decode_pending(false),
+	decode_failed(false) {
 	////
 }
 
 GameSprite::Image::~Image() {
-	unloadGLTexture(0);
+	unloadGLTexture();
 }
 
-void GameSprite::Image::createGLTexture(GLuint whatid) {
+SpriteRegion GameSprite::Image::getHardwareID() {
+	if (!isGLLoaded && g_gui.gfx.decodeInBackground()) {
+		if (decode_failed || (!decode_pending && !g_gui.gfx.requestDecode(this))) {
+			return SpriteRegion();
+		}
+		return g_gui.gfx.getPlaceholder();
+	}
+
+	if (!isGLLoaded) {
+		createGLTexture();
+		if (!isGLLoaded) {
+			return SpriteRegion();
+		}
+	}
+	visit();
+	return g_gui.gfx.atlas.use(atlas_slot);
+}
+
+void GameSprite::Image::createGLTexture() {
 	ASSERT(!isGLLoaded);
 
 	uint8_t* rgba = getRGBAData();
@@ -1137,24 +1390,18 @@ void GameSprite::Image::createGLTexture(GLuint whatid) {
 		return;
 	}
 
-	isGLLoaded = true;
-	g_gui.gfx.loaded_textures += 1;
-
-	glBindTexture(GL_TEXTURE_2D, whatid);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Linear Filtering
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SPRITE_PIXELS, SPRITE_PIXELS, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+	atlas_slot = g_gui.gfx.atlas.insert(this, rgba);
+	isGLLoaded = atlas_slot >= 0;
 
 	delete[] rgba;
-#undef SPRITE_SIZE
 }
 
-void GameSprite::Image::unloadGLTexture(GLuint whatid) {
+void GameSprite::Image::unloadGLTexture() {
+	if (atlas_slot >= 0) {
+		g_gui.gfx.atlas.release(atlas_slot);
+		atlas_slot = -1;
+	}
 	isGLLoaded = false;
-	g_gui.gfx.loaded_textures -= 1;
-	glDeleteTextures(1, &whatid);
 }
 
 void GameSprite::Image::visit() {
@@ -1163,8 +1410,10 @@ void GameSprite::Image::visit() {
 
 void GameSprite::Image::clean(int time) {
 	if (isGLLoaded && time - lastaccess > g_settings.getInteger(Config::TEXTURE_LONGEVITY)) {
-		unloadGLTexture(0);
+		unloadGLTexture();
 	}
+	// Sprites that failed to decode get another try after each clean
+	decode_failed = false;
 }
 
 GameSprite::NormalImage::NormalImage() :
@@ -1197,41 +1446,8 @@ uint8_t* GameSprite::NormalImage::getRGBData() {
 		}
 	}
 
-	const int pixels_data_size = SPRITE_PIXELS * SPRITE_PIXELS * 3;
-	uint8_t* data = newd uint8_t[pixels_data_size];
-	uint8_t bpp = g_gui.gfx.hasTransparency() ? 4 : 3;
-	int write = 0;
-	int read = 0;
-
-	// decompress pixels
-	while (read < size && write < pixels_data_size) {
-		int transparent = dump[read] | dump[read + 1] << 8;
-		read += 2;
-		for (int i = 0; i < transparent && write < pixels_data_size; i++) {
-			data[write + 0] = 0xFF; // red
-			data[write + 1] = 0x00; // green
-			data[write + 2] = 0xFF; // blue
-			write += 3;
-		}
-
-		int colored = dump[read] | dump[read + 1] << 8;
-		read += 2;
-		for (int i = 0; i < colored && write < pixels_data_size; i++) {
-			data[write + 0] = dump[read + 0]; // red
-			data[write + 1] = dump[read + 1]; // green
-			data[write + 2] = dump[read + 2]; // blue
-			write += 3;
-			read += bpp;
-		}
-	}
-
-	// fill remaining pixels
-	while (write < pixels_data_size) {
-		data[write + 0] = 0xFF; // red
-		data[write + 1] = 0x00; // green
-		data[write + 2] = 0xFF; // blue
-		write += 3;
-	}
+	uint8_t* data = newd uint8_t[SPRITE_PIXELS_SIZE * 3];
+	decodeSpriteDump<3>(dump, size, g_gui.gfx.hasTransparency(), data);
 	return data;
 }
 
@@ -1246,69 +1462,27 @@ uint8_t* GameSprite::NormalImage::getRGBAData() {
 		}
 	}
 
-	const int pixels_data_size = SPRITE_PIXELS_SIZE * 4;
-	uint8_t* data = newd uint8_t[pixels_data_size];
-	bool use_alpha = g_gui.gfx.hasTransparency();
-	uint8_t bpp = use_alpha ? 4 : 3;
-	int write = 0;
-	int read = 0;
-
-	// decompress pixels
-	while (read < size && write < pixels_data_size) {
-		int transparent = dump[read] | dump[read + 1] << 8;
-		if (use_alpha && transparent >= SPRITE_PIXELS_SIZE) { // Corrupted sprite?
-			break;
-		}
-		read += 2;
-		for (int i = 0; i < transparent && write < pixels_data_size; i++) {
-			data[write + 0] = 0x00; // red
-			data[write + 1] = 0x00; // green
-			data[write + 2] = 0x00; // blue
-			data[write + 3] = 0x00; // alpha
-			write += 4;
-		}
-
-		int colored = dump[read] | dump[read + 1] << 8;
-		read += 2;
-		for (int i = 0; i < colored && write < pixels_data_size; i++) {
-			data[write + 0] = dump[read + 0]; // red
-			data[write + 1] = dump[read + 1]; // green
-			data[write + 2] = dump[read + 2]; // blue
-			data[write + 3] = use_alpha ? dump[read + 3] : 0xFF; // alpha
-			write += 4;
-			read += bpp;
-		}
-	}
-
-	// fill remaining pixels
-	while (write < pixels_data_size) {
-		data[write + 0] = 0x00; // red
-		data[write + 1] = 0x00; // green
-		data[write + 2] = 0x00; // blue
-		data[write + 3] = 0x00; // alpha
-		write += 4;
-	}
+	uint8_t* data = newd uint8_t[SPRITE_PIXELS_SIZE * 4];
+	decodeSpriteDump<4>(dump, size, g_gui.gfx.hasTransparency(), data);
 	return data;
 }
 
-GLuint GameSprite::NormalImage::getHardwareID() {
-	if (!isGLLoaded) {
-		createGLTexture(id);
-	}
-	visit();
-	return id;
-}
-
-void GameSprite::NormalImage::createGLTexture(GLuint ignored) {
-	Image::createGLTexture(id);
+bool GameSprite::NormalImage::prepareDecode(SpriteDecodeJob& job) const {
+	return prepareSource(job.sources[0]);
 }
 
-void GameSprite::NormalImage::unloadGLTexture(GLuint ignored) {
-	Image::unloadGLTexture(id);
+bool GameSprite::NormalImage::prepareSource(SpriteDecodeSource& source) const {
+	source.id = id;
+	if (dump) {
+		source.dump.assign(dump, dump + size);
+		source.loaded = true;
+		return true;
+	}
+	// Without memcaching the worker reads the dump from the sprite file
+	return !g_settings.getInteger(Config::USE_MEMCACHED_SPRITES);
 }
 
 GameSprite::TemplateImage::TemplateImage(GameSprite* parent, int v, const Outfit& outfit) :
-	gl_tid(0),
 	parent(parent),
 	sprite_index(v),
 	lookHead(outfit.lookHead),
@@ -1322,14 +1496,11 @@ GameSprite::TemplateImage::~TemplateImage() {
 	////
 }
 
-void GameSprite::TemplateImage::colorizePixel(uint8_t color, uint8_t& red, uint8_t& green, uint8_t& blue) {
-	// Thanks! Khaos, or was it mips? Hmmm... =)
-	uint8_t ro = (TemplateOutfitLookupTable[color] & 0xFF0000) >> 16; // rgb outfit
-	uint8_t go = (TemplateOutfitLookupTable[color] & 0xFF00) >> 8;
-	uint8_t bo = (TemplateOutfitLookupTable[color] & 0xFF);
-	red = (uint8_t)(red * (ro / 255.f));
-	green = (uint8_t)(green * (go / 255.f));
-	blue = (uint8_t)(blue * (bo / 255.f));
+void GameSprite::TemplateImage::getLooks(uint8_t looks[4]) const {
+	looks[0] = lookHead < TEMPLATE_OUTFIT_COLORS ? lookHead : 0;
+	looks[1] = lookBody < TEMPLATE_OUTFIT_COLORS ? lookBody : 0;
+	looks[2] = lookLegs < TEMPLATE_OUTFIT_COLORS ? lookLegs : 0;
+	looks[3] = lookFeet < TEMPLATE_OUTFIT_COLORS ? lookFeet : 0;
 }
 
 uint8_t* GameSprite::TemplateImage::getRGBData() {
@@ -1345,115 +1516,150 @@ uint8_t* GameSprite::TemplateImage::getRGBData() {
 		return nullptr;
 	}
 
-	if (lookHead > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookHead = 0;
-	}
-	if (lookBody > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookBody = 0;
-	}
-	if (lookLegs > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookLegs = 0;
-	}
-	if (lookFeet > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookFeet = 0;
-	}
-
-	for (int y = 0; y < SPRITE_PIXELS; ++y) {
-		for (int x = 0; x < SPRITE_PIXELS; ++x) {
-			uint8_t& red = rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 0];
-			uint8_t& green = rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 1];
-			uint8_t& blue = rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 2];
-
-			uint8_t& tred = template_rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 0];
-			uint8_t& tgreen = template_rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 1];
-			uint8_t& tblue = template_rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 2];
-
-			if (tred && tgreen && !tblue) { // yellow => head
-				colorizePixel(lookHead, red, green, blue);
-			} else if (tred && !tgreen && !tblue) { // red => body
-				colorizePixel(lookBody, red, green, blue);
-			} else if (!tred && tgreen && !tblue) { // green => legs
-				colorizePixel(lookLegs, red, green, blue);
-			} else if (!tred && !tgreen && tblue) { // blue => feet
-				colorizePixel(lookFeet, red, green, blue);
-			}
-		}
-	}
+	uint8_t looks[4];
+	getLooks(looks);
+	colorizeOutfit<3>(rgbdata, template_rgbdata, looks);
 	delete[] template_rgbdata;
 	return rgbdata;
 }
 
 uint8_t* GameSprite::TemplateImage::getRGBAData() {
 	uint8_t* rgbadata = parent->spriteList[sprite_index]->getRGBAData();
-	uint8_t* template_rgbdata = parent->spriteList[sprite_index + parent->height * parent->width]->getRGBData();
+	uint8_t* template_rgbadata = parent->spriteList[sprite_index + parent->height * parent->width]->getRGBAData();
 
 	if (!rgbadata) {
-		delete[] template_rgbdata;
+		delete[] template_rgbadata;
 		return nullptr;
 	}
-	if (!template_rgbdata) {
+	if (!template_rgbadata) {
 		delete[] rgbadata;
 		return nullptr;
 	}
 
-	if (lookHead > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookHead = 0;
+	uint8_t looks[4];
+	getLooks(looks);
+	colorizeOutfit<4>(rgbadata, template_rgbadata, looks);
+	delete[] template_rgbadata;
+	return rgbadata;
+}
+
+bool GameSprite::TemplateImage::prepareDecode(SpriteDecodeJob& job) const {
+	job.colorize = true;
+	getLooks(job.looks);
+	return parent->spriteList[sprite_index]->prepareSource(job.sources[0]) &&
+		parent->spriteList[sprite_index + parent->height * parent->width]->prepareSource(job.sources[1]);
+}
+
+// ============================================================================
+// Sprite decoder
+
+SpriteDecoder::SpriteDecoder() :
+	epoch(0),
+	running(0),
+	refresh_posted(false),
+	stopping(false) {
+	////
+}
+
+SpriteDecoder::~SpriteDecoder() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
 	}
-	if (lookBody > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookBody = 0;
+	job_queued.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
 	}
-	if (lookLegs > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookLegs = 0;
+}
+
+void SpriteDecoder::request(SpriteDecodeJob&& job) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (threads.empty()) {
+			const int thread_count = std::max<int>(1, g_settings.getInteger(Config::WORKER_THREADS));
+			for (int i = 0; i < thread_count; ++i) {
+				threads.emplace_back(&SpriteDecoder::work, this);
+			}
+		}
+		queued.push_back(std::move(job));
 	}
-	if (lookFeet > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookFeet = 0;
+	job_queued.notify_one();
+}
+
+void SpriteDecoder::collect(std::vector<SpriteDecodeJob>& done, size_t max) {
+	std::lock_guard<std::mutex> lock(mutex);
+	while (!finished.empty() && done.size() < max) {
+		done.push_back(std::move(finished.front()));
+		finished.pop_front();
 	}
 
-	for (int y = 0; y < SPRITE_PIXELS; ++y) {
-		for (int x = 0; x < SPRITE_PIXELS; ++x) {
-			uint8_t& red = rgbadata[y * SPRITE_PIXELS * 4 + x * 4 + 0];
-			uint8_t& green = rgbadata[y * SPRITE_PIXELS * 4 + x * 4 + 1];
-			uint8_t& blue = rgbadata[y * SPRITE_PIXELS * 4 + x * 4 + 2];
+	// Once everything is picked up the next finished job asks for a redraw
+	refresh_posted = !finished.empty();
+	if (refresh_posted && wxTheApp) {
+		wxTheApp->CallAfter([]() {
+			g_gui.RefreshView();
+		});
+	}
+}
 
-			uint8_t& tred = template_rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 0];
-			uint8_t& tgreen = template_rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 1];
-			uint8_t& tblue = template_rgbdata[y * SPRITE_PIXELS * 3 + x * 3 + 2];
+void SpriteDecoder::cancel() {
+	std::unique_lock<std::mutex> lock(mutex);
+	++epoch;
+	queued.clear();
+	finished.clear();
+	job_finished.wait(lock, [this]() { return running == 0; });
+	refresh_posted = false;
+}
+
+void SpriteDecoder::work() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		job_queued.wait(lock, [this]() { return stopping || !queued.empty(); });
+		if (stopping) {
+			return;
+		}
 
-			if (tred && tgreen && !tblue) { // yellow => head
-				colorizePixel(lookHead, red, green, blue);
-			} else if (tred && !tgreen && !tblue) { // red => body
-				colorizePixel(lookBody, red, green, blue);
-			} else if (!tred && tgreen && !tblue) { // green => legs
-				colorizePixel(lookLegs, red, green, blue);
-			} else if (!tred && !tgreen && tblue) { // blue => feet
-				colorizePixel(lookFeet, red, green, blue);
+		SpriteDecodeJob job = std::move(queued.front());
+		queued.pop_front();
+		const uint32_t job_epoch = epoch;
+		++running;
+		lock.unlock();
+		decode(job);
+		lock.lock();
+		--running;
+
+		if (job_epoch == epoch) {
+			finished.push_back(std::move(job));
+			// One redraw picks up everything that is finished by then
+			if (!refresh_posted && wxTheApp) {
+				refresh_posted = true;
+				wxTheApp->CallAfter([]() {
+					g_gui.RefreshView();
+				});
 			}
 		}
+		job_finished.notify_all();
 	}
-	delete[] template_rgbdata;
-	return rgbadata;
 }
 
-GLuint GameSprite::TemplateImage::getHardwareID() {
-	if (!isGLLoaded) {
-		if (gl_tid == 0) {
-			gl_tid = g_gui.gfx.getFreeTextureID();
-		}
-		createGLTexture(gl_tid);
-		if (!isGLLoaded) {
-			return 0;
+void SpriteDecoder::decode(SpriteDecodeJob& job) {
+	uint8_t template_rgba[SPRITE_PIXELS_SIZE * 4];
+	job.rgba.resize(SPRITE_PIXELS_SIZE * 4);
+
+	const int count = job.colorize ? 2 : 1;
+	for (int i = 0; i < count; ++i) {
+		SpriteDecodeSource& source = job.sources[i];
+		if (!source.loaded && !g_gui.gfx.readSpriteDump(source.id, source.dump)) {
+			job.rgba.clear();
+			return;
 		}
+		uint8_t* target = i == 0 ? job.rgba.data() : template_rgba;
+		decodeSpriteDump<4>(source.dump.data(), uint16_t(source.dump.size()), job.use_alpha, target);
 	}
-	visit();
-	return gl_tid;
-}
 
-void GameSprite::TemplateImage::createGLTexture(GLuint unused) {
-	Image::createGLTexture(gl_tid);
-}
-
-void GameSprite::TemplateImage::unloadGLTexture(GLuint unused) {
-	Image::unloadGLTexture(gl_tid);
+	if (job.colorize) {
+		colorizeOutfit<4>(job.rgba.data(), template_rgba, job.looks);
+	}
 }
 
 // ============================================================================
@@ -21,8 +21,12 @@
 #include "outfit.h"
 #include "common.h"
 #include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "client_version.h"
+#include "filehandle.h"
 
 enum SpriteSize {
 	SPRITE_SIZE_16x16,
@@ -44,6 +48,8 @@ class MapCanvas;
 class GraphicManager;
 class FileReadHandle;
 class Animator;
+struct SpriteDecodeSource;
+struct SpriteDecodeJob;
 
 struct SpriteLight {
 	uint8_t intensity = 0;
@@ -75,14 +81,24 @@ protected:
 	wxBitmap* bm[SPRITE_SIZE_COUNT];
 };
 
+// Where a sprite lives in the atlas, texture is 0 if it could not be loaded
+struct SpriteRegion {
+	SpriteRegion() :
+		texture(0), u0(0.f), v0(0.f), u1(1.f), v1(1.f) { }
+
+	GLuint texture;
+	float u0, v0;
+	float u1, v1;
+};
+
 class GameSprite : public Sprite {
 public:
 	GameSprite();
 	~GameSprite();
 
 	int getIndex(int width, int height, int layer, int pattern_x, int pattern_y, int pattern_z, int frame) const;
-	GLuint getHardwareID(int _x, int _y, int _layer, int _subtype, int _pattern_x, int _pattern_y, int _pattern_z, int _frame);
-	GLuint getHardwareID(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame); // CreatureDatabase
+	SpriteRegion getHardwareID(int _x, int _y, int _layer, int _subtype, int _pattern_x, int _pattern_y, int _pattern_z, int _frame);
+	SpriteRegion getHardwareID(int _x, int _y, int _dir, int _addon, int _pattern_z, const Outfit& _outfit, int _frame); // CreatureDatabase
 	virtual void DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int width = -1, int height = -1);
 
 	virtual void unloadDC();
@@ -115,17 +131,24 @@ protected:
 
 		bool isGLLoaded;
 		int lastaccess;
+		// Slot in the sprite atlas, -1 while not loaded
+		int atlas_slot;
+		// Waiting for a background decode, or that decode failed
+		bool decode_pending;
+		bool decode_failed;
 
 		void visit();
 		virtual void clean(int time);
 
-		virtual GLuint getHardwareID() = 0;
+		SpriteRegion getHardwareID();
 		virtual uint8_t* getRGBData() = 0;
 		virtual uint8_t* getRGBAData() = 0;
+		// Copies what a worker needs to decode this image into the job
+		virtual bool prepareDecode(SpriteDecodeJob& job) const = 0;
 
 	protected:
-		virtual void createGLTexture(GLuint whatid);
-		virtual void unloadGLTexture(GLuint whatid);
+		void createGLTexture();
+		void unloadGLTexture();
 	};
 
 	class NormalImage : public Image {
@@ -133,7 +156,6 @@ protected:
 		NormalImage();
 		virtual ~NormalImage();
 
-		// We use the sprite id as GL texture id
 		uint32_t id;
 
 		// This contains the pixel data
@@ -142,13 +164,10 @@ protected:
 
 		virtual void clean(int time);
 
-		virtual GLuint getHardwareID();
 		virtual uint8_t* getRGBData();
 		virtual uint8_t* getRGBAData();
-
-	protected:
-		virtual void createGLTexture(GLuint ignored = 0);
-		virtual void unloadGLTexture(GLuint ignored = 0);
+		virtual bool prepareDecode(SpriteDecodeJob& job) const;
+		bool prepareSource(SpriteDecodeSource& source) const;
 	};
 
 	class TemplateImage : public Image {
@@ -156,11 +175,10 @@ protected:
 		TemplateImage(GameSprite* parent, int v, const Outfit& outfit);
 		virtual ~TemplateImage();
 
-		virtual GLuint getHardwareID();
 		virtual uint8_t* getRGBData();
 		virtual uint8_t* getRGBAData();
+		virtual bool prepareDecode(SpriteDecodeJob& job) const;
 
-		GLuint gl_tid;
 		GameSprite* parent;
 		int sprite_index;
 		uint8_t lookHead;
@@ -169,10 +187,8 @@ protected:
 		uint8_t lookFeet;
 
 	protected:
-		void colorizePixel(uint8_t color, uint8_t& r, uint8_t& b, uint8_t& g);
-
-		virtual void createGLTexture(GLuint ignored = 0);
-		virtual void unloadGLTexture(GLuint ignored = 0);
+		// Head, body, legs and feet colours, out of range ones are replaced by 0
+		void getLooks(uint8_t looks[4]) const;
 	};
 
 	uint32_t id;
@@ -204,6 +220,8 @@ public:
 	std::list<TemplateImage*> instanced_templates; // Templates that use this sprite
 
 	friend class GraphicManager;
+	friend class SpriteAtlas;
+	friend struct SpriteDecodeJob;
 };
 
 struct FrameDuration {
@@ -261,6 +279,65 @@ private:
 	AnimationDirection direction;
 	long last_time;
 	bool is_complete;
+
+	friend class GraphicManager;
+};
+
+#include "sprite_atlas.h"
+
+// One sprite dump a decode job reads from
+struct SpriteDecodeSource {
+	uint32_t id = 0;
+	// Dumps that were not in memory are read from the sprite file by the worker
+	bool loaded = false;
+	std::vector<uint8_t> dump;
+};
+
+// Everything a worker needs to turn an image into RGBA pixels, so it never
+// has to touch the image itself
+struct SpriteDecodeJob {
+	GameSprite::Image* image = nullptr;
+	bool use_alpha = false;
+	// Outfits are the sprite in sources[0] coloured through the template in sources[1]
+	bool colorize = false;
+	SpriteDecodeSource sources[2];
+	uint8_t looks[4] = { 0, 0, 0, 0 };
+
+	// The decoded pixels, empty if the sprite could not be decoded
+	std::vector<uint8_t> rgba;
+};
+
+// Decodes sprites on background threads, so scrolling into a part of the map
+// that has not been drawn yet does not stall on decompressing and colouring
+// every sprite in it. Finished jobs wait until the render thread uploads them.
+class SpriteDecoder {
+public:
+	SpriteDecoder();
+	~SpriteDecoder();
+
+	// Queues a job, the worker threads are started on first use
+	void request(SpriteDecodeJob&& job);
+	// Moves up to max finished jobs into done, if any are left another
+	// redraw is asked for so they are picked up next frame
+	void collect(std::vector<SpriteDecodeJob>& done, size_t max);
+	// Drops every queued and finished job and waits for the running ones
+	void cancel();
+
+private:
+	void work();
+	static void decode(SpriteDecodeJob& job);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable job_queued;
+	std::condition_variable job_finished;
+	std::deque<SpriteDecodeJob> queued;
+	std::deque<SpriteDecodeJob> finished;
+	// Bumped by cancel, jobs picked up before that are thrown away
+	uint32_t epoch;
+	int running;
+	bool refresh_posted;
+	bool stopping;
 };
 
 class GraphicManager {
@@ -281,9 +358,6 @@ public:
 	uint16_t getItemSpriteMaxID() const;
 	uint16_t getCreatureSpriteMaxID() const;
 
-	// Get an unused texture id (this is acquired by simply increasing a value starting from 0x10000000)
-	GLuint getFreeTextureID();
-
 	// This is part of the binary
 	bool loadEditorSprites();
 	// Metadata should be loaded first
@@ -291,10 +365,26 @@ public:
 	bool loadOTFI(const FileName& filename, wxString& error, wxArrayString& warnings);
 	bool loadSpriteMetadata(const FileName& datafile, wxString& error, wxArrayString& warnings);
 	bool loadSpriteMetadataFlags(FileReadHandle& file, GameSprite* sType, wxString& error, wxArrayString& warnings);
+	// The parsed metadata is kept in a cache file next to the user data of the
+	// client version, so later starts skip parsing the .dat
+	bool loadMetadataCache(const FileName& cachefile, const FileName& datafile, uint32_t dat_signature);
+	bool saveMetadataCache(const FileName& cachefile, const FileName& datafile, uint32_t dat_signature) const;
 	bool loadSpriteData(const FileName& datafile, wxString& error, wxArrayString& warnings);
 
 	// Cleans old & unused textures according to config settings
 	void garbageCollection();
+	// Uploads a bounded number of sprites decoded in the background, call
+	// once per frame with the GL context current
+	void uploadDecodedSprites();
+	// Decodes sprites while drawing instead of drawing placeholders, for
+	// images that are read back right away
+	void setSynchronousDecoding(bool synchronous) {
+		synchronous_decoding = synchronous;
+	}
+	// The batch the drawer is filling, see SpriteAtlas::setBatch
+	void setSpriteBatch(SpriteBatch* batch) {
+		atlas.setBatch(batch);
+	}
 	void addSpriteToCleanup(GameSprite* spr);
 
 	wxFileName getMetadataFileName() const {
@@ -307,13 +397,30 @@ public:
 	bool hasTransparency() const;
 	bool isUnloaded() const;
 
+	// Changes whenever the loaded sprites are thrown away, anything keeping
+	// GameSprite pointers around has to drop them when it does
+	uint32_t getGeneration() const {
+		return generation;
+	}
+
 	ClientVersion* client_version;
 
 private:
 	bool unloaded;
-	// This is used if memcaching is NOT on
-	std::string spritefile;
+	// These are used if memcaching is NOT on, the handle is shared by all
+	// sprite reads and only ever read from at explicit offsets
+	PositionalFileReadHandle sprite_handle;
+	std::vector<uint32_t> sprite_offsets;
+	// With memcaching on the sprite file is mapped and the image dumps point into it
+	MappedFile sprite_file;
+	void releaseMappedDumps();
 	bool loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite_id);
+	// Safe to call from the decode threads
+	bool readSpriteDump(uint32_t sprite_id, std::vector<uint8_t>& dump) const;
+
+	bool decodeInBackground() const;
+	bool requestDecode(GameSprite::Image* image);
+	SpriteRegion getPlaceholder();
 
 	typedef std::map<int, Sprite*> SpriteMap;
 	SpriteMap sprite_space;
@@ -332,14 +439,20 @@ private:
 	wxFileName metadata_file;
 	wxFileName sprites_file;
 
-	int loaded_textures;
+	SpriteAtlas atlas;
+	SpriteDecoder decoder;
+	std::vector<SpriteDecodeJob> decoded;
+	GLuint placeholder_texture;
+	bool synchronous_decoding;
 	int lastclean;
+	uint32_t generation;
 
 	wxStopWatch* animation_timer;
 
 	friend class GameSprite::Image;
 	friend class GameSprite::NormalImage;
 	friend class GameSprite::TemplateImage;
+	friend class SpriteDecoder;
 };
 
 struct RGBQuad {
@@ -1222,7 +1222,7 @@ void GUI::PreparePaste() {
 void GUI::StartPasting() {
 	if (GetCurrentEditor()) {
 		pasting = true;
-		secondary_map = &copybuffer.getBufferMap();
+		secondary_map = &copybuffer.getPreviewMap();
 	}
 }
 
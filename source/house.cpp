@@ -119,6 +119,7 @@ void House::clean() {
 		Tile* tile = map->getTile(*pos_iter);
 		if (tile) {
 			tile->setHouse(nullptr);
+			map->tileChanged(*pos_iter);
 		}
 	}
 
@@ -143,6 +144,7 @@ void House::addTile(Tile* tile) {
 	ASSERT(tile);
 	tile->setHouse(this);
 	tiles.push_back(tile->getPosition());
+	map->tileChanged(tile->getPosition());
 }
 
 void House::removeTile(Tile* tile) {
@@ -151,6 +153,7 @@ void House::removeTile(Tile* tile) {
 		if (*tile_iter == tile->getPosition()) {
 			tiles.erase(tile_iter);
 			tile->setHouse(nullptr);
+			map->tileChanged(tile->getPosition());
 			return;
 		}
 	}
@@ -36,6 +36,7 @@
 #include "wall_brush.h"
 
 #include "iomap_otbm.h"
+#include "otbm_job_queue.h"
 
 typedef uint8_t attribute_t;
 typedef uint32_t flags_t;
@@ -560,7 +561,7 @@ bool IOMapOTBM::getVersionInfo(const FileName& filename, MapVersion& out_ver) {
 #endif
 
 	// Just open a disk-based read handle
-	DiskNodeFileReadHandle f(nstr(filename.GetFullPath()), StringVector(1, "OTBM"));
+	MappedNodeFileReadHandle f(nstr(filename.GetFullPath()), StringVector(1, "OTBM"));
 	if (!f.isOk()) {
 		return false;
 	}
@@ -717,7 +718,7 @@ bool IOMapOTBM::loadMap(Map& map, const FileName& filename) {
 	}
 #endif
 
-	DiskNodeFileReadHandle f(nstr(filename.GetFullPath()), StringVector(1, "OTBM"));
+	MappedNodeFileReadHandle f(nstr(filename.GetFullPath()), StringVector(1, "OTBM"));
 	if (!f.isOk()) {
 		error(("Couldn't open file for reading\nThe error reported was: " + wxstr(f.getErrorMessage())).wc_str());
 		return false;
@@ -744,6 +745,25 @@ bool IOMapOTBM::loadMap(Map& map, const FileName& filename) {
 	return true;
 }
 
+struct OTBM_LoadJob {
+	const uint8_t* raw = nullptr;
+	size_t raw_size = 0;
+	OTBM_TileAreaBatch batch;
+};
+
+// Cached tile areas can only be reused by a saver writing the same format
+// with the same item database
+static uint32_t getAreaCacheTag(const MapVersion& version) {
+	return (g_items.MajorVersion << 24) ^ (g_items.MinorVersion << 8) ^ uint32_t(version.otbm);
+}
+
+OTBM_TileAreaBatch::~OTBM_TileAreaBatch() {
+	// Tiles that never made it onto a map
+	for (Entry& entry : tiles) {
+		delete entry.tile;
+	}
+}
+
 bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f) {
 	BinaryNode* root = f.getRootNode();
 	if (!root) {
@@ -848,9 +868,57 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f) {
 
 	int nodes_loaded = 0;
 
+	// Tile areas are independent until they are placed on the map, so with
+	// several worker threads they are only split off here and decoded in the
+	// background, then merged back in file order.
+	std::unique_ptr<OTBM_JobQueue<OTBM_LoadJob>> loader;
+	const int thread_count = g_settings.getInteger(Config::WORKER_THREADS);
+	if (thread_count > 1 && f.isZeroCopy()) {
+		loader.reset(newd OTBM_JobQueue<OTBM_LoadJob>([this](OTBM_LoadJob& job) {
+			decodeTileArea(job.raw, job.raw_size, job.batch);
+		}, thread_count));
+	}
+
+	// The raw bytes of every area read from a mapped file are kept per
+	// 256x256 block so the next save can write out untouched blocks as they
+	// were. Blocks with anything discarded while loading are left out, and
+	// nothing is kept if an area isn't aligned to a block.
+	bool cache_areas = f.isZeroCopy();
+	TileAreaCache loaded_areas;
+	loaded_areas.setTag(getAreaCacheTag(version));
+	std::vector<Position> rejected_areas;
+
+	auto mergeArea = [&](OTBM_LoadJob& job) {
+		const bool clean = mergeTileArea(map, job.batch);
+		if (!cache_areas) {
+			return;
+		}
+
+		const OTBM_TileAreaBatch& batch = job.batch;
+		if (batch.base_x < 0 || (batch.base_x & 0xFF) || batch.base_y < 0 || (batch.base_y & 0xFF)) {
+			cache_areas = false;
+		} else if (!clean) {
+			rejected_areas.push_back(Position(batch.base_x, batch.base_y, 0));
+		} else {
+			std::vector<uint8_t>& block = loaded_areas.emplace(batch.base_x, batch.base_y);
+			block.insert(block.end(), job.raw, job.raw + job.raw_size);
+		}
+	};
+
+	int areas_merged = 0;
+	auto mergeAreas = [&](bool wait) {
+		while (OTBM_LoadJob* job = loader->front(wait)) {
+			mergeArea(*job);
+			if (++areas_merged % 15 == 0) {
+				g_gui.SetLoadDone(static_cast<int32_t>(100.0 * job->batch.offset / f.size()));
+			}
+			loader->pop();
+		}
+	};
+
 	for (BinaryNode* mapNode = mapHeaderNode->getChild(); mapNode != nullptr; mapNode = mapNode->advance()) {
 		++nodes_loaded;
-		if (nodes_loaded % 15 == 0) {
+		if (!loader && nodes_loaded % 15 == 0) {
 			g_gui.SetLoadDone(static_cast<int32_t>(100.0 * f.tell() / f.size()));
 		}
 
@@ -859,115 +927,40 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f) {
 			warning("Invalid map node");
 			continue;
 		}
+
+		if (loader && node_type != OTBM_TILE_AREA) {
+			// Towns and waypoints refer to tiles, every area before them has to be on the map
+			mergeAreas(true);
+		}
+
 		if (node_type == OTBM_TILE_AREA) {
-			uint16_t base_x, base_y;
-			uint8_t base_z;
-			if (!mapNode->getU16(base_x) || !mapNode->getU16(base_y) || !mapNode->getU8(base_z)) {
-				warning("Invalid map node, no base coordinate");
+			if (!f.isZeroCopy()) {
+				OTBM_TileAreaBatch batch;
+				decodeTileArea(mapNode, batch);
+				mergeTileArea(map, batch);
 				continue;
 			}
 
-			for (BinaryNode* tileNode = mapNode->getChild(); tileNode != nullptr; tileNode = tileNode->advance()) {
-				Tile* tile = nullptr;
-				uint8_t tile_type;
-				if (!tileNode->getByte(tile_type)) {
-					warning("Invalid tile type");
-					continue;
-				}
-				if (tile_type == OTBM_TILE || tile_type == OTBM_HOUSETILE) {
-					// printf("Start\n");
-					uint8_t x_offset, y_offset;
-					if (!tileNode->getU8(x_offset) || !tileNode->getU8(y_offset)) {
-						warning("Could not read position of tile");
-						continue;
-					}
-					const Position pos(base_x + x_offset, base_y + y_offset, base_z);
-
-					if (map.getTile(pos)) {
-						warning("Duplicate tile at %d:%d:%d, discarding duplicate", pos.x, pos.y, pos.z);
-						continue;
-					}
-
-					tile = map.allocator(map.createTileL(pos));
-					House* house = nullptr;
-					if (tile_type == OTBM_HOUSETILE) {
-						uint32_t house_id;
-						if (!tileNode->getU32(house_id)) {
-							warning("House tile without house data, discarding tile");
-							continue;
-						}
-						if (house_id) {
-							house = map.houses.getHouse(house_id);
-							if (!house) {
-								house = newd House(map);
-								house->setID(house_id);
-								map.houses.addHouse(house);
-							}
-						} else {
-							warning("Invalid house id from tile %d:%d:%d", pos.x, pos.y, pos.z);
-						}
-					}
-
-					// printf("So far so good\n");
-
-					uint8_t attribute;
-					while (tileNode->getU8(attribute)) {
-						switch (attribute) {
-							case OTBM_ATTR_TILE_FLAGS: {
-								uint32_t flags = 0;
-								if (!tileNode->getU32(flags)) {
-									warning("Invalid tile flags of tile on %d:%d:%d", pos.x, pos.y, pos.z);
-								}
-								tile->setMapFlags(flags);
-								break;
-							}
-							case OTBM_ATTR_ITEM: {
-								Item* item = Item::Create_OTBM(*this, tileNode);
-								if (item == nullptr) {
-									warning("Invalid item at tile %d:%d:%d", pos.x, pos.y, pos.z);
-								}
-								tile->addItem(item);
-								break;
-							}
-							default: {
-								warning("Unknown tile attribute at %d:%d:%d", pos.x, pos.y, pos.z);
-								break;
-							}
-						}
-					}
-
-					// printf("Didn't die in loop\n");
-
-					for (BinaryNode* itemNode = tileNode->getChild(); itemNode != nullptr; itemNode = itemNode->advance()) {
-						Item* item = nullptr;
-						uint8_t item_type;
-						if (!itemNode->getByte(item_type)) {
-							warning("Unknown item type %d:%d:%d", pos.x, pos.y, pos.z);
-							continue;
-						}
-						if (item_type == OTBM_ITEM) {
-							item = Item::Create_OTBM(*this, itemNode);
-							if (item) {
-								if (!item->unserializeItemNode_OTBM(*this, itemNode)) {
-									warning("Couldn't unserialize item attributes at %d:%d:%d", pos.x, pos.y, pos.z);
-								}
-								// reform(&map, tile, item);
-								tile->addItem(item);
-							}
-						} else {
-							warning("Unknown type of tile child node");
-						}
-					}
-
-					tile->update();
-					if (house) {
-						house->addTile(tile);
-					}
+			const uint8_t* raw;
+			size_t raw_size;
+			if (!mapNode->skipRaw(raw, raw_size)) {
+				warning("Invalid map node, could not split tile area");
+				continue;
+			}
 
-					map.setTile(pos.x, pos.y, pos.z, tile);
-				} else {
-					warning("Unknown type of tile node");
-				}
+			if (loader) {
+				OTBM_LoadJob& job = loader->emplace();
+				job.raw = raw;
+				job.raw_size = raw_size;
+				job.batch.offset = f.tell();
+				loader->submit();
+				mergeAreas(false);
+			} else {
+				OTBM_LoadJob job;
+				job.raw = raw;
+				job.raw_size = raw_size;
+				decodeTileArea(raw, raw_size, job.batch);
+				mergeArea(job);
 			}
 		} else if (node_type == OTBM_TOWNS) {
 			for (BinaryNode* townNode = mapNode->getChild(); townNode != nullptr; townNode = townNode->advance()) {
@@ -1052,12 +1045,172 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f) {
 		}
 	}
 
+	if (loader) {
+		mergeAreas(true);
+	}
+
+	// Swapped in last, placing tiles on the map drops cached blocks
+	if (cache_areas) {
+		for (const Position& position : rejected_areas) {
+			loaded_areas.invalidate(position);
+		}
+		map.area_cache.swap(loaded_areas);
+	} else {
+		map.area_cache.clear();
+	}
+
 	if (!f.isOk()) {
 		warning(wxstr(f.getErrorMessage()).wc_str());
 	}
 	return true;
 }
 
+void IOMapOTBM::decodeTileArea(BinaryNode* mapNode, OTBM_TileAreaBatch& batch) const {
+	uint16_t base_x, base_y;
+	uint8_t base_z;
+	if (!mapNode->getU16(base_x) || !mapNode->getU16(base_y) || !mapNode->getU8(base_z)) {
+		batch.warnings.push_back("Invalid map node, no base coordinate");
+		return;
+	}
+	batch.base_x = base_x;
+	batch.base_y = base_y;
+
+	for (BinaryNode* tileNode = mapNode->getChild(); tileNode != nullptr; tileNode = tileNode->advance()) {
+		uint8_t tile_type;
+		if (!tileNode->getByte(tile_type)) {
+			batch.warnings.push_back("Invalid tile type");
+			continue;
+		}
+		if (tile_type != OTBM_TILE && tile_type != OTBM_HOUSETILE) {
+			batch.warnings.push_back("Unknown type of tile node");
+			continue;
+		}
+
+		uint8_t x_offset, y_offset;
+		if (!tileNode->getU8(x_offset) || !tileNode->getU8(y_offset)) {
+			batch.warnings.push_back("Could not read position of tile");
+			continue;
+		}
+		const Position pos(base_x + x_offset, base_y + y_offset, base_z);
+
+		uint32_t house_id = 0;
+		if (tile_type == OTBM_HOUSETILE) {
+			if (!tileNode->getU32(house_id)) {
+				batch.warnings.push_back("House tile without house data, discarding tile");
+				batch.tiles.push_back({ pos, nullptr, 0 });
+				continue;
+			}
+			if (!house_id) {
+				batch.warnings.push_back(wxString::Format("Invalid house id from tile %d:%d:%d", pos.x, pos.y, pos.z));
+			}
+		}
+
+		Tile* tile = newd Tile(pos.x, pos.y, pos.z);
+
+		uint8_t attribute;
+		while (tileNode->getU8(attribute)) {
+			switch (attribute) {
+				case OTBM_ATTR_TILE_FLAGS: {
+					uint32_t flags = 0;
+					if (!tileNode->getU32(flags)) {
+						batch.warnings.push_back(wxString::Format("Invalid tile flags of tile on %d:%d:%d", pos.x, pos.y, pos.z));
+					}
+					tile->setMapFlags(flags);
+					break;
+				}
+				case OTBM_ATTR_ITEM: {
+					Item* item = Item::Create_OTBM(*this, tileNode);
+					if (item == nullptr) {
+						batch.warnings.push_back(wxString::Format("Invalid item at tile %d:%d:%d", pos.x, pos.y, pos.z));
+					}
+					tile->addItem(item);
+					break;
+				}
+				default: {
+					batch.warnings.push_back(wxString::Format("Unknown tile attribute at %d:%d:%d", pos.x, pos.y, pos.z));
+					break;
+				}
+			}
+		}
+
+		for (BinaryNode* itemNode = tileNode->getChild(); itemNode != nullptr; itemNode = itemNode->advance()) {
+			uint8_t item_type;
+			if (!itemNode->getByte(item_type)) {
+				batch.warnings.push_back(wxString::Format("Unknown item type %d:%d:%d", pos.x, pos.y, pos.z));
+				continue;
+			}
+			if (item_type == OTBM_ITEM) {
+				Item* item = Item::Create_OTBM(*this, itemNode);
+				if (item == nullptr) {
+					// Also keeps the block out of the area cache, the next
+					// save must not write the dropped item back out
+					batch.warnings.push_back(wxString::Format("Invalid item at tile %d:%d:%d", pos.x, pos.y, pos.z));
+					continue;
+				}
+				if (!item->unserializeItemNode_OTBM(*this, itemNode)) {
+					batch.warnings.push_back(wxString::Format("Couldn't unserialize item attributes at %d:%d:%d", pos.x, pos.y, pos.z));
+				}
+				tile->addItem(item);
+			} else {
+				batch.warnings.push_back("Unknown type of tile child node");
+			}
+		}
+
+		tile->update();
+		batch.tiles.push_back({ pos, tile, house_id });
+	}
+}
+
+void IOMapOTBM::decodeTileArea(const uint8_t* raw, size_t raw_size, OTBM_TileAreaBatch& batch) const {
+	MemoryNodeFileReadHandle handle(raw, raw_size);
+	BinaryNode* mapNode = handle.getRootNode();
+
+	uint8_t node_type;
+	if (!mapNode || !mapNode->getByte(node_type)) {
+		batch.warnings.push_back("Invalid map node");
+		return;
+	}
+	decodeTileArea(mapNode, batch);
+}
+
+bool IOMapOTBM::mergeTileArea(Map& map, OTBM_TileAreaBatch& batch) {
+	bool clean = batch.warnings.empty();
+	for (const wxString& message : batch.warnings) {
+		warnings.push_back(message);
+	}
+
+	for (OTBM_TileAreaBatch::Entry& entry : batch.tiles) {
+		const Position& pos = entry.pos;
+		if (map.getTile(pos)) {
+			warning("Duplicate tile at %d:%d:%d, discarding duplicate", pos.x, pos.y, pos.z);
+			delete entry.tile;
+			clean = false;
+			continue;
+		}
+
+		TileLocation* location = map.createTileL(pos);
+		Tile* tile = entry.tile;
+		if (!tile) {
+			continue;
+		}
+		tile->setLocation(location);
+
+		if (entry.house_id) {
+			House* house = map.houses.getHouse(entry.house_id);
+			if (!house) {
+				house = newd House(map);
+				house->setID(entry.house_id);
+				map.houses.addHouse(house);
+			}
+			house->addTile(tile);
+		}
+
+		map.setTile(pos.x, pos.y, pos.z, tile);
+	}
+	batch.tiles.clear();
+	return clean;
+}
+
 bool IOMapOTBM::loadSpawns(Map& map, const FileName& dir) {
 	std::string fn = (const char*)(dir.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME).mb_str(wxConvUTF8));
 	fn += map.spawnfile;
@@ -1462,8 +1615,6 @@ bool IOMapOTBM::saveMap(Map& map, NodeFileWriteHandle& f) {
 
 	bool waypointsWarning = false;
 
-	const IOMapOTBM& self = *this;
-
 	FileName tmpName;
 	MapVersion mapVersion = map.getVersion();
 
@@ -1496,9 +1647,30 @@ bool IOMapOTBM::saveMap(Map& map, NodeFileWriteHandle& f) {
 
 			// Start writing tiles
 			uint32_t tiles_saved = 0;
-			bool first = true;
 
-			int local_x = -1, local_y = -1, local_z = -1;
+			// Tiles are written per 256x256 block, a block always begins with a
+			// new tile area so blocks can be encoded independently, on worker
+			// threads if there are several, and concatenated in order. Blocks
+			// that are unchanged since the map was loaded or last saved are
+			// copied from the area cache instead, everything that is encoded
+			// goes back into the cache for the next save.
+			TileAreaCache& area_cache = map.area_cache;
+			area_cache.setTag(getAreaCacheTag(version));
+
+			OTBM_BlockSaver<Tile> saver(
+				[this](const std::vector<Tile*>& tiles, NodeFileWriteHandle& output) {
+					serializeTileAreas(tiles, output);
+				},
+				[&](int x, int y, const uint8_t* data, size_t size, bool cached) {
+					f.addNodeData(data, size);
+					if (!cached) {
+						area_cache.emplace(x, y).assign(data, data + size);
+					}
+				},
+				g_settings.getInteger(Config::WORKER_THREADS)
+			);
+			int block_x = -1, block_y = -1;
+			const std::vector<uint8_t>* cached_block = nullptr;
 
 			MapIterator map_iterator = map.begin();
 			while (map_iterator != map.end()) {
@@ -1518,75 +1690,18 @@ bool IOMapOTBM::saveMap(Map& map, NodeFileWriteHandle& f) {
 				}
 
 				const Position& pos = save_tile->getPosition();
-
-				// Decide if newd node should be created
-				if (pos.x < local_x || pos.x >= local_x + 256 || pos.y < local_y || pos.y >= local_y + 256 || pos.z != local_z) {
-					// End last node
-					if (!first) {
-						f.endNode();
-					}
-					first = false;
-
-					// Start newd node
-					f.addNode(OTBM_TILE_AREA);
-					f.addU16(local_x = pos.x & 0xFF00);
-					f.addU16(local_y = pos.y & 0xFF00);
-					f.addU8(local_z = pos.z);
-				}
-				f.addNode(save_tile->isHouseTile() ? OTBM_HOUSETILE : OTBM_TILE);
-
-				f.addU8(save_tile->getX() & 0xFF);
-				f.addU8(save_tile->getY() & 0xFF);
-
-				if (save_tile->isHouseTile()) {
-					f.addU32(save_tile->getHouseID());
+				if ((pos.x & 0xFF00) != block_x || (pos.y & 0xFF00) != block_y) {
+					block_x = pos.x & 0xFF00;
+					block_y = pos.y & 0xFF00;
+					cached_block = area_cache.get(block_x, block_y);
+					saver.beginBlock(block_x, block_y, cached_block);
 				}
-
-				if (save_tile->getMapFlags()) {
-					f.addByte(OTBM_ATTR_TILE_FLAGS);
-					f.addU32(save_tile->getMapFlags());
-				}
-
-				if (save_tile->ground) {
-					Item* ground = save_tile->ground;
-					if (ground->isMetaItem()) {
-						// Do nothing, we don't save metaitems...
-					} else if (ground->hasBorderEquivalent()) {
-						bool found = false;
-						for (Item* item : save_tile->items) {
-							if (item->getGroundEquivalent() == ground->getID()) {
-								// Do nothing
-								// Found equivalent
-								found = true;
-								break;
-							}
-						}
-
-						if (!found) {
-							ground->serializeItemNode_OTBM(self, f);
-						}
-					} else if (ground->isComplex()) {
-						ground->serializeItemNode_OTBM(self, f);
-					} else {
-						f.addByte(OTBM_ATTR_ITEM);
-						ground->serializeItemCompact_OTBM(self, f);
-					}
-				}
-
-				for (Item* item : save_tile->items) {
-					if (!item->isMetaItem()) {
-						item->serializeItemNode_OTBM(self, f);
-					}
+				if (!cached_block) {
+					saver.addTile(save_tile);
 				}
-
-				f.endNode();
 				++map_iterator;
 			}
-
-			// Only close the last node if one has actually been created
-			if (!first) {
-				f.endNode();
-			}
+			saver.finish();
 
 			f.addNode(OTBM_TOWNS);
 			for (const auto& townEntry : map.towns) {
@@ -1631,6 +1746,84 @@ bool IOMapOTBM::saveMap(Map& map, NodeFileWriteHandle& f) {
 	return true;
 }
 
+void IOMapOTBM::serializeTileAreas(const std::vector<Tile*>& tiles, NodeFileWriteHandle& f) const {
+	const IOMapOTBM& self = *this;
+
+	bool first = true;
+	int local_x = -1, local_y = -1, local_z = -1;
+
+	for (Tile* save_tile : tiles) {
+		const Position& pos = save_tile->getPosition();
+
+		// Decide if newd node should be created
+		if (pos.x < local_x || pos.x >= local_x + 256 || pos.y < local_y || pos.y >= local_y + 256 || pos.z != local_z) {
+			// End last node
+			if (!first) {
+				f.endNode();
+			}
+			first = false;
+
+			// Start newd node
+			f.addNode(OTBM_TILE_AREA);
+			f.addU16(local_x = pos.x & 0xFF00);
+			f.addU16(local_y = pos.y & 0xFF00);
+			f.addU8(local_z = pos.z);
+		}
+		f.addNode(save_tile->isHouseTile() ? OTBM_HOUSETILE : OTBM_TILE);
+
+		f.addU8(save_tile->getX() & 0xFF);
+		f.addU8(save_tile->getY() & 0xFF);
+
+		if (save_tile->isHouseTile()) {
+			f.addU32(save_tile->getHouseID());
+		}
+
+		if (save_tile->getMapFlags()) {
+			f.addByte(OTBM_ATTR_TILE_FLAGS);
+			f.addU32(save_tile->getMapFlags());
+		}
+
+		if (save_tile->ground) {
+			Item* ground = save_tile->ground;
+			if (ground->isMetaItem()) {
+				// Do nothing, we don't save metaitems...
+			} else if (ground->hasBorderEquivalent()) {
+				bool found = false;
+				for (Item* item : save_tile->items) {
+					if (item->getGroundEquivalent() == ground->getID()) {
+						// Do nothing
+						// Found equivalent
+						found = true;
+						break;
+					}
+				}
+
+				if (!found) {
+					ground->serializeItemNode_OTBM(self, f);
+				}
+			} else if (ground->isComplex()) {
+				ground->serializeItemNode_OTBM(self, f);
+			} else {
+				f.addByte(OTBM_ATTR_ITEM);
+				ground->serializeItemCompact_OTBM(self, f);
+			}
+		}
+
+		for (Item* item : save_tile->items) {
+			if (!item->isMetaItem()) {
+				item->serializeItemNode_OTBM(self, f);
+			}
+		}
+
+		f.endNode();
+	}
+
+	// Only close the last node if one has actually been created
+	if (!first) {
+		f.endNode();
+	}
+}
+
 bool IOMapOTBM::saveSpawns(Map& map, const FileName& dir) {
 	wxString filepath = dir.GetPath(wxPATH_GET_SEPARATOR | wxPATH_GET_VOLUME);
 	filepath += wxString(map.spawnfile.c_str(), wxConvUTF8);
@@ -19,6 +19,7 @@
 #define RME_OTBM_MAP_IO_H_
 
 #include "iomap.h"
+#include "position.h"
 
 // Pragma pack is VERY important since otherwise it won't be able to load the structs correctly
 #pragma pack(1)
@@ -123,6 +124,29 @@ struct OTBM_HouseTile_coords {
 
 #pragma pack()
 
+// The tiles of one OTBM_TILE_AREA node, decoded but not yet placed on a map
+struct OTBM_TileAreaBatch {
+	OTBM_TileAreaBatch() = default;
+	OTBM_TileAreaBatch(const OTBM_TileAreaBatch&) = delete;
+	OTBM_TileAreaBatch& operator=(const OTBM_TileAreaBatch&) = delete;
+	~OTBM_TileAreaBatch();
+
+	struct Entry {
+		Position pos;
+		// nullptr if the tile was discarded while it was being decoded
+		Tile* tile;
+		uint32_t house_id;
+	};
+
+	std::vector<Entry> tiles;
+	wxArrayString warnings;
+	// Base coordinate of the area, -1 if it couldn't be read
+	int base_x = -1;
+	int base_y = -1;
+	// File position after the area, used for progress
+	size_t offset = 0;
+};
+
 class IOMapOTBM : public IOMap {
 public:
 	IOMapOTBM(MapVersion ver) {
@@ -139,6 +163,12 @@ protected:
 	static bool getVersionInfo(NodeFileReadHandle* f, MapVersion& out_ver);
 
 	virtual bool loadMap(Map& map, NodeFileReadHandle& handle);
+	// Decodes the tiles of a tile area node whose type byte has been read,
+	// does not touch the map so it is safe to call from worker threads
+	void decodeTileArea(BinaryNode* mapNode, OTBM_TileAreaBatch& batch) const;
+	void decodeTileArea(const uint8_t* raw, size_t raw_size, OTBM_TileAreaBatch& batch) const;
+	// Returns false if anything in the area had to be discarded or warned about
+	bool mergeTileArea(Map& map, OTBM_TileAreaBatch& batch);
 	bool loadSpawns(Map& map, const FileName& dir);
 	bool loadSpawns(Map& map, pugi::xml_document& doc);
 	bool loadHouses(Map& map, const FileName& dir);
@@ -147,6 +177,9 @@ protected:
 	bool loadWaypoints(Map& map, pugi::xml_document& doc);
 
 	virtual bool saveMap(Map& map, NodeFileWriteHandle& handle);
+	// Writes the tiles as OTBM_TILE_AREA nodes, starting a new node whenever
+	// a tile is outside the area of the previous one
+	void serializeTileAreas(const std::vector<Tile*>& tiles, NodeFileWriteHandle& f) const;
 	bool saveSpawns(Map& map, const FileName& dir);
 	bool saveSpawns(Map& map, pugi::xml_document& doc);
 	bool saveHouses(Map& map, const FileName& dir);
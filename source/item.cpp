@@ -30,6 +30,8 @@
 #include "table_brush.h"
 #include "wall_brush.h"
 
+#include <typeinfo>
+
 Item* Item::Create(uint16_t _type, uint16_t _subtype /*= 0xFFFF*/) {
 	if (_type == 0) {
 		return nullptr;
@@ -87,13 +89,15 @@ Item* Item::deepCopy() const {
 	Item* copy = Create(id, subtype);
 	if (copy) {
 		copy->selected = selected;
-		if (attributes) {
-			copy->attributes = newd ItemAttributeMap(*attributes);
-		}
+		copy->attributes = attributes;
 	}
 	return copy;
 }
 
+bool Item::isSameAs(const Item& other) const {
+	return typeid(*this) == typeid(other) && id == other.id && subtype == other.subtype && selected == other.selected && hasSameAttributes(other);
+}
+
 Item* transformItem(Item* old_item, uint16_t new_id, Tile* parent) {
 	if (old_item == nullptr) {
 		return nullptr;
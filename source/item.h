@@ -91,6 +91,8 @@ public:
 
 	// Deep copy thingy
 	virtual Item* deepCopy() const;
+	// True if other would be a deep copy of this item, selection included
+	virtual bool isSameAs(const Item& other) const;
 
 	// Get memory footprint size
 	uint32_t memsize() const;
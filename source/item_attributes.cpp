@@ -20,15 +20,13 @@
 #include "item_attributes.h"
 #include "filehandle.h"
 
-ItemAttributes::ItemAttributes() :
-	attributes(nullptr) {
+ItemAttributes::ItemAttributes() {
 	////
 }
 
-ItemAttributes::ItemAttributes(const ItemAttributes& o) {
-	if (o.attributes) {
-		attributes = newd ItemAttributeMap(*o.attributes);
-	}
+ItemAttributes::ItemAttributes(const ItemAttributes& o) :
+	attributes(o.attributes) {
+	////
 }
 
 ItemAttributes::~ItemAttributes() {
@@ -37,15 +35,14 @@ ItemAttributes::~ItemAttributes() {
 
 void ItemAttributes::createAttributes() {
 	if (!attributes) {
-		attributes = newd ItemAttributeMap;
+		attributes = std::make_shared<ItemAttributeMap>();
+	} else if (attributes.use_count() > 1) {
+		attributes = std::make_shared<ItemAttributeMap>(*attributes);
 	}
 }
 
 void ItemAttributes::clearAllAttributes() {
-	if (attributes) {
-		delete attributes;
-	}
-	attributes = nullptr;
+	attributes.reset();
 }
 
 ItemAttributeMap ItemAttributes::getAttributes() const {
@@ -55,6 +52,18 @@ ItemAttributeMap ItemAttributes::getAttributes() const {
 	return ItemAttributeMap();
 }
 
+bool ItemAttributes::hasSameAttributes(const ItemAttributes& other) const {
+	if (attributes == other.attributes) {
+		return true;
+	}
+	const bool empty = !attributes || attributes->empty();
+	const bool other_empty = !other.attributes || other.attributes->empty();
+	if (empty || other_empty) {
+		return empty == other_empty;
+	}
+	return *attributes == *other.attributes;
+}
+
 void ItemAttributes::setAttribute(const std::string& key, const ItemAttribute& value) {
 	createAttributes();
 	(*attributes)[key] = value;
@@ -81,15 +90,12 @@ void ItemAttributes::setAttribute(const std::string& key, bool value) {
 }
 
 void ItemAttributes::eraseAttribute(const std::string& key) {
-	if (!attributes) {
+	if (!attributes || attributes->find(key) == attributes->end()) {
 		return;
 	}
 
-	ItemAttributeMap::iterator iter = attributes->find(key);
-
-	if (iter != attributes->end()) {
-		attributes->erase(iter);
-	}
+	createAttributes();
+	attributes->erase(key);
 }
 
 const std::string* ItemAttributes::getStringAttribute(const std::string& key) const {
@@ -217,6 +223,25 @@ ItemAttribute::~ItemAttribute() {
 	clear();
 }
 
+bool ItemAttribute::operator==(const ItemAttribute& o) const {
+	if (type != o.type) {
+		return false;
+	}
+
+	if (type == STRING) {
+		return *reinterpret_cast<const std::string*>(&data) == *reinterpret_cast<const std::string*>(&o.data);
+	} else if (type == INTEGER) {
+		return *reinterpret_cast<const int32_t*>(&data) == *reinterpret_cast<const int32_t*>(&o.data);
+	} else if (type == FLOAT) {
+		return *reinterpret_cast<const float*>(&data) == *reinterpret_cast<const float*>(&o.data);
+	} else if (type == DOUBLE) {
+		return *reinterpret_cast<const double*>(&data) == *reinterpret_cast<const double*>(&o.data);
+	} else if (type == BOOLEAN) {
+		return *reinterpret_cast<const bool*>(&data) == *reinterpret_cast<const bool*>(&o.data);
+	}
+	return true;
+}
+
 void ItemAttribute::clear() {
 	if (type == STRING) {
 		(reinterpret_cast<std::string*>(&data))->~basic_string();
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <map>
+#include <memory>
 
 #include "filehandle.h"
 
@@ -42,6 +43,11 @@ public:
 	ItemAttribute& operator=(const ItemAttribute& o);
 	~ItemAttribute();
 
+	bool operator==(const ItemAttribute& o) const;
+	bool operator!=(const ItemAttribute& o) const {
+		return !(*this == o);
+	}
+
 	enum Type {
 		STRING = 1,
 		INTEGER = 2,
@@ -105,10 +111,13 @@ public:
 
 	void clearAllAttributes();
 	ItemAttributeMap getAttributes() const;
+	bool hasSameAttributes(const ItemAttributes& other) const;
 
 protected:
-	ItemAttributeMap* attributes;
+	// Copies of an item share the map until one of them writes to it
+	std::shared_ptr<ItemAttributeMap> attributes;
 
+	// Makes sure this item has a map of its own to write to
 	void createAttributes();
 };
 
@@ -39,30 +39,44 @@ void LightDrawer::draw(int map_x, int map_y, int end_x, int end_y, int scroll_x,
 
 	buffer.resize(static_cast<size_t>(w * h * PixelFormatRGBA));
 
-	for (int x = 0; x < w; ++x) {
-		for (int y = 0; y < h; ++y) {
-			int mx = (map_x + x);
-			int my = (map_y + y);
-			int index = (y * w + x);
-			int color_index = index * PixelFormatRGBA;
-
-			buffer[color_index] = global_color.Red();
-			buffer[color_index + 1] = global_color.Green();
-			buffer[color_index + 2] = global_color.Blue();
-			buffer[color_index + 3] = 140; // global_color.Alpha();
-
-			for (auto& light : lights) {
-				float intensity = calculateIntensity(mx, my, light);
+	for (int index = 0; index < w * h; ++index) {
+		int color_index = index * PixelFormatRGBA;
+		buffer[color_index] = global_color.Red();
+		buffer[color_index + 1] = global_color.Green();
+		buffer[color_index + 2] = global_color.Blue();
+		buffer[color_index + 3] = 140; // global_color.Alpha();
+	}
+
+	// Every light only touches the tiles it can reach, the brightest light
+	// wins on every channel so the order they are added in does not matter
+	for (auto& light : lights) {
+		const int radius = light.intensity;
+		const int start_x = std::max(light.map_x - radius, map_x);
+		const int start_y = std::max(light.map_y - radius, map_y);
+		const int stop_x = std::min(light.map_x + radius + 1, end_x);
+		const int stop_y = std::min(light.map_y + radius + 1, end_y);
+		if (start_x >= stop_x || start_y >= stop_y) {
+			continue;
+		}
+
+		const std::vector<float>& falloff = getFalloff(radius);
+		const int side = radius * 2 + 1;
+		const wxColor light_color = colorFromEightBit(light.color);
+
+		for (int my = start_y; my < stop_y; ++my) {
+			const float* row = &falloff[(my - light.map_y + radius) * side + start_x - light.map_x + radius];
+			uint8_t* pixel = &buffer[((my - map_y) * w + start_x - map_x) * PixelFormatRGBA];
+			for (int mx = start_x; mx < stop_x; ++mx, ++row, pixel += PixelFormatRGBA) {
+				float intensity = *row;
 				if (intensity == 0.f) {
 					continue;
 				}
-				wxColor light_color = colorFromEightBit(light.color);
 				uint8_t red = static_cast<uint8_t>(light_color.Red() * intensity);
 				uint8_t green = static_cast<uint8_t>(light_color.Green() * intensity);
 				uint8_t blue = static_cast<uint8_t>(light_color.Blue() * intensity);
-				buffer[color_index] = std::max(buffer[color_index], red);
-				buffer[color_index + 1] = std::max(buffer[color_index + 1], green);
-				buffer[color_index + 2] = std::max(buffer[color_index + 2], blue);
+				pixel[0] = std::max(pixel[0], red);
+				pixel[1] = std::max(pixel[1], green);
+				pixel[2] = std::max(pixel[2], blue);
 			}
 		}
 	}
@@ -111,6 +125,22 @@ void LightDrawer::draw(int map_x, int map_y, int end_x, int end_y, int scroll_x,
 	}
 }
 
+const std::vector<float>& LightDrawer::getFalloff(int light_intensity) {
+	static const std::vector<std::vector<float>> falloffs = [] {
+		std::vector<std::vector<float>> tables(MaxLightIntensity + 1);
+		for (int radius = 0; radius <= MaxLightIntensity; ++radius) {
+			std::vector<float>& table = tables[radius];
+			for (int dy = -radius; dy <= radius; ++dy) {
+				for (int dx = -radius; dx <= radius; ++dx) {
+					table.push_back(calculateIntensity(dx, dy, radius));
+				}
+			}
+		}
+		return tables;
+	}();
+	return falloffs[light_intensity];
+}
+
 void LightDrawer::setGlobalLightColor(uint8_t color) {
 	global_color = colorFromEightBit(color);
 }
@@ -43,20 +43,23 @@ private:
 	void createGLTexture();
 	void unloadGLTexture();
 
-	inline float calculateIntensity(int map_x, int map_y, const Light& light) {
-		int dx = map_x - light.map_x;
-		int dy = map_y - light.map_y;
+	// Strength of a light at a tile dx, dy away from it
+	static inline float calculateIntensity(int dx, int dy, int light_intensity) {
 		float distance = std::sqrt(dx * dx + dy * dy);
 		if (distance > MaxLightIntensity) {
 			return 0.f;
 		}
-		float intensity = (-distance + light.intensity) * 0.2f;
+		float intensity = (-distance + light_intensity) * 0.2f;
 		if (intensity < 0.01f) {
 			return 0.f;
 		}
 		return std::min(intensity, 1.f);
 	}
 
+	// calculateIntensity over the square of tiles a light of the given
+	// intensity can reach, row by row with the light in the middle
+	static const std::vector<float>& getFalloff(int light_intensity);
+
 	GLuint texture;
 	std::vector<Light> lights;
 	std::vector<uint8_t> buffer;
@@ -36,6 +36,7 @@
 #include "materials.h"
 #include "live_client.h"
 #include "live_server.h"
+#include "map_image_export.h"
 
 BEGIN_EVENT_TABLE(MainMenuBar, wxEvtHandler)
 END_EVENT_TABLE()
@@ -61,6 +62,7 @@ MainMenuBar::MainMenuBar(MainFrame* frame) :
 	MAKE_ACTION(IMPORT_MONSTERS, wxITEM_NORMAL, OnImportMonsterData);
 	MAKE_ACTION(IMPORT_MINIMAP, wxITEM_NORMAL, OnImportMinimap);
 	MAKE_ACTION(EXPORT_MINIMAP, wxITEM_NORMAL, OnExportMinimap);
+	MAKE_ACTION(EXPORT_MAP_IMAGE, wxITEM_NORMAL, OnExportMapImage);
 	MAKE_ACTION(EXPORT_TILESETS, wxITEM_NORMAL, OnExportTilesets);
 
 	MAKE_ACTION(RELOAD_DATA, wxITEM_NORMAL, OnReloadDataFiles);
@@ -332,6 +334,7 @@ void MainMenuBar::Update() {
 	EnableItem(IMPORT_MONSTERS, is_local);
 	EnableItem(IMPORT_MINIMAP, false);
 	EnableItem(EXPORT_MINIMAP, is_local);
+	EnableItem(EXPORT_MAP_IMAGE, is_local);
 	EnableItem(EXPORT_TILESETS, loaded);
 
 	EnableItem(FIND_ITEM, is_host);
@@ -797,6 +800,25 @@ void MainMenuBar::OnExportMinimap(wxCommandEvent& WXUNUSED(event)) {
 	}
 }
 
+void MainMenuBar::OnExportMapImage(wxCommandEvent& WXUNUSED(event)) {
+	Editor* editor = g_gui.GetCurrentEditor();
+	MapTab* tab = g_gui.GetCurrentMapTab();
+	if (!editor || !tab) {
+		return;
+	}
+
+	wxFileDialog dlg(frame, "Export map image", "", "", "PNG files (*.png)|*.png", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+	if (dlg.ShowModal() != wxID_OK) {
+		return;
+	}
+
+	MapImageExporter exporter(*editor, tab->GetCanvas());
+	if (!exporter.exportFloor(FileName(dlg.GetPath()), g_gui.GetCurrentFloor(), true)) {
+		g_gui.PopupDialog("Error", exporter.getError(), wxOK);
+	}
+	tab->GetCanvas()->Refresh();
+}
+
 void MainMenuBar::OnExportTilesets(wxCommandEvent& WXUNUSED(event)) {
 	if (g_gui.GetCurrentEditor()) {
 		ExportTilesetsWindow dlg(frame, *g_gui.GetCurrentEditor());
@@ -1684,6 +1706,7 @@ void MainMenuBar::OnMapCleanup(wxCommandEvent& WXUNUSED(event)) {
 	int ok = g_gui.PopupDialog("Clean map", "Do you want to remove all invalid items from the map?", wxYES | wxNO);
 
 	if (ok == wxID_YES) {
+		g_gui.GetCurrentEditor()->actionQueue->clear();
 		g_gui.GetCurrentMap().cleanInvalidTiles(true);
 	}
 }
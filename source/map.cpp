@@ -149,6 +149,9 @@ bool Map::convert(const ConversionMap& rm, bool showdialog) {
 	uint64_t tiles_done = 0;
 	std::vector<uint16_t> id_list;
 
+	// Tiles are changed in place, no block can be reused as it was
+	tilesChanged();
+
 	// std::ofstream conversions("converted_items.txt");
 
 	for (MapIterator miter = begin(); miter != end(); ++miter) {
@@ -295,6 +298,7 @@ void Map::cleanInvalidTiles(bool showdialog) {
 			} else {
 				delete *item_iter;
 				item_iter = tile->items.erase(item_iter);
+				tileChanged(tile->getPosition());
 			}
 		}
 
@@ -323,6 +327,7 @@ void Map::convertHouseTiles(uint32_t fromId, uint32_t toId) {
 		}
 
 		tile->setHouseID(toId);
+		tileChanged(tile->getPosition());
 		++tiles_done;
 		if (tiles_done % 0x10000 == 0) {
 			g_gui.SetLoadDone(int(tiles_done / double(getTileCount()) * 100.0));
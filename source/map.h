@@ -265,6 +265,7 @@ inline int64_t RemoveItemOnMap(Map& map, RemoveIfType& condition, bool selectedO
 			if (condition(map, tile->ground, removed, done)) {
 				delete tile->ground;
 				tile->ground = nullptr;
+				map.tileChanged(tile->getPosition());
 				++removed;
 			}
 		}
@@ -274,6 +275,7 @@ inline int64_t RemoveItemOnMap(Map& map, RemoveIfType& condition, bool selectedO
 			if (condition(map, item, removed, done)) {
 				iit = tile->items.erase(iit);
 				delete item;
+				map.tileChanged(tile->getPosition());
 				++removed;
 			} else {
 				++iit;
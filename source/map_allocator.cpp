@@ -0,0 +1,213 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#include "main.h"
+
+#include "map_allocator.h"
+
+#include <mutex>
+#include <new>
+
+// Blocks are handed out in steps of this size, which also keeps them aligned
+static constexpr size_t granularity = 16;
+// Anything bigger than this goes straight to the heap
+static constexpr size_t max_block_size = 1024;
+// Slabs are aligned to their size, the owner of a block is found by masking its address
+static constexpr size_t slab_size = 128 * 1024;
+// Floors and tree nodes of one map are packed into slabs of this size
+static constexpr size_t structure_slab_size = 256 * 1024;
+
+class MapSlabPool {
+public:
+	MapSlabPool(size_t block_size) :
+		block_size(block_size),
+		partial(nullptr),
+		spare(nullptr) {
+		////
+	}
+
+	void* allocate() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Slab* slab = partial;
+		if (!slab) {
+			slab = createSlab();
+			link(slab);
+		}
+		if (slab == spare) {
+			spare = nullptr;
+		}
+
+		void* ptr;
+		if (slab->free_list) {
+			ptr = slab->free_list;
+			slab->free_list = *static_cast<void**>(ptr);
+		} else {
+			ptr = slab->unused;
+			slab->unused += block_size;
+		}
+		++slab->used;
+
+		if (isFull(slab)) {
+			unlink(slab);
+		}
+		return ptr;
+	}
+
+	void deallocate(void* ptr) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(slab_size - 1));
+		if (isFull(slab)) {
+			link(slab);
+		}
+
+		*static_cast<void**>(ptr) = slab->free_list;
+		slab->free_list = ptr;
+		if (--slab->used != 0) {
+			return;
+		}
+
+		// Keep one empty slab around so a tile swapped back and forth
+		// doesn't allocate and release a slab every time
+		if (!spare) {
+			spare = slab;
+		} else {
+			unlink(slab);
+			::operator delete(slab, std::align_val_t(slab_size));
+		}
+	}
+
+private:
+	struct Slab {
+		Slab* prev;
+		Slab* next;
+		void* free_list;
+		// Start of the part of the slab that has never been handed out
+		uint8_t* unused;
+		size_t used;
+	};
+
+	// First block of a slab, the header is padded to keep blocks aligned
+	static size_t firstBlock() {
+		return (sizeof(Slab) + granularity - 1) & ~(granularity - 1);
+	}
+
+	Slab* createSlab() {
+		void* memory = ::operator new(slab_size, std::align_val_t(slab_size));
+		Slab* slab = static_cast<Slab*>(memory);
+		slab->prev = nullptr;
+		slab->next = nullptr;
+		slab->free_list = nullptr;
+		slab->unused = static_cast<uint8_t*>(memory) + firstBlock();
+		slab->used = 0;
+		return slab;
+	}
+
+	bool isFull(const Slab* slab) const {
+		return !slab->free_list && slab->unused + block_size > reinterpret_cast<const uint8_t*>(slab) + slab_size;
+	}
+
+	// Slabs with room left are kept in the partial list
+	void link(Slab* slab) {
+		slab->prev = nullptr;
+		slab->next = partial;
+		if (partial) {
+			partial->prev = slab;
+		}
+		partial = slab;
+	}
+
+	void unlink(Slab* slab) {
+		if (slab->prev) {
+			slab->prev->next = slab->next;
+		} else {
+			partial = slab->next;
+		}
+		if (slab->next) {
+			slab->next->prev = slab->prev;
+		}
+		slab->prev = nullptr;
+		slab->next = nullptr;
+	}
+
+	const size_t block_size;
+	Slab* partial;
+	Slab* spare;
+	std::mutex mutex;
+};
+
+static MapSlabPool& getPool(size_t size) {
+	// Never destroyed, tiles may still be freed while the program exits
+	static MapSlabPool* pools = []() {
+		const size_t count = max_block_size / granularity;
+		MapSlabPool* pools = static_cast<MapSlabPool*>(::operator new(sizeof(MapSlabPool) * count));
+		for (size_t i = 0; i < count; ++i) {
+			new (&pools[i]) MapSlabPool((i + 1) * granularity);
+		}
+		return pools;
+	}();
+	return pools[(size + granularity - 1) / granularity - 1];
+}
+
+void* MapAllocator::allocate(size_t size) {
+	if (size == 0 || size > max_block_size) {
+		return ::operator new(size);
+	}
+	return getPool(size).allocate();
+}
+
+void MapAllocator::deallocate(void* ptr, size_t size) {
+	if (!ptr) {
+		return;
+	}
+	if (size == 0 || size > max_block_size) {
+		::operator delete(ptr);
+		return;
+	}
+	getPool(size).deallocate(ptr);
+}
+
+MapAllocator::MapAllocator() :
+	structure_next(nullptr),
+	structure_end(nullptr) {
+	////
+}
+
+MapAllocator::~MapAllocator() {
+	for (void* slab : structure_slabs) {
+		::operator delete(slab);
+	}
+}
+
+void* MapAllocator::allocateStructure(size_t size) {
+	size = (size + granularity - 1) & ~(granularity - 1);
+	if (structure_next + size > structure_end) {
+		uint8_t* slab = static_cast<uint8_t*>(::operator new(structure_slab_size));
+		structure_slabs.push_back(slab);
+		structure_next = slab;
+		structure_end = slab + structure_slab_size;
+	}
+	void* ptr = structure_next;
+	structure_next += size;
+	return ptr;
+}
+
+size_t MapAllocator::getStructureMemory() const {
+	return structure_slabs.size() * structure_slab_size;
+}
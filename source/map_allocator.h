@@ -21,13 +21,26 @@
 #include "tile.h"
 #include "map_region.h"
 
+#include <new>
+#include <vector>
+
 class BaseMap;
 
 class MapAllocator {
 
 public:
-	MapAllocator() { }
-	~MapAllocator() { }
+	MapAllocator();
+	~MapAllocator();
+
+	MapAllocator(const MapAllocator&) = delete;
+	MapAllocator& operator=(const MapAllocator&) = delete;
+
+	// Raw memory for tiles. Blocks come from slabs shared by every map, one
+	// set per size class, and freed blocks are reused by the next allocation
+	// of that class. Slabs are returned to the heap once they are empty.
+	// Safe to call from several threads.
+	static void* allocate(size_t size);
+	static void deallocate(void* ptr, size_t size);
 
 	// shorthands for tiles
 	Tile* operator()(TileLocation* location) {
@@ -46,21 +59,27 @@ public:
 		delete t;
 	}
 
-	//
+	// Floors and tree nodes are never freed one by one, they stay until the
+	// map is destroyed. They are packed into slabs owned by this allocator,
+	// the destructor releases all of them at once. The owner has to destroy
+	// the objects first, see QTreeNode::~QTreeNode. Like the tree itself this
+	// is not thread safe.
 	Floor* allocateFloor(int x, int y, int z) {
-		return newd Floor(x, y, z);
-	}
-	void freeFloor(Floor* f) {
-		delete f;
+		return new (allocateStructure(sizeof(Floor))) Floor(x, y, z);
 	}
-
-	//
 	QTreeNode* allocateNode(BaseMap& map) {
-		return newd QTreeNode(map);
-	}
-	void freeNode(QTreeNode* qt) {
-		delete qt;
+		return new (allocateStructure(sizeof(QTreeNode))) QTreeNode(map);
 	}
+
+	// Bytes held for floors and tree nodes
+	size_t getStructureMemory() const;
+
+private:
+	void* allocateStructure(size_t size);
+
+	std::vector<void*> structure_slabs;
+	uint8_t* structure_next;
+	uint8_t* structure_end;
 };
 
 #endif
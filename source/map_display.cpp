@@ -221,6 +221,7 @@ void MapCanvas::OnPaint(wxPaintEvent& event) {
 			options.show_preview = g_settings.getBoolean(Config::SHOW_PREVIEW);
 			options.show_hooks = g_settings.getBoolean(Config::SHOW_WALL_HOOKS);
 			options.hide_items_when_zoomed = g_settings.getBoolean(Config::HIDE_ITEMS_WHEN_ZOOMED);
+			options.batch_sprites = g_settings.getBoolean(Config::USE_SPRITE_BATCHING);
 			options.show_towns = g_settings.getBoolean(Config::SHOW_TOWNS);
 			options.always_show_zones = g_settings.getBoolean(Config::ALWAYS_SHOW_ZONES);
 			options.extended_house_shader = g_settings.getBoolean(Config::EXT_HOUSE_SHADER);
@@ -236,6 +237,10 @@ void MapCanvas::OnPaint(wxPaintEvent& event) {
 			animation_timer->Stop();
 		}
 
+		// Screenshots are read back right away, they can't show placeholders
+		g_gui.gfx.setSynchronousDecoding(screenshot_buffer != nullptr);
+		g_gui.gfx.uploadDecodedSprites();
+
 		drawer->SetupVars();
 		drawer->SetupGL();
 		drawer->Draw();
@@ -245,6 +250,7 @@ void MapCanvas::OnPaint(wxPaintEvent& event) {
 		}
 
 		drawer->Release();
+		g_gui.gfx.setSynchronousDecoding(false);
 	}
 
 	// Clean unused textures
@@ -915,6 +921,33 @@ void MapCanvas::OnMouseActionClick(wxMouseEvent& event) {
 	g_gui.UpdateMinimap();
 }
 
+void MapCanvas::SelectBoundingBox(int start_x, int start_y, int end_x, int end_y) {
+	const bool compensate = g_settings.getInteger(Config::COMPENSATED_SELECT) != 0;
+	const int offset = (compensate && floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
+
+	int start_z = floor;
+	switch (g_settings.getInteger(Config::SELECTION_TYPE)) {
+		case SELECT_CURRENT_FLOOR: {
+			editor.selection.addArea(Position(start_x, start_y, floor), Position(end_x, end_y, floor), false);
+			return;
+		}
+		case SELECT_ALL_FLOORS: {
+			start_z = MAP_MAX_LAYER;
+			break;
+		}
+		case SELECT_VISIBLE_FLOORS: {
+			if (floor <= GROUND_LAYER) {
+				start_z = GROUND_LAYER;
+			} else {
+				start_z = std::min(MAP_MAX_LAYER, floor + 2);
+			}
+			break;
+		}
+	}
+
+	editor.selection.addArea(Position(start_x - offset, start_y - offset, start_z), Position(end_x - offset, end_y - offset, floor), compensate);
+}
+
 void MapCanvas::OnMouseActionRelease(wxMouseEvent& event) {
 	int mouse_map_x, mouse_map_y;
 	ScreenToMap(event.GetX(), event.GetY(), &mouse_map_x, &mouse_map_y);
@@ -954,101 +987,8 @@ void MapCanvas::OnMouseActionRelease(wxMouseEvent& event) {
 						last_click_map_y = tmp;
 					}
 
-					int numtiles = 0;
-					int threadcount = std::max(g_settings.getInteger(Config::WORKER_THREADS), 1);
-
-					int start_x = 0, start_y = 0, start_z = 0;
-					int end_x = 0, end_y = 0, end_z = 0;
-
-					switch (g_settings.getInteger(Config::SELECTION_TYPE)) {
-						case SELECT_CURRENT_FLOOR: {
-							start_z = end_z = floor;
-							start_x = last_click_map_x;
-							start_y = last_click_map_y;
-							end_x = mouse_map_x;
-							end_y = mouse_map_y;
-							break;
-						}
-						case SELECT_ALL_FLOORS: {
-							start_x = last_click_map_x;
-							start_y = last_click_map_y;
-							start_z = MAP_MAX_LAYER;
-							end_x = mouse_map_x;
-							end_y = mouse_map_y;
-							end_z = floor;
-
-							if (g_settings.getInteger(Config::COMPENSATED_SELECT)) {
-								start_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-								start_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-
-								end_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-								end_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-							}
-
-							numtiles = (start_z - end_z) * (end_x - start_x) * (end_y - start_y);
-							break;
-						}
-						case SELECT_VISIBLE_FLOORS: {
-							start_x = last_click_map_x;
-							start_y = last_click_map_y;
-							if (floor <= GROUND_LAYER) {
-								start_z = GROUND_LAYER;
-							} else {
-								start_z = std::min(MAP_MAX_LAYER, floor + 2);
-							}
-							end_x = mouse_map_x;
-							end_y = mouse_map_y;
-							end_z = floor;
-
-							if (g_settings.getInteger(Config::COMPENSATED_SELECT)) {
-								start_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-								start_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-
-								end_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-								end_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-							}
-							break;
-						}
-					}
-
-					if (numtiles < 500) {
-						// No point in threading for such a small set.
-						threadcount = 1;
-					}
-					// Subdivide the selection area
-					// We know it's a square, just split it into several areas
-					int width = end_x - start_x;
-					if (width < threadcount) {
-						threadcount = min(1, width);
-					}
-					// Let's divide!
-					int remainder = width;
-					int cleared = 0;
-					std::vector<SelectionThread*> threads;
-					if (width == 0) {
-						threads.push_back(newd SelectionThread(editor, Position(start_x, start_y, start_z), Position(start_x, end_y, end_z)));
-					} else {
-						for (int i = 0; i < threadcount; ++i) {
-							int chunksize = width / threadcount;
-							// The last threads takes all the remainder
-							if (i == threadcount - 1) {
-								chunksize = remainder;
-							}
-							threads.push_back(newd SelectionThread(editor, Position(start_x + cleared, start_y, start_z), Position(start_x + cleared + chunksize, end_y, end_z)));
-							cleared += chunksize;
-							remainder -= chunksize;
-						}
-					}
-					ASSERT(cleared == width);
-					ASSERT(remainder == 0);
-
 					editor.selection.start(); // Start a selection session
-					for (std::vector<SelectionThread*>::iterator iter = threads.begin(); iter != threads.end(); ++iter) {
-						(*iter)->Execute();
-					}
-					for (std::vector<SelectionThread*>::iterator iter = threads.begin(); iter != threads.end(); ++iter) {
-						editor.selection.join(*iter);
-					}
+					SelectBoundingBox(last_click_map_x, last_click_map_y, mouse_map_x, mouse_map_y);
 					editor.selection.finish(); // Finish the selection session
 					editor.selection.updateSelectionCount();
 				}
@@ -1337,100 +1277,7 @@ void MapCanvas::OnMousePropertiesRelease(wxMouseEvent& event) {
 			}
 
 			editor.selection.start(); // Start a selection session
-			switch (g_settings.getInteger(Config::SELECTION_TYPE)) {
-				case SELECT_CURRENT_FLOOR: {
-					for (int x = last_click_map_x; x <= mouse_map_x; x++) {
-						for (int y = last_click_map_y; y <= mouse_map_y; y++) {
-							Tile* tile = editor.map.getTile(x, y, floor);
-							if (!tile) {
-								continue;
-							}
-							editor.selection.add(tile);
-						}
-					}
-					break;
-				}
-				case SELECT_ALL_FLOORS: {
-					int start_x, start_y, start_z;
-					int end_x, end_y, end_z;
-
-					start_x = last_click_map_x;
-					start_y = last_click_map_y;
-					start_z = MAP_MAX_LAYER;
-					end_x = mouse_map_x;
-					end_y = mouse_map_y;
-					end_z = floor;
-
-					if (g_settings.getInteger(Config::COMPENSATED_SELECT)) {
-						start_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-						start_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-
-						end_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-						end_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-					}
-
-					for (int z = start_z; z >= end_z; z--) {
-						for (int x = start_x; x <= end_x; x++) {
-							for (int y = start_y; y <= end_y; y++) {
-								Tile* tile = editor.map.getTile(x, y, z);
-								if (!tile) {
-									continue;
-								}
-								editor.selection.add(tile);
-							}
-						}
-						if (z <= GROUND_LAYER && g_settings.getInteger(Config::COMPENSATED_SELECT)) {
-							start_x++;
-							start_y++;
-							end_x++;
-							end_y++;
-						}
-					}
-					break;
-				}
-				case SELECT_VISIBLE_FLOORS: {
-					int start_x, start_y, start_z;
-					int end_x, end_y, end_z;
-
-					start_x = last_click_map_x;
-					start_y = last_click_map_y;
-					if (floor <= GROUND_LAYER) {
-						start_z = GROUND_LAYER;
-					} else {
-						start_z = std::min(MAP_MAX_LAYER, floor + 2);
-					}
-					end_x = mouse_map_x;
-					end_y = mouse_map_y;
-					end_z = floor;
-
-					if (g_settings.getInteger(Config::COMPENSATED_SELECT)) {
-						start_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-						start_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-
-						end_x -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-						end_y -= (floor < GROUND_LAYER ? GROUND_LAYER - floor : 0);
-					}
-
-					for (int z = start_z; z >= end_z; z--) {
-						for (int x = start_x; x <= end_x; x++) {
-							for (int y = start_y; y <= end_y; y++) {
-								Tile* tile = editor.map.getTile(x, y, z);
-								if (!tile) {
-									continue;
-								}
-								editor.selection.add(tile);
-							}
-						}
-						if (z <= GROUND_LAYER && g_settings.getInteger(Config::COMPENSATED_SELECT)) {
-							start_x++;
-							start_y++;
-							end_x++;
-							end_y++;
-						}
-					}
-					break;
-				}
-			}
+			SelectBoundingBox(last_click_map_x, last_click_map_y, mouse_map_x, mouse_map_y);
 			editor.selection.finish(); // Finish the selection session
 			editor.selection.updateSelectionCount();
 		}
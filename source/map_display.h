@@ -125,6 +125,8 @@ public:
 protected:
 	void getTilesToDraw(int mouse_map_x, int mouse_map_y, int floor, PositionVector* tilestodraw, PositionVector* tilestoborder, bool fill = false);
 	bool floodFill(Map* map, const Position& center, int x, int y, GroundBrush* brush, PositionVector* positions);
+	// Adds the box between the corners to the selection, on the floors SELECTION_TYPE asks for
+	void SelectBoundingBox(int start_x, int start_y, int end_x, int end_y);
 
 private:
 	enum {
@@ -43,6 +43,7 @@
 #include "table_brush.h"
 #include "waypoint_brush.h"
 #include "light_drawer.h"
+#include "sprite_batch.h"
 
 DrawingOptions::DrawingOptions() {
 	SetDefault();
@@ -78,6 +79,7 @@ void DrawingOptions::SetDefault() {
 	show_preview = false;
 	show_hooks = false;
 	hide_items_when_zoomed = true;
+	batch_sprites = true;
 }
 
 void DrawingOptions::SetIngame() {
@@ -117,8 +119,9 @@ bool DrawingOptions::isDrawLight() const noexcept {
 }
 
 MapDrawer::MapDrawer(MapCanvas* canvas) :
-	canvas(canvas), editor(canvas->editor) {
+	canvas(canvas), editor(canvas->editor), draw_cache_key(), draw_frame(0), recording(nullptr) {
 	light_drawer = std::make_shared<LightDrawer>();
+	batch = std::make_shared<SpriteBatch>();
 }
 
 MapDrawer::~MapDrawer() {
@@ -133,8 +136,28 @@ void MapDrawer::SetupVars() {
 	dragging_draw = canvas->dragging_draw;
 
 	zoom = (float)canvas->GetZoom();
-	tile_size = int(TileSize / zoom); // after zoom
 	floor = canvas->GetFloor();
+	SetupRange();
+}
+
+void MapDrawer::SetupVars(int scroll_x, int scroll_y, int width, int height, int new_floor) {
+	mouse_map_x = 0;
+	mouse_map_y = 0;
+	view_scroll_x = scroll_x;
+	view_scroll_y = scroll_y;
+	screensize_x = width;
+	screensize_y = height;
+
+	dragging = false;
+	dragging_draw = false;
+
+	zoom = 1.0f;
+	floor = new_floor;
+	SetupRange();
+}
+
+void MapDrawer::SetupRange() {
+	tile_size = int(TileSize / zoom); // after zoom
 
 	if (options.show_all_floors) {
 		if (floor <= GROUND_LAYER) {
@@ -190,6 +213,9 @@ void MapDrawer::Release() {
 		light_drawer->clear();
 	}
 
+	FlushBatch();
+	g_gui.gfx.setSpriteBatch(nullptr);
+
 	// Disable 2D mode
 	glMatrixMode(GL_PROJECTION);
 	glPopMatrix();
@@ -200,18 +226,23 @@ void MapDrawer::Release() {
 void MapDrawer::Draw() {
 	DrawBackground();
 	DrawMap();
+	FlushBatch();
 	if (options.isDrawLight()) {
 		DrawLight();
 	}
 	DrawDraggingShadow();
+	FlushBatch();
 	DrawHigherFloors();
+	FlushBatch();
 	if (options.dragging) {
 		DrawSelectionBox();
 	}
 	DrawLiveCursors();
 	DrawBrush();
+	FlushBatch();
 	if (options.show_grid) {
 		DrawGrid();
+		FlushBatch();
 	}
 	if (options.show_ingame_box) {
 		DrawIngameBox();
@@ -221,6 +252,15 @@ void MapDrawer::Draw() {
 	}
 }
 
+void MapDrawer::DrawMapImage() {
+	DrawBackground();
+	DrawMap();
+	FlushBatch();
+	if (options.isDrawLight()) {
+		DrawLight();
+	}
+}
+
 void MapDrawer::DrawBackground() {
 	// Black Background
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -228,6 +268,10 @@ void MapDrawer::DrawBackground() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glLoadIdentity();
 
+	// Other canvases may have bound something else since the last frame
+	batch->invalidateBinding();
+	g_gui.gfx.setSpriteBatch(batch.get());
+
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glEnable(GL_BLEND);
 
@@ -235,6 +279,34 @@ void MapDrawer::DrawBackground() {
 	// glEnable(GL_ALPHA_TEST);
 }
 
+// Bumped by every drawer that animates items, the frames cached by the
+// other drawers are stale afterwards
+static uint32_t animation_epoch = 0;
+
+// Cached floors not drawn for this many frames are dropped
+static const uint32_t DRAW_CACHE_MAX_AGE = 64;
+
+static uint32_t getLocationSignature(Floor* floor) {
+	// These live on the locations and change without the tile being replaced
+	uint32_t signature = 2166136261u;
+	for (TileLocation& location : floor->locs) {
+		signature = (signature ^ uint32_t(location.getSpawnCount())) * 16777619u;
+		signature = (signature ^ uint32_t(location.getWaypointCount())) * 16777619u;
+		signature = (signature ^ uint32_t(location.getTownCount())) * 16777619u;
+		if (HouseExitList* exits = location.getHouseExits()) {
+			for (uint32_t house_id : *exits) {
+				signature = (signature ^ house_id) * 16777619u;
+			}
+		}
+		signature = (signature ^ 0xFFFFFFFF) * 16777619u;
+	}
+	return signature;
+}
+
+static bool isSameOutfit(const Outfit& a, const Outfit& b) {
+	return a.lookType == b.lookType && a.lookItem == b.lookItem && a.lookMount == b.lookMount && a.lookAddon == b.lookAddon && a.lookHead == b.lookHead && a.lookBody == b.lookBody && a.lookLegs == b.lookLegs && a.lookFeet == b.lookFeet && a.lookMountHead == b.lookMountHead && a.lookMountBody == b.lookMountBody && a.lookMountLegs == b.lookMountLegs && a.lookMountFeet == b.lookMountFeet;
+}
+
 inline int getFloorAdjustment(int floor) {
 	if (floor > GROUND_LAYER) { // Underground
 		return 0; // No adjustment
@@ -268,28 +340,41 @@ void MapDrawer::DrawMap() {
 
 	bool only_colors = options.show_as_minimap || options.show_only_colors;
 
+	bool animating = options.show_preview && zoom <= 2.0;
+	if (animating) {
+		++animation_epoch;
+	}
+
+	// Tooltips are collected while drawing and animations advance every frame,
+	// in those modes every tile is drawn like before
+	bool use_draw_cache = !live_client && !animating && !options.show_tooltips && !options.show_only_modified;
+	if (use_draw_cache) {
+		const DrawCacheKey key = getDrawCacheKey();
+		if (!(key == draw_cache_key)) {
+			draw_cache.clear();
+			draw_cache_key = key;
+		}
+		++draw_frame;
+	} else {
+		draw_cache.clear();
+	}
+
 	// Enable texture mode
 	if (!only_colors) {
-		glEnable(GL_TEXTURE_2D);
+		batch->setTexturing(true);
 	}
 
 	for (int map_z = start_z; map_z >= superend_z; map_z--) {
 		if (map_z == end_z && start_z != end_z && options.show_shade) {
 			// Draw shade
 			if (!only_colors) {
-				glDisable(GL_TEXTURE_2D);
+				batch->setTexturing(false);
 			}
 
-			glColor4ub(0, 0, 0, 128);
-			glBegin(GL_QUADS);
-			glVertex2f(0, int(screensize_y * zoom));
-			glVertex2f(int(screensize_x * zoom), int(screensize_y * zoom));
-			glVertex2f(int(screensize_x * zoom), 0);
-			glVertex2f(0, 0);
-			glEnd();
+			glBlitQuad(0, 0, int(screensize_x * zoom), int(screensize_y * zoom), 0, 0, 0, 128);
 
 			if (!only_colors) {
-				glEnable(GL_TEXTURE_2D);
+				batch->setTexturing(true);
 			}
 		}
 
@@ -312,10 +397,15 @@ void MapDrawer::DrawMap() {
 					}
 
 					if (!live_client || nd->isVisible(map_z > GROUND_LAYER)) {
+						if (use_draw_cache) {
+							DrawCachedFloor(nd->getFloor(map_z));
+						}
 						for (int map_x = 0; map_x < 4; ++map_x) {
 							for (int map_y = 0; map_y < 4; ++map_y) {
 								TileLocation* location = nd->getTile(map_x, map_y, map_z);
-								DrawTile(location);
+								if (!use_draw_cache) {
+									DrawTile(location);
+								}
 								// draw light, but only if not zoomed too far
 								if (location && options.isDrawLight() && zoom <= 10.0) {
 									AddLight(location);
@@ -331,20 +421,14 @@ void MapDrawer::DrawMap() {
 						int cy = (nd_map_y)*TileSize - view_scroll_y - getFloorAdjustment(floor);
 						int cx = (nd_map_x)*TileSize - view_scroll_x - getFloorAdjustment(floor);
 
-						glColor4ub(255, 0, 255, 128);
-						glBegin(GL_QUADS);
-						glVertex2f(cx, cy + TileSize * 4);
-						glVertex2f(cx + TileSize * 4, cy + TileSize * 4);
-						glVertex2f(cx + TileSize * 4, cy);
-						glVertex2f(cx, cy);
-						glEnd();
+						glBlitQuad(cx, cy, TileSize * 4, TileSize * 4, 255, 0, 255, 128);
 					}
 				}
 			}
 		}
 
 		if (only_colors) {
-			glEnable(GL_TEXTURE_2D);
+			batch->setTexturing(true);
 		}
 
 		// Draws the doodad preview or the paste preview (or import preview)
@@ -354,6 +438,11 @@ void MapDrawer::DrawMap() {
 
 			if (canvas->isPasting()) {
 				normalPos = editor.copybuffer.getPosition();
+				// Only the part of the buffer under the view gets decoded
+				editor.copybuffer.preparePreview(
+					normalPos + Position(start_x, start_y, map_z) - to,
+					normalPos + Position(end_x, end_y, map_z) - to
+				);
 			} else if (brush && brush->isDoodad()) {
 				normalPos = Position(0x8000, 0x8000, 0x8);
 			}
@@ -437,7 +526,109 @@ void MapDrawer::DrawMap() {
 	}
 
 	if (!only_colors) {
-		glEnable(GL_TEXTURE_2D);
+		batch->setTexturing(true);
+	}
+
+	// Forget floors that scrolled out of view a while ago, or were deleted
+	if (use_draw_cache && draw_frame % DRAW_CACHE_MAX_AGE == 0) {
+		for (auto it = draw_cache.begin(); it != draw_cache.end();) {
+			if (draw_frame - it->second.last_frame > DRAW_CACHE_MAX_AGE) {
+				it = draw_cache.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+}
+
+MapDrawer::DrawCacheKey MapDrawer::getDrawCacheKey() const {
+	// Everything DrawTile and the blits it makes look at
+	const bool flags[] = {
+		options.ingame,
+		options.show_as_minimap,
+		options.show_only_colors,
+		options.show_special_tiles,
+		options.show_blocking,
+		options.highlight_items,
+		options.highlight_locked_doors,
+		options.show_spawns,
+		options.show_houses,
+		options.extended_house_shader,
+		options.always_show_zones,
+		options.hide_items_when_zoomed,
+		options.show_items,
+		options.transparent_items,
+		options.show_tech_items,
+		options.show_creatures,
+		options.show_waypoints,
+		options.show_towns,
+		options.show_hooks,
+		options.show_light_str,
+		zoom > 3.0,
+		zoom >= 10.0,
+	};
+
+	DrawCacheKey key;
+	key.options = uint32_t(floor);
+	for (bool flag : flags) {
+		key.options = (key.options << 1) | (flag ? 1 : 0);
+	}
+	key.house_id = current_house_id;
+	key.map_revision = editor.map.getRevision();
+	key.graphics = g_gui.gfx.getGeneration();
+	key.animation = animation_epoch;
+	return key;
+}
+
+void MapDrawer::DrawCachedFloor(Floor* floor) {
+	if (!floor) {
+		return;
+	}
+
+	const uint32_t signature = getLocationSignature(floor);
+	FloorDrawCache& cache = draw_cache[floor];
+	cache.last_frame = draw_frame;
+	if (cache.revision == floor->getRevision() && cache.signature == signature) {
+		ReplayFloor(cache);
+		return;
+	}
+
+	cache.blits.clear();
+	cache.outfits.clear();
+	cache.revision = floor->getRevision();
+	cache.signature = signature;
+
+	recording = &cache;
+	for (TileLocation& location : floor->locs) {
+		DrawTile(&location);
+	}
+	recording = nullptr;
+}
+
+void MapDrawer::ReplayFloor(const FloorDrawCache& cache) {
+	for (const CachedBlit& blit : cache.blits) {
+		const int sx = blit.x - view_scroll_x;
+		const int sy = blit.y - view_scroll_y;
+		switch (blit.type) {
+			case CachedBlit::SPRITE: {
+				// Asked for again so the atlas still sees the sprite as in use
+				const SpriteRegion region = blit.sprite->getHardwareID(blit.cx, blit.cy, blit.layer, blit.subtype, blit.pattern_x, blit.pattern_y, blit.pattern_z, blit.frame);
+				glBlitTexture(sx, sy, region, blit.red, blit.green, blit.blue, blit.alpha);
+				break;
+			}
+			case CachedBlit::OUTFIT: {
+				const SpriteRegion region = blit.sprite->getHardwareID(blit.cx, blit.cy, blit.layer, blit.subtype, blit.pattern_z, cache.outfits[blit.extra], blit.frame);
+				glBlitTexture(sx, sy, region, blit.red, blit.green, blit.blue, blit.alpha);
+				break;
+			}
+			case CachedBlit::SQUARE:
+				BlitUntexturedSquare(sx, sy, blit.red, blit.green, blit.blue, blit.alpha, blit.extra);
+				break;
+			case CachedBlit::HOOK_SOUTH:
+			case CachedBlit::HOOK_EAST:
+				DrawHookIndicator(sx, sy, blit.type == CachedBlit::HOOK_SOUTH);
+				break;
+		}
 	}
 }
 
@@ -458,7 +649,7 @@ void MapDrawer::DrawIngameBox() {
 
 	static wxColor side_color(0, 0, 0, 200);
 
-	glDisable(GL_TEXTURE_2D);
+	batch->setTexturing(false);
 
 	// left side
 	if (box_start_map_x >= start_x) {
@@ -497,10 +688,20 @@ void MapDrawer::DrawIngameBox() {
 	box_end_y = box_start_y + TileSize;
 	drawRect(box_start_x, box_start_y, box_end_x - box_start_x, box_end_y - box_start_y, *wxGREEN);
 
-	glEnable(GL_TEXTURE_2D);
+	batch->setTexturing(true);
 }
 
 void MapDrawer::DrawGrid() {
+	if (options.batch_sprites) {
+		for (int y = start_y; y < end_y; ++y) {
+			batch->addLine(start_x * TileSize - view_scroll_x, y * TileSize - view_scroll_y, end_x * TileSize - view_scroll_x, y * TileSize - view_scroll_y, 255, 255, 255, 128);
+		}
+		for (int x = start_x; x < end_x; ++x) {
+			batch->addLine(x * TileSize - view_scroll_x, start_y * TileSize - view_scroll_y, x * TileSize - view_scroll_x, end_y * TileSize - view_scroll_y, 255, 255, 255, 128);
+		}
+		return;
+	}
+
 	for (int y = start_y; y < end_y; ++y) {
 		glColor4ub(255, 255, 255, 128);
 		glBegin(GL_LINES);
@@ -519,11 +720,11 @@ void MapDrawer::DrawGrid() {
 }
 
 void MapDrawer::DrawDraggingShadow() {
-	glEnable(GL_TEXTURE_2D);
+	batch->setTexturing(true);
 
 	// Draw dragging shadow
 	if (!editor.selection.isBusy() && dragging && !options.ingame) {
-		for (TileSet::iterator tit = editor.selection.begin(); tit != editor.selection.end(); tit++) {
+		for (Selection::iterator tit = editor.selection.begin(); tit != editor.selection.end(); tit++) {
 			Tile* tile = *tit;
 			Position pos = tile->getPosition();
 
@@ -576,11 +777,11 @@ void MapDrawer::DrawDraggingShadow() {
 		}
 	}
 
-	glDisable(GL_TEXTURE_2D);
+	batch->setTexturing(false);
 }
 
 void MapDrawer::DrawHigherFloors() {
-	glEnable(GL_TEXTURE_2D);
+	batch->setTexturing(true);
 
 	// Draw "transparent higher floor"
 	if (floor != 8 && floor != 0 && options.transparent_floors) {
@@ -619,7 +820,7 @@ void MapDrawer::DrawHigherFloors() {
 		}
 	}
 
-	glDisable(GL_TEXTURE_2D);
+	batch->setTexturing(false);
 }
 
 void MapDrawer::DrawSelectionBox() {
@@ -788,7 +989,7 @@ void MapDrawer::DrawBrush() {
 			glEnd();
 		} else {
 			if (brush->isRaw()) {
-				glEnable(GL_TEXTURE_2D);
+				batch->setTexturing(true);
 			}
 
 			if (g_gui.GetBrushShape() == BRUSHSHAPE_SQUARE || brush->isSpawn() /* Spawn brush is always square */) {
@@ -907,7 +1108,7 @@ void MapDrawer::DrawBrush() {
 			}
 
 			if (brush->isRaw()) {
-				glDisable(GL_TEXTURE_2D);
+				batch->setTexturing(false);
 			}
 		}
 	} else {
@@ -967,7 +1168,7 @@ void MapDrawer::DrawBrush() {
 			glVertex2f(cx, cy);
 			glEnd();
 		} else if (brush->isCreature()) {
-			glEnable(GL_TEXTURE_2D);
+			batch->setTexturing(true);
 			int cy = (mouse_map_y)*TileSize - view_scroll_y - getFloorAdjustment(floor);
 			int cx = (mouse_map_x)*TileSize - view_scroll_x - getFloorAdjustment(floor);
 			CreatureBrush* creature_brush = brush->asCreature();
@@ -976,11 +1177,11 @@ void MapDrawer::DrawBrush() {
 			} else {
 				BlitCreature(cx, cy, creature_brush->getType()->outfit, SOUTH, 255, 64, 64, 160);
 			}
-			glDisable(GL_TEXTURE_2D);
+			batch->setTexturing(false);
 		} else if (!brush->isDoodad()) {
 			RAWBrush* raw_brush = nullptr;
 			if (brush->isRaw()) { // Textured brush
-				glEnable(GL_TEXTURE_2D);
+				batch->setTexturing(true);
 				raw_brush = brush->asRaw();
 			}
 
@@ -1044,7 +1245,7 @@ void MapDrawer::DrawBrush() {
 			}
 
 			if (brush->isRaw()) { // Textured brush
-				glDisable(GL_TEXTURE_2D);
+				batch->setTexturing(false);
 			}
 		}
 	}
@@ -1178,8 +1379,7 @@ void MapDrawer::BlitItem(int& draw_x, int& draw_y, const Position& pos, Item* it
 	for (int cx = 0; cx != spr->width; cx++) {
 		for (int cy = 0; cy != spr->height; cy++) {
 			for (int cf = 0; cf != spr->layers; cf++) {
-				int texnum = spr->getHardwareID(cx, cy, cf, subtype, pattern_x, pattern_y, pattern_z, frame);
-				glBlitTexture(screenx - cx * TileSize, screeny - cy * TileSize, texnum, red, green, blue, alpha);
+				BlitSpriteCell(screenx - cx * TileSize, screeny - cy * TileSize, spr, cx, cy, cf, subtype, pattern_x, pattern_y, pattern_z, frame, red, green, blue, alpha);
 			}
 		}
 	}
@@ -1213,7 +1413,7 @@ void MapDrawer::BlitItem(int& draw_x, int& draw_y, const Position& pos, Item* it
 
 	// draw wall hook
 	if (!options.ingame && options.show_hooks && (it.hookSouth || it.hookEast)) {
-		DrawHookIndicator(draw_x, draw_y, it);
+		DrawHookIndicator(draw_x, draw_y, it.hookSouth);
 	}
 
 	// draw light color indicator
@@ -1228,10 +1428,8 @@ void MapDrawer::BlitItem(int& draw_x, int& draw_y, const Position& pos, Item* it
 
 			int startOffset = std::max<int>(16, 32 - light.intensity);
 			int sqSize = TileSize - startOffset;
-			glDisable(GL_TEXTURE_2D);
-			glBlitSquare(draw_x + startOffset - 2, draw_y + startOffset - 2, 0, 0, 0, byteA, sqSize + 2);
-			glBlitSquare(draw_x + startOffset - 1, draw_y + startOffset - 1, byteR, byteG, byteB, byteA, sqSize);
-			glEnable(GL_TEXTURE_2D);
+			BlitUntexturedSquare(draw_x + startOffset - 2, draw_y + startOffset - 2, 0, 0, 0, byteA, sqSize + 2);
+			BlitUntexturedSquare(draw_x + startOffset - 1, draw_y + startOffset - 1, byteR, byteG, byteB, byteA, sqSize);
 		}
 	}
 }
@@ -1248,9 +1446,7 @@ void MapDrawer::BlitSpriteType(int screenx, int screeny, uint32_t spriteid, int
 	for (int cx = 0; cx != spr->width; ++cx) {
 		for (int cy = 0; cy != spr->height; ++cy) {
 			for (int cf = 0; cf != spr->layers; ++cf) {
-				int texnum = spr->getHardwareID(cx, cy, cf, -1, 0, 0, 0, tme);
-				// printf("CF: %d\tTexturenum: %d\n", cf, texnum);
-				glBlitTexture(screenx - cx * TileSize, screeny - cy * TileSize, texnum, red, green, blue, alpha);
+				BlitSpriteCell(screenx - cx * TileSize, screeny - cy * TileSize, spr, cx, cy, cf, -1, 0, 0, 0, tme, red, green, blue, alpha);
 			}
 		}
 	}
@@ -1267,9 +1463,7 @@ void MapDrawer::BlitSpriteType(int screenx, int screeny, GameSprite* spr, int re
 	for (int cx = 0; cx != spr->width; ++cx) {
 		for (int cy = 0; cy != spr->height; ++cy) {
 			for (int cf = 0; cf != spr->layers; ++cf) {
-				int texnum = spr->getHardwareID(cx, cy, cf, -1, 0, 0, 0, tme);
-				// printf("CF: %d\tTexturenum: %d\n", cf, texnum);
-				glBlitTexture(screenx - cx * TileSize, screeny - cy * TileSize, texnum, red, green, blue, alpha);
+				BlitSpriteCell(screenx - cx * TileSize, screeny - cy * TileSize, spr, cx, cy, cf, -1, 0, 0, 0, tme, red, green, blue, alpha);
 			}
 		}
 	}
@@ -1303,8 +1497,7 @@ void MapDrawer::BlitCreature(int screenx, int screeny, const Outfit& outfit, Dir
 
 				for (int cx = 0; cx != mountSpr->width; ++cx) {
 					for (int cy = 0; cy != mountSpr->height; ++cy) {
-						int texnum = mountSpr->getHardwareID(cx, cy, (int)dir, 0, 0, mountOutfit, tme);
-						glBlitTexture(screenx - cx * TileSize, screeny - cy * TileSize, texnum, red, green, blue, alpha);
+						BlitOutfitCell(screenx - cx * TileSize, screeny - cy * TileSize, mountSpr, cx, cy, (int)dir, 0, 0, mountOutfit, tme, red, green, blue, alpha);
 					}
 				}
 
@@ -1322,8 +1515,7 @@ void MapDrawer::BlitCreature(int screenx, int screeny, const Outfit& outfit, Dir
 
 			for (int cx = 0; cx != spr->width; ++cx) {
 				for (int cy = 0; cy != spr->height; ++cy) {
-					int texnum = spr->getHardwareID(cx, cy, (int)dir, pattern_y, pattern_z, outfit, tme);
-					glBlitTexture(screenx - cx * TileSize, screeny - cy * TileSize, texnum, red, green, blue, alpha);
+					BlitOutfitCell(screenx - cx * TileSize, screeny - cy * TileSize, spr, cx, cy, (int)dir, pattern_y, pattern_z, outfit, tme, red, green, blue, alpha);
 				}
 			}
 		}
@@ -1349,23 +1541,86 @@ void MapDrawer::BlitSquare(int sx, int sy, int red, int green, int blue, int alp
 		return;
 	}
 
-	int texnum = spr->getHardwareID(0, 0, 0, -1, 0, 0, 0, 0);
-	if (texnum == 0) {
-		return;
+	BlitSpriteCell(sx, sy, spr, 0, 0, 0, -1, 0, 0, 0, 0, red, green, blue, alpha);
+}
+
+void MapDrawer::BlitSpriteCell(int sx, int sy, GameSprite* spr, int cx, int cy, int layer, int subtype, int pattern_x, int pattern_y, int pattern_z, int frame, int red, int green, int blue, int alpha) {
+	const SpriteRegion region = spr->getHardwareID(cx, cy, layer, subtype, pattern_x, pattern_y, pattern_z, frame);
+	glBlitTexture(sx, sy, region, red, green, blue, alpha);
+
+	if (recording) {
+		CachedBlit blit;
+		blit.type = CachedBlit::SPRITE;
+		blit.red = uint8_t(red);
+		blit.green = uint8_t(green);
+		blit.blue = uint8_t(blue);
+		blit.alpha = uint8_t(alpha);
+		blit.x = sx + view_scroll_x;
+		blit.y = sy + view_scroll_y;
+		blit.sprite = spr;
+		blit.cx = int16_t(cx);
+		blit.cy = int16_t(cy);
+		blit.layer = int16_t(layer);
+		blit.subtype = int16_t(subtype);
+		blit.pattern_x = int16_t(pattern_x);
+		blit.pattern_y = int16_t(pattern_y);
+		blit.pattern_z = int16_t(pattern_z);
+		blit.frame = int16_t(frame);
+		blit.extra = 0;
+		recording->blits.push_back(blit);
 	}
+}
 
-	glBindTexture(GL_TEXTURE_2D, texnum);
-	glColor4ub(uint8_t(red), uint8_t(green), uint8_t(blue), uint8_t(alpha));
-	glBegin(GL_QUADS);
-	glTexCoord2f(0.f, 0.f);
-	glVertex2f(sx, sy);
-	glTexCoord2f(1.f, 0.f);
-	glVertex2f(sx + TileSize, sy);
-	glTexCoord2f(1.f, 1.f);
-	glVertex2f(sx + TileSize, sy + TileSize);
-	glTexCoord2f(0.f, 1.f);
-	glVertex2f(sx, sy + TileSize);
-	glEnd();
+void MapDrawer::BlitOutfitCell(int sx, int sy, GameSprite* spr, int cx, int cy, int dir, int addon, int pattern_z, const Outfit& outfit, int frame, int red, int green, int blue, int alpha) {
+	const SpriteRegion region = spr->getHardwareID(cx, cy, dir, addon, pattern_z, outfit, frame);
+	glBlitTexture(sx, sy, region, red, green, blue, alpha);
+
+	if (recording) {
+		// A creature is made of several cells with the same outfit
+		std::vector<Outfit>& outfits = recording->outfits;
+		if (outfits.empty() || !isSameOutfit(outfits.back(), outfit)) {
+			outfits.push_back(outfit);
+		}
+
+		CachedBlit blit;
+		blit.type = CachedBlit::OUTFIT;
+		blit.red = uint8_t(red);
+		blit.green = uint8_t(green);
+		blit.blue = uint8_t(blue);
+		blit.alpha = uint8_t(alpha);
+		blit.x = sx + view_scroll_x;
+		blit.y = sy + view_scroll_y;
+		blit.sprite = spr;
+		blit.cx = int16_t(cx);
+		blit.cy = int16_t(cy);
+		blit.layer = int16_t(dir);
+		blit.subtype = int16_t(addon);
+		blit.pattern_x = 0;
+		blit.pattern_y = 0;
+		blit.pattern_z = int16_t(pattern_z);
+		blit.frame = int16_t(frame);
+		blit.extra = int32_t(outfits.size() - 1);
+		recording->blits.push_back(blit);
+	}
+}
+
+void MapDrawer::BlitUntexturedSquare(int sx, int sy, int red, int green, int blue, int alpha, int size) {
+	batch->setTexturing(false);
+	glBlitSquare(sx, sy, red, green, blue, alpha, size);
+	batch->setTexturing(true);
+
+	if (recording) {
+		CachedBlit blit = {};
+		blit.type = CachedBlit::SQUARE;
+		blit.red = uint8_t(red);
+		blit.green = uint8_t(green);
+		blit.blue = uint8_t(blue);
+		blit.alpha = uint8_t(alpha);
+		blit.x = sx + view_scroll_x;
+		blit.y = sy + view_scroll_y;
+		blit.extra = size;
+		recording->blits.push_back(blit);
+	}
 }
 
 void MapDrawer::DrawRawBrush(int screenx, int screeny, ItemType* itemType, uint8_t r, uint8_t g, uint8_t b, uint8_t alpha) {
@@ -1687,6 +1942,8 @@ void MapDrawer::DrawBrushIndicator(int x, int y, Brush* brush, uint8_t r, uint8_
 		{ -15, -20 }, // 0
 	};
 
+	FlushBatch();
+
 	// circle
 	glBegin(GL_TRIANGLE_FAN);
 	glColor4ub(0x00, 0x00, 0x00, 0x50);
@@ -1716,18 +1973,27 @@ void MapDrawer::DrawBrushIndicator(int x, int y, Brush* brush, uint8_t r, uint8_
 	glEnd();
 }
 
-void MapDrawer::DrawHookIndicator(int x, int y, const ItemType& type) {
-	glDisable(GL_TEXTURE_2D);
+void MapDrawer::DrawHookIndicator(int x, int y, bool south) {
+	if (recording) {
+		CachedBlit blit = {};
+		blit.type = south ? CachedBlit::HOOK_SOUTH : CachedBlit::HOOK_EAST;
+		blit.x = x + view_scroll_x;
+		blit.y = y + view_scroll_y;
+		recording->blits.push_back(blit);
+	}
+
+	FlushBatch();
+	batch->setTexturing(false);
 	glColor4ub(uint8_t(0), uint8_t(0), uint8_t(255), uint8_t(200));
 	glBegin(GL_QUADS);
-	if (type.hookSouth) {
+	if (south) {
 		x -= 10;
 		y += 10;
 		glVertex2f(x, y);
 		glVertex2f(x + 10, y);
 		glVertex2f(x + 20, y + 10);
 		glVertex2f(x + 10, y + 10);
-	} else if (type.hookEast) {
+	} else {
 		x += 10;
 		y -= 10;
 		glVertex2f(x, y);
@@ -1736,7 +2002,7 @@ void MapDrawer::DrawHookIndicator(int x, int y, const ItemType& type) {
 		glVertex2f(x, y + 10);
 	}
 	glEnd();
-	glEnable(GL_TEXTURE_2D);
+	batch->setTexturing(true);
 }
 
 void MapDrawer::DrawTooltips() {
@@ -1848,6 +2114,8 @@ void MapDrawer::DrawTooltips() {
 void MapDrawer::DrawLight() {
 	// draw in-game light
 	light_drawer->draw(start_x, start_y, end_x, end_y, view_scroll_x, view_scroll_y, options.experimental_fog);
+	// The light drawer binds its own texture
+	batch->invalidateBinding();
 }
 
 void MapDrawer::MakeTooltip(int screenx, int screeny, const std::string& text, uint8_t r, uint8_t g, uint8_t b) {
@@ -1913,18 +2181,21 @@ void MapDrawer::TakeScreenshot(uint8_t* screenshot_buffer) {
 	}
 }
 
-void MapDrawer::glBlitTexture(int sx, int sy, int texture_number, int red, int green, int blue, int alpha) {
-	if (texture_number != 0) {
-		glBindTexture(GL_TEXTURE_2D, texture_number);
+void MapDrawer::glBlitTexture(int sx, int sy, const SpriteRegion& region, int red, int green, int blue, int alpha) {
+	if (options.batch_sprites) {
+		batch->addQuad(sx, sy, TileSize, TileSize, region, uint8_t(red), uint8_t(green), uint8_t(blue), uint8_t(alpha));
+	} else if (region.texture != 0) {
+		// Most sprites of a frame share an atlas page, only bind when it changes
+		batch->bindTexture(region.texture);
 		glColor4ub(uint8_t(red), uint8_t(green), uint8_t(blue), uint8_t(alpha));
 		glBegin(GL_QUADS);
-		glTexCoord2f(0.f, 0.f);
+		glTexCoord2f(region.u0, region.v0);
 		glVertex2f(sx, sy);
-		glTexCoord2f(1.f, 0.f);
+		glTexCoord2f(region.u1, region.v0);
 		glVertex2f(sx + TileSize, sy);
-		glTexCoord2f(1.f, 1.f);
+		glTexCoord2f(region.u1, region.v1);
 		glVertex2f(sx + TileSize, sy + TileSize);
-		glTexCoord2f(0.f, 1.f);
+		glTexCoord2f(region.u0, region.v1);
 		glVertex2f(sx, sy + TileSize);
 		glEnd();
 	}
@@ -1934,16 +2205,28 @@ void MapDrawer::glBlitSquare(int sx, int sy, int red, int green, int blue, int a
 	if (size == 0) {
 		size = TileSize;
 	}
+	glBlitQuad(sx, sy, size, size, red, green, blue, alpha);
+}
+
+void MapDrawer::glBlitQuad(float x, float y, float w, float h, int red, int green, int blue, int alpha) {
+	if (options.batch_sprites) {
+		batch->addQuad(x, y, w, h, uint8_t(red), uint8_t(green), uint8_t(blue), uint8_t(alpha));
+		return;
+	}
 
 	glColor4ub(uint8_t(red), uint8_t(green), uint8_t(blue), uint8_t(alpha));
 	glBegin(GL_QUADS);
-	glVertex2f(sx, sy);
-	glVertex2f(sx + size, sy);
-	glVertex2f(sx + size, sy + size);
-	glVertex2f(sx, sy + size);
+	glVertex2f(x, y);
+	glVertex2f(x + w, y);
+	glVertex2f(x + w, y + h);
+	glVertex2f(x, y + h);
 	glEnd();
 }
 
+void MapDrawer::FlushBatch() {
+	batch->flush();
+}
+
 void MapDrawer::glColor(wxColor color) {
 	glColor4ub(color.Red(), color.Green(), color.Blue(), color.Alpha());
 }
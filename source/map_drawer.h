@@ -18,7 +18,13 @@
 #ifndef RME_MAP_DRAWER_H_
 #define RME_MAP_DRAWER_H_
 
+#include "outfit.h"
+
+#include <unordered_map>
+
 class GameSprite;
+struct SpriteRegion;
+class Floor;
 
 struct MapTooltip {
 	enum TextLength {
@@ -85,16 +91,74 @@ struct DrawingOptions {
 	bool extended_house_shader;
 
 	bool experimental_fog;
+	// Queue sprites and squares into vertex arrays instead of drawing each one with glBegin/glEnd
+	bool batch_sprites;
 };
 
 class MapCanvas;
 class LightDrawer;
+class SpriteBatch;
 
 class MapDrawer {
+	// One sprite cell or square drawn by DrawTile, positions are in map pixels
+	// so the same commands can be drawn again at any scroll position
+	struct CachedBlit {
+		enum Type : uint8_t {
+			SPRITE,
+			OUTFIT,
+			SQUARE,
+			HOOK_SOUTH,
+			HOOK_EAST,
+		};
+
+		Type type;
+		uint8_t red, green, blue, alpha;
+		int x, y;
+		GameSprite* sprite;
+		int16_t cx, cy;
+		int16_t layer; // direction for outfits
+		int16_t subtype; // addon for outfits
+		int16_t pattern_x, pattern_y, pattern_z;
+		int16_t frame;
+		int32_t extra; // index into the outfits for outfits, size for squares
+	};
+
+	// What DrawTile drew for the 16 tiles of one floor of a leaf
+	struct FloorDrawCache {
+		FloorDrawCache() :
+			revision(0), signature(0), last_frame(0) { }
+
+		std::vector<CachedBlit> blits;
+		std::vector<Outfit> outfits;
+		uint32_t revision; // Floor::getRevision when recorded, 0 if never
+		uint32_t signature; // waypoints, towns, spawns and house exits on the floor
+		uint32_t last_frame;
+	};
+
+	// Everything besides the floor itself the cached commands depend on
+	struct DrawCacheKey {
+		uint32_t options;
+		uint32_t house_id;
+		uint32_t map_revision;
+		uint32_t graphics;
+		uint32_t animation;
+
+		bool operator==(const DrawCacheKey& other) const {
+			return options == other.options && house_id == other.house_id && map_revision == other.map_revision && graphics == other.graphics && animation == other.animation;
+		}
+	};
+
 	MapCanvas* canvas;
 	Editor& editor;
 	DrawingOptions options;
 	std::shared_ptr<LightDrawer> light_drawer;
+	std::shared_ptr<SpriteBatch> batch;
+
+	std::unordered_map<const Floor*, FloorDrawCache> draw_cache;
+	DrawCacheKey draw_cache_key;
+	uint32_t draw_frame;
+	// Set while DrawTile runs for a cache entry, the blits are recorded into it
+	FloorDrawCache* recording;
 
 	float zoom;
 
@@ -120,10 +184,14 @@ public:
 	bool dragging_draw;
 
 	void SetupVars();
+	// View at zoom 1 that does not follow the canvas, for rendering exports
+	void SetupVars(int scroll_x, int scroll_y, int width, int height, int floor);
 	void SetupGL();
 	void Release();
 
 	void Draw();
+	// Only the map itself, none of the editing overlays
+	void DrawMapImage();
 	void DrawBackground();
 	void DrawMap();
 	void DrawDraggingShadow();
@@ -143,6 +211,7 @@ public:
 	}
 
 protected:
+	void SetupRange();
 	void BlitItem(int& screenx, int& screeny, const Tile* tile, Item* item, bool ephemeral = false, int red = 255, int green = 255, int blue = 255, int alpha = 255);
 	void BlitItem(int& screenx, int& screeny, const Position& pos, Item* item, bool ephemeral = false, int red = 255, int green = 255, int blue = 255, int alpha = 255, const Tile* tile = nullptr);
 	void BlitSpriteType(int screenx, int screeny, uint32_t spriteid, int red = 255, int green = 255, int blue = 255, int alpha = 255);
@@ -150,10 +219,16 @@ protected:
 	void BlitCreature(int screenx, int screeny, const Creature* c, int red = 255, int green = 255, int blue = 255, int alpha = 255);
 	void BlitCreature(int screenx, int screeny, const Outfit& outfit, Direction dir, int red = 255, int green = 255, int blue = 255, int alpha = 255);
 	void BlitSquare(int sx, int sy, int red, int green, int blue, int alpha, int size = 0);
+	void BlitSpriteCell(int sx, int sy, GameSprite* spr, int cx, int cy, int layer, int subtype, int pattern_x, int pattern_y, int pattern_z, int frame, int red, int green, int blue, int alpha);
+	void BlitOutfitCell(int sx, int sy, GameSprite* spr, int cx, int cy, int dir, int addon, int pattern_z, const Outfit& outfit, int frame, int red, int green, int blue, int alpha);
+	void BlitUntexturedSquare(int sx, int sy, int red, int green, int blue, int alpha, int size);
 	void DrawRawBrush(int screenx, int screeny, ItemType* itemType, uint8_t r, uint8_t g, uint8_t b, uint8_t alpha);
 	void DrawTile(TileLocation* tile);
+	void DrawCachedFloor(Floor* floor);
+	void ReplayFloor(const FloorDrawCache& cache);
+	DrawCacheKey getDrawCacheKey() const;
 	void DrawBrushIndicator(int x, int y, Brush* brush, uint8_t r, uint8_t g, uint8_t b);
-	void DrawHookIndicator(int x, int y, const ItemType& type);
+	void DrawHookIndicator(int x, int y, bool south);
 	void WriteTooltip(Item* item, std::ostringstream& stream, bool isHouseTile = false);
 	void WriteTooltip(Waypoint* item, std::ostringstream& stream);
 	void MakeTooltip(int screenx, int screeny, const std::string& text, uint8_t r = 255, uint8_t g = 255, uint8_t b = 255);
@@ -171,8 +246,10 @@ protected:
 	};
 
 	void getColor(Brush* brush, const Position& position, uint8_t& r, uint8_t& g, uint8_t& b);
-	void glBlitTexture(int sx, int sy, int texture_number, int red, int green, int blue, int alpha);
+	void glBlitTexture(int sx, int sy, const SpriteRegion& region, int red, int green, int blue, int alpha);
 	void glBlitSquare(int sx, int sy, int red, int green, int blue, int alpha, int size = 0);
+	void glBlitQuad(float x, float y, float w, float h, int red, int green, int blue, int alpha);
+	void FlushBatch();
 	void glColor(wxColor color);
 	void glColor(BrushColor color);
 	void glColorCheck(Brush* brush, const Position& pos);
@@ -0,0 +1,243 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "gui.h"
+#include "editor.h"
+#include "settings.h"
+#include "map_display.h"
+#include "map_drawer.h"
+#include "png_writer.h"
+#include "map_image_export.h"
+
+#ifndef __WINDOWS__
+	#include <dlfcn.h>
+#endif
+
+// Size of the off-screen framebuffer, every strip of the image is this many
+// rows high and is rendered in pieces this many columns wide
+static const int EXPORT_CHUNK_WIDTH = 1024;
+static const int EXPORT_CHUNK_HEIGHT = 256;
+
+// GL_EXT_framebuffer_object, looked up at runtime since the GL headers of
+// some platforms only declare OpenGL 1.1
+#define RME_GL_FRAMEBUFFER_EXT 0x8D40
+#define RME_GL_COLOR_ATTACHMENT0_EXT 0x8CE0
+#define RME_GL_FRAMEBUFFER_COMPLETE_EXT 0x8CD5
+
+#ifndef APIENTRY
+	#define APIENTRY
+#endif
+
+typedef void(APIENTRY* GenFramebuffersFunction)(GLsizei, GLuint*);
+typedef void(APIENTRY* DeleteFramebuffersFunction)(GLsizei, const GLuint*);
+typedef void(APIENTRY* BindFramebufferFunction)(GLenum, GLuint);
+typedef void(APIENTRY* FramebufferTexture2DFunction)(GLenum, GLenum, GLenum, GLuint, GLint);
+typedef GLenum(APIENTRY* CheckFramebufferStatusFunction)(GLenum);
+
+static GenFramebuffersFunction genFramebuffers = nullptr;
+static DeleteFramebuffersFunction deleteFramebuffers = nullptr;
+static BindFramebufferFunction bindFramebuffer = nullptr;
+static FramebufferTexture2DFunction framebufferTexture2D = nullptr;
+static CheckFramebufferStatusFunction checkFramebufferStatus = nullptr;
+
+static void* getGLFunction(const char* name) {
+#ifdef __WINDOWS__
+	return reinterpret_cast<void*>(wglGetProcAddress(name));
+#else
+	return dlsym(RTLD_DEFAULT, name);
+#endif
+}
+
+static bool loadFramebufferFunctions() {
+	if (genFramebuffers) {
+		return true;
+	}
+
+	const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+	if (!extensions || !strstr(extensions, "GL_EXT_framebuffer_object")) {
+		return false;
+	}
+
+	genFramebuffers = reinterpret_cast<GenFramebuffersFunction>(getGLFunction("glGenFramebuffersEXT"));
+	deleteFramebuffers = reinterpret_cast<DeleteFramebuffersFunction>(getGLFunction("glDeleteFramebuffersEXT"));
+	bindFramebuffer = reinterpret_cast<BindFramebufferFunction>(getGLFunction("glBindFramebufferEXT"));
+	framebufferTexture2D = reinterpret_cast<FramebufferTexture2DFunction>(getGLFunction("glFramebufferTexture2DEXT"));
+	checkFramebufferStatus = reinterpret_cast<CheckFramebufferStatusFunction>(getGLFunction("glCheckFramebufferStatusEXT"));
+	if (!genFramebuffers || !deleteFramebuffers || !bindFramebuffer || !framebufferTexture2D || !checkFramebufferStatus) {
+		genFramebuffers = nullptr;
+		return false;
+	}
+	return true;
+}
+
+// Framebuffer with a texture as colour buffer, bound while it exists
+class OffscreenTarget {
+public:
+	OffscreenTarget() :
+		framebuffer(0), texture(0) { }
+	~OffscreenTarget() {
+		if (framebuffer != 0) {
+			bindFramebuffer(RME_GL_FRAMEBUFFER_EXT, 0);
+			deleteFramebuffers(1, &framebuffer);
+		}
+		if (texture != 0) {
+			glDeleteTextures(1, &texture);
+		}
+	}
+
+	bool create(int width, int height) {
+		if (!loadFramebufferFunctions()) {
+			return false;
+		}
+
+		GLint previous_texture = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindTexture(GL_TEXTURE_2D, GLuint(previous_texture));
+
+		genFramebuffers(1, &framebuffer);
+		bindFramebuffer(RME_GL_FRAMEBUFFER_EXT, framebuffer);
+		framebufferTexture2D(RME_GL_FRAMEBUFFER_EXT, RME_GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, texture, 0);
+		return checkFramebufferStatus(RME_GL_FRAMEBUFFER_EXT) == RME_GL_FRAMEBUFFER_COMPLETE_EXT;
+	}
+
+private:
+	GLuint framebuffer;
+	GLuint texture;
+};
+
+MapImageExporter::MapImageExporter(Editor& editor, MapCanvas* canvas) :
+	editor(editor), canvas(canvas) {
+	////
+}
+
+bool MapImageExporter::findBounds(int floor, int& min_x, int& min_y, int& max_x, int& max_y) const {
+	min_x = min_y = 0x10000;
+	max_x = max_y = -1;
+
+	Map& map = editor.map;
+	for (MapIterator mit = map.begin(); mit != map.end(); ++mit) {
+		Tile* tile = (*mit)->get();
+		if (!tile || tile->empty() || tile->getZ() != floor) {
+			continue;
+		}
+		min_x = std::min(min_x, tile->getX());
+		min_y = std::min(min_y, tile->getY());
+		max_x = std::max(max_x, tile->getX());
+		max_y = std::max(max_y, tile->getY());
+	}
+	return max_x >= 0;
+}
+
+bool MapImageExporter::exportFloor(const FileName& filename, int floor, bool showdialog, bool printprogress) {
+	int min_x, min_y, max_x, max_y;
+	if (!findBounds(floor, min_x, min_y, max_x, max_y)) {
+		error = "There is nothing on floor " + i2ws(floor) + ".";
+		return false;
+	}
+
+	const int width = (max_x - min_x + 1) * TileSize;
+	const int height = (max_y - min_y + 1) * TileSize;
+
+	canvas->SetCurrent(*g_gui.GetGLContext(canvas));
+
+	OffscreenTarget target;
+	if (!target.create(EXPORT_CHUNK_WIDTH, EXPORT_CHUNK_HEIGHT)) {
+		error = "The video driver does not support off-screen rendering.";
+		return false;
+	}
+
+	PNGStreamWriter writer;
+	if (!writer.open(nstr(filename.GetFullPath()), width, height)) {
+		error = "Could not open " + filename.GetFullPath() + " for writing.";
+		return false;
+	}
+
+	MapDrawer drawer(canvas);
+	DrawingOptions& options = drawer.getOptions();
+	options.SetIngame();
+	options.batch_sprites = g_settings.getBoolean(Config::USE_SPRITE_BATCHING);
+
+	// Floors above the ground are drawn shifted up and left like in the client
+	const int adjustment = floor <= GROUND_LAYER ? TileSize * (GROUND_LAYER - floor) : 0;
+	const int scroll_x = min_x * TileSize - adjustment;
+	const int scroll_y = min_y * TileSize - adjustment;
+
+	std::vector<uint8_t> strip(size_t(width) * EXPORT_CHUNK_HEIGHT * 3);
+	std::vector<uint8_t> chunk(size_t(EXPORT_CHUNK_WIDTH) * EXPORT_CHUNK_HEIGHT * 3);
+
+	if (showdialog) {
+		g_gui.CreateLoadBar("Exporting map image...");
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	// Every chunk is read back as soon as it is drawn
+	g_gui.gfx.setSynchronousDecoding(true);
+
+	bool ok = true;
+	const int strips = (height + EXPORT_CHUNK_HEIGHT - 1) / EXPORT_CHUNK_HEIGHT;
+	for (int strip_index = 0; strip_index < strips && ok; ++strip_index) {
+		const int strip_y = strip_index * EXPORT_CHUNK_HEIGHT;
+		const int rows = std::min(EXPORT_CHUNK_HEIGHT, height - strip_y);
+
+		for (int chunk_x = 0; chunk_x < width; chunk_x += EXPORT_CHUNK_WIDTH) {
+			const int columns = std::min(EXPORT_CHUNK_WIDTH, width - chunk_x);
+
+			drawer.SetupVars(scroll_x + chunk_x, scroll_y + strip_y, EXPORT_CHUNK_WIDTH, EXPORT_CHUNK_HEIGHT, floor);
+			drawer.SetupGL();
+			drawer.DrawMapImage();
+			glReadPixels(0, 0, EXPORT_CHUNK_WIDTH, EXPORT_CHUNK_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, chunk.data());
+			drawer.Release();
+
+			// GL rows go bottom to top
+			for (int row = 0; row < rows; ++row) {
+				const uint8_t* source = &chunk[size_t(EXPORT_CHUNK_HEIGHT - 1 - row) * EXPORT_CHUNK_WIDTH * 3];
+				memcpy(&strip[(size_t(row) * width + chunk_x) * 3], source, size_t(columns) * 3);
+			}
+		}
+
+		if (!writer.addRows(strip.data(), rows)) {
+			error = "Could not write to " + filename.GetFullPath() + ".";
+			ok = false;
+		}
+		const int progress = int((strip_index + 1) * 100.0 / strips);
+		if (showdialog) {
+			g_gui.SetLoadDone(progress);
+		}
+		if (printprogress) {
+			std::cout << "Exporting floor " << floor << ": " << progress << "%" << std::endl;
+		}
+	}
+
+	g_gui.gfx.setSynchronousDecoding(false);
+	if (showdialog) {
+		g_gui.DestroyLoadBar();
+	}
+
+	if (ok && !writer.close()) {
+		error = "Could not write to " + filename.GetFullPath() + ".";
+		ok = false;
+	}
+	return ok;
+}
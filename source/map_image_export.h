@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_IMAGE_EXPORT_H_
+#define RME_MAP_IMAGE_EXPORT_H_
+
+class Editor;
+class MapCanvas;
+
+// Renders a whole floor at full size into a PNG. The map is drawn in chunks
+// into an off-screen framebuffer and written out one strip of chunks at a
+// time, so only a strip is ever held in memory.
+class MapImageExporter {
+public:
+	// The canvas of the editor provides the GL context, its view is not touched
+	MapImageExporter(Editor& editor, MapCanvas* canvas);
+
+	// showdialog shows a load bar, printprogress writes the progress to stdout
+	bool exportFloor(const FileName& filename, int floor, bool showdialog, bool printprogress = false);
+
+	wxString getError() const {
+		return error;
+	}
+
+private:
+	bool findBounds(int floor, int& min_x, int& min_y, int& max_x, int& max_y) const;
+
+	Editor& editor;
+	MapCanvas* canvas;
+	wxString error;
+};
+
+#endif
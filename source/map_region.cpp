@@ -22,6 +22,8 @@
 #include "position.h"
 #include "tile.h"
 
+#include <atomic>
+
 //**************** Tile Location **********************
 
 TileLocation::TileLocation() :
@@ -52,7 +54,11 @@ bool TileLocation::empty() const {
 
 //**************** Floor **********************
 
-Floor::Floor(int sx, int sy, int z) {
+static std::atomic<uint32_t> floor_revision(0);
+
+Floor::Floor(int sx, int sy, int z) :
+	revision(++floor_revision),
+	selected(0) {
 	sx = sx & ~3;
 	sy = sy & ~3;
 
@@ -63,6 +69,10 @@ Floor::Floor(int sx, int sy, int z) {
 	}
 }
 
+void Floor::touch() {
+	revision = ++floor_revision;
+}
+
 //**************** QTreeNode **********************
 
 QTreeNode::QTreeNode(BaseMap& map) :
@@ -76,13 +86,19 @@ QTreeNode::QTreeNode(BaseMap& map) :
 }
 
 QTreeNode::~QTreeNode() {
+	// Floors and child nodes live in the map's allocator, which releases
+	// their memory all at once after the tree has been destroyed
 	if (isLeaf) {
 		for (int i = 0; i < MAP_LAYERS; ++i) {
-			delete array[i];
+			if (array[i]) {
+				array[i]->~Floor();
+			}
 		}
 	} else {
 		for (int i = 0; i < MAP_LAYERS; ++i) {
-			delete child[i];
+			if (child[i]) {
+				child[i]->~QTreeNode();
+			}
 		}
 	}
 }
@@ -122,11 +138,11 @@ QTreeNode* QTreeNode::getLeafForce(int x, int y) {
 
 		} else {
 			if (level == 0) {
-				qt = newd QTreeNode(map);
+				qt = map.allocator.allocateNode(map);
 				qt->isLeaf = true;
 				return qt;
 			} else {
-				qt = newd QTreeNode(map);
+				qt = map.allocator.allocateNode(map);
 			}
 		}
 		node = node->child[index];
@@ -141,7 +157,7 @@ QTreeNode* QTreeNode::getLeafForce(int x, int y) {
 Floor* QTreeNode::createFloor(int x, int y, int z) {
 	ASSERT(isLeaf);
 	if (!array[z]) {
-		array[z] = newd Floor(x, y, z);
+		array[z] = map.allocator.allocateFloor(x, y, z);
 	}
 	return array[z];
 }
@@ -158,6 +174,31 @@ bool QTreeNode::isRequested(bool underground) {
 	}
 }
 
+void QTreeNode::clearTiles(bool del) {
+	if (!isLeaf) {
+		for (int i = 0; i < MAP_LAYERS; ++i) {
+			if (child[i]) {
+				child[i]->clearTiles(del);
+			}
+		}
+		return;
+	}
+
+	for (int z = 0; z < MAP_LAYERS; ++z) {
+		Floor* floor = array[z];
+		if (!floor) {
+			continue;
+		}
+		for (TileLocation& location : floor->locs) {
+			if (del) {
+				delete location.tile;
+			}
+			location.tile = nullptr;
+		}
+		floor->touch();
+	}
+}
+
 void QTreeNode::clearVisible(uint32_t u) {
 	if (isLeaf) {
 		visible &= u;
@@ -235,6 +276,7 @@ Tile* QTreeNode::setTile(int x, int y, int z, Tile* newtile) {
 	TileLocation* tmp = &f->locs[offset_x * 4 + offset_y];
 	Tile* oldtile = tmp->tile;
 	tmp->tile = newtile;
+	f->touch();
 
 	if (newtile && !oldtile) {
 		++map.tilecount;
@@ -255,4 +297,5 @@ void QTreeNode::clearTile(int x, int y, int z) {
 	TileLocation* tmp = &f->locs[offset_x * 4 + offset_y];
 	delete tmp->tile;
 	tmp->tile = map.allocator(tmp);
+	f->touch();
 }
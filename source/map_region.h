@@ -112,8 +112,30 @@ public:
 
 class Floor {
 public:
+	// Only created through MapAllocator::allocateFloor
 	Floor(int x, int y, int z);
+
+	// Changes whenever a tile on this floor is replaced or edited in place,
+	// values are never reused so a recycled floor never matches an old one
+	uint32_t getRevision() const {
+		return revision;
+	}
+	void touch();
+
+	// Locations with a selected tile, a bit for each of locs. Kept by the
+	// Selection of the editor.
+	uint16_t getSelected() const {
+		return selected;
+	}
+	void setSelected(uint16_t mask) {
+		selected = mask;
+	}
+
 	TileLocation locs[MAP_LAYERS];
+
+private:
+	uint32_t revision;
+	uint16_t selected;
 };
 
 // This is not a QuadTree, but a HexTree (16 child nodes to every node), so the name is abit misleading
@@ -133,6 +155,9 @@ public:
 	TileLocation* getTile(int x, int y, int z);
 	Tile* setTile(int x, int y, int z, Tile* tile);
 	void clearTile(int x, int y, int z);
+	// Takes every tile below this node out of the tree, deleting them if del
+	// is set. Doesn't update the tile count.
+	void clearTiles(bool del);
 
 	Floor* createFloor(int x, int y, int z);
 	Floor* getFloor(uint32_t z) {
@@ -37,16 +37,13 @@ END_EVENT_TABLE()
 
 MinimapWindow::MinimapWindow(wxWindow* parent) :
 	wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(205, 130)),
+	paint_count(0),
 	update_timer(this) {
-	for (int i = 0; i < 256; ++i) {
-		pens[i] = newd wxPen(wxColor(minimap_color[i].red, minimap_color[i].green, minimap_color[i].blue));
-	}
+	////
 }
 
 MinimapWindow::~MinimapWindow() {
-	for (int i = 0; i < 256; ++i) {
-		delete pens[i];
-	}
+	////
 }
 
 void MinimapWindow::OnSize(wxSizeEvent& event) {
@@ -119,24 +116,15 @@ void MinimapWindow::OnPaint(wxPaintEvent& event) {
 
 	int floor = g_gui.GetCurrentFloor();
 
-	// printf("Draw from %d:%d to %d:%d\n", start_x, start_y, end_x, end_y);
-	uint8_t last = 0;
 	if (g_gui.IsRenderingEnabled()) {
-		for (int y = start_y, window_y = 0; y <= end_y; ++y, ++window_y) {
-			for (int x = start_x, window_x = 0; x <= end_x; ++x, ++window_x) {
-				Tile* tile = editor.map.getTile(x, y, floor);
-				if (tile) {
-					uint8_t color = tile->getMiniMapColor();
-					if (color) {
-						if (last != color) {
-							pdc.SetPen(*pens[color]);
-							last = color;
-						}
-						pdc.DrawPoint(window_x, window_y);
-					}
-				}
+		++paint_count;
+		for (int chunk_y = start_y / MINIMAP_CHUNK_SIZE; chunk_y <= end_y / MINIMAP_CHUNK_SIZE; ++chunk_y) {
+			for (int chunk_x = start_x / MINIMAP_CHUNK_SIZE; chunk_x <= end_x / MINIMAP_CHUNK_SIZE; ++chunk_x) {
+				const MinimapChunk& chunk = GetChunk(editor.map, chunk_x, chunk_y, floor);
+				pdc.DrawBitmap(chunk.bitmap, chunk_x * MINIMAP_CHUNK_SIZE - start_x, chunk_y * MINIMAP_CHUNK_SIZE - start_y);
 			}
 		}
+		DropUnusedChunks();
 
 		if (g_settings.getInteger(Config::MINIMAP_VIEW_BOX)) {
 			pdc.SetPen(*wxWHITE_PEN);
@@ -174,6 +162,84 @@ void MinimapWindow::OnPaint(wxPaintEvent& event) {
 	}
 }
 
+MinimapChunk& MinimapWindow::GetChunk(Map& map, int chunk_x, int chunk_y, int floor) {
+	const int leaves = MINIMAP_CHUNK_SIZE / 4;
+	const uint32_t key = (uint32_t(floor) << 16) | (uint32_t(chunk_x) << 8) | uint32_t(chunk_y);
+
+	MinimapChunk& chunk = chunks[key];
+	chunk.last_used = paint_count;
+
+	// Bulk edits don't touch the floors, so start over when the map says so
+	bool redraw = false;
+	if (!chunk.image.IsOk()) {
+		chunk.image.Create(MINIMAP_CHUNK_SIZE, MINIMAP_CHUNK_SIZE);
+		chunk.revisions.assign(leaves * leaves, 0);
+		chunk.map_revision = map.getRevision();
+		redraw = true;
+	} else if (chunk.map_revision != map.getRevision()) {
+		chunk.map_revision = map.getRevision();
+		redraw = true;
+	}
+
+	const int base_x = chunk_x * MINIMAP_CHUNK_SIZE;
+	const int base_y = chunk_y * MINIMAP_CHUNK_SIZE;
+	unsigned char* data = chunk.image.GetData();
+	bool changed = false;
+
+	for (int leaf_y = 0; leaf_y < leaves; ++leaf_y) {
+		for (int leaf_x = 0; leaf_x < leaves; ++leaf_x) {
+			QTreeNode* leaf = map.getLeaf(base_x + leaf_x * 4, base_y + leaf_y * 4);
+			Floor* leaf_floor = leaf ? leaf->getFloor(floor) : nullptr;
+
+			// Floor revisions are never reused, so this also catches floors
+			// that were freed and allocated again for another map
+			uint32_t& revision = chunk.revisions[leaf_y * leaves + leaf_x];
+			const uint32_t current = leaf_floor ? leaf_floor->getRevision() : 0;
+			if (!redraw && revision == current) {
+				continue;
+			}
+			revision = current;
+			changed = true;
+
+			for (int i = 0; i < MAP_LAYERS; ++i) {
+				const int x = leaf_x * 4 + (i >> 2);
+				const int y = leaf_y * 4 + (i & 3);
+				unsigned char* pixel = data + (y * MINIMAP_CHUNK_SIZE + x) * 3;
+
+				const Tile* tile = leaf_floor ? leaf_floor->locs[i].get() : nullptr;
+				const uint8_t color = tile ? tile->getMiniMapColor() : 0;
+				if (color) {
+					pixel[0] = minimap_color[color].red;
+					pixel[1] = minimap_color[color].green;
+					pixel[2] = minimap_color[color].blue;
+				} else {
+					pixel[0] = pixel[1] = pixel[2] = 0;
+				}
+			}
+		}
+	}
+
+	if (changed || !chunk.bitmap.IsOk()) {
+		chunk.bitmap = wxBitmap(chunk.image);
+	}
+	return chunk;
+}
+
+void MinimapWindow::DropUnusedChunks() {
+	while (chunks.size() > MINIMAP_CHUNK_CACHE) {
+		auto oldest = chunks.begin();
+		for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+			if (it->second.last_used < oldest->second.last_used) {
+				oldest = it;
+			}
+		}
+		if (oldest->second.last_used == paint_count) {
+			break;
+		}
+		chunks.erase(oldest);
+	}
+}
+
 void MinimapWindow::OnMouseClick(wxMouseEvent& event) {
 	if (!g_gui.IsEditorOpen()) {
 		return;
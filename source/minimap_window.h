@@ -18,6 +18,23 @@
 #ifndef RME_MINIMAP_WINDOW_H_
 #define RME_MINIMAP_WINDOW_H_
 
+class Map;
+
+// Side of the square blocks the minimap caches, matches one leaf index page
+#define MINIMAP_CHUNK_SIZE 256
+// How many blocks are kept around before the least recently drawn is dropped
+#define MINIMAP_CHUNK_CACHE 64
+
+// One floor of a 256x256 block of the map, rasterized once and redrawn
+// only where the revision of a leaf below it changed
+struct MinimapChunk {
+	wxImage image;
+	wxBitmap bitmap;
+	std::vector<uint32_t> revisions; // Floor revision of each 4x4 leaf, 0 for none
+	uint32_t map_revision;
+	uint32_t last_used;
+};
+
 class MinimapWindow : public wxPanel {
 public:
 	MinimapWindow(wxWindow* parent);
@@ -34,7 +51,12 @@ public:
 	void OnKey(wxKeyEvent& event);
 
 protected:
-	wxPen* pens[256];
+	// Brings the cached block up to date with the map and returns it
+	MinimapChunk& GetChunk(Map& map, int chunk_x, int chunk_y, int floor);
+	void DropUnusedChunks();
+
+	std::map<uint32_t, MinimapChunk> chunks;
+	uint32_t paint_count;
 	wxTimer update_timer;
 	int last_start_x;
 	int last_start_y;
@@ -107,15 +107,45 @@ mt_set(void* vstate, unsigned long int s) {
 }
 
 static mt_state_t mt_state;
+static thread_local MTRandomStream* mt_stream = nullptr;
 
 void mt_seed(unsigned long s) {
 	mt_set(&mt_state, s);
 }
 
 unsigned long mt_randi() {
+	if (mt_stream) {
+		return mt_stream->next();
+	}
 	return mt_get(&mt_state);
 }
 
 double mt_randd() {
+	if (mt_stream) {
+		return mt_stream->next() / 4294967296.0;
+	}
 	return mt_get_double(&mt_state);
 }
+
+MTRandomStream::MTRandomStream(uint64_t key) :
+	state(key),
+	previous(mt_stream) {
+	mt_stream = this;
+}
+
+MTRandomStream::~MTRandomStream() {
+	mt_stream = previous;
+}
+
+uint32_t MTRandomStream::next() {
+	// splitmix64
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return uint32_t((z ^ (z >> 31)) >> 32);
+}
+
+uint64_t MTRandomStream::key(uint64_t seed, int x, int y, int z) {
+	const uint64_t position = (uint64_t(uint16_t(x)) << 24) | (uint64_t(uint16_t(y)) << 8) | uint64_t(uint8_t(z));
+	return seed ^ (position * 0xD6E8FEB86659FD93ULL);
+}
@@ -18,8 +18,32 @@
 #ifndef RME_MT_RAND_H_
 #define RME_MT_RAND_H_
 
+#include <stdint.h>
+
 void mt_seed(unsigned long s);
 unsigned long mt_randi();
 double mt_randd();
 
+// While one of these is alive, mt_randi and mt_randd on the thread that
+// created it draw from a small generator seeded with the key instead of the
+// shared twister. Work split over several threads can give each tile its own
+// stream and get the same numbers however the work is scheduled.
+class MTRandomStream {
+public:
+	MTRandomStream(uint64_t key);
+	~MTRandomStream();
+
+	MTRandomStream(const MTRandomStream&) = delete;
+	MTRandomStream& operator=(const MTRandomStream&) = delete;
+
+	uint32_t next();
+
+	// Combines a per-run seed with a map position into a stream key
+	static uint64_t key(uint64_t seed, int x, int y, int z);
+
+private:
+	uint64_t state;
+	MTRandomStream* previous;
+};
+
 #endif
@@ -0,0 +1,254 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_OTBM_JOB_QUEUE_H_
+#define RME_OTBM_JOB_QUEUE_H_
+
+#include "filehandle.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs jobs on a pool of worker threads. Jobs are queued in order and
+// handed back in that same order once they have been processed, so the
+// results can be consumed sequentially (merged into a map, written to file).
+template <typename Job>
+class OTBM_JobQueue {
+public:
+	OTBM_JobQueue(std::function<void(Job&)> process, int thread_count) :
+		process(process) {
+		for (int i = 0; i < thread_count; ++i) {
+			threads.emplace_back(&OTBM_JobQueue::work, this);
+		}
+	}
+
+	~OTBM_JobQueue() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		job_queued.notify_all();
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+
+	// Appends a job, workers won't pick it up until it is submitted
+	Job& emplace() {
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.emplace_back();
+		return jobs.back().job;
+	}
+
+	// Submits the most recently emplaced job
+	void submit() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			++submitted;
+		}
+		job_queued.notify_one();
+	}
+
+	// Returns the oldest job once it has been processed, or nullptr if there
+	// is none. If wait is set, blocks until the oldest job is done.
+	Job* front(bool wait) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (jobs.empty()) {
+			return nullptr;
+		}
+		Entry& entry = jobs.front();
+		if (!entry.done) {
+			if (!wait) {
+				return nullptr;
+			}
+			job_done.wait(lock, [&entry]() { return entry.done; });
+		}
+		return &entry.job;
+	}
+
+	// Releases the job returned by front()
+	void pop() {
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.pop_front();
+		--next_job;
+		--submitted;
+	}
+
+	size_t size() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return jobs.size();
+	}
+
+private:
+	struct Entry {
+		Job job;
+		bool done = false;
+	};
+
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			job_queued.wait(lock, [this]() { return stopping || next_job < submitted; });
+			if (next_job >= submitted) {
+				return;
+			}
+
+			// Deque elements stay in place while others are pushed or popped
+			Entry& entry = jobs[next_job++];
+			lock.unlock();
+			process(entry.job);
+			lock.lock();
+
+			entry.done = true;
+			job_done.notify_all();
+		}
+	}
+
+	std::function<void(Job&)> process;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable job_queued;
+	std::condition_variable job_done;
+	std::deque<Entry> jobs;
+	size_t next_job = 0;
+	size_t submitted = 0;
+	bool stopping = false;
+};
+
+// Collects the tiles of a map into 256x256 blocks, encodes every block into
+// a buffer of its own, on worker threads if there are several, and passes
+// the buffers on in the order the blocks were started. Since a block always
+// begins with a new tile area, the result is the same as encoding all tiles
+// in one go, whatever the number of threads.
+template <typename TileType>
+class OTBM_BlockSaver {
+public:
+	typedef std::function<void(const std::vector<TileType*>&, NodeFileWriteHandle&)> Encoder;
+	// Gets the origin and contents of each block, cached is set for blocks
+	// that were passed in already encoded
+	typedef std::function<void(int, int, const uint8_t*, size_t, bool)> Writer;
+
+	OTBM_BlockSaver(Encoder encode, Writer write, int thread_count) :
+		encode(encode),
+		write(write),
+		thread_count(thread_count),
+		block_x(-1),
+		block_y(-1),
+		cached_block(nullptr) {
+		if (thread_count > 1) {
+			queue.reset(newd OTBM_JobQueue<Job>([this](Job& job) {
+				if (!job.cached) {
+					this->encode(job.tiles, job.output);
+				}
+			}, thread_count));
+		}
+	}
+
+	// Ends the current block and starts the one at x, y. If cached is set it
+	// holds the block already encoded, and no tiles are added to it.
+	void beginBlock(int x, int y, const std::vector<uint8_t>* cached) {
+		flush();
+		block_x = x;
+		block_y = y;
+		cached_block = cached;
+	}
+	void addTile(TileType* tile) {
+		tiles.push_back(tile);
+	}
+	// Ends the last block and returns once every block has been written
+	void finish() {
+		flush();
+		block_x = -1;
+		if (queue) {
+			writeReady(true);
+		}
+	}
+
+private:
+	struct Job {
+		int x = 0;
+		int y = 0;
+		const std::vector<uint8_t>* cached = nullptr;
+		std::vector<TileType*> tiles;
+		MemoryNodeFileWriteHandle output;
+	};
+
+	void writeJob(Job& job) {
+		if (job.cached) {
+			write(job.x, job.y, job.cached->data(), job.cached->size(), true);
+		} else {
+			write(job.x, job.y, job.output.getMemory(), job.output.getSize(), false);
+		}
+	}
+
+	void writeReady(bool wait) {
+		while (Job* job = queue->front(wait)) {
+			writeJob(*job);
+			queue->pop();
+		}
+	}
+
+	void flush() {
+		if (block_x < 0 || (!cached_block && tiles.empty())) {
+			return;
+		}
+		if (!queue) {
+			Job job;
+			job.x = block_x;
+			job.y = block_y;
+			job.cached = cached_block;
+			if (!cached_block) {
+				encode(tiles, job.output);
+				tiles.clear();
+			}
+			writeJob(job);
+			return;
+		}
+
+		Job& job = queue->emplace();
+		job.x = block_x;
+		job.y = block_y;
+		job.cached = cached_block;
+		job.tiles.swap(tiles);
+		queue->submit();
+
+		// Don't let encoded blocks pile up in memory
+		while (queue->size() > size_t(thread_count) * 4) {
+			if (Job* oldest = queue->front(true)) {
+				writeJob(*oldest);
+				queue->pop();
+			}
+		}
+		writeReady(false);
+	}
+
+	Encoder encode;
+	Writer write;
+	const int thread_count;
+	int block_x;
+	int block_y;
+	const std::vector<uint8_t>* cached_block;
+	std::vector<TileType*> tiles;
+	std::unique_ptr<OTBM_JobQueue<Job>> queue;
+};
+
+#endif
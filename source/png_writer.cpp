@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "png_writer.h"
+
+// Compressed data is flushed to the file in IDAT chunks of this size
+static const size_t PNG_IDAT_SIZE = 64 * 1024;
+
+static void writeU32BE(uint8_t* out, uint32_t value) {
+	out[0] = uint8_t(value >> 24);
+	out[1] = uint8_t(value >> 16);
+	out[2] = uint8_t(value >> 8);
+	out[3] = uint8_t(value);
+}
+
+PNGStreamWriter::PNGStreamWriter() :
+	file(nullptr),
+	stream_open(false),
+	width(0),
+	height(0),
+	rows_written(0) {
+	memset(&stream, 0, sizeof(stream));
+}
+
+PNGStreamWriter::~PNGStreamWriter() {
+	if (stream_open) {
+		deflateEnd(&stream);
+	}
+	delete file;
+}
+
+bool PNGStreamWriter::open(const std::string& filename, uint32_t new_width, uint32_t new_height) {
+	if (file || new_width == 0 || new_height == 0 || new_width > 0x7FFFFFFF / 3) {
+		return false;
+	}
+
+	file = newd FileWriteHandle(filename);
+	if (!file->isOk()) {
+		return false;
+	}
+
+	if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		return false;
+	}
+	stream_open = true;
+
+	width = new_width;
+	height = new_height;
+	rows_written = 0;
+	filtered.resize(size_t(width) * 3 + 1);
+	compressed.resize(PNG_IDAT_SIZE);
+	stream.next_out = compressed.data();
+	stream.avail_out = uInt(PNG_IDAT_SIZE);
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (!file->addRAW(signature, sizeof(signature))) {
+		return false;
+	}
+
+	uint8_t header[13];
+	writeU32BE(header, width);
+	writeU32BE(header + 4, height);
+	header[8] = 8; // bits per channel
+	header[9] = 2; // RGB
+	header[10] = 0; // deflate
+	header[11] = 0; // adaptive filtering
+	header[12] = 0; // not interlaced
+	return writeChunk("IHDR", header, sizeof(header));
+}
+
+bool PNGStreamWriter::addRows(const uint8_t* rows, uint32_t count) {
+	if (!stream_open || rows_written + count > height) {
+		return false;
+	}
+
+	const size_t stride = size_t(width) * 3;
+	for (uint32_t row = 0; row < count; ++row, rows += stride) {
+		// The "sub" filter, neighbouring pixels of a map render are often
+		// the same so this compresses much better than storing them raw
+		filtered[0] = 1;
+		memcpy(&filtered[1], rows, 3);
+		for (size_t i = 3; i < stride; ++i) {
+			filtered[i + 1] = uint8_t(rows[i] - rows[i - 3]);
+		}
+		if (!compress(filtered.data(), filtered.size(), Z_NO_FLUSH)) {
+			return false;
+		}
+	}
+	rows_written += count;
+	return true;
+}
+
+bool PNGStreamWriter::close() {
+	if (!stream_open) {
+		return false;
+	}
+
+	bool ok = rows_written == height && compress(nullptr, 0, Z_FINISH) && writeChunk("IEND", nullptr, 0);
+	deflateEnd(&stream);
+	stream_open = false;
+
+	ok = ok && file->isOk();
+	delete file;
+	file = nullptr;
+	return ok;
+}
+
+bool PNGStreamWriter::writeChunk(const char* type, const uint8_t* data, size_t size) {
+	uint8_t length[4];
+	writeU32BE(length, uint32_t(size));
+
+	uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+	if (size > 0) {
+		crc = crc32(crc, data, uInt(size));
+	}
+	uint8_t checksum[4];
+	writeU32BE(checksum, uint32_t(crc));
+
+	return file->addRAW(length, 4) && file->addRAW(reinterpret_cast<const uint8_t*>(type), 4) && (size == 0 || file->addRAW(data, size)) && file->addRAW(checksum, 4);
+}
+
+bool PNGStreamWriter::compress(const uint8_t* data, size_t size, int flush) {
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = uInt(size);
+
+	while (true) {
+		int ret = deflate(&stream, flush);
+		if (ret == Z_STREAM_ERROR) {
+			return false;
+		}
+
+		if (stream.avail_out == 0) {
+			if (!flushOutput()) {
+				return false;
+			}
+		} else if (ret == Z_STREAM_END) {
+			return flushOutput();
+		} else if (flush == Z_NO_FLUSH && stream.avail_in == 0) {
+			return true;
+		}
+	}
+}
+
+bool PNGStreamWriter::flushOutput() {
+	size_t pending = PNG_IDAT_SIZE - stream.avail_out;
+	if (pending > 0 && !writeChunk("IDAT", compressed.data(), pending)) {
+		return false;
+	}
+	stream.next_out = compressed.data();
+	stream.avail_out = uInt(PNG_IDAT_SIZE);
+	return true;
+}
@@ -0,0 +1,55 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_PNG_WRITER_H_
+#define RME_PNG_WRITER_H_
+
+#include "filehandle.h"
+
+#include <zlib.h>
+
+// Writes an 8 bit RGB PNG a few rows at a time, only the rows passed to
+// addRows and the compressor state are kept in memory, so images far bigger
+// than the available RAM can be written.
+class PNGStreamWriter : boost::noncopyable {
+public:
+	PNGStreamWriter();
+	~PNGStreamWriter();
+
+	bool open(const std::string& filename, uint32_t width, uint32_t height);
+	// Rows are width * 3 bytes each, top to bottom
+	bool addRows(const uint8_t* rows, uint32_t count);
+	// Fails if fewer rows than the height were added
+	bool close();
+
+private:
+	bool writeChunk(const char* type, const uint8_t* data, size_t size);
+	bool compress(const uint8_t* data, size_t size, int flush);
+	// Writes the compressed data collected so far as an IDAT chunk
+	bool flushOutput();
+
+	FileWriteHandle* file;
+	z_stream stream;
+	bool stream_open;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rows_written;
+	std::vector<uint8_t> filtered;
+	std::vector<uint8_t> compressed;
+};
+
+#endif
@@ -215,6 +215,16 @@ wxNotebookPage* PreferencesWindow::CreateGraphicsPage() {
 	sizer->Add(icon_selection_shadow_chkbox, 0, wxLEFT | wxTOP, 5);
 	SetWindowToolTip(icon_selection_shadow_chkbox, "When this option is checked, selected items in the palette menu will be shaded.");
 
+	use_sprite_batching_chkbox = newd wxCheckBox(graphics_page, wxID_ANY, "Batch sprite drawing");
+	use_sprite_batching_chkbox->SetValue(g_settings.getBoolean(Config::USE_SPRITE_BATCHING));
+	sizer->Add(use_sprite_batching_chkbox, 0, wxLEFT | wxTOP, 5);
+	SetWindowToolTip(use_sprite_batching_chkbox, "When this is checked, sprites are collected and drawn in large batches, which is much faster on busy maps.\nUncheck it to draw every sprite on its own if the map does not display correctly.");
+
+	use_background_decoding_chkbox = newd wxCheckBox(graphics_page, wxID_ANY, "Decode sprites in the background");
+	use_background_decoding_chkbox->SetValue(g_settings.getBoolean(Config::USE_BACKGROUND_SPRITE_DECODING));
+	sizer->Add(use_background_decoding_chkbox, 0, wxLEFT | wxTOP, 5);
+	SetWindowToolTip(use_background_decoding_chkbox, "When this is checked, sprites that have not been shown yet are loaded on worker threads and drawn as faint squares until they are ready.\nThis keeps scrolling smooth, uncheck it to load every sprite before the frame is shown.");
+
 	use_memcached_chkbox = newd wxCheckBox(graphics_page, wxID_ANY, "Use memcached sprites");
 	use_memcached_chkbox->SetValue(g_settings.getBoolean(Config::USE_MEMCACHED_SPRITES));
 	sizer->Add(use_memcached_chkbox, 0, wxLEFT | wxTOP, 5);
@@ -612,6 +622,8 @@ void PreferencesWindow::Apply() {
 
 	// Graphics
 	g_settings.setInteger(Config::USE_GUI_SELECTION_SHADOW, icon_selection_shadow_chkbox->GetValue());
+	g_settings.setInteger(Config::USE_SPRITE_BATCHING, use_sprite_batching_chkbox->GetValue());
+	g_settings.setInteger(Config::USE_BACKGROUND_SPRITE_DECODING, use_background_decoding_chkbox->GetValue());
 	if (g_settings.getBoolean(Config::USE_MEMCACHED_SPRITES) != use_memcached_chkbox->GetValue()) {
 		must_restart = true;
 	}
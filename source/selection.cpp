@@ -18,29 +18,71 @@
 #include "main.h"
 
 #include "selection.h"
+#include "floor_selection.h"
 #include "tile.h"
 #include "creature.h"
 #include "item.h"
 #include "editor.h"
 #include "gui.h"
 
+#include <atomic>
+#include <thread>
+
+// Width of the columns a box selection is split into, a multiple of the leaf size
+#define SELECTION_STRIPE_SIZE 64
+
+Selection::iterator::iterator(std::unordered_set<Floor*>::const_iterator floor, std::unordered_set<Floor*>::const_iterator end) :
+	floor(floor),
+	end(end),
+	index(0) {
+	skip();
+}
+
+void Selection::iterator::skip() {
+	for (; floor != end; ++floor, index = 0) {
+		const uint16_t selected = (*floor)->getSelected();
+		for (; index < MAP_LAYERS; ++index) {
+			if ((selected & (1 << index)) && (*floor)->locs[index].get()) {
+				return;
+			}
+		}
+	}
+	index = 0;
+}
+
+Selection::iterator& Selection::iterator::operator++() {
+	++index;
+	skip();
+	return *this;
+}
+
+Selection::iterator Selection::iterator::operator++(int) {
+	iterator previous = *this;
+	++*this;
+	return previous;
+}
+
 Selection::Selection(Editor& editor) :
 	busy(false),
 	editor(editor),
 	session(nullptr),
-	subsession(nullptr) {
+	subsession(nullptr),
+	tile_count(0) {
 	////
 }
 
 Selection::~Selection() {
+	for (auto& entry : pending) {
+		delete entry.second;
+	}
 	delete subsession;
 	delete session;
 }
 
 Position Selection::minPosition() const {
 	Position minPos(0x10000, 0x10000, 0x10);
-	for (TileSet::const_iterator tile = tiles.begin(); tile != tiles.end(); ++tile) {
-		Position pos((*tile)->getPosition());
+	for (Tile* tile : *this) {
+		Position pos(tile->getPosition());
 		if (minPos.x > pos.x) {
 			minPos.x = pos.x;
 		}
@@ -56,8 +98,8 @@ Position Selection::minPosition() const {
 
 Position Selection::maxPosition() const {
 	Position maxPos(0, 0, 0);
-	for (TileSet::const_iterator tile = tiles.begin(); tile != tiles.end(); ++tile) {
-		Position pos((*tile)->getPosition());
+	for (Tile* tile : *this) {
+		Position pos(tile->getPosition());
 		if (maxPos.x < pos.x) {
 			maxPos.x = pos.x;
 		}
@@ -71,6 +113,31 @@ Position Selection::maxPosition() const {
 	return maxPos;
 }
 
+Floor* Selection::getFloor(const Tile* tile) const {
+	const Position pos = tile->getPosition();
+	QTreeNode* leaf = editor.map.getLeaf(pos.x, pos.y);
+	return leaf ? leaf->getFloor(pos.z) : nullptr;
+}
+
+FloorSelection* Selection::record(Tile* tile) {
+	ASSERT(subsession);
+	Floor* floor = getFloor(tile);
+	ASSERT(floor);
+
+	FloorSelection*& state = pending[floor];
+	if (!state) {
+		state = newd FloorSelection(floor);
+	}
+	return state;
+}
+
+void Selection::flush() {
+	for (auto& entry : pending) {
+		subsession->addChange(newd Change(entry.second));
+	}
+	pending.clear();
+}
+
 void Selection::add(Tile* tile, Item* item) {
 	ASSERT(subsession);
 	ASSERT(tile);
@@ -80,18 +147,13 @@ void Selection::add(Tile* tile, Item* item) {
 		return;
 	}
 
-	// Make a copy of the tile with the item selected
-	item->select();
-	Tile* new_tile = tile->deepCopy(editor.map);
-	item->deselect();
-
+	FloorSelection* state = record(tile);
+	state->select(tile, item, true);
 	if (g_settings.getInteger(Config::BORDER_IS_GROUND)) {
 		if (item->isBorder()) {
-			new_tile->selectGround();
+			state->selectGround(tile, true);
 		}
 	}
-
-	subsession->addChange(newd Change(new_tile));
 }
 
 void Selection::add(Tile* tile, Spawn* spawn) {
@@ -103,12 +165,7 @@ void Selection::add(Tile* tile, Spawn* spawn) {
 		return;
 	}
 
-	// Make a copy of the tile with the item selected
-	spawn->select();
-	Tile* new_tile = tile->deepCopy(editor.map);
-	spawn->deselect();
-
-	subsession->addChange(newd Change(new_tile));
+	record(tile)->selectSpawn(tile, true);
 }
 
 void Selection::add(Tile* tile, Creature* creature) {
@@ -120,22 +177,14 @@ void Selection::add(Tile* tile, Creature* creature) {
 		return;
 	}
 
-	// Make a copy of the tile with the item selected
-	creature->select();
-	Tile* new_tile = tile->deepCopy(editor.map);
-	creature->deselect();
-
-	subsession->addChange(newd Change(new_tile));
+	record(tile)->selectCreature(tile, true);
 }
 
 void Selection::add(Tile* tile) {
 	ASSERT(subsession);
 	ASSERT(tile);
 
-	Tile* new_tile = tile->deepCopy(editor.map);
-	new_tile->select();
-
-	subsession->addChange(newd Change(new_tile));
+	record(tile)->selectAll(tile, true);
 }
 
 void Selection::remove(Tile* tile, Item* item) {
@@ -143,17 +192,11 @@ void Selection::remove(Tile* tile, Item* item) {
 	ASSERT(tile);
 	ASSERT(item);
 
-	bool tmp = item->isSelected();
-	item->deselect();
-	Tile* new_tile = tile->deepCopy(editor.map);
-	if (tmp) {
-		item->select();
-	}
+	FloorSelection* state = record(tile);
+	state->select(tile, item, false);
 	if (item->isBorder() && g_settings.getInteger(Config::BORDER_IS_GROUND)) {
-		new_tile->deselectGround();
+		state->selectGround(tile, false);
 	}
-
-	subsession->addChange(newd Change(new_tile));
 }
 
 void Selection::remove(Tile* tile, Spawn* spawn) {
@@ -161,14 +204,7 @@ void Selection::remove(Tile* tile, Spawn* spawn) {
 	ASSERT(tile);
 	ASSERT(spawn);
 
-	bool tmp = spawn->isSelected();
-	spawn->deselect();
-	Tile* new_tile = tile->deepCopy(editor.map);
-	if (tmp) {
-		spawn->select();
-	}
-
-	subsession->addChange(newd Change(new_tile));
+	record(tile)->selectSpawn(tile, false);
 }
 
 void Selection::remove(Tile* tile, Creature* creature) {
@@ -176,58 +212,74 @@ void Selection::remove(Tile* tile, Creature* creature) {
 	ASSERT(tile);
 	ASSERT(creature);
 
-	bool tmp = creature->isSelected();
-	creature->deselect();
-	Tile* new_tile = tile->deepCopy(editor.map);
-	if (tmp) {
-		creature->select();
-	}
-
-	subsession->addChange(newd Change(new_tile));
+	record(tile)->selectCreature(tile, false);
 }
 
 void Selection::remove(Tile* tile) {
 	ASSERT(subsession);
 
-	Tile* new_tile = tile->deepCopy(editor.map);
-	new_tile->deselect();
-
-	subsession->addChange(newd Change(new_tile));
+	record(tile)->selectAll(tile, false);
 }
 
 void Selection::addInternal(Tile* tile) {
 	ASSERT(tile);
 
-	tiles.insert(tile);
+	Floor* floor = getFloor(tile);
+	const Position pos = tile->getPosition();
+	const uint16_t bit = 1 << ((pos.x & 3) * 4 + (pos.y & 3));
+	if (!floor || (floor->getSelected() & bit)) {
+		return;
+	}
+	floor->setSelected(floor->getSelected() | bit);
+	floors.insert(floor);
+	++tile_count;
 }
 
 void Selection::removeInternal(Tile* tile) {
 	ASSERT(tile);
-	tiles.erase(tile);
+
+	Floor* floor = getFloor(tile);
+	const Position pos = tile->getPosition();
+	const uint16_t bit = 1 << ((pos.x & 3) * 4 + (pos.y & 3));
+	if (!floor || !(floor->getSelected() & bit)) {
+		return;
+	}
+	floor->setSelected(floor->getSelected() & ~bit);
+	if (floor->getSelected() == 0) {
+		floors.erase(floor);
+	}
+	--tile_count;
+}
+
+void Selection::updateInternal(Tile* tile) {
+	if (tile->isSelected()) {
+		addInternal(tile);
+	} else {
+		removeInternal(tile);
+	}
 }
 
 void Selection::clear() {
 	if (session) {
-		for (TileSet::iterator it = tiles.begin(); it != tiles.end(); it++) {
-			Tile* new_tile = (*it)->deepCopy(editor.map);
-			new_tile->deselect();
-			subsession->addChange(newd Change(new_tile));
+		for (Tile* tile : *this) {
+			record(tile)->selectAll(tile, false);
 		}
 	} else {
-		for (TileSet::iterator it = tiles.begin(); it != tiles.end(); it++) {
-			(*it)->deselect();
+		for (Tile* tile : *this) {
+			tile->deselect();
+			editor.map.tileTouched(tile->getPosition());
+		}
+		for (Floor* floor : floors) {
+			floor->setSelected(0);
 		}
-		tiles.clear();
+		floors.clear();
+		tile_count = 0;
 	}
 }
 
 void Selection::start(SessionFlags flags) {
 	if (!(flags & INTERNAL)) {
-		if (flags & SUBTHREAD) {
-			;
-		} else {
-			session = editor.actionQueue->createBatch(ACTION_SELECT);
-		}
+		session = editor.actionQueue->createBatch(ACTION_SELECT);
 		subsession = editor.actionQueue->createAction(ACTION_SELECT);
 	}
 	busy = true;
@@ -236,6 +288,7 @@ void Selection::start(SessionFlags flags) {
 void Selection::commit() {
 	if (session) {
 		ASSERT(subsession);
+		flush();
 		// We need to step out of the session before we do the action, else peril awaits us!
 		BatchAction* tmp = session;
 		session = nullptr;
@@ -251,22 +304,18 @@ void Selection::commit() {
 
 void Selection::finish(SessionFlags flags) {
 	if (!(flags & INTERNAL)) {
-		if (flags & SUBTHREAD) {
-			ASSERT(subsession);
-			subsession = nullptr;
-		} else {
-			ASSERT(session);
-			ASSERT(subsession);
-			// We need to exit the session before we do the action, else peril awaits us!
-			BatchAction* tmp = session;
-			session = nullptr;
+		ASSERT(session);
+		ASSERT(subsession);
+		flush();
+		// We need to exit the session before we do the action, else peril awaits us!
+		BatchAction* tmp = session;
+		session = nullptr;
 
-			tmp->addAndCommitAction(subsession);
-			editor.addBatch(tmp, 2);
+		tmp->addAndCommitAction(subsession);
+		editor.addBatch(tmp, 2);
 
-			session = nullptr;
-			subsession = nullptr;
-		}
+		session = nullptr;
+		subsession = nullptr;
 	}
 	busy = false;
 }
@@ -283,57 +332,96 @@ void Selection::updateSelectionCount() {
 	}
 }
 
-void Selection::join(SelectionThread* thread) {
-	thread->Wait();
-
-	ASSERT(session);
-	session->addAction(thread->result);
-	thread->selection.subsession = nullptr;
-
-	delete thread;
-}
-
-SelectionThread::SelectionThread(Editor& editor, Position start, Position end) :
-	wxThread(wxTHREAD_JOINABLE),
-	editor(editor),
-	start(start),
-	end(end),
-	selection(editor),
-	result(nullptr) {
-	////
-}
-
-SelectionThread::~SelectionThread() {
-	////
-}
+void Selection::addArea(const Position& start, const Position& end, bool compensate) {
+	ASSERT(subsession);
 
-void SelectionThread::Execute() {
-	Create();
-	Run();
-}
+	// One stripe of leaves on one floor
+	struct Stripe {
+		int start_x, end_x;
+		int start_y, end_y;
+		int z;
+	};
+
+	std::vector<Stripe> stripes;
+	int64_t area = 0;
+	for (int z = start.z, shift = 0; z >= end.z; --z) {
+		const int start_x = std::max(start.x + shift, 0);
+		const int start_y = std::max(start.y + shift, 0);
+		const int end_x = end.x + shift;
+		const int end_y = end.y + shift;
+		for (int x = start_x; x <= end_x; x = (x & ~(SELECTION_STRIPE_SIZE - 1)) + SELECTION_STRIPE_SIZE) {
+			const int stripe_end = std::min(end_x, (x | (SELECTION_STRIPE_SIZE - 1)));
+			stripes.push_back({ x, stripe_end, start_y, end_y, z });
+			area += int64_t(stripe_end - x + 1) * std::max(end_y - start_y + 1, 0);
+		}
+		if (z <= GROUND_LAYER && compensate) {
+			++shift;
+		}
+	}
 
-wxThread::ExitCode SelectionThread::Entry() {
-	selection.start(Selection::SUBTHREAD);
-	for (int z = start.z; z >= end.z; --z) {
-		for (int x = start.x; x <= end.x; ++x) {
-			for (int y = start.y; y <= end.y; ++y) {
-				Tile* tile = editor.map.getTile(x, y, z);
-				if (!tile) {
+	// A floor lies in a single stripe, so the records a worker creates or
+	// finds in pending are only touched by that worker
+	BaseMap& map = editor.map;
+	auto selectStripe = [&](const Stripe& stripe, std::vector<FloorSelection*>& created) {
+		for (int x = stripe.start_x & ~3; x <= stripe.end_x; x += 4) {
+			for (int y = stripe.start_y & ~3; y <= stripe.end_y; y += 4) {
+				QTreeNode* leaf = map.getLeaf(x, y);
+				Floor* floor = leaf ? leaf->getFloor(stripe.z) : nullptr;
+				if (!floor) {
 					continue;
 				}
 
-				selection.add(tile);
+				FloorSelection* state = nullptr;
+				auto it = pending.find(floor);
+				if (it != pending.end()) {
+					state = it->second;
+				}
+				for (TileLocation& location : floor->locs) {
+					Tile* tile = location.get();
+					if (!tile) {
+						continue;
+					}
+					const Position pos = location.getPosition();
+					if (pos.x < stripe.start_x || pos.x > stripe.end_x || pos.y < stripe.start_y || pos.y > stripe.end_y) {
+						continue;
+					}
+
+					if (!state) {
+						state = newd FloorSelection(floor);
+						created.push_back(state);
+					}
+					state->selectAll(tile, true);
+				}
 			}
 		}
-		if (z <= GROUND_LAYER && g_settings.getInteger(Config::COMPENSATED_SELECT)) {
-			++start.x;
-			++start.y;
-			++end.x;
-			++end.y;
+	};
+
+	// Every worker fills its own list, they are added to pending afterwards
+	int thread_count = std::min<int>(std::max(g_settings.getInteger(Config::WORKER_THREADS), 1), stripes.size());
+	if (area < 4096) {
+		// Not worth starting threads for
+		thread_count = 1;
+	}
+	std::vector<std::vector<FloorSelection*>> results(std::max(thread_count, 1));
+	std::atomic<size_t> next(0);
+	auto work = [&](std::vector<FloorSelection*>& created) {
+		for (size_t i = next++; i < stripes.size(); i = next++) {
+			selectStripe(stripes[i], created);
 		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < thread_count; ++i) {
+		threads.emplace_back(work, std::ref(results[i]));
+	}
+	work(results[0]);
+	for (std::thread& thread : threads) {
+		thread.join();
 	}
-	result = selection.subsession;
-	selection.finish(Selection::SUBTHREAD);
 
-	return nullptr;
+	for (std::vector<FloorSelection*>& created : results) {
+		for (FloorSelection* state : created) {
+			pending[state->getFloor()] = state;
+		}
+	}
 }
@@ -19,12 +19,14 @@
 #define RME_SELECTION_H
 
 #include "position.h"
+#include "map_region.h"
+
+#include <unordered_map>
 
 class Action;
 class Editor;
 class BatchAction;
-
-class SelectionThread;
+class FloorSelection;
 
 class Selection {
 public:
@@ -45,6 +47,14 @@ public:
 	// The tile will be added to the list of selected tiles, however, the items on the tile won't be selected
 	void addInternal(Tile* tile);
 	void removeInternal(Tile* tile);
+	// Adds or removes the tile as its items say
+	void updateInternal(Tile* tile);
+
+	// Selects every tile in the box, start.z being the deepest floor. With
+	// compensate the box moves one tile right and down for each floor it
+	// climbs at or above ground. Leaf aligned stripes of the box are handed
+	// out to WORKER_THREADS threads.
+	void addArea(const Position& start, const Position& end, bool compensate);
 
 	// Clears the selection completely
 	void clear();
@@ -60,69 +70,83 @@ public:
 
 	// This manages a "selection session"
 	// Internal session doesn't store the result (eg. no undo)
-	// Subthread means the session doesn't create a complete
-	// action, just part of one to be merged with the main thread
-	// later.
 	enum SessionFlags {
 		NONE,
 		INTERNAL = 1,
-		SUBTHREAD = 2,
 	};
 
 	void start(SessionFlags flags = NONE);
 	void commit();
 	void finish(SessionFlags flags = NONE);
 
-	// Joins the selection instance in this thread with this instance
-	// This deletes the thread
-	void join(SelectionThread* thread);
-
 	size_t size() {
-		return tiles.size();
+		return tile_count;
 	}
 	size_t size() const {
-		return tiles.size();
+		return tile_count;
 	}
 	void updateSelectionCount();
-	TileSet::iterator begin() {
-		return tiles.begin();
-	}
-	TileSet::iterator end() {
-		return tiles.end();
+
+	// Visits the selected tiles floor by floor, in no particular order
+	class iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef Tile* value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Tile** pointer;
+		typedef Tile*& reference;
+
+		iterator(std::unordered_set<Floor*>::const_iterator floor, std::unordered_set<Floor*>::const_iterator end);
+
+		Tile* operator*() const {
+			return (*floor)->locs[index].get();
+		}
+		iterator& operator++();
+		iterator operator++(int);
+		bool operator==(const iterator& other) const {
+			return floor == other.floor && index == other.index;
+		}
+		bool operator!=(const iterator& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		// Moves to the next selected tile starting at the current index
+		void skip();
+
+		std::unordered_set<Floor*>::const_iterator floor;
+		std::unordered_set<Floor*>::const_iterator end;
+		int index;
+	};
+
+	iterator begin() const {
+		return iterator(floors.begin(), floors.end());
 	}
-	TileSet& getTiles() {
-		return tiles;
+	iterator end() const {
+		return iterator(floors.end(), floors.end());
 	}
 	Tile* getSelectedTile() {
 		ASSERT(size() == 1);
-		return *tiles.begin();
+		return *begin();
 	}
 
 private:
+	Floor* getFloor(const Tile* tile) const;
+	// The record of the running session for the floor of the tile
+	FloorSelection* record(Tile* tile);
+	// Hands the records to the running session
+	void flush();
+
 	bool busy;
 	Editor& editor;
 	BatchAction* session;
 	Action* subsession;
 
-	TileSet tiles;
-
-	friend class SelectionThread;
-};
-
-class SelectionThread : public wxThread {
-public:
-	SelectionThread(Editor& editor, Position start, Position end);
-	virtual ~SelectionThread();
-
-	void Execute(); // Calls "Create" and then "Run"
-protected:
-	virtual ExitCode Entry();
-	Editor& editor;
-	Position start, end;
-	Selection selection;
-	Action* result;
-
-	friend class Selection;
+	// Floors with a selected tile, the tiles are the bits of Floor::getSelected
+	std::unordered_set<Floor*> floors;
+	size_t tile_count;
+	// Not yet committed records of the session, one per floor
+	std::unordered_map<Floor*, FloorSelection*> pending;
 };
 
 #endif
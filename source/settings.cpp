@@ -290,6 +290,8 @@ void Settings::IO(IOMode mode) {
 	Int(ICON_BACKGROUND, 0);
 	Int(HARD_REFRESH_RATE, 200);
 	Int(HIDE_ITEMS_WHEN_ZOOMED, 1);
+	Int(USE_SPRITE_BATCHING, 1);
+	Int(USE_BACKGROUND_SPRITE_DECODING, 1);
 	String(SCREENSHOT_DIRECTORY, "");
 	String(SCREENSHOT_FORMAT, "png");
 	IntToSave(USE_MEMCACHED_SPRITES, 0);
@@ -60,6 +60,8 @@ namespace Config {
 		SHOW_ONLY_TILEFLAGS,
 		SHOW_ONLY_MODIFIED_TILES,
 		HIDE_ITEMS_WHEN_ZOOMED,
+		USE_SPRITE_BATCHING,
+		USE_BACKGROUND_SPRITE_DECODING,
 		GROUP_ACTIONS,
 		SCROLL_SPEED,
 		ZOOM_SPEED,
@@ -0,0 +1,205 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "graphics.h"
+#include "sprite_batch.h"
+
+// Slots are padded by one pixel on every side
+static const int ATLAS_SLOT_PIXELS = SPRITE_PIXELS + 2;
+static const int ATLAS_MAX_PAGE_SIZE = 2048;
+// 8 pages of 2048x2048 hold 28800 sprites in 128 MB of texture memory
+static const size_t ATLAS_MAX_PAGES = 8;
+
+SpriteAtlas::SpriteAtlas() :
+	lru_head(-1),
+	lru_tail(-1),
+	used_slots(0),
+	batch(nullptr),
+	batch_serial(0),
+	page_size(0),
+	slots_per_row(0),
+	slots_per_page(0) {
+	////
+}
+
+bool SpriteAtlas::addPage() {
+	if (page_size == 0) {
+		GLint max_size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+		page_size = std::min<int>(std::max<int>(max_size, 256), ATLAS_MAX_PAGE_SIZE);
+		slots_per_row = page_size / ATLAS_SLOT_PIXELS;
+		slots_per_page = slots_per_row * slots_per_row;
+	}
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	if (texture == 0) {
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page_size, page_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	const int first = int(slots.size());
+	pages.push_back(texture);
+	slots.resize(slots.size() + slots_per_page);
+	// Hand out the new slots in order, so a page fills up row by row
+	for (int slot = int(slots.size()) - 1; slot >= first; --slot) {
+		slots[slot].owner = nullptr;
+		slots[slot].prev = -1;
+		slots[slot].next = -1;
+		slots[slot].serial = batch_serial - 1;
+		free_slots.push_back(slot);
+	}
+	return true;
+}
+
+void SpriteAtlas::unlink(int slot) {
+	Slot& s = slots[slot];
+	if (s.prev >= 0) {
+		slots[s.prev].next = s.next;
+	} else {
+		lru_head = s.next;
+	}
+	if (s.next >= 0) {
+		slots[s.next].prev = s.prev;
+	} else {
+		lru_tail = s.prev;
+	}
+	s.prev = -1;
+	s.next = -1;
+}
+
+void SpriteAtlas::pushFront(int slot) {
+	Slot& s = slots[slot];
+	s.prev = -1;
+	s.next = lru_head;
+	if (lru_head >= 0) {
+		slots[lru_head].prev = slot;
+	} else {
+		lru_tail = slot;
+	}
+	lru_head = slot;
+}
+
+int SpriteAtlas::insert(GameSprite::Image* owner, const uint8_t* rgba) {
+	// Uploading binds the page, put back whatever the drawer had bound
+	GLint bound = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+
+	int slot = -1;
+	if (free_slots.empty() && (pages.size() >= ATLAS_MAX_PAGES || !addPage())) {
+		if (lru_tail < 0) {
+			glBindTexture(GL_TEXTURE_2D, bound);
+			return -1;
+		}
+		// Every page is full, take over the slot that was drawn the longest time ago
+		slot = lru_tail;
+		if (batch && slots[slot].serial == batch_serial) {
+			// Quads waiting in the batch still point at the old sprite
+			batch->flush();
+			// The binding is put back to what it was before the flush
+			batch->invalidateBinding();
+			++batch_serial;
+		}
+		GameSprite::Image* evicted = slots[slot].owner;
+		unlink(slot);
+		evicted->atlas_slot = -1;
+		evicted->isGLLoaded = false;
+	} else {
+		slot = free_slots.back();
+		free_slots.pop_back();
+		++used_slots;
+	}
+
+	slots[slot].owner = owner;
+	slots[slot].serial = batch_serial;
+	pushFront(slot);
+
+	// Copy the sprite into the middle of the slot and repeat its edges into the border
+	uint8_t padded[ATLAS_SLOT_PIXELS * ATLAS_SLOT_PIXELS * 4];
+	for (int y = 0; y < ATLAS_SLOT_PIXELS; ++y) {
+		const int sy = std::min<int>(std::max<int>(y - 1, 0), SPRITE_PIXELS - 1);
+		for (int x = 0; x < ATLAS_SLOT_PIXELS; ++x) {
+			const int sx = std::min<int>(std::max<int>(x - 1, 0), SPRITE_PIXELS - 1);
+			memcpy(&padded[(y * ATLAS_SLOT_PIXELS + x) * 4], &rgba[(sy * SPRITE_PIXELS + sx) * 4], 4);
+		}
+	}
+
+	const int index = slot % slots_per_page;
+	glBindTexture(GL_TEXTURE_2D, pages[slot / slots_per_page]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (index % slots_per_row) * ATLAS_SLOT_PIXELS, (index / slots_per_row) * ATLAS_SLOT_PIXELS, ATLAS_SLOT_PIXELS, ATLAS_SLOT_PIXELS, GL_RGBA, GL_UNSIGNED_BYTE, padded);
+	glBindTexture(GL_TEXTURE_2D, bound);
+	return slot;
+}
+
+void SpriteAtlas::release(int slot) {
+	ASSERT(slot >= 0 && slot < int(slots.size()));
+	if (!slots[slot].owner) {
+		return;
+	}
+	unlink(slot);
+	slots[slot].owner = nullptr;
+	free_slots.push_back(slot);
+	--used_slots;
+}
+
+SpriteRegion SpriteAtlas::use(int slot) {
+	if (slot != lru_head) {
+		unlink(slot);
+		pushFront(slot);
+	}
+	slots[slot].serial = batch_serial;
+
+	const int index = slot % slots_per_page;
+	const float x = float((index % slots_per_row) * ATLAS_SLOT_PIXELS + 1);
+	const float y = float((index / slots_per_row) * ATLAS_SLOT_PIXELS + 1);
+	const float scale = 1.f / page_size;
+
+	SpriteRegion region;
+	region.texture = pages[slot / slots_per_page];
+	region.u0 = x * scale;
+	region.v0 = y * scale;
+	region.u1 = (x + SPRITE_PIXELS) * scale;
+	region.v1 = (y + SPRITE_PIXELS) * scale;
+	return region;
+}
+
+void SpriteAtlas::clear() {
+	for (Slot& slot : slots) {
+		if (slot.owner) {
+			slot.owner->atlas_slot = -1;
+			slot.owner->isGLLoaded = false;
+		}
+	}
+	if (!pages.empty()) {
+		glDeleteTextures(GLsizei(pages.size()), pages.data());
+	}
+	pages.clear();
+	slots.clear();
+	free_slots.clear();
+	lru_head = -1;
+	lru_tail = -1;
+	used_slots = 0;
+}
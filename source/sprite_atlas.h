@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SPRITE_ATLAS_H_
+#define RME_SPRITE_ATLAS_H_
+
+// Included by graphics.h once GameSprite is declared, the slots point back
+// at the images drawn from them
+
+class SpriteBatch;
+
+// Packs game sprites into a few large textures, so drawing a frame binds a
+// handful of pages instead of one texture per sprite. Each page is a grid of
+// slots with a one pixel border around every sprite, which keeps linear
+// filtering from bleeding into the neighbouring slots. When every page is
+// full the least recently drawn slot is handed over to the new sprite.
+class SpriteAtlas {
+public:
+	SpriteAtlas();
+
+	// The batch that may still hold quads using atlas slots, it is drawn
+	// before such a slot is handed to another sprite
+	void setBatch(SpriteBatch* new_batch) {
+		batch = new_batch;
+	}
+
+	// Uploads a SPRITE_PIXELS square of RGBA pixels, returns the slot or -1
+	int insert(GameSprite::Image* owner, const uint8_t* rgba);
+	void release(int slot);
+	// Marks the slot as most recently used and returns where it is
+	SpriteRegion use(int slot);
+
+	// Deletes the page textures and unloads every sprite still in them
+	void clear();
+
+	int getUsedSlots() const {
+		return used_slots;
+	}
+	size_t getPageCount() const {
+		return pages.size();
+	}
+
+private:
+	bool addPage();
+	void unlink(int slot);
+	void pushFront(int slot);
+
+	struct Slot {
+		GameSprite::Image* owner;
+		// Neighbours in the use list, most recently used first
+		int prev;
+		int next;
+		// batch_serial when the slot was last used
+		uint32_t serial;
+	};
+
+	std::vector<GLuint> pages;
+	std::vector<Slot> slots;
+	std::vector<int> free_slots;
+	int lru_head;
+	int lru_tail;
+	int used_slots;
+
+	SpriteBatch* batch;
+	// Bumped whenever the batch is drawn, slots used since may still be queued
+	uint32_t batch_serial;
+
+	int page_size;
+	int slots_per_row;
+	int slots_per_page;
+};
+
+#endif
@@ -0,0 +1,154 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "sprite_batch.h"
+
+// The atlas draws the batch before it evicts a slot that is still queued
+static const size_t BATCH_MAX_VERTICES = 4096 * 4;
+
+SpriteBatch::SpriteBatch() :
+	mode(GL_QUADS),
+	texture(0),
+	bound_texture(0),
+	texturing(true) {
+	vertices.reserve(BATCH_MAX_VERTICES);
+}
+
+void SpriteBatch::begin(GLenum new_mode, GLuint new_texture, size_t count) {
+	if (new_mode != mode || new_texture != texture || vertices.size() + count > BATCH_MAX_VERTICES) {
+		flush();
+		mode = new_mode;
+		texture = new_texture;
+	}
+}
+
+void SpriteBatch::push(float x, float y, float u, float v, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	Vertex vertex;
+	vertex.x = x;
+	vertex.y = y;
+	vertex.u = u;
+	vertex.v = v;
+	vertex.r = r;
+	vertex.g = g;
+	vertex.b = b;
+	vertex.a = a;
+	vertices.push_back(vertex);
+}
+
+void SpriteBatch::addQuad(float x, float y, float w, float h, const SpriteRegion& region, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	if (region.texture == 0) {
+		return;
+	}
+
+	// Sprites blitted while texturing is off come out as plain coloured
+	// squares in immediate mode (the "only colors" view relies on that)
+	if (!texturing) {
+		addQuad(x, y, w, h, r, g, b, a);
+		return;
+	}
+
+	begin(GL_QUADS, region.texture, 4);
+	push(x, y, region.u0, region.v0, r, g, b, a);
+	push(x + w, y, region.u1, region.v0, r, g, b, a);
+	push(x + w, y + h, region.u1, region.v1, r, g, b, a);
+	push(x, y + h, region.u0, region.v1, r, g, b, a);
+}
+
+void SpriteBatch::addQuad(float x, float y, float w, float h, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	begin(GL_QUADS, 0, 4);
+	push(x, y, 0.f, 0.f, r, g, b, a);
+	push(x + w, y, 0.f, 0.f, r, g, b, a);
+	push(x + w, y + h, 0.f, 0.f, r, g, b, a);
+	push(x, y + h, 0.f, 0.f, r, g, b, a);
+}
+
+void SpriteBatch::addLine(float x1, float y1, float x2, float y2, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	begin(GL_LINES, 0, 2);
+	push(x1, y1, 0.f, 0.f, r, g, b, a);
+	push(x2, y2, 0.f, 0.f, r, g, b, a);
+}
+
+void SpriteBatch::bindTexture(GLuint new_texture) {
+	if (new_texture != bound_texture) {
+		glBindTexture(GL_TEXTURE_2D, new_texture);
+		bound_texture = new_texture;
+	}
+}
+
+void SpriteBatch::setTexturing(bool enabled) {
+	if (enabled) {
+		glEnable(GL_TEXTURE_2D);
+	} else {
+		glDisable(GL_TEXTURE_2D);
+	}
+	texturing = enabled;
+}
+
+void SpriteBatch::invalidateBinding() {
+	bound_texture = 0;
+	texturing = glIsEnabled(GL_TEXTURE_2D) == GL_TRUE;
+}
+
+void SpriteBatch::flush() {
+	if (vertices.empty()) {
+		return;
+	}
+
+	// The caller's texturing state may have changed since the vertices were
+	// queued, so set what the batch needs and put it back afterwards
+	const bool textured = texture != 0;
+	const bool was_textured = texturing;
+	if (textured) {
+		if (!was_textured) {
+			glEnable(GL_TEXTURE_2D);
+		}
+		bindTexture(texture);
+	} else if (was_textured) {
+		glDisable(GL_TEXTURE_2D);
+	}
+
+	const Vertex* data = vertices.data();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof(Vertex), &data->x);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), &data->r);
+	if (textured) {
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &data->u);
+	}
+
+	glDrawArrays(mode, 0, GLsizei(vertices.size()));
+
+	if (textured) {
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	}
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	// The colour array leaves the current colour undefined
+	glColor4ub(255, 255, 255, 255);
+
+	if (textured != was_textured) {
+		if (was_textured) {
+			glEnable(GL_TEXTURE_2D);
+		} else {
+			glDisable(GL_TEXTURE_2D);
+		}
+	}
+	vertices.clear();
+}
@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SPRITE_BATCH_H_
+#define RME_SPRITE_BATCH_H_
+
+#include "graphics.h"
+
+// Collects quads and lines with their texture and colour into a client side
+// vertex array, and draws everything that shares a texture in a single call.
+// The batch is drawn when the texture or primitive changes, when it is full
+// or when flush is called, so anything drawn directly with GL in between must
+// flush first to keep the drawing order.
+class SpriteBatch {
+public:
+	SpriteBatch();
+
+	// Textured quad, nothing is drawn if the region has no texture and the
+	// quad is drawn untextured if texturing is disabled when it is added
+	void addQuad(float x, float y, float w, float h, const SpriteRegion& region, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+	// Untextured quad
+	void addQuad(float x, float y, float w, float h, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+	// Untextured line
+	void addLine(float x1, float y1, float x2, float y2, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+
+	void flush();
+
+	// Binds a texture unless it is already bound, used by the immediate path too
+	void bindTexture(GLuint new_texture);
+	// Enables or disables GL_TEXTURE_2D and remembers it, so quads don't have
+	// to ask GL whether texturing is on
+	void setTexturing(bool enabled);
+	// Call after something else may have bound a texture or changed texturing
+	void invalidateBinding();
+
+private:
+	struct Vertex {
+		float x, y;
+		float u, v;
+		uint8_t r, g, b, a;
+	};
+
+	void begin(GLenum new_mode, GLuint new_texture, size_t count);
+	void push(float x, float y, float u, float v, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+
+	std::vector<Vertex> vertices;
+	GLenum mode;
+	GLuint texture;
+	GLuint bound_texture;
+	bool texturing;
+};
+
+#endif
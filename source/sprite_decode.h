@@ -0,0 +1,286 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SPRITE_DECODE_H_
+#define RME_SPRITE_DECODE_H_
+
+// The sprite decoding and outfit colouring kernels. They only need the
+// standard library, so tools/sprite_decode_check can build them on their own.
+
+#include "definitions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// All 133 template colors
+static const uint32_t TemplateOutfitLookupTable[] = {
+	0xFFFFFF,
+	0xFFD4BF,
+	0xFFE9BF,
+	0xFFFFBF,
+	0xE9FFBF,
+	0xD4FFBF,
+	0xBFFFBF,
+	0xBFFFD4,
+	0xBFFFE9,
+	0xBFFFFF,
+	0xBFE9FF,
+	0xBFD4FF,
+	0xBFBFFF,
+	0xD4BFFF,
+	0xE9BFFF,
+	0xFFBFFF,
+	0xFFBFE9,
+	0xFFBFD4,
+	0xFFBFBF,
+	0xDADADA,
+	0xBF9F8F,
+	0xBFAF8F,
+	0xBFBF8F,
+	0xAFBF8F,
+	0x9FBF8F,
+	0x8FBF8F,
+	0x8FBF9F,
+	0x8FBFAF,
+	0x8FBFBF,
+	0x8FAFBF,
+	0x8F9FBF,
+	0x8F8FBF,
+	0x9F8FBF,
+	0xAF8FBF,
+	0xBF8FBF,
+	0xBF8FAF,
+	0xBF8F9F,
+	0xBF8F8F,
+	0xB6B6B6,
+	0xBF7F5F,
+	0xBFAF8F,
+	0xBFBF5F,
+	0x9FBF5F,
+	0x7FBF5F,
+	0x5FBF5F,
+	0x5FBF7F,
+	0x5FBF9F,
+	0x5FBFBF,
+	0x5F9FBF,
+	0x5F7FBF,
+	0x5F5FBF,
+	0x7F5FBF,
+	0x9F5FBF,
+	0xBF5FBF,
+	0xBF5F9F,
+	0xBF5F7F,
+	0xBF5F5F,
+	0x919191,
+	0xBF6A3F,
+	0xBF943F,
+	0xBFBF3F,
+	0x94BF3F,
+	0x6ABF3F,
+	0x3FBF3F,
+	0x3FBF6A,
+	0x3FBF94,
+	0x3FBFBF,
+	0x3F94BF,
+	0x3F6ABF,
+	0x3F3FBF,
+	0x6A3FBF,
+	0x943FBF,
+	0xBF3FBF,
+	0xBF3F94,
+	0xBF3F6A,
+	0xBF3F3F,
+	0x6D6D6D,
+	0xFF5500,
+	0xFFAA00,
+	0xFFFF00,
+	0xAAFF00,
+	0x54FF00,
+	0x00FF00,
+	0x00FF54,
+	0x00FFAA,
+	0x00FFFF,
+	0x00A9FF,
+	0x0055FF,
+	0x0000FF,
+	0x5500FF,
+	0xA900FF,
+	0xFE00FF,
+	0xFF00AA,
+	0xFF0055,
+	0xFF0000,
+	0x484848,
+	0xBF3F00,
+	0xBF7F00,
+	0xBFBF00,
+	0x7FBF00,
+	0x3FBF00,
+	0x00BF00,
+	0x00BF3F,
+	0x00BF7F,
+	0x00BFBF,
+	0x007FBF,
+	0x003FBF,
+	0x0000BF,
+	0x3F00BF,
+	0x7F00BF,
+	0xBF00BF,
+	0xBF007F,
+	0xBF003F,
+	0xBF0000,
+	0x242424,
+	0x7F2A00,
+	0x7F5500,
+	0x7F7F00,
+	0x557F00,
+	0x2A7F00,
+	0x007F00,
+	0x007F2A,
+	0x007F55,
+	0x007F7F,
+	0x00547F,
+	0x002A7F,
+	0x00007F,
+	0x2A007F,
+	0x54007F,
+	0x7F007F,
+	0x7F0055,
+	0x7F002A,
+	0x7F0000,
+};
+
+static const size_t TEMPLATE_OUTFIT_COLORS = sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]);
+
+// Decompresses a sprite dump into SPRITE_PIXELS_SIZE pixels of OutputBpp
+// bytes, RGBA with transparent black or RGB with a magenta colour key. The
+// dump is made of runs of transparent pixels, each followed by a run of
+// coloured ones that take 4 bytes if the sprites have alpha and 3 if not.
+// Whole runs are cleared and copied at once instead of pixel by pixel.
+template <int OutputBpp>
+inline void decodeSpriteDump(const uint8_t* dump, uint16_t size, bool use_alpha, uint8_t* data) {
+	static_assert(OutputBpp == 3 || OutputBpp == 4, "sprites decode to RGB or RGBA");
+
+	const int input_bpp = use_alpha ? 4 : 3;
+	int pixel = 0;
+	int read = 0;
+
+	const auto fillTransparent = [data](int first, int count) {
+		uint8_t* target = data + first * OutputBpp;
+		if (OutputBpp == 4) {
+			memset(target, 0, count * 4);
+			return;
+		}
+		for (int i = 0; i < count; ++i, target += 3) {
+			target[0] = 0xFF; // red
+			target[1] = 0x00; // green
+			target[2] = 0xFF; // blue
+		}
+	};
+
+	while (read + 2 <= size && pixel < SPRITE_PIXELS_SIZE) {
+		int transparent = dump[read] | dump[read + 1] << 8;
+		if (OutputBpp == 4 && use_alpha && transparent >= SPRITE_PIXELS_SIZE) { // Corrupted sprite?
+			break;
+		}
+		read += 2;
+		transparent = std::min<int>(transparent, SPRITE_PIXELS_SIZE - pixel);
+		fillTransparent(pixel, transparent);
+		pixel += transparent;
+
+		if (read + 2 > size) {
+			break;
+		}
+		int colored = dump[read] | dump[read + 1] << 8;
+		read += 2;
+		colored = std::min<int>(std::min<int>(colored, SPRITE_PIXELS_SIZE - pixel), (size - read) / input_bpp);
+
+		const uint8_t* source = dump + read;
+		uint8_t* target = data + pixel * OutputBpp;
+		if (input_bpp == OutputBpp) {
+			memcpy(target, source, colored * OutputBpp);
+		} else if (OutputBpp == 4) {
+			for (int i = 0; i < colored; ++i, source += 3, target += 4) {
+				target[0] = source[0]; // red
+				target[1] = source[1]; // green
+				target[2] = source[2]; // blue
+				target[3] = 0xFF; // alpha
+			}
+		} else {
+			for (int i = 0; i < colored; ++i, source += 4, target += 3) {
+				target[0] = source[0]; // red
+				target[1] = source[1]; // green
+				target[2] = source[2]; // blue
+			}
+		}
+		pixel += colored;
+		read += colored * input_bpp;
+	}
+
+	// fill remaining pixels
+	fillTransparent(pixel, SPRITE_PIXELS_SIZE - pixel);
+}
+
+// Every outfit colour as three 256 entry tables, one per channel, holding
+// what a channel value becomes when it is coloured. The last entry leaves
+// values as they are. Built once, the colouring is then table lookups only.
+typedef uint8_t OutfitChannelScale[3][256];
+
+inline const OutfitChannelScale* getOutfitScaleTable() {
+	static const std::vector<OutfitChannelScale> table = []() {
+		std::vector<OutfitChannelScale> scales(TEMPLATE_OUTFIT_COLORS + 1);
+		for (size_t color = 0; color <= TEMPLATE_OUTFIT_COLORS; ++color) {
+			// Thanks! Khaos, or was it mips? Hmmm... =)
+			const uint32_t rgb = color < TEMPLATE_OUTFIT_COLORS ? TemplateOutfitLookupTable[color] : 0xFFFFFF;
+			const float factors[3] = { uint8_t(rgb >> 16) / 255.f, uint8_t(rgb >> 8) / 255.f, uint8_t(rgb) / 255.f };
+			for (int channel = 0; channel < 3; ++channel) {
+				for (int value = 0; value < 256; ++value) {
+					scales[color][channel][value] = uint8_t(value * factors[channel]);
+				}
+			}
+		}
+		return scales;
+	}();
+	return table.data();
+}
+
+// Colours the pixels of an outfit through its template, looks holds the
+// head, body, legs and feet colours. Which channels of the template are set
+// picks the colour of a pixel, without branching on them.
+template <int Bpp>
+inline void colorizeOutfit(uint8_t* pixels, const uint8_t* template_pixels, const uint8_t looks[4]) {
+	const OutfitChannelScale* table = getOutfitScaleTable();
+	// Indexed by red << 2 | green << 1 | blue of the template, yellow is the
+	// head, red the body, green the legs and blue the feet
+	const OutfitChannelScale* parts[8] = {
+		&table[TEMPLATE_OUTFIT_COLORS], &table[looks[3]], &table[looks[2]], &table[TEMPLATE_OUTFIT_COLORS],
+		&table[looks[1]], &table[TEMPLATE_OUTFIT_COLORS], &table[looks[0]], &table[TEMPLATE_OUTFIT_COLORS]
+	};
+
+	for (int i = 0; i < SPRITE_PIXELS_SIZE; ++i) {
+		const uint8_t* mask = template_pixels + i * Bpp;
+		const OutfitChannelScale& scale = *parts[(mask[0] != 0) << 2 | (mask[1] != 0) << 1 | (mask[2] != 0)];
+
+		uint8_t* pixel = pixels + i * Bpp;
+		pixel[0] = scale[0][pixel[0]];
+		pixel[1] = scale[1][pixel[1]];
+		pixel[2] = scale[2][pixel[2]];
+	}
+}
+
+#endif
@@ -154,8 +154,7 @@ void TableBrush::draw(BaseMap* map, Tile* tile, void* parameter) {
 	}
 }
 
-bool hasMatchingTableBrushAtTile(BaseMap* map, TableBrush* table_brush, uint32_t x, uint32_t y, uint32_t z) {
-	Tile* t = map->getTile(x, y, z);
+bool hasMatchingTableBrushAtTile(const Tile* t, TableBrush* table_brush) {
 	if (!t) {
 		return false;
 	}
@@ -177,11 +176,8 @@ void TableBrush::doTables(BaseMap* map, Tile* tile) {
 		return;
 	}
 
-	const Position& position = tile->getPosition();
-
-	int32_t x = position.x;
-	int32_t y = position.y;
-	int32_t z = position.z;
+	TileNeighbourhood around;
+	map->getNeighbourhood(tile->getPosition(), around);
 
 	for (Item* item : tile->items) {
 		ASSERT(item);
@@ -192,44 +188,8 @@ void TableBrush::doTables(BaseMap* map, Tile* tile) {
 		}
 
 		bool neighbours[8];
-		if (x == 0) {
-			if (y == 0) {
-				neighbours[0] = false;
-				neighbours[1] = false;
-				neighbours[2] = false;
-				neighbours[3] = false;
-				neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-				neighbours[5] = false;
-				neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x, y + 1, z);
-				neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
-			} else {
-				neighbours[0] = false;
-				neighbours[1] = hasMatchingTableBrushAtTile(map, table_brush, x, y - 1, z);
-				neighbours[2] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y - 1, z);
-				neighbours[3] = false;
-				neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-				neighbours[5] = false;
-				neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x, y + 1, z);
-				neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
-			}
-		} else if (y == 0) {
-			neighbours[0] = false;
-			neighbours[1] = false;
-			neighbours[2] = false;
-			neighbours[3] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y, z);
-			neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-			neighbours[5] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y + 1, z);
-			neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x, y + 1, z);
-			neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
-		} else {
-			neighbours[0] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y - 1, z);
-			neighbours[1] = hasMatchingTableBrushAtTile(map, table_brush, x, y - 1, z);
-			neighbours[2] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y - 1, z);
-			neighbours[3] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y, z);
-			neighbours[4] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y, z);
-			neighbours[5] = hasMatchingTableBrushAtTile(map, table_brush, x - 1, y + 1, z);
-			neighbours[6] = hasMatchingTableBrushAtTile(map, table_brush, x, y + 1, z);
-			neighbours[7] = hasMatchingTableBrushAtTile(map, table_brush, x + 1, y + 1, z);
+		for (int32_t i = 0; i < 8; ++i) {
+			neighbours[i] = hasMatchingTableBrushAtTile(around.getNeighbour(i), table_brush);
 		}
 
 		uint32_t tiledata = 0;
@@ -66,6 +66,24 @@ Tile::~Tile() {
 	delete spawn;
 }
 
+void* Tile::operator new(size_t size) {
+	return MapAllocator::allocate(size);
+}
+
+void Tile::operator delete(void* ptr, size_t size) {
+	MapAllocator::deallocate(ptr, size);
+}
+
+#ifdef DEBUG_MEM
+void* Tile::operator new(size_t size, const char* file, int line) {
+	return MapAllocator::allocate(size);
+}
+
+void Tile::operator delete(void* ptr, const char* file, int line) {
+	MapAllocator::deallocate(ptr, sizeof(Tile));
+}
+#endif
+
 Tile* Tile::deepCopy(BaseMap& map) {
 	Tile* copy = map.allocator.allocateTile(location);
 	copy->flags = flags;
@@ -62,6 +62,14 @@ public:
 
 	~Tile();
 
+	// Allocated from the MapAllocator slabs
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+#ifdef DEBUG_MEM
+	static void* operator new(size_t size, const char* file, int line);
+	static void operator delete(void* ptr, const char* file, int line);
+#endif
+
 	// Argument is a the map to allocate the tile from
 	Tile* deepCopy(BaseMap& map);
 
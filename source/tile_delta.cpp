@@ -0,0 +1,144 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "tile_delta.h"
+#include "tile.h"
+#include "basemap.h"
+#include "creature.h"
+#include "spawn.h"
+
+TileDelta::TileDelta() :
+	house_id(0),
+	mapflags(0),
+	statflags(0),
+	shared_bottom(0),
+	shared_top(0),
+	shared_ground(false),
+	ground(nullptr),
+	creature(nullptr),
+	spawn(nullptr) {
+	////
+}
+
+TileDelta::~TileDelta() {
+	for (Item* item : items) {
+		delete item;
+	}
+	delete ground;
+	delete creature;
+	delete spawn;
+}
+
+TileDelta* TileDelta::Create(Tile* other, const Tile* current) {
+	ASSERT(other && current);
+
+	TileDelta* delta = newd TileDelta();
+	delta->position = other->getPosition();
+	delta->house_id = other->house_id;
+	delta->mapflags = other->getMapFlags();
+	delta->statflags = other->getStatFlags();
+
+	ItemVector& own = other->items;
+	const ItemVector& shared = current->items;
+	size_t bottom = 0;
+	while (bottom < own.size() && bottom < shared.size() && own[bottom]->isSameAs(*shared[bottom])) {
+		++bottom;
+	}
+	size_t top = 0;
+	while (bottom + top < own.size() && bottom + top < shared.size() && own[own.size() - top - 1]->isSameAs(*shared[shared.size() - top - 1])) {
+		++top;
+	}
+	delta->shared_bottom = bottom;
+	delta->shared_top = top;
+	delta->items.assign(own.begin() + bottom, own.end() - top);
+	own.erase(own.begin() + bottom, own.end() - top);
+
+	if (other->ground && current->ground) {
+		delta->shared_ground = other->ground->isSameAs(*current->ground);
+	} else {
+		delta->shared_ground = !other->ground && !current->ground;
+	}
+	if (!delta->shared_ground) {
+		delta->ground = other->ground;
+		other->ground = nullptr;
+	}
+
+	delta->creature = other->creature;
+	other->creature = nullptr;
+	delta->spawn = other->spawn;
+	other->spawn = nullptr;
+
+	// Whatever is left is on the map already
+	delete other;
+	return delta;
+}
+
+Tile* TileDelta::restore(BaseMap& map, const Tile* current) {
+	Tile* tile = map.allocator(map.createTileL(position));
+	tile->house_id = house_id;
+	tile->setMapFlags(mapflags);
+	tile->setStatFlags(statflags);
+
+	size_t bottom = 0;
+	size_t top = 0;
+	if (current) {
+		ASSERT(shared_bottom + shared_top <= current->items.size());
+		bottom = std::min<size_t>(shared_bottom, current->items.size());
+		top = std::min<size_t>(shared_top, current->items.size() - bottom);
+	}
+
+	if (shared_ground) {
+		tile->ground = current && current->ground ? current->ground->deepCopy() : nullptr;
+	} else {
+		tile->ground = ground;
+		ground = nullptr;
+	}
+
+	tile->items.reserve(bottom + items.size() + top);
+	for (size_t i = 0; i < bottom; ++i) {
+		tile->items.push_back(current->items[i]->deepCopy());
+	}
+	tile->items.insert(tile->items.end(), items.begin(), items.end());
+	items.clear();
+	for (size_t i = 0; i < top; ++i) {
+		tile->items.push_back(current->items[current->items.size() - top + i]->deepCopy());
+	}
+
+	tile->creature = creature;
+	creature = nullptr;
+	tile->spawn = spawn;
+	spawn = nullptr;
+	return tile;
+}
+
+uint32_t TileDelta::memsize() const {
+	uint32_t mem = sizeof(*this);
+	if (ground) {
+		mem += ground->memsize();
+	}
+	for (const Item* item : items) {
+		mem += item->memsize();
+	}
+	mem += sizeof(Item*) * items.capacity();
+	return mem;
+}
+
+uint32_t TileDelta::approx_memsize() const {
+	return sizeof(*this) + (items.size() + (ground ? 1 : 0)) * sizeof(Item);
+}
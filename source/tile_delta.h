@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_TILE_DELTA_H_
+#define RME_TILE_DELTA_H_
+
+#include "position.h"
+
+class BaseMap;
+class Tile;
+class Item;
+class Creature;
+class Spawn;
+
+// A tile that was swapped out of the map, kept as its difference to the
+// tile that replaced it. Items both tiles have at the bottom and the top of
+// the stack are only stored once, on the map.
+class TileDelta {
+public:
+	// Takes ownership of other, current is the tile now on the map
+	static TileDelta* Create(Tile* other, const Tile* current);
+	~TileDelta();
+
+	// Builds the stored tile again, the shared items are copied from current
+	Tile* restore(BaseMap& map, const Tile* current);
+
+	const Position& getPosition() const {
+		return position;
+	}
+
+	// Get memory footprint
+	uint32_t memsize() const;
+	uint32_t approx_memsize() const;
+
+private:
+	TileDelta();
+
+	Position position;
+	uint32_t house_id;
+	uint16_t mapflags;
+	uint16_t statflags;
+	uint32_t shared_bottom;
+	uint32_t shared_top;
+	bool shared_ground;
+	Item* ground;
+	Creature* creature;
+	Spawn* spawn;
+	ItemVector items;
+};
+
+#endif
@@ -370,8 +370,7 @@ void WallBrush::draw(BaseMap* map, Tile* tile, void* parameter) {
 	tile->addWallItem(Item::Create(id));
 }
 
-bool hasMatchingWallBrushAtTile(BaseMap* map, WallBrush* wall_brush, uint32_t x, uint32_t y, uint32_t z) {
-	Tile* t = map->getTile(x, y, z);
+bool hasMatchingWallBrushAtTile(const Tile* t, WallBrush* wall_brush) {
 	if (!t) {
 		return false;
 	}
@@ -395,10 +394,8 @@ bool hasMatchingWallBrushAtTile(BaseMap* map, WallBrush* wall_brush, uint32_t x,
 void WallBrush::doWalls(BaseMap* map, Tile* tile) {
 	ASSERT(tile);
 
-	// For quicker reference
-	unsigned int x = tile->getPosition().x;
-	unsigned int y = tile->getPosition().y;
-	unsigned int z = tile->getPosition().z;
+	TileNeighbourhood around;
+	map->getNeighbourhood(tile->getPosition(), around);
 
 	// Advance the vector to the beginning of the walls
 	ItemVector::iterator it = tile->items.begin();
@@ -426,30 +423,10 @@ void WallBrush::doWalls(BaseMap* map, Tile* tile) {
 			continue;
 		}
 		bool neighbours[4];
-
-		if (x == 0) {
-			if (y == 0) {
-				neighbours[0] = false;
-				neighbours[1] = false;
-				neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-				neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x, y + 1, z);
-			} else {
-				neighbours[0] = hasMatchingWallBrushAtTile(map, wall_brush, x, y - 1, z);
-				neighbours[1] = false;
-				neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-				neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x, y + 1, z);
-			}
-		} else if (y == 0) {
-			neighbours[0] = false;
-			neighbours[1] = hasMatchingWallBrushAtTile(map, wall_brush, x - 1, y, z);
-			neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-			neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x, y + 1, z);
-		} else {
-			neighbours[0] = hasMatchingWallBrushAtTile(map, wall_brush, x, y - 1, z);
-			neighbours[1] = hasMatchingWallBrushAtTile(map, wall_brush, x - 1, y, z);
-			neighbours[2] = hasMatchingWallBrushAtTile(map, wall_brush, x + 1, y, z);
-			neighbours[3] = hasMatchingWallBrushAtTile(map, wall_brush, x, y + 1, z);
-		}
+		neighbours[0] = hasMatchingWallBrushAtTile(around.get(0, -1), wall_brush);
+		neighbours[1] = hasMatchingWallBrushAtTile(around.get(-1, 0), wall_brush);
+		neighbours[2] = hasMatchingWallBrushAtTile(around.get(1, 0), wall_brush);
+		neighbours[3] = hasMatchingWallBrushAtTile(around.get(0, 1), wall_brush);
 
 		uint32_t tiledata = 0;
 		for (int i = 0; i < 4; i++) {
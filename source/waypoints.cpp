@@ -20,6 +20,10 @@
 #include "waypoints.h"
 #include "map.h"
 
+static uint64_t getPositionKey(const Position& pos) {
+	return (uint64_t(uint32_t(pos.x)) << 32) | (uint64_t(uint16_t(pos.y)) << 16) | uint16_t(pos.z);
+}
+
 void Waypoints::addWaypoint(Waypoint* wp) {
 	removeWaypoint(wp->name);
 	if (wp->pos != Position()) {
@@ -30,6 +34,7 @@ void Waypoints::addWaypoint(Waypoint* wp) {
 		t->getLocation()->increaseWaypointCount();
 	}
 	waypoints.insert(std::make_pair(as_lower_str(wp->name), wp));
+	addPosition(wp);
 }
 
 Waypoint* Waypoints::getWaypoint(std::string name) {
@@ -45,14 +50,20 @@ Waypoint* Waypoints::getWaypoint(TileLocation* location) {
 	if (!location) {
 		return nullptr;
 	}
-	// TODO find waypoint by position hash.
-	for (WaypointMap::iterator it = waypoints.begin(); it != waypoints.end(); it++) {
-		Waypoint* waypoint = it->second;
-		if (waypoint && waypoint->pos == location->position) {
-			return waypoint;
+
+	auto range = positions.equal_range(getPositionKey(location->position));
+	if (range.first == range.second) {
+		return nullptr;
+	}
+
+	// Several waypoints on one tile, use the first by name like the list does
+	Waypoint* found = range.first->second;
+	for (auto it = std::next(range.first); it != range.second; ++it) {
+		if (as_lower_str(it->second->name) < as_lower_str(found->name)) {
+			found = it->second;
 		}
 	}
-	return nullptr;
+	return found;
 }
 
 void Waypoints::removeWaypoint(std::string name) {
@@ -61,6 +72,39 @@ void Waypoints::removeWaypoint(std::string name) {
 	if (iter == waypoints.end()) {
 		return;
 	}
+	removePosition(iter->second);
 	delete iter->second;
 	waypoints.erase(iter);
 }
+
+void Waypoints::moveWaypoint(Waypoint* wp, const Position& pos) {
+	removePosition(wp);
+	wp->pos = pos;
+	addPosition(wp);
+}
+
+void Waypoints::merge(Waypoints& other) {
+	for (WaypointMap::iterator iter = other.waypoints.begin(); iter != other.waypoints.end(); ++iter) {
+		if (waypoints.insert(*iter).second) {
+			addPosition(iter->second);
+		} else {
+			delete iter->second;
+		}
+	}
+	other.waypoints.clear();
+	other.positions.clear();
+}
+
+void Waypoints::addPosition(Waypoint* wp) {
+	positions.insert(std::make_pair(getPositionKey(wp->pos), wp));
+}
+
+void Waypoints::removePosition(Waypoint* wp) {
+	auto range = positions.equal_range(getPositionKey(wp->pos));
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == wp) {
+			positions.erase(it);
+			return;
+		}
+	}
+}
@@ -20,6 +20,8 @@
 
 #include "position.h"
 
+#include <unordered_map>
+
 class Waypoint {
 public:
 	std::string name;
@@ -44,6 +46,10 @@ public:
 	Waypoint* getWaypoint(std::string name);
 	Waypoint* getWaypoint(TileLocation* location);
 	void removeWaypoint(std::string name);
+	// Changes the position of a waypoint, the tile counts are left to the caller
+	void moveWaypoint(Waypoint* wp, const Position& pos);
+	// Takes over all waypoints of another map, names already in use here are dropped
+	void merge(Waypoints& other);
 
 	WaypointMap waypoints;
 
@@ -59,6 +65,13 @@ public:
 	WaypointMap::const_iterator end() const {
 		return waypoints.end();
 	}
+
+private:
+	void addPosition(Waypoint* wp);
+	void removePosition(Waypoint* wp);
+
+	// The waypoints by position, drawing looks one up for every tile
+	std::unordered_multimap<uint64_t, Waypoint*> positions;
 };
 
 #endif
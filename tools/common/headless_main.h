@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Takes the place of source/main.h for the tools, which build a few of the
+// editor's source files without wxWidgets. Include it before any of them.
+
+#ifndef RME_HEADLESS_MAIN_H_
+#define RME_HEADLESS_MAIN_H_
+
+#define RME_MAIN_H_
+
+#if defined _WIN32 && !defined __WINDOWS__
+	#define __WINDOWS__
+#endif
+
+#include <boost/utility.hpp>
+
+#include <math.h>
+#include <list>
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <queue>
+#include <stdexcept>
+#include <fstream>
+
+#include "definitions.h"
+
+#define newd new
+
+#include <assert.h>
+#define _MSG(msg) !bool(msg)
+#define ASSERT(...)
+
+typedef std::vector<std::string> StringVector;
+
+inline std::string i2s(int i) {
+	return std::to_string(i);
+}
+
+inline bool testFlags(size_t flags, size_t test) {
+	return (flags & test) != 0;
+}
+
+#include "rme_forward_declarations.h"
+
+#endif
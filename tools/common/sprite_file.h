@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Writes and reads the header of .spr files for the tools that load sprites
+
+#ifndef RME_SPRITE_FILE_H_
+#define RME_SPRITE_FILE_H_
+
+#include "filehandle.h"
+
+#include <random>
+
+struct SpriteFile {
+	std::string name;
+	bool extended = false;
+	bool use_alpha = false;
+	uint32_t count = 0;
+};
+
+// Runs of transparent and coloured pixels, like the client's sprites
+inline bool writeSpriteFile(const std::string& filename, uint32_t count) {
+	std::mt19937 random(1);
+	std::vector<std::vector<uint8_t>> dumps(count);
+	for (std::vector<uint8_t>& dump : dumps) {
+		int pixel = 0;
+		while (pixel < SPRITE_PIXELS_SIZE && random() % 6 != 0) {
+			const int transparent = random() % std::min(64, SPRITE_PIXELS_SIZE - pixel + 1);
+			const int colored = random() % std::min(96, SPRITE_PIXELS_SIZE - pixel - transparent + 1);
+			dump.push_back(uint8_t(transparent));
+			dump.push_back(uint8_t(transparent >> 8));
+			dump.push_back(uint8_t(colored));
+			dump.push_back(uint8_t(colored >> 8));
+			for (int i = 0; i < colored * 3; ++i) {
+				dump.push_back(uint8_t(random()));
+			}
+			pixel += transparent + colored;
+		}
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	const auto put = [&file](uint32_t value, int bytes) {
+		for (int i = 0; i < bytes; ++i) {
+			file.put(char(value >> (i * 8)));
+		}
+	};
+	put(0x12345678, 4); // Signature
+	put(count, 2);
+	uint32_t offset = 6 + count * 4;
+	for (const std::vector<uint8_t>& dump : dumps) {
+		put(offset, 4);
+		offset += 3 + 2 + uint32_t(dump.size());
+	}
+	for (const std::vector<uint8_t>& dump : dumps) {
+		put(0xFF00FF, 3); // Colour key
+		put(uint32_t(dump.size()), 2);
+		file.write(reinterpret_cast<const char*>(dump.data()), dump.size());
+	}
+	return bool(file);
+}
+
+// Reads the sprite count and the offset table
+inline bool readSpriteHeader(SpriteFile& spr, std::vector<uint32_t>& offsets) {
+	FileReadHandle fh(spr.name);
+	uint32_t signature;
+	if (!fh.isOk() || !fh.getU32(signature)) {
+		return false;
+	}
+	if (spr.extended) {
+		if (!fh.getU32(spr.count)) {
+			return false;
+		}
+	} else {
+		uint16_t count;
+		if (!fh.getU16(count)) {
+			return false;
+		}
+		spr.count = count;
+	}
+	offsets.resize(spr.count);
+	return spr.count == 0 || fh.getRAW(reinterpret_cast<uint8_t*>(offsets.data()), spr.count * sizeof(uint32_t));
+}
+
+#endif
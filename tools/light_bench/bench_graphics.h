@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Takes the place of source/graphics.h for light_bench. LightDrawer only
+// needs wxColor, SpriteLight and a few GL calls. The GL calls do nothing
+// except keep the pixels of the last glTexImage2D, so the bench can check
+// what the drawer would have uploaded.
+
+#ifndef RME_GRAPHICS_H_
+#define RME_GRAPHICS_H_
+
+#include <cmath>
+#include <cstring>
+
+class wxColor {
+public:
+	wxColor(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0, uint8_t alpha = 255) :
+		red(red), green(green), blue(blue), alpha(alpha) { }
+
+	uint8_t Red() const {
+		return red;
+	}
+	uint8_t Green() const {
+		return green;
+	}
+	uint8_t Blue() const {
+		return blue;
+	}
+	uint8_t Alpha() const {
+		return alpha;
+	}
+
+private:
+	uint8_t red, green, blue, alpha;
+};
+
+// Same as in common.cpp
+inline wxColor colorFromEightBit(int color) {
+	if (color <= 0 || color >= 216) {
+		return wxColor(0, 0, 0);
+	}
+	const uint8_t red = (uint8_t)(int(color / 36) % 6 * 51);
+	const uint8_t green = (uint8_t)(int(color / 6) % 6 * 51);
+	const uint8_t blue = (uint8_t)(color % 6 * 51);
+	return wxColor(red, green, blue);
+}
+
+struct SpriteLight {
+	uint8_t intensity = 0;
+	uint8_t color = 0;
+};
+
+typedef unsigned int GLuint;
+typedef unsigned int GLenum;
+typedef int GLint;
+typedef int GLsizei;
+
+enum {
+	GL_TEXTURE_2D,
+	GL_TEXTURE_MIN_FILTER,
+	GL_TEXTURE_MAG_FILTER,
+	GL_TEXTURE_WRAP_S,
+	GL_TEXTURE_WRAP_T,
+	GL_LINEAR,
+	GL_RGBA,
+	GL_UNSIGNED_BYTE,
+	GL_QUADS,
+	GL_SRC_ALPHA,
+	GL_ONE_MINUS_SRC_ALPHA,
+	GL_DST_COLOR,
+};
+
+// Pixels of the last glTexImage2D
+inline std::vector<uint8_t>& uploadedTexture() {
+	static std::vector<uint8_t> pixels;
+	return pixels;
+}
+
+inline void glGenTextures(GLsizei, GLuint* textures) {
+	*textures = 1;
+}
+inline void glDeleteTextures(GLsizei, const GLuint*) { }
+inline void glBindTexture(GLenum, GLuint) { }
+inline void glTexParameteri(GLenum, GLenum, GLint) { }
+inline void glTexImage2D(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum, GLenum, const void* pixels) {
+	const uint8_t* data = static_cast<const uint8_t*>(pixels);
+	uploadedTexture().assign(data, data + size_t(width) * height * 4);
+}
+inline void glBlendFunc(GLenum, GLenum) { }
+inline void glColor4ub(uint8_t, uint8_t, uint8_t, uint8_t) { }
+inline void glEnable(GLenum) { }
+inline void glDisable(GLenum) { }
+inline void glBegin(GLenum) { }
+inline void glEnd() { }
+inline void glTexCoord2f(float, float) { }
+inline void glVertex2f(float, float) { }
+
+#endif
@@ -0,0 +1,187 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Times LightDrawer::draw, the light map the editor builds every frame when
+// lights are shown, on a view full of random lights. Compares it with the
+// old loop that went over every light for every tile of the view, copied
+// here from before the drawer only touched the tiles a light can reach,
+// and checks that both build the same texture.
+//
+//   light_bench --lights <count> [--view <width>x<height>] [--rounds <n>]
+//
+// The view is in tiles, 256x144 is about a 1920x1080 window zoomed out to
+// 4. The upload and drawing of the texture are left out, they didn't
+// change. Exits with 1 if the two ways build different light maps.
+
+#include "headless_main.h"
+#include "bench_graphics.h"
+#include "light_drawer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+struct BenchLight {
+	int map_x, map_y;
+	SpriteLight light;
+};
+
+// Lights anywhere in the view, never the same as the one before it so
+// addLight keeps every one of them
+static std::vector<BenchLight> generateLights(int count, int map_x, int map_y, int width, int height) {
+	std::mt19937 random(1);
+	std::vector<BenchLight> lights;
+	while (int(lights.size()) < count) {
+		BenchLight light;
+		light.map_x = map_x + random() % width;
+		light.map_y = map_y + random() % height;
+		light.light.intensity = uint8_t(1 + random() % MaxLightIntensity);
+		light.light.color = uint8_t(random() % 216);
+		if (!lights.empty()) {
+			const BenchLight& previous = lights.back();
+			if (previous.map_x == light.map_x && previous.map_y == light.map_y && previous.light.color == light.light.color) {
+				continue;
+			}
+		}
+		lights.push_back(light);
+	}
+	return lights;
+}
+
+// LightDrawer::calculateIntensity before it took the distance
+static float oldIntensity(int map_x, int map_y, const BenchLight& light) {
+	int dx = map_x - light.map_x;
+	int dy = map_y - light.map_y;
+	float distance = std::sqrt(dx * dx + dy * dy);
+	if (distance > MaxLightIntensity) {
+		return 0.f;
+	}
+	float intensity = (-distance + light.light.intensity) * 0.2f;
+	if (intensity < 0.01f) {
+		return 0.f;
+	}
+	return std::min(intensity, 1.f);
+}
+
+// The light map of the old LightDrawer::draw
+static void oldDraw(const std::vector<BenchLight>& lights, const wxColor& global_color, int map_x, int map_y, int end_x, int end_y, std::vector<uint8_t>& buffer) {
+	int w = end_x - map_x;
+	int h = end_y - map_y;
+
+	buffer.resize(static_cast<size_t>(w * h * PixelFormatRGBA));
+
+	for (int x = 0; x < w; ++x) {
+		for (int y = 0; y < h; ++y) {
+			int mx = (map_x + x);
+			int my = (map_y + y);
+			int index = (y * w + x);
+			int color_index = index * PixelFormatRGBA;
+
+			buffer[color_index] = global_color.Red();
+			buffer[color_index + 1] = global_color.Green();
+			buffer[color_index + 2] = global_color.Blue();
+			buffer[color_index + 3] = 140; // global_color.Alpha();
+
+			for (auto& light : lights) {
+				float intensity = oldIntensity(mx, my, light);
+				if (intensity == 0.f) {
+					continue;
+				}
+				wxColor light_color = colorFromEightBit(light.light.color);
+				uint8_t red = static_cast<uint8_t>(light_color.Red() * intensity);
+				uint8_t green = static_cast<uint8_t>(light_color.Green() * intensity);
+				uint8_t blue = static_cast<uint8_t>(light_color.Blue() * intensity);
+				buffer[color_index] = std::max(buffer[color_index], red);
+				buffer[color_index + 1] = std::max(buffer[color_index + 1], green);
+				buffer[color_index + 2] = std::max(buffer[color_index + 2], blue);
+			}
+		}
+	}
+}
+
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+	int light_count = 0;
+	int width = 256, height = 144;
+	int rounds = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--lights" && i + 1 < argc) {
+			light_count = std::stoi(argv[++i]);
+		} else if (arg == "--view" && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+				light_count = 0;
+				break;
+			}
+		} else if (arg == "--rounds" && i + 1 < argc) {
+			rounds = std::max(1, std::stoi(argv[++i]));
+		} else {
+			light_count = 0;
+			break;
+		}
+	}
+	if (light_count <= 0 || width <= 0 || height <= 0) {
+		std::cerr << "Usage: " << argv[0] << " --lights <count> [--view <width>x<height>] [--rounds <n>]" << std::endl;
+		return 2;
+	}
+
+	// Somewhere in the middle of the map, on the ground floor
+	const int map_x = 1000, map_y = 1000;
+	const int end_x = map_x + width, end_y = map_y + height;
+	const std::vector<BenchLight> lights = generateLights(light_count, map_x, map_y, width, height);
+
+	LightDrawer drawer;
+	drawer.setGlobalLightColor(215);
+	std::vector<uint8_t> old_buffer;
+	double best_new = 0, best_old = 0;
+	for (int round = 0; round < rounds; ++round) {
+		// Lights are added again every frame, like MapDrawer does
+		double start = now();
+		drawer.clear();
+		for (const BenchLight& light : lights) {
+			drawer.addLight(light.map_x, light.map_y, GROUND_LAYER, light.light);
+		}
+		drawer.draw(map_x, map_y, end_x, end_y, 0, 0, false);
+		const double time_new = now() - start;
+
+		start = now();
+		oldDraw(lights, colorFromEightBit(215), map_x, map_y, end_x, end_y, old_buffer);
+		const double time_old = now() - start;
+
+		if (round == 0 || time_new < best_new) {
+			best_new = time_new;
+		}
+		if (round == 0 || time_old < best_old) {
+			best_old = time_old;
+		}
+	}
+
+	std::cout << lights.size() << " lights in a " << width << "x" << height << " view, best of " << rounds << std::endl;
+	printf("every tile  %9.2f ms per frame\n", best_old * 1000);
+	printf("reach only  %9.2f ms per frame\n", best_new * 1000);
+
+	if (uploadedTexture() != old_buffer) {
+		std::cout << "FAIL the two ways build different light maps" << std::endl;
+		return 1;
+	}
+	std::cout << "OK, both build the same light map" << std::endl;
+	return 0;
+}
@@ -0,0 +1,202 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Takes the place of source/tile.h for map_bench. The map structure,
+// TileDelta and FloorSelection only need a few members of Tile, the real one pulls in items,
+// brushes and the graphics. Items are plain blocks of about the size of a
+// real Item so creating and deleting tiles costs roughly what it does in
+// the editor. Creatures and spawns are left empty, item.h, creature.h and
+// spawn.h are kept out too.
+
+#ifndef RME_TILE_H
+#define RME_TILE_H
+#define RME_ITEM_H_
+#define RME_CREATURE_H_
+#define RME_SPAWN_H_
+
+#include "position.h"
+#include "map_region.h"
+
+#include <cstring>
+
+class Item {
+public:
+	uint16_t id = 0;
+	bool selected = false;
+	uint8_t payload[45] = {};
+
+	void select() {
+		selected = true;
+	}
+	void deselect() {
+		selected = false;
+	}
+	bool isSelected() const {
+		return selected;
+	}
+	bool isBorder() const {
+		return false;
+	}
+
+	Item* deepCopy() const {
+		return new Item(*this);
+	}
+	bool isSameAs(const Item& other) const {
+		return id == other.id && memcmp(payload, other.payload, sizeof(payload)) == 0;
+	}
+	uint32_t memsize() const {
+		return sizeof(*this);
+	}
+};
+
+// Never created, only here for what FloorSelection calls
+class Creature {
+public:
+	void select() { }
+	void deselect() { }
+	bool isSelected() const {
+		return false;
+	}
+};
+
+class Spawn {
+public:
+	void select() { }
+	void deselect() { }
+	bool isSelected() const {
+		return false;
+	}
+};
+
+typedef std::vector<Item*> ItemVector;
+
+class Tile {
+public:
+	TileLocation* location;
+	Item* ground;
+	ItemVector items;
+	Creature* creature;
+	Spawn* spawn;
+	uint32_t house_id;
+	uint16_t mapflags;
+	uint16_t statflags;
+
+	Tile(TileLocation& location) :
+		location(&location),
+		ground(nullptr),
+		creature(nullptr),
+		spawn(nullptr),
+		house_id(0),
+		mapflags(0),
+		statflags(0) { }
+	~Tile() {
+		delete creature;
+		delete spawn;
+		delete ground;
+		for (Item* item : items) {
+			delete item;
+		}
+	}
+
+	// Allocated from the MapAllocator slabs, like the real tile
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
+	void setLocation(TileLocation* where) {
+		location = where;
+	}
+
+	Position getPosition() const {
+		return location->getPosition();
+	}
+	int getX() const {
+		return location->getPosition().x;
+	}
+	int getY() const {
+		return location->getPosition().y;
+	}
+	int getZ() const {
+		return location->getPosition().z;
+	}
+	int size() const {
+		return int(items.size()) + (ground ? 1 : 0);
+	}
+	uint16_t getMapFlags() const {
+		return mapflags;
+	}
+	void setMapFlags(uint16_t flags) {
+		mapflags |= flags;
+	}
+	uint16_t getStatFlags() const {
+		return statflags;
+	}
+	void setStatFlags(uint16_t flags) {
+		statflags |= flags;
+	}
+	bool isHouseTile() const {
+		return house_id != 0;
+	}
+
+	// Selection as in the real tile, statflags only has the selected bit
+	bool isSelected() const {
+		return statflags & 1;
+	}
+	void select() {
+		if (ground) {
+			ground->select();
+		}
+		for (Item* item : items) {
+			item->select();
+		}
+		statflags |= 1;
+	}
+	void deselect() {
+		if (ground) {
+			ground->deselect();
+		}
+		for (Item* item : items) {
+			item->deselect();
+		}
+		statflags &= ~1;
+	}
+	void update() {
+		statflags &= ~1;
+		if (ground && ground->isSelected()) {
+			statflags |= 1;
+		}
+		for (const Item* item : items) {
+			if (item->isSelected()) {
+				statflags |= 1;
+			}
+		}
+	}
+
+	// Same as the real ones, without creatures and spawns
+	Tile* deepCopy(BaseMap& map);
+	uint32_t memsize() const {
+		uint32_t mem = sizeof(*this);
+		if (ground) {
+			mem += ground->memsize();
+		}
+		for (const Item* item : items) {
+			mem += item->memsize();
+		}
+		return mem + sizeof(Item*) * items.capacity();
+	}
+};
+
+#endif
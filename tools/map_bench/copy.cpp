@@ -0,0 +1,473 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Copies a square of tiles, pastes it over another square of the same
+// size and undoes the paste, the way CopyBuffer and the undo history do
+// it. Reports the time of each step, what the buffer and the undo history
+// hold and the peak resident memory. Two ways are compared:
+//
+// deep:    the copy buffer before the chunks, a second BaseMap of deep
+//          copied tiles that paste copies again, with the replaced tiles
+//          kept whole for undo
+// chunked: CopyBuffer now, one blob of OTBM tile nodes per leaf that paste
+//          decodes onto the map, with the replaced tiles kept as TileDelta
+//          if the sources have it
+//
+//   copy_bench --size <side> [--merge] [--mode deep|chunked]
+//
+// Without --mode both ways run, each in a process of its own so the peaks
+// don't mix. --merge pastes like MERGE_PASTE, on top of a copy of the tile
+// that was there. Tiles are the stand-ins of bench_tile.h. Exits with 1 if
+// undo doesn't bring back the tiles that were pasted over.
+
+#include "headless_main.h"
+#include "bench_tile.h"
+#include "basemap.h"
+#include "filehandle.h"
+#if __has_include("tile_delta.h")
+	#include "tile_delta.h"
+	#define HAVE_TILE_DELTA
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+// Node types and attributes of the OTBM format, as in iomap_otbm.h
+enum {
+	OTBM_TILE = 5,
+	OTBM_ITEM = 6,
+};
+
+enum {
+	OTBM_ATTR_TILE_FLAGS = 3,
+};
+
+// Grounds are told apart from other items by their id, like
+// Tile::addItem does with the ground flag of the item type
+static constexpr uint16_t first_item_id = 1000;
+
+static constexpr int source_x = 1000;
+static constexpr int source_y = 1000;
+static constexpr int floor_z = 7;
+
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A value of /proc/self/status in megabytes, 0 if unknown
+static double statusMemory(const std::string& key) {
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, key.size(), key) == 0) {
+			return std::strtod(line.c_str() + key.size() + 1, nullptr) / 1024.0;
+		}
+	}
+	return 0;
+}
+
+static void fillSquare(BaseMap& map, int start_x, int side, uint32_t seed) {
+	std::mt19937 random(seed);
+	for (int y = 0; y < side; ++y) {
+		for (int x = 0; x < side; ++x) {
+			Tile* tile = map.createTile(start_x + x, source_y + y, floor_z);
+			tile->ground = new Item();
+			tile->ground->id = uint16_t(100 + random() % 100);
+			const int items = random() % 4;
+			for (int n = 0; n < items; ++n) {
+				Item* item = new Item();
+				item->id = uint16_t(first_item_id + random() % 3000);
+				tile->items.push_back(item);
+			}
+		}
+	}
+}
+
+static std::vector<uint16_t> tileIds(const Tile* tile) {
+	std::vector<uint16_t> ids;
+	if (tile) {
+		ids.push_back(tile->ground ? tile->ground->id : 0);
+		for (const Item* item : tile->items) {
+			ids.push_back(item->id);
+		}
+	}
+	return ids;
+}
+
+// Tile::merge, the other tile's ground replaces this one's and its items
+// go on top
+static void merge(Tile* tile, Tile* other) {
+	if (other->ground) {
+		delete tile->ground;
+		tile->ground = other->ground;
+		other->ground = nullptr;
+	}
+	for (Item* item : other->items) {
+		tile->items.push_back(item);
+	}
+	other->items.clear();
+}
+
+// The old tiles of the paste, kept by the Changes of its action
+class UndoHistory {
+public:
+	explicit UndoHistory(bool compact) :
+		compact(compact) { }
+
+	~UndoHistory() {
+		for (void* change : changes) {
+#ifdef HAVE_TILE_DELTA
+			if (compact) {
+				delete static_cast<TileDelta*>(change);
+				continue;
+			}
+#endif
+			delete static_cast<Tile*>(change);
+		}
+	}
+
+	// Action::commit, swaps the new tile onto the map and keeps the old one
+	void commit(BaseMap& map, Tile* newtile) {
+		const Position pos = newtile->getPosition();
+		Tile* oldtile = map.swapTile(pos, newtile);
+		positions.push_back(pos);
+		bytes += sizeof(void*) * 2;
+#ifdef HAVE_TILE_DELTA
+		if (compact && oldtile) {
+			TileDelta* delta = TileDelta::Create(oldtile, newtile);
+			bytes += delta->memsize();
+			changes.push_back(delta);
+			return;
+		}
+#endif
+		bytes += oldtile ? oldtile->memsize() : 0;
+		changes.push_back(oldtile);
+	}
+
+	// Action::undo
+	void undo(BaseMap& map) {
+		for (size_t i = changes.size(); i-- > 0;) {
+			const Position& pos = positions[i];
+			Tile* oldtile = static_cast<Tile*>(changes[i]);
+#ifdef HAVE_TILE_DELTA
+			if (compact && changes[i]) {
+				TileDelta* delta = static_cast<TileDelta*>(changes[i]);
+				oldtile = delta->restore(map, map.getTile(pos));
+				delete delta;
+			}
+#endif
+			delete map.swapTile(pos, oldtile);
+		}
+		changes.clear();
+		positions.clear();
+	}
+
+	uint64_t bytes = 0;
+
+private:
+	bool compact;
+	std::vector<void*> changes;
+	std::vector<Position> positions;
+};
+
+// The copy buffer before the chunks, a second map of deep copies
+class DeepBuffer {
+public:
+	void copy(BaseMap& map, int side) {
+		for (int y = 0; y < side; ++y) {
+			for (int x = 0; x < side; ++x) {
+				const Tile* tile = map.getTile(source_x + x, source_y + y, floor_z);
+				Tile* copied_tile = tiles.createTile(tile->getX(), tile->getY(), tile->getZ());
+				copied_tile->ground = tile->ground ? tile->ground->deepCopy() : nullptr;
+				for (const Item* item : tile->items) {
+					copied_tile->items.push_back(item->deepCopy());
+				}
+				bytes += copied_tile->memsize();
+			}
+		}
+	}
+
+	void paste(BaseMap& map, const Position& offset, bool merge_paste, UndoHistory& history) {
+		std::vector<Tile*> pasted;
+		for (MapIterator it = tiles.begin(); it != tiles.end(); ++it) {
+			Tile* buffer_tile = (*it)->get();
+			TileLocation* location = map.createTileL(buffer_tile->getPosition() + offset);
+			Tile* copy_tile = buffer_tile->deepCopy(map);
+			copy_tile->setLocation(location);
+
+			Tile* new_dest_tile = copy_tile;
+			if (merge_paste) {
+				Tile* old_dest_tile = location->get();
+				new_dest_tile = old_dest_tile ? old_dest_tile->deepCopy(map) : map.allocator(location);
+				merge(new_dest_tile, copy_tile);
+				delete copy_tile;
+			}
+			pasted.push_back(new_dest_tile);
+		}
+		// The whole paste is one action, committed at the end
+		for (Tile* tile : pasted) {
+			history.commit(map, tile);
+		}
+	}
+
+	uint64_t bytes = 0;
+
+private:
+	BaseMap tiles;
+};
+
+// CopyBuffer now, a blob of tile nodes for every leaf
+class ChunkedBuffer {
+public:
+	void copy(BaseMap& map, int side) {
+		std::map<uint32_t, std::vector<const Tile*>> leaves;
+		for (int y = 0; y < side; ++y) {
+			for (int x = 0; x < side; ++x) {
+				const Tile* tile = map.getTile(source_x + x, source_y + y, floor_z);
+				leaves[chunkKey(tile->getX(), tile->getY())].push_back(tile);
+			}
+		}
+
+		MemoryNodeFileWriteHandle writer;
+		for (const auto& leaf : leaves) {
+			writer.reset();
+			writer.addNode(0);
+			for (const Tile* tile : leaf.second) {
+				writeTile(writer, tile);
+			}
+			writer.endNode();
+			chunks[leaf.first].assign(writer.getMemory(), writer.getMemory() + writer.getSize());
+			bytes += writer.getSize();
+		}
+		bytes += chunks.size() * (sizeof(std::vector<uint8_t>) + sizeof(uint32_t) + 4 * sizeof(void*));
+	}
+
+	void paste(BaseMap& map, const Position& offset, bool merge_paste, UndoHistory& history) {
+		std::vector<Tile*> pasted;
+		for (const auto& chunk : chunks) {
+			for (Tile* copy_tile : readChunk(map, chunk.second, offset)) {
+				Tile* new_dest_tile = copy_tile;
+				if (merge_paste) {
+					TileLocation* location = copy_tile->location;
+					Tile* old_dest_tile = location->get();
+					new_dest_tile = old_dest_tile ? old_dest_tile->deepCopy(map) : map.allocator(location);
+					merge(new_dest_tile, copy_tile);
+					delete copy_tile;
+				}
+				pasted.push_back(new_dest_tile);
+			}
+		}
+		for (Tile* tile : pasted) {
+			history.commit(map, tile);
+		}
+	}
+
+	uint64_t bytes = 0;
+
+private:
+	static uint32_t chunkKey(int x, int y) {
+		return (static_cast<uint32_t>(x >> 2) << 16) | static_cast<uint32_t>(y >> 2);
+	}
+
+	static void writeTile(MemoryNodeFileWriteHandle& writer, const Tile* tile) {
+		writer.addNode(OTBM_TILE);
+		writer.addU16(tile->getX());
+		writer.addU16(tile->getY());
+		writer.addU8(tile->getZ());
+		if (tile->getMapFlags()) {
+			writer.addByte(OTBM_ATTR_TILE_FLAGS);
+			writer.addU32(tile->getMapFlags());
+		}
+		auto writeItem = [&writer](const Item* item) {
+			writer.addNode(OTBM_ITEM);
+			writer.addU16(item->id);
+			writer.endNode();
+		};
+		if (tile->ground) {
+			writeItem(tile->ground);
+		}
+		for (const Item* item : tile->items) {
+			writeItem(item);
+		}
+		writer.endNode();
+	}
+
+	// CopyBuffer::readChunk
+	std::vector<Tile*> readChunk(BaseMap& map, const std::vector<uint8_t>& data, const Position& offset) {
+		std::vector<Tile*> tiles;
+
+		MemoryNodeFileReadHandle reader(data.data(), data.size());
+		BinaryNode* rootNode = reader.getRootNode();
+		if (!rootNode) {
+			return tiles;
+		}
+
+		BinaryNode* tileNode = rootNode->getChild();
+		if (!tileNode) {
+			return tiles;
+		}
+
+		do {
+			uint8_t tileType;
+			uint16_t x, y;
+			uint8_t z;
+			if (!tileNode->getByte(tileType) || !tileNode->getU16(x) || !tileNode->getU16(y) || !tileNode->getU8(z)) {
+				continue;
+			}
+
+			const Position pos = Position(x, y, z) + offset;
+			Tile* tile = map.allocator(map.createTileL(pos));
+
+			bool ok = true;
+			uint8_t attribute;
+			while (ok && tileNode->getU8(attribute)) {
+				if (attribute == OTBM_ATTR_TILE_FLAGS) {
+					uint32_t flags = 0;
+					ok = tileNode->getU32(flags);
+					tile->setMapFlags(flags);
+				}
+			}
+			if (!ok) {
+				delete tile;
+				continue;
+			}
+
+			BinaryNode* itemNode = tileNode->getChild();
+			if (itemNode) {
+				do {
+					uint8_t itemType;
+					uint16_t id;
+					if (!itemNode->getByte(itemType) || itemType != OTBM_ITEM || !itemNode->getU16(id)) {
+						continue;
+					}
+					Item* item = new Item();
+					item->id = id;
+					if (id < first_item_id) {
+						delete tile->ground;
+						tile->ground = item;
+					} else {
+						tile->items.push_back(item);
+					}
+				} while (itemNode->advance());
+			}
+			tiles.push_back(tile);
+		} while (tileNode->advance());
+
+		return tiles;
+	}
+
+	std::map<uint32_t, std::vector<uint8_t>> chunks;
+};
+
+template <typename Buffer>
+static int run(const char* name, int side, bool merge_paste, bool compact) {
+	std::unique_ptr<BaseMap> map(new BaseMap());
+	fillSquare(*map, source_x, side, 1);
+	// The square pasted over, far enough to the right not to overlap
+	const int dest_x = source_x + ((side + 67) & ~63);
+	fillSquare(*map, dest_x, side, 2);
+
+	std::vector<std::vector<uint16_t>> before;
+	for (int y = 0; y < side; ++y) {
+		for (int x = 0; x < side; ++x) {
+			before.push_back(tileIds(map->getTile(dest_x + x, source_y + y, floor_z)));
+		}
+	}
+	const double start_memory = statusMemory("VmRSS:");
+
+	std::unique_ptr<Buffer> buffer(new Buffer());
+	UndoHistory history(compact);
+
+	double start = now();
+	buffer->copy(*map, side);
+	const double copy = now() - start;
+
+	start = now();
+	buffer->paste(*map, Position(dest_x - source_x, 0, 0), merge_paste, history);
+	const double paste = now() - start;
+	const uint64_t history_bytes = history.bytes;
+
+	start = now();
+	history.undo(*map);
+	const double undo = now() - start;
+	const double peak_memory = statusMemory("VmHWM:");
+
+	bool restored = true;
+	size_t i = 0;
+	for (int y = 0; y < side && restored; ++y) {
+		for (int x = 0; x < side && restored; ++x, ++i) {
+			restored = tileIds(map->getTile(dest_x + x, source_y + y, floor_z)) == before[i];
+		}
+	}
+
+	printf("%-8s copy %7.1f ms, paste %7.1f ms, undo %7.1f ms, buffer %6.1f MB, undo kept %6.1f MB", name, copy * 1000, paste * 1000, undo * 1000, buffer->bytes / (1024.0 * 1024.0), history_bytes / (1024.0 * 1024.0));
+	if (peak_memory > 0) {
+		printf(", peak %6.1f MB over the map", peak_memory - start_memory);
+	}
+	printf("\n");
+	if (!restored) {
+		std::cout << "FAIL " << name << ": undo didn't bring back the tiles that were pasted over" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int side = 0;
+	bool merge_paste = false;
+	std::string mode;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--size" && i + 1 < argc) {
+			side = std::stoi(argv[++i]);
+		} else if (arg == "--merge") {
+			merge_paste = true;
+		} else if (arg == "--mode" && i + 1 < argc) {
+			mode = argv[++i];
+		} else {
+			side = 0;
+			break;
+		}
+	}
+	if (side <= 0 || side > 4096 || (!mode.empty() && mode != "deep" && mode != "chunked")) {
+		std::cerr << "Usage: " << argv[0] << " --size <side> [--merge] [--mode deep|chunked]" << std::endl;
+		return 2;
+	}
+
+	if (mode.empty()) {
+		std::cout << side << "x" << side << " tiles, " << (merge_paste ? "merged" : "replacing") << " paste" << std::endl;
+		int failures = 0;
+		for (const char* each : { "deep", "chunked" }) {
+			const std::string command = "\"" + std::string(argv[0]) + "\" --size " + std::to_string(side) + (merge_paste ? " --merge" : "") + " --mode " + each;
+			std::cout << std::flush;
+			failures += std::system(command.c_str()) != 0;
+		}
+		if (failures == 0) {
+			std::cout << "OK, undo brought back every tile" << std::endl;
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	if (mode == "deep") {
+		return run<DeepBuffer>("deep", side, merge_paste, false);
+	}
+	return run<ChunkedBuffer>("chunked", side, merge_paste, true);
+}
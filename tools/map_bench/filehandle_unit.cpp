@@ -0,0 +1,3 @@
+// Builds the editor's file handles without the rest of the editor
+#include "headless_main.h"
+#include "filehandle.cpp"
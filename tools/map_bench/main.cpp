@@ -0,0 +1,597 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Times the editor's map structure, BaseMap with its tree, floors and
+// allocator, on a generated map, and checks that it holds what was put
+// in. Tiles are stand-ins with a ground and a few items, see bench_tile.h.
+//
+//   map_bench --tiles <count> [--rounds <n>]
+//
+// fill:     creating every tile, like loading a map
+// clear:    BaseMap::clear, which deletes the tiles but keeps the tree
+// teardown: destroying the map, like closing it
+// random:   getTile at random tile positions
+// neighbour: getTile for the 8 neighbours of every tile, the way the
+//           border, wall and table brushes look around a tile
+// borderize: the lookups of Editor::borderizeMap, every tile of the map in
+//           iterator order reading the ground of its 8 neighbours, once
+//           with 8 getTile calls like the brushes did before and once
+//           with BaseMap::getNeighbourhood if the sources have it. The
+//           brushes themselves need the item database and aren't run.
+// undo:     changing every tile and keeping what the undo history would,
+//           once replacing an item in the middle of the stack like Replace
+//           Items and once adding one on top like the border brushes.
+//           Each is done with the old tile of every change kept as it is
+//           and compacted into a TileDelta if the sources have it, then
+//           undone. Memory is what Change::memsize counts against the undo
+//           size limit.
+// select:   selecting every tile and undoing it, once whole tiles like
+//           Select All or a box and once only the top item of every tile
+//           like clicking through a stack. Each is recorded with a
+//           TileSelection for every tile as the selection did before and
+//           with a FloorSelection for every floor of a leaf if the sources
+//           have it.
+//
+// Resident memory is read from /proc/self/statm where available. Exits
+// with 1 if the map doesn't hold the expected tiles.
+
+#include "headless_main.h"
+#include "bench_tile.h"
+#include "basemap.h"
+#if __has_include("tile_delta.h")
+	#include "tile_delta.h"
+	#define HAVE_TILE_DELTA
+#endif
+#if __has_include("floor_selection.h")
+	#include "floor_selection.h"
+	#define HAVE_FLOOR_SELECTION
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+// Tiles are laid out in rows of this width on floor 7, with every fourth
+// tile also on floor 6
+static constexpr int map_width = 2048;
+static constexpr int map_origin = 1000;
+
+static Position tilePosition(int index) {
+	const int ground = index / 5 * 4 + std::min(index % 5, 3);
+	const int x = map_origin + ground % map_width;
+	const int y = map_origin + ground / map_width;
+	return Position(x, y, index % 5 == 4 ? 6 : 7);
+}
+
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Resident memory in megabytes, 0 if unknown
+static double residentMemory() {
+	std::ifstream statm("/proc/self/statm");
+	size_t pages = 0, resident = 0;
+	if (!(statm >> pages >> resident)) {
+		return 0;
+	}
+	return resident * 4096.0 / (1024.0 * 1024.0);
+}
+
+static void fill(BaseMap& map, int tiles) {
+	std::mt19937 random(1);
+	for (int i = 0; i < tiles; ++i) {
+		const Position pos = tilePosition(i);
+		Tile* tile = map.createTile(pos.x, pos.y, pos.z);
+		tile->ground = new Item();
+		const int items = random() % 4;
+		for (int n = 0; n < items; ++n) {
+			tile->items.push_back(new Item());
+		}
+	}
+}
+
+static bool check(BaseMap& map, int tiles, bool empty) {
+	if (map.size() != uint64_t(empty ? 0 : tiles)) {
+		std::cout << "FAIL map has " << map.size() << " tiles" << std::endl;
+		return false;
+	}
+	for (int i = 0; i < tiles; i += 7) {
+		const Position pos = tilePosition(i);
+		Tile* tile = map.getTile(pos);
+		if (empty ? tile != nullptr : !tile || tile->getPosition() != pos) {
+			std::cout << "FAIL wrong tile at " << pos.x << ":" << pos.y << ":" << pos.z << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns the number of tiles found, so the lookups can't be left out
+static size_t lookupRandom(BaseMap& map, int tiles, int lookups) {
+	std::mt19937 random(2);
+	size_t found = 0;
+	for (int i = 0; i < lookups; ++i) {
+		const Position pos = tilePosition(random() % tiles);
+		found += map.getTile(pos.x, pos.y, pos.z) != nullptr;
+	}
+	return found;
+}
+
+static size_t lookupNeighbours(BaseMap& map, int tiles, int lookups) {
+	size_t found = 0;
+	for (int i = 0; i < tiles && lookups > 0; ++i, lookups -= 8) {
+		const Position pos = tilePosition(i);
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dx = -1; dx <= 1; ++dx) {
+				if (dx != 0 || dy != 0) {
+					found += map.getTile(pos.x + dx, pos.y + dy, pos.z) != nullptr;
+				}
+			}
+		}
+	}
+	return found;
+}
+
+// Ground of a neighbour, standing in for Tile::getGroundBrush
+static uintptr_t groundOf(const Tile* tile) {
+	return tile ? reinterpret_cast<uintptr_t>(tile->ground) : 0;
+}
+
+static uintptr_t borderizeGetTile(BaseMap& map) {
+	uintptr_t sum = 0;
+	for (MapIterator it = map.begin(); it != map.end(); ++it) {
+		const Position pos = (*it)->getPosition();
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dx = -1; dx <= 1; ++dx) {
+				if ((dx == 0 && dy == 0) || (pos.x == 0 && dx < 0) || (pos.y == 0 && dy < 0)) {
+					continue;
+				}
+				sum += groundOf(map.getTile(pos.x + dx, pos.y + dy, pos.z));
+			}
+		}
+	}
+	return sum;
+}
+
+// Takes the type of the neighbourhood from getNeighbourhood itself, so
+// the bench still builds with sources that don't have it
+template <typename MapType, typename Around>
+static uintptr_t borderizeWith(MapType& map, void (MapType::*)(const Position&, Around&)) {
+	uintptr_t sum = 0;
+	Around around;
+	for (MapIterator it = map.begin(); it != map.end(); ++it) {
+		map.getNeighbourhood((*it)->getPosition(), around);
+		for (int i = 0; i < 8; ++i) {
+			sum += groundOf(around.getNeighbour(i));
+		}
+	}
+	return sum;
+}
+
+template <typename MapType>
+static auto borderizeNeighbourhood(MapType& map, int) -> decltype(borderizeWith(map, &MapType::getNeighbourhood)) {
+	return borderizeWith(map, &MapType::getNeighbourhood);
+}
+
+// Sources from before getNeighbourhood was added
+template <typename MapType>
+static uintptr_t borderizeNeighbourhood(MapType& map, long) {
+	return 0;
+}
+
+// What the undo history of an edit on every tile kept, and its cost
+struct UndoResult {
+	uint64_t bytes = 0;
+	double edit = 0;
+	double undo = 0;
+	bool restored = true;
+};
+
+// Ids of a tile's ground and items, to check that undo brings it back
+static std::vector<uint16_t> tileIds(const Tile* tile) {
+	std::vector<uint16_t> ids;
+	ids.push_back(tile->ground ? tile->ground->id : 0);
+	for (const Item* item : tile->items) {
+		ids.push_back(item->id);
+	}
+	return ids;
+}
+
+enum UndoEdit {
+	EDIT_REPLACE,
+	EDIT_ADD,
+	EDIT_COUNT,
+};
+
+static const char* edit_names[EDIT_COUNT] = {
+	"replace",
+	"add",
+};
+
+// Action::commit swaps the changed copy onto the map and keeps the old
+// tile in the Change, Action::undo swaps it back
+static UndoResult editAndUndo(BaseMap& map, int tiles, UndoEdit edit, bool compact) {
+	UndoResult result;
+	std::vector<std::vector<uint16_t>> before;
+	for (int i = 0; i < tiles; ++i) {
+		before.push_back(tileIds(map.getTile(tilePosition(i))));
+	}
+
+	std::vector<void*> history(tiles);
+	double start = now();
+	for (int i = 0; i < tiles; ++i) {
+		const Position pos = tilePosition(i);
+		Tile* newtile = map.getTile(pos)->deepCopy(map);
+		if (edit == EDIT_ADD) {
+			newtile->items.push_back(new Item());
+		} else {
+			Item* replaced = newtile->items.empty() ? newtile->ground : newtile->items[newtile->items.size() / 2];
+			replaced->id += 1;
+		}
+		Tile* oldtile = map.swapTile(pos, newtile);
+		result.bytes += sizeof(void*) * 2;
+#ifdef HAVE_TILE_DELTA
+		if (compact) {
+			TileDelta* delta = TileDelta::Create(oldtile, newtile);
+			result.bytes += delta->memsize();
+			history[i] = delta;
+			continue;
+		}
+#endif
+		result.bytes += oldtile->memsize();
+		history[i] = oldtile;
+	}
+	result.edit = now() - start;
+
+	start = now();
+	for (int i = tiles - 1; i >= 0; --i) {
+		const Position pos = tilePosition(i);
+		Tile* oldtile = static_cast<Tile*>(history[i]);
+#ifdef HAVE_TILE_DELTA
+		if (compact) {
+			TileDelta* delta = static_cast<TileDelta*>(history[i]);
+			oldtile = delta->restore(map, map.getTile(pos));
+			delete delta;
+		}
+#endif
+		delete map.swapTile(pos, oldtile);
+	}
+	result.undo = now() - start;
+
+	for (int i = 0; i < tiles && result.restored; ++i) {
+		result.restored = tileIds(map.getTile(tilePosition(i))) == before[i];
+	}
+	return result;
+}
+
+// The record of one tile the selection kept before FloorSelection
+class TileSelection {
+public:
+	explicit TileSelection(const Tile* tile) :
+		position(tile->getPosition()),
+		bits(3 + tile->items.size(), false) {
+		bits[0] = tile->ground && tile->ground->isSelected();
+		for (size_t i = 0; i < tile->items.size(); ++i) {
+			bits[3 + i] = tile->items[i]->isSelected();
+		}
+	}
+
+	void selectTop(const Tile* tile) {
+		bits[tile->items.empty() ? 0 : bits.size() - 1] = true;
+	}
+	void selectAll() {
+		std::fill(bits.begin(), bits.end(), true);
+	}
+	void swap(Tile* tile) {
+		TileSelection current(tile);
+		if (tile->ground) {
+			bits[0] ? tile->ground->select() : tile->ground->deselect();
+		}
+		for (size_t i = 0; i < tile->items.size() && 3 + i < bits.size(); ++i) {
+			bits[3 + i] ? tile->items[i]->select() : tile->items[i]->deselect();
+		}
+		bits.swap(current.bits);
+		tile->update();
+	}
+	uint32_t memsize() const {
+		return sizeof(*this) + bits.capacity() / 8;
+	}
+
+	Position position;
+	std::vector<bool> bits;
+};
+
+enum SelectEdit {
+	SELECT_TILES,
+	SELECT_TOP_ITEM,
+	SELECT_COUNT,
+};
+
+static const char* select_names[SELECT_COUNT] = {
+	"select",
+	"select top",
+};
+
+static bool selectedAsExpected(BaseMap& map, int tiles, SelectEdit edit, bool selected) {
+	for (int i = 0; i < tiles; ++i) {
+		const Tile* tile = map.getTile(tilePosition(i));
+		const Item* top = tile->items.empty() ? tile->ground : tile->items.back();
+		if (tile->isSelected() != selected || top->isSelected() != selected) {
+			return false;
+		}
+		if (edit == SELECT_TOP_ITEM && tile->items.size() > 0 && tile->ground->isSelected()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Selection::add records the state in the running action, committing it
+// applies the records and undo applies them again. Every tile starts out
+// unselected.
+static UndoResult selectAndUndo(BaseMap& map, int tiles, SelectEdit edit, bool per_floor) {
+	UndoResult result;
+	std::vector<TileSelection*> tile_records;
+#ifdef HAVE_FLOOR_SELECTION
+	std::unordered_map<Floor*, FloorSelection*> pending;
+	std::vector<FloorSelection*> floor_records;
+#endif
+
+	double start = now();
+	for (int i = 0; i < tiles; ++i) {
+		const Position pos = tilePosition(i);
+		Tile* tile = map.getTile(pos);
+#ifdef HAVE_FLOOR_SELECTION
+		if (per_floor) {
+			Floor* floor = map.getLeaf(pos.x, pos.y)->getFloor(pos.z);
+			FloorSelection*& state = pending[floor];
+			if (!state) {
+				state = new FloorSelection(floor);
+				floor_records.push_back(state);
+			}
+			if (edit == SELECT_TILES) {
+				state->selectAll(tile, true);
+			} else {
+				state->select(tile, tile->items.empty() ? tile->ground : tile->items.back(), true);
+			}
+			continue;
+		}
+#endif
+		TileSelection* state = new TileSelection(tile);
+		if (edit == SELECT_TILES) {
+			state->selectAll();
+		} else {
+			state->selectTop(tile);
+		}
+		tile_records.push_back(state);
+	}
+	for (TileSelection* state : tile_records) {
+		state->swap(map.getTile(state->position));
+		result.bytes += sizeof(void*) * 2 + state->memsize();
+	}
+#ifdef HAVE_FLOOR_SELECTION
+	for (FloorSelection* state : floor_records) {
+		state->swap();
+		result.bytes += sizeof(void*) * 2 + state->memsize();
+	}
+#endif
+	result.edit = now() - start;
+	result.restored = selectedAsExpected(map, tiles, edit, true);
+
+	start = now();
+	for (auto it = tile_records.rbegin(); it != tile_records.rend(); ++it) {
+		(*it)->swap(map.getTile((*it)->position));
+		delete *it;
+	}
+#ifdef HAVE_FLOOR_SELECTION
+	for (auto it = floor_records.rbegin(); it != floor_records.rend(); ++it) {
+		(*it)->swap();
+		delete *it;
+	}
+#endif
+	result.undo = now() - start;
+
+	result.restored = result.restored && selectedAsExpected(map, tiles, edit, false);
+	return result;
+}
+
+struct Times {
+	double fill = 0;
+	double clear = 0;
+	double teardown = 0;
+	double random = 0;
+	double neighbour = 0;
+	double borderize = 0;
+	double borderize_around = 0;
+	UndoResult undo_full[EDIT_COUNT];
+	UndoResult undo_delta[EDIT_COUNT];
+	UndoResult select_tile[SELECT_COUNT];
+	UndoResult select_floor[SELECT_COUNT];
+};
+
+static void keepBest(double& best, double time, int round) {
+	if (round == 0 || time < best) {
+		best = time;
+	}
+}
+
+static void keepBestUndo(UndoResult& best, const UndoResult& result, int round) {
+	best.bytes = result.bytes;
+	keepBest(best.edit, result.edit, round);
+	keepBest(best.undo, result.undo, round);
+}
+
+int main(int argc, char** argv) {
+	int tiles = 0;
+	int rounds = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--tiles" && i + 1 < argc) {
+			tiles = std::stoi(argv[++i]);
+		} else if (arg == "--rounds" && i + 1 < argc) {
+			rounds = std::max(1, std::stoi(argv[++i]));
+		} else {
+			tiles = 0;
+			break;
+		}
+	}
+	if (tiles <= 0) {
+		std::cerr << "Usage: " << argv[0] << " --tiles <count> [--rounds <n>]" << std::endl;
+		return 2;
+	}
+
+	const double base_memory = residentMemory();
+	double filled_memory = 0;
+	double closed_memory = 0;
+	const int lookups = 4000000;
+	size_t found = 0;
+	bool have_neighbourhood = false;
+	Times best;
+	for (int round = 0; round < rounds; ++round) {
+		Times times;
+
+		// Closing a loaded map, timed first while the heap still looks like
+		// it does after loading. Tiles freed and created again are spread
+		// differently in memory, which costs more than the map structure.
+		std::unique_ptr<BaseMap> map(new BaseMap());
+		double start = now();
+		fill(*map, tiles);
+		times.fill = now() - start;
+		if (!check(*map, tiles, false)) {
+			return 1;
+		}
+		if (round == 0) {
+			filled_memory = residentMemory();
+		}
+
+		start = now();
+		found += lookupRandom(*map, tiles, lookups);
+		times.random = now() - start;
+		start = now();
+		found += lookupNeighbours(*map, tiles, lookups);
+		times.neighbour = now() - start;
+
+		// Alternate which one goes first, the second finds more of the map
+		// in the cache
+		uintptr_t borders = 0, borders_around = 0;
+		for (int pass = 0; pass < 2; ++pass) {
+			start = now();
+			if ((pass + round) % 2 == 0) {
+				borders = borderizeGetTile(*map);
+				times.borderize = now() - start;
+			} else {
+				borders_around = borderizeNeighbourhood(*map, 0);
+				times.borderize_around = now() - start;
+			}
+		}
+		if (borders_around != 0 && borders_around != borders) {
+			std::cout << "FAIL getNeighbourhood found other tiles than getTile" << std::endl;
+			return 1;
+		}
+		have_neighbourhood = borders_around != 0;
+
+		for (int edit = 0; edit < EDIT_COUNT; ++edit) {
+			times.undo_full[edit] = editAndUndo(*map, tiles, UndoEdit(edit), false);
+#ifdef HAVE_TILE_DELTA
+			times.undo_delta[edit] = editAndUndo(*map, tiles, UndoEdit(edit), true);
+#endif
+			if (!times.undo_full[edit].restored || !times.undo_delta[edit].restored) {
+				std::cout << "FAIL undo didn't bring back every tile" << std::endl;
+				return 1;
+			}
+		}
+
+		for (int edit = 0; edit < SELECT_COUNT; ++edit) {
+			times.select_tile[edit] = selectAndUndo(*map, tiles, SelectEdit(edit), false);
+#ifdef HAVE_FLOOR_SELECTION
+			times.select_floor[edit] = selectAndUndo(*map, tiles, SelectEdit(edit), true);
+#endif
+			if (!times.select_tile[edit].restored || !times.select_floor[edit].restored) {
+				std::cout << "FAIL the selection isn't what was selected or undone" << std::endl;
+				return 1;
+			}
+		}
+
+		start = now();
+		map.reset();
+		times.teardown = now() - start;
+		if (round == 0) {
+			closed_memory = residentMemory();
+		}
+
+		map.reset(new BaseMap());
+		fill(*map, tiles);
+		start = now();
+		map->clear(true);
+		times.clear = now() - start;
+		if (!check(*map, tiles, true)) {
+			return 1;
+		}
+		map.reset();
+
+		keepBest(best.fill, times.fill, round);
+		keepBest(best.clear, times.clear, round);
+		keepBest(best.teardown, times.teardown, round);
+		keepBest(best.random, times.random, round);
+		keepBest(best.neighbour, times.neighbour, round);
+		keepBest(best.borderize, times.borderize, round);
+		keepBest(best.borderize_around, times.borderize_around, round);
+		for (int edit = 0; edit < EDIT_COUNT; ++edit) {
+			keepBestUndo(best.undo_full[edit], times.undo_full[edit], round);
+			keepBestUndo(best.undo_delta[edit], times.undo_delta[edit], round);
+		}
+		for (int edit = 0; edit < SELECT_COUNT; ++edit) {
+			keepBestUndo(best.select_tile[edit], times.select_tile[edit], round);
+			keepBestUndo(best.select_floor[edit], times.select_floor[edit], round);
+		}
+	}
+
+	std::cout << tiles << " tiles, best of " << rounds << std::endl;
+	printf("fill      %9.1f ms\n", best.fill * 1000);
+	printf("clear     %9.1f ms\n", best.clear * 1000);
+	printf("teardown  %9.1f ms\n", best.teardown * 1000);
+	printf("random    %9.1f ns per getTile\n", best.random * 1e9 / lookups);
+	printf("neighbour %9.1f ns per getTile\n", best.neighbour * 1e9 / std::min(lookups, tiles * 8));
+	printf("borderize %9.1f ms with getTile\n", best.borderize * 1000);
+	if (have_neighbourhood) {
+		printf("borderize %9.1f ms with getNeighbourhood\n", best.borderize_around * 1000);
+	}
+	for (int edit = 0; edit < EDIT_COUNT; ++edit) {
+		const UndoResult& full = best.undo_full[edit];
+		printf("%-9s %9.1f MB kept, edit %.1f ms, undo %.1f ms with full tiles\n", edit_names[edit], full.bytes / (1024.0 * 1024.0), full.edit * 1000, full.undo * 1000);
+#ifdef HAVE_TILE_DELTA
+		const UndoResult& delta = best.undo_delta[edit];
+		printf("%-9s %9.1f MB kept, edit %.1f ms, undo %.1f ms with TileDelta\n", edit_names[edit], delta.bytes / (1024.0 * 1024.0), delta.edit * 1000, delta.undo * 1000);
+#endif
+	}
+	for (int edit = 0; edit < SELECT_COUNT; ++edit) {
+		const UndoResult& tile = best.select_tile[edit];
+		printf("%-10s %8.1f MB kept, select %.1f ms, undo %.1f ms with TileSelection\n", select_names[edit], tile.bytes / (1024.0 * 1024.0), tile.edit * 1000, tile.undo * 1000);
+#ifdef HAVE_FLOOR_SELECTION
+		const UndoResult& floor = best.select_floor[edit];
+		printf("%-10s %8.1f MB kept, select %.1f ms, undo %.1f ms with FloorSelection\n", select_names[edit], floor.bytes / (1024.0 * 1024.0), floor.edit * 1000, floor.undo * 1000);
+#endif
+	}
+	if (base_memory > 0) {
+		printf("resident  %9.1f MB filled, %.1f MB after closing (%.1f MB at start)\n", filled_memory - base_memory, closed_memory - base_memory, base_memory);
+	}
+	std::cout << "OK, " << found << " lookups hit" << std::endl;
+	return 0;
+}
@@ -0,0 +1,37 @@
+// Builds the editor's map structure and undo deltas without the rest of
+// the editor
+#include "headless_main.h"
+#include "bench_tile.h"
+
+#include "basemap.cpp"
+#include "map_region.cpp"
+#include "map_allocator.cpp"
+// Sources from before TileDelta was split out of action.cpp don't have it
+#if __has_include("tile_delta.cpp")
+	#include "tile_delta.cpp"
+#endif
+#if __has_include("floor_selection.cpp")
+	#include "floor_selection.cpp"
+#endif
+
+Tile* Tile::deepCopy(BaseMap& map) {
+	Tile* copy = map.allocator.allocateTile(location);
+	copy->house_id = house_id;
+	copy->mapflags = mapflags;
+	copy->statflags = statflags;
+	if (ground) {
+		copy->ground = ground->deepCopy();
+	}
+	for (const Item* item : items) {
+		copy->items.push_back(item->deepCopy());
+	}
+	return copy;
+}
+
+void* Tile::operator new(size_t size) {
+	return MapAllocator::allocate(size);
+}
+
+void Tile::operator delete(void* ptr, size_t size) {
+	MapAllocator::deallocate(ptr, size);
+}
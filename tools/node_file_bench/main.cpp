@@ -0,0 +1,471 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Loads an OTBM style node file with both node parsers and every read
+// handle, checks that they all produce the same tree and times them. The
+// handles are "disk", which refills a heap cache with fread, "mapped",
+// which maps the file, and "heap", the same handle reading the whole file
+// into memory as it does where mapping is not available.
+//
+//   node_file_bench --tiles <count> [--rounds <n>] [--keep <file>]
+//   node_file_bench --file <map.otbm> [--rounds <n>]
+//
+// --tiles writes a generated map with that many tiles to a temporary file
+// (or to --keep) and checks every tree against what was written. --file
+// reads an existing map instead and only compares the handles and parsers
+// with each other. Times include hashing every value read, which costs the
+// same for all of them. Exits with 1 if any of them differ.
+
+#include "headless_main.h"
+#include "filehandle.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+
+// Node types and attributes of the OTBM format, as in iomap_otbm.h
+enum {
+	OTBM_MAP_DATA = 2,
+	OTBM_TILE_AREA = 4,
+	OTBM_TILE = 5,
+	OTBM_ITEM = 6,
+	OTBM_HOUSETILE = 14,
+};
+
+enum {
+	OTBM_ATTR_DESCRIPTION = 1,
+	OTBM_ATTR_TILE_FLAGS = 3,
+	OTBM_ATTR_ACTION_ID = 4,
+	OTBM_ATTR_TEXT = 6,
+	OTBM_ATTR_ITEM = 9,
+	OTBM_ATTR_COUNT = 15,
+};
+
+// FNV-1a over every value read from the tree and the depth of each node
+class Digest {
+public:
+	void add(const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+		}
+	}
+	template <typename T>
+	void add(T value) {
+		add(&value, sizeof(value));
+	}
+	void add(const std::string& str) {
+		add(uint16_t(str.size()));
+		add(str.data(), str.size());
+	}
+
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	size_t nodes = 0;
+};
+
+// ============================================================================
+// Generated map
+
+// Writes the map and digests it the way readMapNode reads it back
+class MapWriter {
+public:
+	MapWriter(NodeFileWriteHandle& file, Digest& digest) :
+		file(file), digest(digest), random(1), depth(0) { }
+
+	void write(int tiles) {
+		beginNode(0);
+		addU32(2); // OTBM version
+		addU16(0xFFFF); // Width and height
+		addU16(0xFFFF);
+		addU32(3); // Item major version
+		addU32(57); // Item minor version
+
+		beginNode(OTBM_MAP_DATA);
+		addU8(OTBM_ATTR_DESCRIPTION);
+		addString("Generated by node_file_bench");
+
+		// Areas of 256x256 like the saver writes, filled row by row with
+		// a few floors above and below the ground floor
+		int written = 0;
+		for (int area = 0; written < tiles; ++area) {
+			const int z = area % 4 == 3 ? 6 : 7;
+			const int base_x = 1024 + (area % 16) * 256;
+			const int base_y = 1024 + (area / 16) * 256;
+			beginNode(OTBM_TILE_AREA);
+			addU16(uint16_t(base_x));
+			addU16(uint16_t(base_y));
+			addU8(uint8_t(z));
+			for (int i = 0; i < 256 * 256 && written < tiles; ++i, ++written) {
+				writeTile(uint8_t(i & 0xFF), uint8_t(i >> 8));
+			}
+			endNode();
+		}
+
+		endNode();
+		endNode();
+	}
+
+private:
+	void writeTile(uint8_t x, uint8_t y) {
+		const bool house = random() % 50 == 0;
+		beginNode(house ? OTBM_HOUSETILE : OTBM_TILE);
+		addU8(x);
+		addU8(y);
+		if (house) {
+			addU32(random() % 2000);
+		}
+		if (random() % 20 == 0) {
+			addU8(OTBM_ATTR_TILE_FLAGS);
+			addU32(random() % 64);
+		}
+		addU8(OTBM_ATTR_ITEM);
+		addU16(uint16_t(100 + random() % 40000));
+
+		const int items = random() % 4;
+		for (int i = 0; i < items; ++i) {
+			beginNode(OTBM_ITEM);
+			addU16(uint16_t(100 + random() % 40000));
+			if (random() % 8 == 0) {
+				addU8(OTBM_ATTR_COUNT);
+				addU8(uint8_t(random()));
+			}
+			if (random() % 16 == 0) {
+				addU8(OTBM_ATTR_ACTION_ID);
+				addU16(uint16_t(random()));
+			}
+			if (random() % 200 == 0) {
+				addU8(OTBM_ATTR_TEXT);
+				std::string text(random() % 200, 'a');
+				for (char& c : text) {
+					c = char(random());
+				}
+				addString(text);
+			}
+			endNode();
+		}
+		endNode();
+	}
+
+	void beginNode(uint8_t type) {
+		file.addNode(type);
+		digest.add(depth++);
+		digest.add(type);
+		++digest.nodes;
+	}
+	void endNode() {
+		file.endNode();
+		--depth;
+	}
+	void addU8(uint8_t value) {
+		file.addU8(value);
+		digest.add(value);
+	}
+	void addU16(uint16_t value) {
+		file.addU16(value);
+		digest.add(value);
+	}
+	void addU32(uint32_t value) {
+		file.addU32(value);
+		digest.add(value);
+	}
+	void addString(const std::string& str) {
+		file.addString(str);
+		digest.add(str);
+	}
+
+	NodeFileWriteHandle& file;
+	Digest& digest;
+	std::mt19937 random;
+	int depth;
+};
+
+// ============================================================================
+// Readers
+
+static bool readAttributes(BinaryNode* node, Digest& digest) {
+	uint8_t attribute;
+	while (node->getU8(attribute)) {
+		digest.add(attribute);
+		switch (attribute) {
+			case OTBM_ATTR_DESCRIPTION:
+			case OTBM_ATTR_TEXT: {
+				std::string str;
+				if (!node->getString(str)) {
+					return false;
+				}
+				digest.add(str);
+				break;
+			}
+			case OTBM_ATTR_TILE_FLAGS: {
+				uint32_t flags;
+				if (!node->getU32(flags)) {
+					return false;
+				}
+				digest.add(flags);
+				break;
+			}
+			case OTBM_ATTR_ACTION_ID:
+			case OTBM_ATTR_ITEM: {
+				uint16_t value;
+				if (!node->getU16(value)) {
+					return false;
+				}
+				digest.add(value);
+				break;
+			}
+			case OTBM_ATTR_COUNT: {
+				uint8_t count;
+				if (!node->getU8(count)) {
+					return false;
+				}
+				digest.add(count);
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+// Reads the generated map field by field, the way IOMapOTBM::loadMap does
+static bool readMapNode(BinaryNode* node, int depth, Digest& digest) {
+	uint8_t type;
+	if (!node->getU8(type)) {
+		return false;
+	}
+	digest.add(depth);
+	digest.add(type);
+	++digest.nodes;
+
+	switch (depth == 0 ? 0 : type) {
+		case 0: {
+			uint32_t version, major, minor;
+			uint16_t width, height;
+			if (!node->getU32(version) || !node->getU16(width) || !node->getU16(height) || !node->getU32(major) || !node->getU32(minor)) {
+				return false;
+			}
+			digest.add(version);
+			digest.add(width);
+			digest.add(height);
+			digest.add(major);
+			digest.add(minor);
+			break;
+		}
+		case OTBM_TILE_AREA: {
+			uint16_t x, y;
+			uint8_t z;
+			if (!node->getU16(x) || !node->getU16(y) || !node->getU8(z)) {
+				return false;
+			}
+			digest.add(x);
+			digest.add(y);
+			digest.add(z);
+			break;
+		}
+		case OTBM_TILE:
+		case OTBM_HOUSETILE: {
+			uint8_t x, y;
+			if (!node->getU8(x) || !node->getU8(y)) {
+				return false;
+			}
+			digest.add(x);
+			digest.add(y);
+			if (type == OTBM_HOUSETILE) {
+				uint32_t house_id;
+				if (!node->getU32(house_id)) {
+					return false;
+				}
+				digest.add(house_id);
+			}
+			if (!readAttributes(node, digest)) {
+				return false;
+			}
+			break;
+		}
+		case OTBM_ITEM: {
+			uint16_t id;
+			if (!node->getU16(id)) {
+				return false;
+			}
+			digest.add(id);
+			if (!readAttributes(node, digest)) {
+				return false;
+			}
+			break;
+		}
+		case OTBM_MAP_DATA:
+			if (!readAttributes(node, digest)) {
+				return false;
+			}
+			break;
+		default:
+			return false;
+	}
+
+	for (BinaryNode* child = node->getChild(); child; child = child->advance()) {
+		if (!readMapNode(child, depth + 1, digest)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Reads any node file, every byte of every node
+static bool readAnyNode(BinaryNode* node, int depth, Digest& digest) {
+	digest.add(depth);
+	++digest.nodes;
+	uint8_t byte;
+	while (node->getU8(byte)) {
+		digest.add(byte);
+	}
+	for (BinaryNode* child = node->getChild(); child; child = child->advance()) {
+		if (!readAnyNode(child, depth + 1, digest)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// ============================================================================
+
+typedef std::function<bool(BinaryNode*, int, Digest&)> NodeReader;
+typedef std::function<NodeFileReadHandle*(const std::string&)> HandleFactory;
+
+struct Backend {
+	const char* name;
+	HandleFactory open;
+};
+
+struct Result {
+	bool ok = false;
+	Digest digest;
+	double seconds = 0;
+};
+
+static Result load(const std::string& filename, const Backend& backend, NodeParseMode mode, const NodeReader& reader) {
+	Result result;
+	const auto start = std::chrono::steady_clock::now();
+	std::unique_ptr<NodeFileReadHandle> handle(backend.open(filename));
+	if (handle->isOk()) {
+		handle->setParseMode(mode);
+		BinaryNode* root = handle->getRootNode();
+		result.ok = root && reader(root, 0, result.digest) && handle->error_code == FILE_NO_ERROR;
+	}
+	handle.reset();
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static size_t fileSize(const std::string& filename) {
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	return file ? size_t(file.tellg()) : 0;
+}
+
+int main(int argc, char** argv) {
+	std::string filename;
+	std::string keep;
+	int tiles = 0;
+	int rounds = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--tiles" && i + 1 < argc) {
+			tiles = std::stoi(argv[++i]);
+		} else if (arg == "--file" && i + 1 < argc) {
+			filename = argv[++i];
+		} else if (arg == "--keep" && i + 1 < argc) {
+			keep = argv[++i];
+		} else if (arg == "--rounds" && i + 1 < argc) {
+			rounds = std::max(1, std::stoi(argv[++i]));
+		} else {
+			std::cerr << "Usage: " << argv[0] << " --tiles <count> [--keep <file>] | --file <map.otbm> [--rounds <n>]" << std::endl;
+			return 2;
+		}
+	}
+
+	const std::vector<std::string> identifiers = { "OTBM" };
+	std::vector<Backend> backends = {
+		{ "disk", [&](const std::string& name) { return new DiskNodeFileReadHandle(name, identifiers); } },
+		{ "mapped", [&](const std::string& name) { return new MappedNodeFileReadHandle(name, identifiers); } },
+		{ "heap", [&](const std::string& name) { return new MappedNodeFileReadHandle(name, identifiers, false); } },
+	};
+
+	NodeReader reader = readAnyNode;
+	Digest expected;
+	bool generated = false;
+	if (tiles > 0) {
+		if (filename.empty()) {
+			filename = keep.empty() ? "node_file_bench.otbm" : keep;
+		}
+		DiskNodeFileWriteHandle file(filename, "OTBM");
+		if (!file.isOk()) {
+			std::cerr << "Could not write " << filename << std::endl;
+			return 2;
+		}
+		MapWriter(file, expected).write(tiles);
+		file.close();
+		reader = readMapNode;
+		generated = true;
+	} else if (filename.empty()) {
+		std::cerr << "Nothing to load, pass --tiles or --file" << std::endl;
+		return 2;
+	}
+
+	const double megabytes = fileSize(filename) / (1024.0 * 1024.0);
+	std::cout << filename << ": " << megabytes << " MB" << std::endl;
+
+	int failures = 0;
+	bool have_reference = generated;
+	Digest reference = expected;
+	for (const Backend& backend : backends) {
+		for (NodeParseMode mode : { NODE_PARSE_BYTEWISE, NODE_PARSE_BULK }) {
+			const char* mode_name = mode == NODE_PARSE_BULK ? "bulk" : "bytewise";
+			Result best;
+			for (int round = 0; round < rounds; ++round) {
+				Result result = load(filename, backend, mode, reader);
+				if (round == 0 || result.seconds < best.seconds) {
+					best = result;
+				}
+			}
+
+			if (!best.ok) {
+				std::cout << "FAIL " << backend.name << " " << mode_name << ": could not read the file" << std::endl;
+				++failures;
+				continue;
+			}
+			if (!have_reference) {
+				reference = best.digest;
+				have_reference = true;
+			} else if (best.digest.hash != reference.hash || best.digest.nodes != reference.nodes) {
+				std::cout << "FAIL " << backend.name << " " << mode_name << ": the tree differs from " << (generated ? "what was written" : "the first one read") << std::endl;
+				++failures;
+			}
+			printf("%-8s %-9s %8zu nodes %9.1f ms %8.1f MB/s\n", backend.name, mode_name, best.digest.nodes, best.seconds * 1000, megabytes / best.seconds);
+		}
+	}
+
+	if (failures == 0) {
+		std::cout << "OK, every handle and parser read the same tree" << std::endl;
+	}
+	if (generated && keep.empty()) {
+		std::remove(filename.c_str());
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Saves a generated map through OTBM_BlockSaver, the block pipeline of
+// IOMapOTBM::saveMap, with 1 to N worker threads and checks that every
+// file is byte for byte the same as the one written by a single thread.
+// It also saves with every other block taken from the area cache, the way
+// a map is saved again after a few edits, and checks that file too.
+//
+//   otbm_save_bench --tiles <count> [--threads <max>] [--rounds <n>] [--keep]
+//
+// Tiles are encoded the way IOMapOTBM::serializeTileAreas writes them,
+// with items reduced to an id, a count and an action id. Times cover the
+// encoding and writing the file. Exits with 1 if any file differs.
+
+#include "headless_main.h"
+#include "otbm_job_queue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+
+// Node types and attributes of the OTBM format, as in iomap_otbm.h
+enum {
+	OTBM_MAP_DATA = 2,
+	OTBM_TILE_AREA = 4,
+	OTBM_TILE = 5,
+	OTBM_ITEM = 6,
+	OTBM_HOUSETILE = 14,
+};
+
+enum {
+	OTBM_ATTR_DESCRIPTION = 1,
+	OTBM_ATTR_TILE_FLAGS = 3,
+	OTBM_ATTR_ACTION_ID = 4,
+	OTBM_ATTR_ITEM = 9,
+	OTBM_ATTR_COUNT = 15,
+};
+
+struct BenchItem {
+	uint16_t id;
+	uint8_t count;
+	uint16_t action_id;
+};
+
+struct BenchTile {
+	int x, y, z;
+	uint32_t house_id = 0;
+	uint32_t flags = 0;
+	uint16_t ground = 0;
+	std::vector<BenchItem> items;
+};
+
+// Tiles in the order a MapIterator visits them: 4x4 leaves in quad tree
+// order, each leaf floor by floor
+static std::vector<BenchTile> generateTiles(int count) {
+	std::vector<BenchTile> tiles;
+	tiles.reserve(count);
+	std::mt19937 random(1);
+
+	for (uint32_t leaf = 0; int(tiles.size()) < count; ++leaf) {
+		// De-interleave the leaf index into leaf coordinates
+		int leaf_x = 0, leaf_y = 0;
+		for (int bit = 0; bit < 16; ++bit) {
+			leaf_x |= ((leaf >> (bit * 2)) & 1) << bit;
+			leaf_y |= ((leaf >> (bit * 2 + 1)) & 1) << bit;
+		}
+		for (int z = 6; z <= 7 && int(tiles.size()) < count; ++z) {
+			// Upper floors are sparse
+			if (z == 6 && random() % 4 != 0) {
+				continue;
+			}
+			for (int i = 0; i < 16 && int(tiles.size()) < count; ++i) {
+				BenchTile tile;
+				tile.x = 1024 + leaf_x * 4 + (i & 3);
+				tile.y = 1024 + leaf_y * 4 + (i >> 2);
+				tile.z = z;
+				if (random() % 50 == 0) {
+					tile.house_id = random() % 2000;
+				}
+				if (random() % 20 == 0) {
+					tile.flags = random() % 64;
+				}
+				tile.ground = uint16_t(100 + random() % 40000);
+				const int items = random() % 4;
+				for (int n = 0; n < items; ++n) {
+					BenchItem item;
+					item.id = uint16_t(100 + random() % 40000);
+					item.count = random() % 8 == 0 ? uint8_t(1 + random() % 99) : 0;
+					item.action_id = random() % 16 == 0 ? uint16_t(random()) : 0;
+					tile.items.push_back(item);
+				}
+				tiles.push_back(std::move(tile));
+			}
+		}
+	}
+	return tiles;
+}
+
+// Same structure as IOMapOTBM::serializeTileAreas
+static void serializeTileAreas(const std::vector<BenchTile*>& tiles, NodeFileWriteHandle& f) {
+	bool first = true;
+	int local_x = -1, local_y = -1, local_z = -1;
+
+	for (BenchTile* tile : tiles) {
+		if (tile->x < local_x || tile->x >= local_x + 256 || tile->y < local_y || tile->y >= local_y + 256 || tile->z != local_z) {
+			if (!first) {
+				f.endNode();
+			}
+			first = false;
+
+			f.addNode(OTBM_TILE_AREA);
+			f.addU16(local_x = tile->x & 0xFF00);
+			f.addU16(local_y = tile->y & 0xFF00);
+			f.addU8(local_z = tile->z);
+		}
+		f.addNode(tile->house_id ? OTBM_HOUSETILE : OTBM_TILE);
+		f.addU8(tile->x & 0xFF);
+		f.addU8(tile->y & 0xFF);
+		if (tile->house_id) {
+			f.addU32(tile->house_id);
+		}
+		if (tile->flags) {
+			f.addByte(OTBM_ATTR_TILE_FLAGS);
+			f.addU32(tile->flags);
+		}
+		if (tile->ground) {
+			f.addByte(OTBM_ATTR_ITEM);
+			f.addU16(tile->ground);
+		}
+		for (const BenchItem& item : tile->items) {
+			f.addNode(OTBM_ITEM);
+			f.addU16(item.id);
+			if (item.count) {
+				f.addU8(OTBM_ATTR_COUNT);
+				f.addU8(item.count);
+			}
+			if (item.action_id) {
+				f.addU8(OTBM_ATTR_ACTION_ID);
+				f.addU16(item.action_id);
+			}
+			f.endNode();
+		}
+		f.endNode();
+	}
+
+	if (!first) {
+		f.endNode();
+	}
+}
+
+// Encoded blocks by origin, like TileAreaCache
+typedef std::map<std::pair<int, int>, std::vector<uint8_t>> BlockCache;
+
+// Saves the tiles the way IOMapOTBM::saveMap does. Blocks found in cached
+// are copied from it, the others are encoded and stored in encoded.
+static bool save(const std::string& filename, std::vector<BenchTile>& tiles, int thread_count, const BlockCache* cached, BlockCache* encoded) {
+	DiskNodeFileWriteHandle f(filename, "OTBM");
+	if (!f.isOk()) {
+		return false;
+	}
+	f.addNode(0);
+	f.addU32(2);
+	f.addU16(0xFFFF);
+	f.addU16(0xFFFF);
+	f.addU32(3);
+	f.addU32(57);
+
+	f.addNode(OTBM_MAP_DATA);
+	f.addByte(OTBM_ATTR_DESCRIPTION);
+	f.addString("Saved by otbm_save_bench");
+
+	OTBM_BlockSaver<BenchTile> saver(
+		serializeTileAreas,
+		[&](int x, int y, const uint8_t* data, size_t size, bool from_cache) {
+			f.addNodeData(data, size);
+			if (!from_cache && encoded) {
+				(*encoded)[std::make_pair(x, y)].assign(data, data + size);
+			}
+		},
+		thread_count
+	);
+	int block_x = -1, block_y = -1;
+	const std::vector<uint8_t>* cached_block = nullptr;
+	for (BenchTile& tile : tiles) {
+		if ((tile.x & 0xFF00) != block_x || (tile.y & 0xFF00) != block_y) {
+			block_x = tile.x & 0xFF00;
+			block_y = tile.y & 0xFF00;
+			cached_block = nullptr;
+			if (cached) {
+				auto it = cached->find(std::make_pair(block_x, block_y));
+				if (it != cached->end()) {
+					cached_block = &it->second;
+				}
+			}
+			saver.beginBlock(block_x, block_y, cached_block);
+		}
+		if (!cached_block) {
+			saver.addTile(&tile);
+		}
+	}
+	saver.finish();
+
+	f.endNode();
+	f.endNode();
+	const bool ok = f.isOk() && f.error_code == FILE_NO_ERROR;
+	f.close();
+	return ok;
+}
+
+static std::vector<uint8_t> readFile(const std::string& filename) {
+	std::ifstream file(filename, std::ios::binary);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char** argv) {
+	int tile_count = 0;
+	int max_threads = 8;
+	int rounds = 1;
+	bool keep = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--tiles" && i + 1 < argc) {
+			tile_count = std::stoi(argv[++i]);
+		} else if (arg == "--threads" && i + 1 < argc) {
+			max_threads = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--rounds" && i + 1 < argc) {
+			rounds = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--keep") {
+			keep = true;
+		} else {
+			tile_count = 0;
+			break;
+		}
+	}
+	if (tile_count <= 0) {
+		std::cerr << "Usage: " << argv[0] << " --tiles <count> [--threads <max>] [--rounds <n>] [--keep]" << std::endl;
+		return 2;
+	}
+
+	std::vector<BenchTile> tiles = generateTiles(tile_count);
+	std::cout << tiles.size() << " tiles, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+	// The single threaded save is the reference, and fills the cache with
+	// every other block for the cached runs
+	const std::string reference_name = "otbm_save_bench_1.otbm";
+	BlockCache encoded;
+	if (!save(reference_name, tiles, 1, nullptr, &encoded)) {
+		std::cerr << "Could not write " << reference_name << std::endl;
+		return 2;
+	}
+	const std::vector<uint8_t> reference = readFile(reference_name);
+	const double megabytes = reference.size() / (1024.0 * 1024.0);
+	std::cout << reference_name << ": " << megabytes << " MB, " << encoded.size() << " blocks" << std::endl;
+
+	BlockCache half_cache;
+	bool take = false;
+	for (auto& block : encoded) {
+		if ((take = !take)) {
+			half_cache.insert(block);
+		}
+	}
+
+	std::vector<int> thread_counts;
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		thread_counts.push_back(threads);
+	}
+
+	int failures = 0;
+	for (bool use_cache : { false, true }) {
+		for (int threads : thread_counts) {
+			const std::string filename = "otbm_save_bench_" + std::to_string(threads) + (use_cache ? "_cached" : "") + ".otbm";
+			double best = 0;
+			bool ok = true;
+			for (int round = 0; round < rounds && ok; ++round) {
+				const auto start = std::chrono::steady_clock::now();
+				ok = save(filename, tiles, threads, use_cache ? &half_cache : nullptr, nullptr);
+				const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (round == 0 || seconds < best) {
+					best = seconds;
+				}
+			}
+
+			const char* mode = use_cache ? "half cached" : "encode all";
+			if (!ok) {
+				std::cout << "FAIL " << threads << " threads, " << mode << ": could not write " << filename << std::endl;
+				++failures;
+				continue;
+			}
+			if (readFile(filename) != reference) {
+				std::cout << "FAIL " << threads << " threads, " << mode << ": " << filename << " differs from " << reference_name << std::endl;
+				++failures;
+			}
+			printf("%-11s %2d threads %9.1f ms %8.1f MB/s\n", mode, threads, best * 1000, megabytes / best);
+			if (!keep) {
+				std::remove(filename.c_str());
+			}
+		}
+	}
+
+	if (failures == 0) {
+		std::cout << "OK, every file is identical to the single threaded one" << std::endl;
+	}
+	if (!keep) {
+		std::remove(reference_name.c_str());
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Takes the place of source/graphics.h for render_bench. The atlas and the
+// batch only need SpriteRegion, the atlas fields of GameSprite::Image and
+// GL. Texture binds and draw calls are counted on the way to GL.
+
+#ifndef RME_GRAPHICS_H_
+#define RME_GRAPHICS_H_
+
+#include "headless_gl.h"
+
+#include <cstring>
+
+struct RenderCounters {
+	size_t binds = 0;
+	size_t draw_calls = 0;
+};
+
+inline RenderCounters& renderCounters() {
+	static RenderCounters counters;
+	return counters;
+}
+
+inline void countedBindTexture(GLenum target, GLuint texture) {
+	++renderCounters().binds;
+	glBindTexture(target, texture);
+}
+
+inline void countedBegin(GLenum mode) {
+	++renderCounters().draw_calls;
+	glBegin(mode);
+}
+
+inline void countedDrawArrays(GLenum mode, GLint first, GLsizei count) {
+	++renderCounters().draw_calls;
+	glDrawArrays(mode, first, count);
+}
+
+#define glBindTexture countedBindTexture
+#define glBegin countedBegin
+#define glDrawArrays countedDrawArrays
+
+// Same as in graphics.h
+struct SpriteRegion {
+	SpriteRegion() :
+		texture(0), u0(0.f), v0(0.f), u1(1.f), v1(1.f) { }
+
+	GLuint texture;
+	float u0, v0;
+	float u1, v1;
+};
+
+class GameSprite {
+public:
+	class Image {
+	public:
+		bool isGLLoaded = false;
+		int atlas_slot = -1;
+	};
+};
+
+#include "sprite_atlas.h"
+
+#endif
@@ -0,0 +1,309 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Draws a dense part of a map the way MapDrawer does, into an offscreen
+// framebuffer of a headless GL context, and reports the frame time with
+// the texture binds and draw calls of every frame.
+//
+//   render_bench [--zoom <zoom>] [--sprites <count>] [--frames <n>]
+//
+// texture per sprite: every sprite its own 32x32 texture, bound for every
+//                     quad, as GameSprite::Image and glBlitTexture did
+//                     before the atlas
+// atlas:              the sprites packed by SpriteAtlas, bound only when
+//                     the page changes, one glBegin/glEnd per quad
+// batched:            the atlas with the quads collected by SpriteBatch,
+//                     as with the "batch sprites" option on
+//
+// The view is a 1920x1080 window, at zoom 4 that is 240x135 tiles. Every
+// tile has a ground and up to three items, picked from the given number of
+// distinct sprites. Sprites are uploaded before timing starts, so this
+// measures drawing only. Submit is the time until the last GL call of the
+// frame returns, before waiting for the frame to finish. Without a GPU the context runs on a software
+// rasterizer, which makes filling pixels slow too and leaves less of the
+// difference to the binds than on a real driver. Exits with 1 if the two
+// ways draw different pixels and with 77 if no GL context can be made.
+
+#include "headless_main.h"
+#include "bench_graphics.h"
+#include "sprite_batch.h"
+#include "headless_gl.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+
+static const int screen_width = 1920;
+static const int screen_height = 1080;
+
+// Blocks of colour with transparent holes, so blending and filtering matter
+static std::vector<uint8_t> generateSprite(std::mt19937& random) {
+	std::vector<uint8_t> rgba(SPRITE_PIXELS_SIZE * 4);
+	const uint8_t red = random(), green = random(), blue = random();
+	const int hole = random() % SPRITE_PIXELS;
+	for (int y = 0; y < SPRITE_PIXELS; ++y) {
+		for (int x = 0; x < SPRITE_PIXELS; ++x) {
+			uint8_t* pixel = &rgba[(y * SPRITE_PIXELS + x) * 4];
+			const bool transparent = std::abs(x - hole) + std::abs(y - hole) < 8;
+			pixel[0] = uint8_t(red + x * 4);
+			pixel[1] = uint8_t(green + y * 4);
+			pixel[2] = blue;
+			pixel[3] = transparent ? 0 : 255;
+		}
+	}
+	return rgba;
+}
+
+struct BenchSprite {
+	// For the texture per sprite path
+	GLuint texture = 0;
+	// For the atlas path
+	GameSprite::Image image;
+};
+
+// Sprite indices of every tile in the view, row by row, ground first
+struct View {
+	int width = 0;
+	int height = 0;
+	std::vector<std::vector<int>> tiles;
+};
+
+static View generateView(float zoom, int sprite_count) {
+	View view;
+	view.width = int(screen_width * zoom + TileSize - 1) / TileSize;
+	view.height = int(screen_height * zoom + TileSize - 1) / TileSize;
+	std::mt19937 random(2);
+	// A tenth of the sprites are grounds, which repeat a lot more than items
+	const int grounds = std::max(1, sprite_count / 10);
+	for (int i = 0; i < view.width * view.height; ++i) {
+		std::vector<int> tile;
+		tile.push_back(random() % grounds);
+		const int items = random() % 4;
+		for (int n = 0; n < items; ++n) {
+			tile.push_back(random() % sprite_count);
+		}
+		view.tiles.push_back(std::move(tile));
+	}
+	return view;
+}
+
+// The texture per sprite path, GameSprite::Image::createGLTexture and
+// MapDrawer::glBlitTexture from before the atlas
+static void uploadTexture(BenchSprite& sprite, const uint8_t* rgba) {
+	glGenTextures(1, &sprite.texture);
+	glBindTexture(GL_TEXTURE_2D, sprite.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Linear Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SPRITE_PIXELS, SPRITE_PIXELS, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+}
+
+static void blitTexturePerSprite(int sx, int sy, GLuint texture_number) {
+	glBindTexture(GL_TEXTURE_2D, texture_number);
+	glColor4ub(255, 255, 255, 255);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.f, 0.f);
+	glVertex2f(sx, sy);
+	glTexCoord2f(1.f, 0.f);
+	glVertex2f(sx + TileSize, sy);
+	glTexCoord2f(1.f, 1.f);
+	glVertex2f(sx + TileSize, sy + TileSize);
+	glTexCoord2f(0.f, 1.f);
+	glVertex2f(sx, sy + TileSize);
+	glEnd();
+}
+
+// MapDrawer::glBlitTexture with batching off
+static void blitAtlas(SpriteBatch& batch, int sx, int sy, const SpriteRegion& region) {
+	batch.bindTexture(region.texture);
+	glColor4ub(255, 255, 255, 255);
+	glBegin(GL_QUADS);
+	glTexCoord2f(region.u0, region.v0);
+	glVertex2f(sx, sy);
+	glTexCoord2f(region.u1, region.v0);
+	glVertex2f(sx + TileSize, sy);
+	glTexCoord2f(region.u1, region.v1);
+	glVertex2f(sx + TileSize, sy + TileSize);
+	glTexCoord2f(region.u0, region.v1);
+	glVertex2f(sx, sy + TileSize);
+	glEnd();
+}
+
+enum DrawPath {
+	PATH_TEXTURE_PER_SPRITE,
+	PATH_ATLAS,
+	PATH_BATCHED,
+	PATH_COUNT,
+};
+
+static const char* path_names[PATH_COUNT] = {
+	"texture per sprite",
+	"atlas",
+	"batched",
+};
+
+struct FrameStats {
+	double total = 0;
+	double worst = 0;
+	double submit = 0;
+	size_t binds = 0;
+	size_t draw_calls = 0;
+};
+
+static void drawFrame(DrawPath path, const View& view, std::vector<BenchSprite>& sprites, SpriteAtlas& atlas, SpriteBatch& batch) {
+	glClearColor(0.f, 0.f, 0.f, 1.f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	batch.invalidateBinding();
+	for (int y = 0; y < view.height; ++y) {
+		for (int x = 0; x < view.width; ++x) {
+			for (int index : view.tiles[y * view.width + x]) {
+				BenchSprite& sprite = sprites[index];
+				if (path == PATH_TEXTURE_PER_SPRITE) {
+					blitTexturePerSprite(x * TileSize, y * TileSize, sprite.texture);
+				} else if (path == PATH_ATLAS) {
+					blitAtlas(batch, x * TileSize, y * TileSize, atlas.use(sprite.image.atlas_slot));
+				} else {
+					batch.addQuad(x * TileSize, y * TileSize, TileSize, TileSize, atlas.use(sprite.image.atlas_slot), 255, 255, 255, 255);
+				}
+			}
+		}
+	}
+	batch.flush();
+}
+
+static std::vector<uint8_t> readPixels() {
+	std::vector<uint8_t> pixels(size_t(screen_width) * screen_height * 4);
+	glReadPixels(0, 0, screen_width, screen_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+// Pixels that differ by more than rounding in any channel
+static size_t countDifferent(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+	size_t different = 0;
+	for (size_t i = 0; i < a.size(); i += 4) {
+		for (int c = 0; c < 4; ++c) {
+			if (std::abs(int(a[i + c]) - int(b[i + c])) > 2) {
+				++different;
+				break;
+			}
+		}
+	}
+	return different;
+}
+
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+	float zoom = 4.f;
+	int sprite_count = 4000;
+	int frames = 20;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--zoom" && i + 1 < argc) {
+			zoom = std::stof(argv[++i]);
+		} else if (arg == "--sprites" && i + 1 < argc) {
+			sprite_count = std::stoi(argv[++i]);
+		} else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::stoi(argv[++i]);
+		} else {
+			frames = 0;
+			break;
+		}
+	}
+	if (frames <= 0 || sprite_count <= 0 || zoom <= 0) {
+		std::cerr << "Usage: " << argv[0] << " [--zoom <zoom>] [--sprites <count>] [--frames <n>]" << std::endl;
+		return 2;
+	}
+
+	if (!createHeadlessContext(screen_width, screen_height)) {
+		std::cout << "No headless GL context, skipped" << std::endl;
+		return 77;
+	}
+	std::cout << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+
+	std::vector<BenchSprite> sprites(sprite_count);
+	SpriteAtlas atlas;
+	SpriteBatch batch;
+	atlas.setBatch(&batch);
+	std::mt19937 random(1);
+	for (BenchSprite& sprite : sprites) {
+		const std::vector<uint8_t> rgba = generateSprite(random);
+		uploadTexture(sprite, rgba.data());
+		sprite.image.atlas_slot = atlas.insert(&sprite.image, rgba.data());
+		sprite.image.isGLLoaded = sprite.image.atlas_slot >= 0;
+		if (!sprite.image.isGLLoaded) {
+			std::cout << "FAIL the atlas has no room for " << sprite_count << " sprites" << std::endl;
+			return 1;
+		}
+	}
+
+	const View view = generateView(zoom, sprite_count);
+	size_t quads = 0;
+	for (const std::vector<int>& tile : view.tiles) {
+		quads += tile.size();
+	}
+	std::cout << view.width << "x" << view.height << " tiles at zoom " << zoom << ", " << quads << " sprites a frame from " << sprite_count << " sprites in " << atlas.getPageCount() << " atlas pages" << std::endl;
+
+	setupHeadlessView(screen_width, screen_height, zoom);
+	FrameStats stats[PATH_COUNT];
+	std::vector<uint8_t> pixels[PATH_COUNT];
+	// Take turns, so the paths share whatever the machine is doing
+	for (int frame = 0; frame < frames; ++frame) {
+		for (int p = 0; p < PATH_COUNT; ++p) {
+			const DrawPath path = DrawPath((p + frame) % PATH_COUNT);
+			renderCounters() = RenderCounters();
+			const double start = now();
+			drawFrame(path, view, sprites, atlas, batch);
+			const double submit = now() - start;
+			glFinish();
+			const double time = now() - start;
+
+			FrameStats& s = stats[path];
+			s.total += time;
+			s.submit += submit;
+			s.worst = std::max(s.worst, time);
+			s.binds = renderCounters().binds;
+			s.draw_calls = renderCounters().draw_calls;
+			if (frame == 0) {
+				pixels[path] = readPixels();
+			}
+		}
+	}
+
+	for (int path = 0; path < PATH_COUNT; ++path) {
+		const FrameStats& s = stats[path];
+		printf("%-19s %8.2f ms per frame, worst %8.2f ms, submit %8.2f ms, %6zu binds, %6zu draw calls\n", path_names[path], s.total * 1000 / frames, s.worst * 1000, s.submit * 1000 / frames, s.binds, s.draw_calls);
+	}
+
+	int failures = 0;
+	for (int path = 1; path < PATH_COUNT; ++path) {
+		const size_t different = countDifferent(pixels[0], pixels[path]);
+		if (different > 0) {
+			std::cout << "FAIL " << path_names[path] << " draws " << different << " pixels differently" << std::endl;
+			++failures;
+		}
+	}
+	if (failures == 0) {
+		std::cout << "OK, every path draws the same pixels" << std::endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
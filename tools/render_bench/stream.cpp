@@ -0,0 +1,431 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Scrolls across a map whose sprites have not been loaded yet, the way
+// panning into a new part of a big map does, and reports how often a frame
+// hitches and how long the worst frame takes.
+//
+//   sprite_stream_bench [--zoom <zoom>] [--threads <n>] [--frames <n>] [--step <tiles>]
+//
+// synchronous: every missing sprite is read from the sprite file, decoded
+//              and put in the atlas while the frame is drawn, as
+//              GameSprite::Image::getHardwareID did before the decoder
+// background:  missing sprites are handed to worker threads and drawn as a
+//              placeholder, at most 128 decoded sprites are uploaded at the
+//              start of every frame, as GraphicManager::uploadDecodedSprites
+//
+// The sprites come from a generated .spr file read through
+// PositionalFileReadHandle, like with memcached sprites off (the default).
+// The worker queue follows SpriteDecoder, which needs the GUI to build, the
+// file reads, decoding, atlas and batch are the editor's. Both views scroll
+// by the given number of tiles a frame and then stand still until every
+// sprite is in. A frame hitches when it takes longer than drawing the view
+// with everything loaded by more than a 60 Hz refresh, 16.7 ms. The window
+// is 960x540 so the software rasterizer doesn't hide the loading entirely,
+// loading is the time the render thread spends reading, decoding and
+// uploading sprites in a frame, which doesn't depend on the rasterizer.
+
+#include "headless_main.h"
+#include "bench_graphics.h"
+#include "sprite_batch.h"
+#include "sprite_decode.h"
+#include "sprite_file.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+
+static const int screen_width = 960;
+static const int screen_height = 540;
+// Same as in graphics.cpp
+static const size_t DECODED_SPRITE_UPLOADS_PER_FRAME = 128;
+static const double hitch_time = 1.0 / 60;
+
+// Every band of columns uses its own sprites, so each step brings new ones
+static const int band_columns = 16;
+static const int band_sprites = 400;
+
+static bool readSpriteDump(const PositionalFileReadHandle& handle, const std::vector<uint32_t>& offsets, uint32_t sprite_id, std::vector<uint8_t>& dump) {
+	if (sprite_id == 0 || sprite_id > offsets.size()) {
+		return false;
+	}
+	const size_t offset = size_t(offsets[sprite_id - 1]) + 3;
+	uint8_t size_bytes[2];
+	if (!handle.read(offset, size_bytes, sizeof(size_bytes))) {
+		return false;
+	}
+	dump.resize(size_bytes[0] | size_bytes[1] << 8);
+	return dump.empty() || handle.read(offset + sizeof(size_bytes), dump.data(), dump.size());
+}
+
+struct StreamSprite {
+	GameSprite::Image image;
+	bool decode_pending = false;
+};
+
+struct DecodeJob {
+	uint32_t sprite_id = 0;
+	std::vector<uint8_t> rgba;
+};
+
+// SpriteDecoder without the GUI
+class BackgroundDecoder {
+public:
+	BackgroundDecoder(const PositionalFileReadHandle& handle, const std::vector<uint32_t>& offsets, int thread_count) :
+		handle(handle), offsets(offsets), stopping(false) {
+		for (int i = 0; i < thread_count; ++i) {
+			threads.emplace_back(&BackgroundDecoder::work, this);
+		}
+	}
+	~BackgroundDecoder() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		job_queued.notify_all();
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+
+	void request(uint32_t sprite_id) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			DecodeJob job;
+			job.sprite_id = sprite_id;
+			queued.push_back(std::move(job));
+		}
+		job_queued.notify_one();
+	}
+
+	void collect(std::vector<DecodeJob>& done, size_t max) {
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!finished.empty() && done.size() < max) {
+			done.push_back(std::move(finished.front()));
+			finished.pop_front();
+		}
+	}
+
+private:
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			job_queued.wait(lock, [this]() { return stopping || !queued.empty(); });
+			if (stopping) {
+				return;
+			}
+			DecodeJob job = std::move(queued.front());
+			queued.pop_front();
+			lock.unlock();
+
+			std::vector<uint8_t> dump;
+			if (readSpriteDump(handle, offsets, job.sprite_id, dump)) {
+				job.rgba.resize(SPRITE_PIXELS_SIZE * 4);
+				decodeSpriteDump<4>(dump.data(), uint16_t(dump.size()), false, job.rgba.data());
+			}
+
+			lock.lock();
+			finished.push_back(std::move(job));
+		}
+	}
+
+	const PositionalFileReadHandle& handle;
+	const std::vector<uint32_t>& offsets;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable job_queued;
+	std::deque<DecodeJob> queued;
+	std::deque<DecodeJob> finished;
+	bool stopping;
+};
+
+// Sprite ids of every tile of the map, column by column, ground first
+struct StreamMap {
+	int width = 0;
+	int height = 0;
+	std::vector<std::vector<uint32_t>> tiles;
+
+	const std::vector<uint32_t>& at(int x, int y) const {
+		return tiles[x * height + y];
+	}
+};
+
+static StreamMap generateMap(int width, int height) {
+	StreamMap map;
+	map.width = width;
+	map.height = height;
+	std::mt19937 random(2);
+	for (int x = 0; x < width; ++x) {
+		const uint32_t first = 1 + (x / band_columns) * band_sprites;
+		for (int y = 0; y < height; ++y) {
+			std::vector<uint32_t> tile;
+			tile.push_back(first + random() % (band_sprites / 10));
+			const int items = random() % 4;
+			for (int n = 0; n < items; ++n) {
+				tile.push_back(first + random() % band_sprites);
+			}
+			map.tiles.push_back(std::move(tile));
+		}
+	}
+	return map;
+}
+
+enum LoadPath {
+	LOAD_SYNCHRONOUS,
+	LOAD_BACKGROUND,
+	LOAD_COUNT,
+};
+
+static const char* path_names[LOAD_COUNT] = {
+	"synchronous",
+	"background",
+};
+
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Loader {
+	LoadPath path;
+	const PositionalFileReadHandle& handle;
+	const std::vector<uint32_t>& offsets;
+	std::vector<StreamSprite>& sprites;
+	SpriteAtlas& atlas;
+	BackgroundDecoder* decoder;
+	GLuint placeholder;
+	std::vector<DecodeJob> decoded;
+	size_t placeholders = 0;
+	// Render thread time spent loading sprites since it was last reset
+	double loading = 0;
+
+	// GraphicManager::uploadDecodedSprites
+	void upload() {
+		if (!decoder) {
+			return;
+		}
+		const double start = now();
+		decoded.clear();
+		decoder->collect(decoded, DECODED_SPRITE_UPLOADS_PER_FRAME);
+		for (DecodeJob& job : decoded) {
+			StreamSprite& sprite = sprites[job.sprite_id];
+			sprite.decode_pending = false;
+			if (!sprite.image.isGLLoaded && !job.rgba.empty()) {
+				sprite.image.atlas_slot = atlas.insert(&sprite.image, job.rgba.data());
+				sprite.image.isGLLoaded = sprite.image.atlas_slot >= 0;
+			}
+		}
+		loading += now() - start;
+	}
+
+	// GameSprite::Image::getHardwareID
+	SpriteRegion getRegion(uint32_t sprite_id) {
+		StreamSprite& sprite = sprites[sprite_id];
+		if (!sprite.image.isGLLoaded && decoder) {
+			if (!sprite.decode_pending) {
+				sprite.decode_pending = true;
+				decoder->request(sprite_id);
+			}
+			++placeholders;
+			SpriteRegion region;
+			region.texture = placeholder;
+			return region;
+		}
+		if (!sprite.image.isGLLoaded) {
+			const double start = now();
+			std::vector<uint8_t> dump;
+			uint8_t rgba[SPRITE_PIXELS_SIZE * 4];
+			if (!readSpriteDump(handle, offsets, sprite_id, dump)) {
+				return SpriteRegion();
+			}
+			decodeSpriteDump<4>(dump.data(), uint16_t(dump.size()), false, rgba);
+			sprite.image.atlas_slot = atlas.insert(&sprite.image, rgba);
+			sprite.image.isGLLoaded = sprite.image.atlas_slot >= 0;
+			loading += now() - start;
+			if (!sprite.image.isGLLoaded) {
+				return SpriteRegion();
+			}
+		}
+		return atlas.use(sprite.image.atlas_slot);
+	}
+};
+
+// GraphicManager::getPlaceholder
+static GLuint createPlaceholder() {
+	static const uint8_t pixel[4] = { 0x80, 0x80, 0x80, 0x30 };
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	return texture;
+}
+
+static void drawFrame(Loader& loader, SpriteBatch& batch, const StreamMap& map, int view_x, int view_width) {
+	loader.upload();
+	glClearColor(0.f, 0.f, 0.f, 1.f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	batch.invalidateBinding();
+	for (int y = 0; y < map.height; ++y) {
+		for (int x = 0; x < view_width; ++x) {
+			for (uint32_t sprite_id : map.at(view_x + x, y)) {
+				batch.addQuad(x * TileSize, y * TileSize, TileSize, TileSize, loader.getRegion(sprite_id), 255, 255, 255, 255);
+			}
+		}
+	}
+	batch.flush();
+	glFinish();
+}
+
+struct StreamStats {
+	std::vector<double> frames;
+	std::vector<double> loading;
+	double steady = 0;
+	size_t placeholders = 0;
+	int settle_frames = 0;
+};
+
+int main(int argc, char** argv) {
+	float zoom = 2.f;
+	int thread_count = 1;
+	int frames = 40;
+	int step = 8;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--zoom" && i + 1 < argc) {
+			zoom = std::stof(argv[++i]);
+		} else if (arg == "--threads" && i + 1 < argc) {
+			thread_count = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::stoi(argv[++i]);
+		} else if (arg == "--step" && i + 1 < argc) {
+			step = std::stoi(argv[++i]);
+		} else {
+			frames = 0;
+			break;
+		}
+	}
+	if (frames <= 0 || step <= 0 || zoom <= 0) {
+		std::cerr << "Usage: " << argv[0] << " [--zoom <zoom>] [--threads <n>] [--frames <n>] [--step <tiles>]" << std::endl;
+		return 2;
+	}
+
+	const int view_width = int(screen_width * zoom + TileSize - 1) / TileSize;
+	const int view_height = int(screen_height * zoom + TileSize - 1) / TileSize;
+	const int map_width = view_width + frames * step;
+	const int sprite_count = (map_width + band_columns - 1) / band_columns * band_sprites;
+	if (sprite_count > 0xFFFF) {
+		std::cerr << "Too many frames for one sprite file, use fewer or a smaller step" << std::endl;
+		return 2;
+	}
+
+	if (!createHeadlessContext(screen_width, screen_height)) {
+		std::cout << "No headless GL context, skipped" << std::endl;
+		return 77;
+	}
+	std::cout << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+
+	SpriteFile spr;
+	spr.name = "sprite_stream_bench.spr";
+	std::vector<uint32_t> offsets;
+	PositionalFileReadHandle handle;
+	if (!writeSpriteFile(spr.name, sprite_count) || !readSpriteHeader(spr, offsets) || !handle.open(spr.name)) {
+		std::cerr << "Could not write " << spr.name << std::endl;
+		return 2;
+	}
+
+	const StreamMap map = generateMap(map_width, view_height);
+	std::cout << view_width << "x" << view_height << " tiles at zoom " << zoom << ", scrolling " << step << " tiles a frame for " << frames << " frames, " << sprite_count << " sprites, " << thread_count << " decode threads" << std::endl;
+
+	setupHeadlessView(screen_width, screen_height, zoom);
+	const GLuint placeholder = createPlaceholder();
+	StreamStats stats[LOAD_COUNT];
+	for (int p = 0; p < LOAD_COUNT; ++p) {
+		const LoadPath path = LoadPath(p);
+		std::vector<StreamSprite> sprites(sprite_count + 1);
+		SpriteAtlas atlas;
+		SpriteBatch batch;
+		atlas.setBatch(&batch);
+		std::unique_ptr<BackgroundDecoder> decoder;
+		if (path == LOAD_BACKGROUND) {
+			decoder.reset(new BackgroundDecoder(handle, offsets, thread_count));
+		}
+		Loader loader { path, handle, offsets, sprites, atlas, decoder.get(), placeholder };
+		StreamStats& s = stats[path];
+
+		// The view the scrolling starts from, loaded, for the steady frame time
+		while (true) {
+			loader.placeholders = 0;
+			drawFrame(loader, batch, map, 0, view_width);
+			if (loader.placeholders == 0) {
+				break;
+			}
+		}
+		std::vector<double> steady;
+		for (int i = 0; i < 5; ++i) {
+			const double start = now();
+			drawFrame(loader, batch, map, 0, view_width);
+			steady.push_back(now() - start);
+		}
+		std::sort(steady.begin(), steady.end());
+		s.steady = steady[steady.size() / 2];
+
+		// Scroll, then stand still until nothing is missing
+		loader.placeholders = 0;
+		for (int frame = 1; frame <= frames; ++frame) {
+			loader.loading = 0;
+			const double start = now();
+			drawFrame(loader, batch, map, frame * step, view_width);
+			s.frames.push_back(now() - start);
+			s.loading.push_back(loader.loading);
+		}
+		s.placeholders = loader.placeholders;
+		while (loader.placeholders > 0) {
+			loader.placeholders = 0;
+			loader.loading = 0;
+			const double start = now();
+			drawFrame(loader, batch, map, frames * step, view_width);
+			s.frames.push_back(now() - start);
+			s.loading.push_back(loader.loading);
+			++s.settle_frames;
+		}
+		atlas.clear();
+	}
+	handle.close();
+	std::remove(spr.name.c_str());
+
+	for (int path = 0; path < LOAD_COUNT; ++path) {
+		const StreamStats& s = stats[path];
+		int hitches = 0;
+		double worst = 0, total = 0, worst_loading = 0, total_loading = 0;
+		for (size_t frame = 0; frame < s.frames.size(); ++frame) {
+			hitches += s.frames[frame] > s.steady + hitch_time;
+			worst = std::max(worst, s.frames[frame]);
+			total += s.frames[frame];
+			worst_loading = std::max(worst_loading, s.loading[frame]);
+			total_loading += s.loading[frame];
+		}
+		printf("%-12s frames: steady %6.2f ms, mean %6.2f ms, worst %6.2f ms, %3d of %3zu hitch\n", path_names[path], s.steady * 1000, total * 1000 / s.frames.size(), worst * 1000, hitches, s.frames.size());
+		printf("%-12s loading: worst %6.2f ms, total %7.2f ms, %6zu placeholders, %d frames to settle\n", "", worst_loading * 1000, total_loading * 1000, s.placeholders, s.settle_frames);
+	}
+	return 0;
+}
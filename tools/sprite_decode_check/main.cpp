@@ -0,0 +1,419 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Checks the sprite decoder and outfit colouring in sprite_decode.h against
+// the pixel by pixel loops they replaced, and times both.
+//
+//   sprite_decode_check --random <count>
+//   sprite_decode_check --spr <file.spr> [--extended] [--alpha] [--rounds <n>]
+//
+// --random builds well formed dumps from a fixed seed. --spr reads every
+// sprite of a client sprite file, --extended for files with 32 bit sprite
+// counts and --alpha for files whose pixels have an alpha channel. Exits
+// with 1 if any output differs.
+
+#include "sprite_decode.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+// ============================================================================
+// The loops from before the run based decoder and the colour tables
+
+static void referenceDecodeRGB(const uint8_t* dump, uint16_t size, bool use_alpha, uint8_t* data) {
+	const int pixels_data_size = SPRITE_PIXELS * SPRITE_PIXELS * 3;
+	uint8_t bpp = use_alpha ? 4 : 3;
+	int write = 0;
+	int read = 0;
+
+	// decompress pixels
+	while (read < size && write < pixels_data_size) {
+		int transparent = dump[read] | dump[read + 1] << 8;
+		read += 2;
+		for (int i = 0; i < transparent && write < pixels_data_size; i++) {
+			data[write + 0] = 0xFF; // red
+			data[write + 1] = 0x00; // green
+			data[write + 2] = 0xFF; // blue
+			write += 3;
+		}
+
+		int colored = dump[read] | dump[read + 1] << 8;
+		read += 2;
+		for (int i = 0; i < colored && write < pixels_data_size; i++) {
+			data[write + 0] = dump[read + 0]; // red
+			data[write + 1] = dump[read + 1]; // green
+			data[write + 2] = dump[read + 2]; // blue
+			write += 3;
+			read += bpp;
+		}
+	}
+
+	// fill remaining pixels
+	while (write < pixels_data_size) {
+		data[write + 0] = 0xFF; // red
+		data[write + 1] = 0x00; // green
+		data[write + 2] = 0xFF; // blue
+		write += 3;
+	}
+}
+
+static void referenceDecodeRGBA(const uint8_t* dump, uint16_t size, bool use_alpha, uint8_t* data) {
+	const int pixels_data_size = SPRITE_PIXELS_SIZE * 4;
+	uint8_t bpp = use_alpha ? 4 : 3;
+	int write = 0;
+	int read = 0;
+
+	// decompress pixels
+	while (read < size && write < pixels_data_size) {
+		int transparent = dump[read] | dump[read + 1] << 8;
+		if (use_alpha && transparent >= SPRITE_PIXELS_SIZE) { // Corrupted sprite?
+			break;
+		}
+		read += 2;
+		for (int i = 0; i < transparent && write < pixels_data_size; i++) {
+			data[write + 0] = 0x00; // red
+			data[write + 1] = 0x00; // green
+			data[write + 2] = 0x00; // blue
+			data[write + 3] = 0x00; // alpha
+			write += 4;
+		}
+
+		int colored = dump[read] | dump[read + 1] << 8;
+		read += 2;
+		for (int i = 0; i < colored && write < pixels_data_size; i++) {
+			data[write + 0] = dump[read + 0]; // red
+			data[write + 1] = dump[read + 1]; // green
+			data[write + 2] = dump[read + 2]; // blue
+			data[write + 3] = use_alpha ? dump[read + 3] : 0xFF; // alpha
+			write += 4;
+			read += bpp;
+		}
+	}
+
+	// fill remaining pixels
+	while (write < pixels_data_size) {
+		data[write + 0] = 0x00; // red
+		data[write + 1] = 0x00; // green
+		data[write + 2] = 0x00; // blue
+		data[write + 3] = 0x00; // alpha
+		write += 4;
+	}
+}
+
+static void referenceColorizePixel(uint8_t color, uint8_t& red, uint8_t& green, uint8_t& blue) {
+	uint8_t ro = (TemplateOutfitLookupTable[color] & 0xFF0000) >> 16; // rgb outfit
+	uint8_t go = (TemplateOutfitLookupTable[color] & 0xFF00) >> 8;
+	uint8_t bo = (TemplateOutfitLookupTable[color] & 0xFF);
+	red = (uint8_t)(red * (ro / 255.f));
+	green = (uint8_t)(green * (go / 255.f));
+	blue = (uint8_t)(blue * (bo / 255.f));
+}
+
+template <int Bpp>
+static void referenceColorize(uint8_t* pixels, const uint8_t* template_pixels, const uint8_t looks[4]) {
+	for (int i = 0; i < SPRITE_PIXELS_SIZE; ++i) {
+		uint8_t& red = pixels[i * Bpp + 0];
+		uint8_t& green = pixels[i * Bpp + 1];
+		uint8_t& blue = pixels[i * Bpp + 2];
+
+		const uint8_t tred = template_pixels[i * Bpp + 0];
+		const uint8_t tgreen = template_pixels[i * Bpp + 1];
+		const uint8_t tblue = template_pixels[i * Bpp + 2];
+
+		if (tred && tgreen && !tblue) { // yellow => head
+			referenceColorizePixel(looks[0], red, green, blue);
+		} else if (tred && !tgreen && !tblue) { // red => body
+			referenceColorizePixel(looks[1], red, green, blue);
+		} else if (!tred && tgreen && !tblue) { // green => legs
+			referenceColorizePixel(looks[2], red, green, blue);
+		} else if (!tred && !tgreen && tblue) { // blue => feet
+			referenceColorizePixel(looks[3], red, green, blue);
+		}
+	}
+}
+
+// ============================================================================
+// Sprite sources
+
+typedef std::vector<uint8_t> Dump;
+
+// Runs of transparent and coloured pixels, like the client writes them
+static Dump makeRandomDump(std::mt19937& random, bool use_alpha) {
+	const int bpp = use_alpha ? 4 : 3;
+	Dump dump;
+	int pixel = 0;
+	while (pixel < SPRITE_PIXELS_SIZE && random() % 8 != 0) {
+		const int transparent = random() % (SPRITE_PIXELS_SIZE - pixel + 1);
+		const int colored = random() % (SPRITE_PIXELS_SIZE - pixel - transparent + 1);
+		dump.push_back(uint8_t(transparent));
+		dump.push_back(uint8_t(transparent >> 8));
+		dump.push_back(uint8_t(colored));
+		dump.push_back(uint8_t(colored >> 8));
+		for (int i = 0; i < colored * bpp; ++i) {
+			dump.push_back(uint8_t(random()));
+		}
+		pixel += transparent + colored;
+	}
+	return dump;
+}
+
+static bool readSpriteFile(const std::string& filename, bool extended, std::vector<Dump>& dumps) {
+	std::ifstream file(filename, std::ios::binary);
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	auto readU16 = [&data](size_t offset) {
+		return uint32_t(data[offset] | data[offset + 1] << 8);
+	};
+	auto readU32 = [&](size_t offset) {
+		return readU16(offset) | readU16(offset + 2) << 16;
+	};
+
+	// Signature first, then the sprite count and an offset per sprite
+	const size_t table = extended ? 8 : 6;
+	if (data.size() < table) {
+		return false;
+	}
+	const uint32_t count = extended ? readU32(4) : readU16(4);
+	if (table + size_t(count) * 4 > data.size()) {
+		return false;
+	}
+
+	for (uint32_t id = 0; id < count; ++id) {
+		const size_t offset = readU32(table + id * 4);
+		if (offset == 0) {
+			continue;
+		}
+		// 3 byte colour key, then the dump size
+		if (offset + 5 > data.size()) {
+			return false;
+		}
+		const size_t size = readU16(offset + 3);
+		if (offset + 5 + size > data.size()) {
+			return false;
+		}
+		dumps.emplace_back(data.begin() + offset + 5, data.begin() + offset + 5 + size);
+	}
+	return true;
+}
+
+// Templates use pure channels for the body parts, other pixels test that
+// any non zero channel counts as set
+static void makeRandomTemplate(std::mt19937& random, uint8_t* pixels, int bpp) {
+	static const uint8_t parts[][3] = {
+		{ 0, 0, 0 }, { 255, 255, 0 }, { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 0, 255 }, { 255, 255, 255 }
+	};
+	for (int i = 0; i < SPRITE_PIXELS_SIZE; ++i) {
+		uint8_t* pixel = pixels + i * bpp;
+		const uint32_t pick = random() % 9;
+		for (int channel = 0; channel < bpp; ++channel) {
+			pixel[channel] = pick < 7 && channel < 3 ? parts[pick][channel] : uint8_t(random());
+		}
+	}
+}
+
+// ============================================================================
+
+struct Check {
+	const std::vector<Dump>& dumps;
+	bool use_alpha;
+	uint32_t seed;
+	int failures = 0;
+
+	template <int Bpp, typename Reference>
+	void compareDecode(const char* name, Reference reference) {
+		uint8_t expected[SPRITE_PIXELS_SIZE * 4];
+		uint8_t actual[SPRITE_PIXELS_SIZE * 4];
+		for (size_t i = 0; i < dumps.size(); ++i) {
+			const Dump& dump = dumps[i];
+			reference(dump.data(), uint16_t(dump.size()), use_alpha, expected);
+			decodeSpriteDump<Bpp>(dump.data(), uint16_t(dump.size()), use_alpha, actual);
+			if (memcmp(expected, actual, SPRITE_PIXELS_SIZE * Bpp) != 0) {
+				report(name, i);
+				return;
+			}
+		}
+	}
+
+	template <int Bpp>
+	void compareColorize(const char* name) {
+		std::mt19937 random(seed);
+		uint8_t pixels[SPRITE_PIXELS_SIZE * 4];
+		uint8_t template_pixels[SPRITE_PIXELS_SIZE * 4];
+		uint8_t expected[SPRITE_PIXELS_SIZE * 4];
+		for (size_t i = 0; i < dumps.size(); ++i) {
+			const Dump& dump = dumps[i];
+			decodeSpriteDump<Bpp>(dump.data(), uint16_t(dump.size()), use_alpha, pixels);
+			if (i + 1 < dumps.size() && random() % 2) {
+				// Real outfits are coloured through the sprite that follows them
+				const Dump& next = dumps[i + 1];
+				decodeSpriteDump<Bpp>(next.data(), uint16_t(next.size()), use_alpha, template_pixels);
+			} else {
+				makeRandomTemplate(random, template_pixels, Bpp);
+			}
+
+			uint8_t looks[4];
+			for (uint8_t& look : looks) {
+				look = uint8_t(random() % TEMPLATE_OUTFIT_COLORS);
+			}
+
+			memcpy(expected, pixels, sizeof(pixels));
+			referenceColorize<Bpp>(expected, template_pixels, looks);
+			colorizeOutfit<Bpp>(pixels, template_pixels, looks);
+			if (memcmp(expected, pixels, SPRITE_PIXELS_SIZE * Bpp) != 0) {
+				report(name, i);
+				return;
+			}
+		}
+	}
+
+	void report(const char* name, size_t index) {
+		std::cout << "FAIL " << name << ": sprite " << index << " differs from the reference" << std::endl;
+		++failures;
+	}
+};
+
+template <typename Function>
+static double timeRounds(int rounds, Function function) {
+	const auto start = std::chrono::steady_clock::now();
+	for (int round = 0; round < rounds; ++round) {
+		function();
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <int Bpp, typename Reference>
+static void benchmarkDecode(const char* name, const std::vector<Dump>& dumps, bool use_alpha, int rounds, Reference reference) {
+	uint8_t pixels[SPRITE_PIXELS_SIZE * 4];
+	uint32_t sink = 0;
+	const double before = timeRounds(rounds, [&]() {
+		for (const Dump& dump : dumps) {
+			reference(dump.data(), uint16_t(dump.size()), use_alpha, pixels);
+			sink += pixels[0];
+		}
+	});
+	const double after = timeRounds(rounds, [&]() {
+		for (const Dump& dump : dumps) {
+			decodeSpriteDump<Bpp>(dump.data(), uint16_t(dump.size()), use_alpha, pixels);
+			sink += pixels[0];
+		}
+	});
+	const double sprites = double(dumps.size()) * rounds;
+	printf("%-16s reference %10.0f sprites/s, current %10.0f sprites/s, %.2fx (%u)\n", name, sprites / before, sprites / after, before / after, sink & 1);
+}
+
+template <int Bpp>
+static void benchmarkColorize(const char* name, const std::vector<Dump>& dumps, bool use_alpha, int rounds) {
+	std::mt19937 random(1);
+	uint8_t template_pixels[SPRITE_PIXELS_SIZE * 4];
+	makeRandomTemplate(random, template_pixels, Bpp);
+	const uint8_t looks[4] = { 10, 50, 90, 130 };
+
+	std::vector<uint8_t> decoded(dumps.size() * SPRITE_PIXELS_SIZE * Bpp);
+	for (size_t i = 0; i < dumps.size(); ++i) {
+		decodeSpriteDump<Bpp>(dumps[i].data(), uint16_t(dumps[i].size()), use_alpha, &decoded[i * SPRITE_PIXELS_SIZE * Bpp]);
+	}
+
+	std::vector<uint8_t> pixels(decoded.size());
+	const double before = timeRounds(rounds, [&]() {
+		pixels = decoded;
+		for (size_t i = 0; i < dumps.size(); ++i) {
+			referenceColorize<Bpp>(&pixels[i * SPRITE_PIXELS_SIZE * Bpp], template_pixels, looks);
+		}
+	});
+	const double after = timeRounds(rounds, [&]() {
+		pixels = decoded;
+		for (size_t i = 0; i < dumps.size(); ++i) {
+			colorizeOutfit<Bpp>(&pixels[i * SPRITE_PIXELS_SIZE * Bpp], template_pixels, looks);
+		}
+	});
+	const double sprites = double(dumps.size()) * rounds;
+	printf("%-16s reference %10.0f sprites/s, current %10.0f sprites/s, %.2fx\n", name, sprites / before, sprites / after, before / after);
+}
+
+static int run(const std::vector<Dump>& dumps, bool use_alpha, int rounds) {
+	std::cout << dumps.size() << " sprites, " << (use_alpha ? "with" : "without") << " alpha" << std::endl;
+
+	Check check { dumps, use_alpha, 12345 };
+	check.compareDecode<3>("decode RGB", referenceDecodeRGB);
+	check.compareDecode<4>("decode RGBA", referenceDecodeRGBA);
+	check.compareColorize<3>("colorize RGB");
+	check.compareColorize<4>("colorize RGBA");
+	if (check.failures == 0) {
+		std::cout << "OK, the output matches the reference" << std::endl;
+	}
+
+	if (rounds > 0) {
+		benchmarkDecode<3>("decode RGB", dumps, use_alpha, rounds, referenceDecodeRGB);
+		benchmarkDecode<4>("decode RGBA", dumps, use_alpha, rounds, referenceDecodeRGBA);
+		benchmarkColorize<3>("colorize RGB", dumps, use_alpha, rounds);
+		benchmarkColorize<4>("colorize RGBA", dumps, use_alpha, rounds);
+	}
+	return check.failures;
+}
+
+int main(int argc, char** argv) {
+	std::string spr_file;
+	bool extended = false;
+	bool use_alpha = false;
+	int random_count = 0;
+	int rounds = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--spr" && i + 1 < argc) {
+			spr_file = argv[++i];
+		} else if (arg == "--random" && i + 1 < argc) {
+			random_count = std::stoi(argv[++i]);
+		} else if (arg == "--rounds" && i + 1 < argc) {
+			rounds = std::stoi(argv[++i]);
+		} else if (arg == "--extended") {
+			extended = true;
+		} else if (arg == "--alpha") {
+			use_alpha = true;
+		} else {
+			std::cerr << "Usage: " << argv[0] << " --random <count> | --spr <file.spr> [--extended] [--alpha] [--rounds <n>]" << std::endl;
+			return 2;
+		}
+	}
+
+	int failures = 0;
+	if (!spr_file.empty()) {
+		std::vector<Dump> dumps;
+		if (!readSpriteFile(spr_file, extended, dumps)) {
+			std::cerr << "Could not read " << spr_file << std::endl;
+			return 2;
+		}
+		failures += run(dumps, use_alpha, rounds);
+	} else if (random_count > 0) {
+		std::mt19937 random(random_count);
+		for (bool alpha : { false, true }) {
+			std::vector<Dump> dumps;
+			for (int i = 0; i < random_count; ++i) {
+				dumps.push_back(makeRandomDump(random, alpha));
+			}
+			failures += run(dumps, alpha, rounds);
+		}
+	} else {
+		std::cerr << "Nothing to check, pass --random or --spr" << std::endl;
+		return 2;
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+// Cold loads sprites the way GraphicManager does when sprites aren't
+// memcached, every sprite read from the file and decoded once, in random
+// order like panning into a new area. Compares the old way of reopening
+// the file for every dump with the shared PositionalFileReadHandle and
+// the offset table read up front, and checks both decode the same pixels.
+//
+//   sprite_load_bench --sprites <count> [--rounds <n>] [--keep <file>]
+//   sprite_load_bench --spr <file.spr> [--extended] [--alpha] [--rounds <n>]
+//
+// --sprites writes a generated sprite file first. The file is in the page
+// cache either way, so this times the system calls and decoding, not the
+// disk. Exits with 1 if the two ways decode different pixels.
+
+#include "headless_main.h"
+#include "filehandle.h"
+#include "sprite_decode.h"
+#include "sprite_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <random>
+
+// GraphicManager::loadSpriteDump before the shared handle
+static bool loadDumpReopen(const SpriteFile& spr, int sprite_id, uint8_t*& target, uint16_t& size) {
+	FileReadHandle fh(spr.name);
+	if (!fh.isOk()) {
+		return false;
+	}
+	if (!fh.seek((spr.extended ? 4 : 2) + sprite_id * sizeof(uint32_t))) {
+		return false;
+	}
+	uint32_t to_seek = 0;
+	if (fh.getU32(to_seek)) {
+		fh.seek(to_seek + 3);
+		uint16_t sprite_size;
+		if (fh.getU16(sprite_size)) {
+			target = new uint8_t[sprite_size];
+			if (fh.getRAW(target, sprite_size)) {
+				size = sprite_size;
+				return true;
+			}
+			delete[] target;
+			target = nullptr;
+		}
+	}
+	return false;
+}
+
+// GraphicManager::loadSpriteDump and readSpriteDump now
+static bool loadDumpPositional(const PositionalFileReadHandle& handle, const std::vector<uint32_t>& offsets, int sprite_id, uint8_t*& target, uint16_t& size) {
+	if (sprite_id <= 0 || size_t(sprite_id) > offsets.size()) {
+		return false;
+	}
+	const size_t offset = size_t(offsets[sprite_id - 1]) + 3;
+	uint8_t size_bytes[2];
+	if (!handle.read(offset, size_bytes, sizeof(size_bytes))) {
+		return false;
+	}
+	std::vector<uint8_t> dump(size_bytes[0] | size_bytes[1] << 8);
+	if (!dump.empty() && !handle.read(offset + sizeof(size_bytes), dump.data(), dump.size())) {
+		return false;
+	}
+	target = new uint8_t[dump.size()];
+	memcpy(target, dump.data(), dump.size());
+	size = uint16_t(dump.size());
+	return true;
+}
+
+struct Result {
+	bool ok = true;
+	double seconds = 0;
+	uint64_t hash = 0xCBF29CE484222325ULL;
+};
+
+template <typename Loader>
+static Result coldLoad(const SpriteFile& spr, const std::vector<int>& order, Loader load) {
+	Result result;
+	uint8_t rgba[SPRITE_PIXELS_SIZE * 4];
+	const auto start = std::chrono::steady_clock::now();
+	for (int sprite_id : order) {
+		uint8_t* dump = nullptr;
+		uint16_t size = 0;
+		if (!load(sprite_id, dump, size)) {
+			result.ok = false;
+			break;
+		}
+		decodeSpriteDump<4>(dump, size, spr.use_alpha, rgba);
+		delete[] dump;
+		// A few bytes of every sprite, hashing all of them would cost more
+		// than the loading
+		for (int i = 0; i < SPRITE_PIXELS_SIZE * 4; i += 61) {
+			result.hash = (result.hash ^ rgba[i]) * 0x100000001B3ULL;
+		}
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+int main(int argc, char** argv) {
+	SpriteFile spr;
+	std::string keep;
+	int generate = 0;
+	int rounds = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--sprites" && i + 1 < argc) {
+			generate = std::stoi(argv[++i]);
+		} else if (arg == "--spr" && i + 1 < argc) {
+			spr.name = argv[++i];
+		} else if (arg == "--extended") {
+			spr.extended = true;
+		} else if (arg == "--alpha") {
+			spr.use_alpha = true;
+		} else if (arg == "--keep" && i + 1 < argc) {
+			keep = argv[++i];
+		} else if (arg == "--rounds" && i + 1 < argc) {
+			rounds = std::max(1, std::stoi(argv[++i]));
+		} else {
+			spr.name.clear();
+			generate = 0;
+			break;
+		}
+	}
+
+	if (generate > 0) {
+		generate = std::min(generate, 0xFFFF);
+		spr.name = keep.empty() ? "sprite_load_bench.spr" : keep;
+		spr.extended = false;
+		spr.use_alpha = false;
+		if (!writeSpriteFile(spr.name, uint32_t(generate))) {
+			std::cerr << "Could not write " << spr.name << std::endl;
+			return 2;
+		}
+	} else if (spr.name.empty()) {
+		std::cerr << "Usage: " << argv[0] << " --sprites <count> [--keep <file>] | --spr <file.spr> [--extended] [--alpha] [--rounds <n>]" << std::endl;
+		return 2;
+	}
+
+	std::vector<uint32_t> offsets;
+	if (!readSpriteHeader(spr, offsets)) {
+		std::cerr << "Could not read " << spr.name << std::endl;
+		return 2;
+	}
+
+	std::vector<int> order(spr.count);
+	std::iota(order.begin(), order.end(), 1);
+	std::shuffle(order.begin(), order.end(), std::mt19937(2));
+
+	Result reopen, positional;
+	for (int round = 0; round < rounds; ++round) {
+		Result result = coldLoad(spr, order, [&spr](int id, uint8_t*& dump, uint16_t& size) {
+			return loadDumpReopen(spr, id, dump, size);
+		});
+		if (round == 0 || result.seconds < reopen.seconds) {
+			reopen = result;
+		}
+
+		// The handle and table are set up once when the sprites are loaded,
+		// time them with the dumps anyway
+		const auto start = std::chrono::steady_clock::now();
+		PositionalFileReadHandle handle;
+		std::vector<uint32_t> table;
+		SpriteFile header = spr;
+		if (!handle.open(spr.name) || !readSpriteHeader(header, table)) {
+			std::cerr << "Could not open " << spr.name << std::endl;
+			return 2;
+		}
+		const double setup = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result = coldLoad(spr, order, [&handle, &table](int id, uint8_t*& dump, uint16_t& size) {
+			return loadDumpPositional(handle, table, id, dump, size);
+		});
+		result.seconds += setup;
+		if (round == 0 || result.seconds < positional.seconds) {
+			positional = result;
+		}
+	}
+
+	std::cout << spr.count << " sprites from " << spr.name << ", best of " << rounds << std::endl;
+	printf("reopen      %9.1f ms %7.2f us per sprite\n", reopen.seconds * 1000, reopen.seconds * 1e6 / spr.count);
+	printf("positional  %9.1f ms %7.2f us per sprite\n", positional.seconds * 1000, positional.seconds * 1e6 / spr.count);
+
+	int failures = 0;
+	if (!reopen.ok || !positional.ok) {
+		std::cout << "FAIL could not read every sprite" << std::endl;
+		++failures;
+	} else if (reopen.hash != positional.hash) {
+		std::cout << "FAIL the two ways decode different pixels" << std::endl;
+		++failures;
+	} else {
+		std::cout << "OK, both decode the same pixels" << std::endl;
+	}
+	if (generate > 0 && keep.empty()) {
+		std::remove(spr.name.c_str());
+	}
+	return failures == 0 ? 0 : 1;
+}